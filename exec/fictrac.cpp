@@ -6,13 +6,19 @@
 
 #include "Logger.h"
 #include "Trackball.h"
+#include "ThreadPool.h"
+#include "ChunkedRun.h"
 #include "timing.h"
 #include "misc.h"
 #include "fictrac_version.h"
 
 #include <string>
 #include <csignal>
+#include <cstdlib>  // atoi
 #include <memory>
+#include <vector>
+#include <thread>   // hardware_concurrency
+#include <algorithm>
 
 using namespace std;
 
@@ -25,17 +31,23 @@ int main(int argc, char *argv[])
 {
      PRINT("///");
      PRINT("/// FicTrac:\tA webcam-based method for generating fictive paths.\n///");
-     PRINT("/// Usage:\tfictrac CONFIG_FN [-v LOG_VERBOSITY]\n///");
+     PRINT("/// Usage:\tfictrac CONFIG_FN [CONFIG_FN ...] [-v LOG_VERBOSITY] [-t NUM_THREADS] [--batch [-j NUM_JOBS]] [--chunks NUM_CHUNKS]\n///");
      PRINT("/// \tCONFIG_FN\tPath to input config file (defaults to config.txt).");
+     PRINT("/// \t\t\tSeveral config files may be given to track several rigs in one process.");
      PRINT("/// \tLOG_VERBOSITY\t[Optional] One of DBG, INF, WRN, ERR.");
+     PRINT("/// \tNUM_THREADS\t[Optional] Size of the (core-pinned) worker pool shared by all rigs.");
+     PRINT("/// \t--batch\t\t[Optional] Process recorded videos headless and as fast as possible.");
+     PRINT("/// \tNUM_JOBS\t[Optional] Number of videos (or chunks) processed concurrently in batch mode.");
+     PRINT("/// \tNUM_CHUNKS\t[Optional] Split a single recorded video into chunks that are tracked in parallel.");
      PRINT("///");
      PRINT("/// Version: %d.%d.%d (build date: %s)", FICTRAC_VERSION_MAJOR, FICTRAC_VERSION_MIDDLE, FICTRAC_VERSION_MINOR, __DATE__);
      PRINT("///\n");
 
 	/// Parse args.
 	string log_level = "info";
-	string config_fn = "config.txt";
-    bool do_stats = false;
+	vector<string> config_fns;
+    int nthreads = 0, njobs = 0, nchunks = 0;
+    bool do_stats = false, do_batch = false;
 	for (int i = 1; i < argc; ++i) {
 		if ((string(argv[i]) == "--verbosity") || (string(argv[i]) == "-v")) {
 			if (++i < argc) {
@@ -46,13 +58,46 @@ int main(int argc, char *argv[])
 				return -1;
 			}
         }
+        else if ((string(argv[i]) == "--threads") || (string(argv[i]) == "-t")) {
+            if (++i < argc) {
+                nthreads = atoi(argv[i]);
+            }
+            else {
+                LOG_ERR("-t/--threads requires one argument (number of shared worker threads)!");
+                return -1;
+            }
+        }
+        else if ((string(argv[i]) == "--jobs") || (string(argv[i]) == "-j")) {
+            if (++i < argc) {
+                njobs = atoi(argv[i]);
+            }
+            else {
+                LOG_ERR("-j/--jobs requires one argument (number of concurrent videos in batch mode)!");
+                return -1;
+            }
+        }
+        else if (string(argv[i]) == "--chunks") {
+            if (++i < argc) {
+                nchunks = atoi(argv[i]);
+            }
+            else {
+                LOG_ERR("--chunks requires one argument (number of chunks to split the video into)!");
+                return -1;
+            }
+        }
         else if (string(argv[i]) == "--stats") {
             do_stats = true;
         }
+        else if (string(argv[i]) == "--batch") {
+            do_batch = true;
+        }
         else {
-            config_fn = argv[i];
+            config_fns.push_back(argv[i]);
 		}
 	}
+    if (config_fns.empty()) {
+        config_fns.push_back("config.txt");
+    }
 
     /// Set logging level.
     Logger::setVerbosity(log_level);
@@ -67,29 +112,93 @@ int main(int argc, char *argv[])
         LOG("Set process priority to HIGH!");
     }
 
-    unique_ptr<Trackball> tracker = make_unique<Trackball>(config_fn);
+    /// One long video tracked as parallel chunks (always headless).
+    if (nchunks > 0) {
+        if (config_fns.size() != 1) {
+            LOG_ERR("--chunks requires exactly one config file!");
+            return -1;
+        }
+        auto pool = make_shared<ThreadPool>(nthreads, true);
+        auto chunked = make_unique<ChunkedRun>(config_fns[0], nchunks, njobs, pool);
+        bool ok = chunked->run(_active);
+        chunked.reset();
+        pool.reset();
+        sleep(250);
+        return ok ? 0 : -1;
+    }
 
-    /// Now Trackball has spawned our worker threads, we set this thread to low priority.
-    SetThreadNormalPriority();
+    /// Several rigs share one pool of pinned worker threads (global search only, started on first use).
+    shared_ptr<ThreadPool> pool;
+    if (config_fns.size() > 1) {
+        pool = make_shared<ThreadPool>(nthreads, true);
+        LOG("Tracking %d rigs using a shared global search pool of %d threads.", static_cast<int>(config_fns.size()), pool->size());
+    }
 
-    /// Wait for tracking to finish.
-    while (tracker->isActive()) {
-        if (!_active) {
-            tracker->terminate();
+    /// In batch mode, videos are queued and (each tracked in order) processed several at a time.
+    size_t max_jobs = config_fns.size();
+    if (do_batch) {
+        int ncores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        max_jobs = (njobs > 0) ? njobs : std::max(1, ncores / 2);  // each tracker runs grab and track threads
+        LOG("Batch processing %d videos, %d at a time.", static_cast<int>(config_fns.size()), static_cast<int>(max_jobs));
+    }
+
+    auto finish = [&](unique_ptr<Trackball>& tracker) {
+        /// Save the eventual template to disk.
+        tracker->writeTemplate();
+
+        /// If we're running in test mode, print some stats.
+        if (do_stats) {
+            tracker->dumpStats();
+        }
+    };
+
+    vector<unique_ptr<Trackball>> trackers;
+    size_t next = 0;
+    bool started = false;
+    while (true) {
+        /// Start queued trackers.
+        while (_active && (next < config_fns.size()) && (trackers.size() < max_jobs)) {
+            const string& fn = config_fns[next++];
+            string name = (config_fns.size() > 1) ? fn : "";
+            trackers.push_back(make_unique<Trackball>(fn, pool, name, do_batch));
+        }
+
+        /// Now Trackball has spawned our worker threads, we set this thread to low priority.
+        if (!started) {
+            SetThreadNormalPriority();
+            started = true;
         }
+
+        bool any_active = false;
+        for (auto it = trackers.begin(); it != trackers.end(); ) {
+            if (!_active) {
+                (*it)->terminate();
+            }
+            if ((*it)->isActive()) {
+                any_active = true;
+                ++it;
+            }
+            else if (do_batch) {
+                finish(*it);    // release finished videos straight away
+                it = trackers.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        /// Wait for tracking to finish.
+        if (!any_active && (!_active || (next >= config_fns.size()))) { break; }
         sleep(250);
     }
 
-    /// Save the eventual template to disk.
-    tracker->writeTemplate();
-
-    /// If we're running in test mode, print some stats.
-    if (do_stats) {
-        tracker->dumpStats();
+    for (auto& tracker : trackers) {
+        finish(tracker);
     }
 
     /// Try to force release of all objects.
-    tracker.reset();
+    trackers.clear();
+    pool.reset();
 
     /// Wait a bit before exiting...
     sleep(250);
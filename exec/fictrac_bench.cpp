@@ -0,0 +1,479 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       fictrac_bench.cpp
+/// \brief      Offline benchmark and regression check over recorded videos and simulated balls.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "Logger.h"
+#include "Trackball.h"
+#include "FrameGrabber.h"
+#include "CameraRemap.h"
+#include "CVSource.h"
+#include "SimSource.h"
+#include "ConfigParser.h"
+#include "timing.h"
+#include "misc.h"
+#include "fictrac_version.h"
+
+#include <string>
+#include <cstdlib>  // atoi, atof
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+const int BENCH_ITERS_DEFAULT = 1000;
+const double BENCH_TOL_DEFAULT = 1e-4;
+const double BENCH_SIM_TOL_DEFAULT = 5e-3;  // rendered frames are not bit-exact with the rotations tracked
+
+///
+/// Serves the same (pre-decoded) frame over and over, so FrameGrabber can be timed without decoding.
+///
+class MemSource : public FrameSource
+{
+public:
+    MemSource(const cv::Mat& frame) : _frame(frame) {
+        _open = !frame.empty();
+        _width = frame.cols;
+        _height = frame.rows;
+        _timestamp = 0;
+        _ms_since_midnight = 0;
+        _live = false;
+    }
+
+    virtual bool rewind() { _timestamp = 0; return true; }
+    virtual bool grab(cv::Mat& frame) { _frame.copyTo(frame); _timestamp += 1; return _open; }
+    virtual bool grabBuffer(cv::Mat& frame) { frame = _frame; _timestamp += 1; return _open; }
+
+private:
+    cv::Mat _frame;
+};
+
+///
+/// Benchmark access to Trackball internals (declared friend in Trackball/Localiser).
+///
+class TrackballBench
+{
+public:
+    /// Track a whole video as fast as possible. Returns data file written.
+    static string run(Trackball& tb, double& secs, unsigned int& frames);
+
+    /// Print per-stage percentiles gathered during run.
+    static void printStages(Trackball& tb);
+
+    /// Time the tracking building blocks in isolation (using the state left by run).
+    static void micro(Trackball& tb, int iters);
+};
+
+///
+///
+///
+string TrackballBench::run(Trackball& tb, double& secs, unsigned int& frames)
+{
+    double t0 = ts_ms();
+    while (tb.isActive()) {
+        sleep(1);
+    }
+    secs = (ts_ms() - t0) / 1000.;
+    frames = tb._data.cnt;
+    return tb._base_fn + "-" + execTime() + (tb._bin_log ? ".bin" : ".dat");
+}
+
+///
+///
+///
+void TrackballBench::printStages(Trackball& tb)
+{
+    static const char* names[Trackball::NUM_STATS] = { "grab", "opt", "map", "path", "log", "disp", "frame", "cam_out", "evals", "queue" };
+    PRINT("  %-8s %10s %10s %10s %10s %10s %10s", "stage", "n", "mean", "p50", "p99", "p99.9", "max");
+    for (int i = 0; i < Trackball::NUM_STATS; i++) {
+        LatencyHist::Summary s = tb._hist[i]->summarise();
+        if (s.count == 0) { continue; }
+        PRINT("  %-8s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f", names[i], static_cast<unsigned long long>(s.count), s.mean, s.p50, s.p99, s.p999, s.max);
+    }
+}
+
+///
+///
+///
+void TrackballBench::micro(Trackball& tb, int iters)
+{
+    if (tb._roi_frame.empty() || !tb._localOpt) {
+        LOG_WRN("Warning! No tracked frames - skipping microbenchmarks.");
+        return;
+    }
+
+    /// Source frame (first video frame).
+    cv::Mat src_bgr, src_grey;
+    {
+        const string src_fn = tb._cfg("src_fn");
+        unique_ptr<FrameSource> src;
+        if (SimSource::isSim(src_fn)) {
+            src = unique_ptr<FrameSource>(new SimSource(src_fn));
+        } else {
+            src = unique_ptr<FrameSource>(new CVSource(src_fn));
+        }
+        if (!src->isOpen() || !src->grab(src_bgr) || src_bgr.empty()) {
+            LOG_WRN("Warning! Could not read source frame - skipping microbenchmarks.");
+            return;
+        }
+        src_bgr = src_bgr.clone();
+    }
+    if (src_bgr.channels() == 1) {
+        src_grey = src_bgr;
+        cv::cvtColor(src_grey, src_bgr, cv::COLOR_GRAY2BGR);
+    } else {
+        cv::cvtColor(src_bgr, src_grey, cv::COLOR_BGR2GRAY);
+    }
+
+    double t0, t1;
+
+    /// Remapper::apply (full-frame reference path).
+    CameraRemapPtr remapper = CameraRemapPtr(new CameraRemap(tb._src_model, tb._roi_model, tb._cam_to_roi));
+    cv::Mat roi(tb._roi_h, tb._roi_w, CV_8UC1);
+    remapper->apply(src_grey, roi);     // build cached maps
+    t0 = ts_ms();
+    for (int i = 0; i < iters; i++) {
+        remapper->apply(src_grey, roi);
+    }
+    t1 = ts_ms();
+    PRINT("  %-24s %10.3f us", "Remapper::apply", 1e3 * (t1 - t0) / iters);
+
+    /// FrameGrabber (colour conversion, remap and thresholding; no decoding).
+    {
+        double thresh_ratio = 0, thresh_win_pc = 0;
+        bool fused_prep = true;
+        tb._cfg.getDbl("thr_ratio", thresh_ratio);
+        tb._cfg.getDbl("thr_win_pc", thresh_win_pc);
+        tb._cfg.getBool("fused_prep", fused_prep);
+
+        auto source = make_shared<MemSource>(src_bgr);
+        cv::Mat frame, remap;
+        double ts, ms;
+        t0 = ts_ms();
+        FrameGrabber grabber(source, remapper, tb._roi_mask, thresh_ratio, thresh_win_pc, tb._cfg("thr_rgb_tfrm"), 8, iters, false, 0, fused_prep);
+        int n = 0;
+        while (grabber.getNextFrameSet(frame, remap, ts, ms)) { n++; }
+        t1 = ts_ms();
+        PRINT("  %-24s %10.3f us", "FrameGrabber (prep)", 1e3 * (t1 - t0) / std::max(n, 1));
+    }
+
+    /// Localiser::testRotation (single evaluation at full resolution).
+    {
+        Localiser& loc = *tb._localOpt;
+        CmMat33d R_roi = tb._data.R_roi;
+        loc._R_roi = R_roi.data();
+        loc._cur_kernel = loc._kernel.get();
+        loc._cur_roi = tb._roi_frame;
+        loc._cur_map = loc._sphere_map;
+        loc._cur_tiles = loc._tiles;
+        double x[3] = { 0, 0, 0 }, sum = 0;
+        t0 = ts_ms();
+        for (int i = 0; i < iters; i++) {
+            x[0] = 1e-3 * (i % 7);
+            sum += loc.testRotation(x);
+        }
+        t1 = ts_ms();
+        loc._cur_roi.release();
+        PRINT("  %-24s %10.3f us (%g)", "Localiser::testRotation", 1e3 * (t1 - t0) / iters, sum / iters);
+    }
+
+    /// Localiser::testRotations (batch of 64, time per rotation).
+    {
+        const int nbatch = 64;
+        Localiser& loc = *tb._localOpt;
+        CmMat33d R_roi = tb._data.R_roi;
+        vector<double> x(3 * nbatch, 0), err(nbatch);
+        for (int j = 0; j < nbatch; j++) {
+            x[3 * j] = 1e-3 * (j % 7);
+            x[3 * j + 1] = 1e-3 * (j / 7);
+        }
+        double sum = 0;
+        int nb = std::max(1, iters / nbatch);
+        t0 = ts_ms();
+        for (int i = 0; i < nb; i++) {
+            loc.testRotations(tb._roi_frame, R_roi, x.data(), nbatch, err.data());
+            sum += err[i % nbatch];
+        }
+        t1 = ts_ms();
+        PRINT("  %-24s %10.3f us (%g)", "Localiser::testRotations", 1e3 * (t1 - t0) / (nb * nbatch), sum / nb);
+    }
+
+    /// updateSphere (into a scratch copy of the map).
+    {
+        cv::Mat map = tb._sphere_map.clone();
+        const bool do_display = tb._do_display;
+        tb._do_display = false;
+        t0 = ts_ms();
+        for (int i = 0; i < iters; i++) {
+            tb.updateSphere(tb._data.R_roi, tb._roi_frame, map);
+        }
+        t1 = ts_ms();
+        tb._do_display = do_display;
+        PRINT("  %-24s %10.3f us", "Trackball::updateSphere", 1e3 * (t1 - t0) / iters);
+    }
+}
+
+///
+/// Read CSV data file into frame -> columns (cols 1-25, data_header.txt numbering).
+///
+static bool readDat(const string& fn, map<unsigned int, vector<double>>& rows)
+{
+    ifstream f(fn);
+    if (!f.is_open()) { return false; }
+
+    string line;
+    while (getline(f, line)) {
+        vector<double> v(1, 0);     // col 0 unused
+        stringstream ss(line);
+        string tok;
+        while (getline(ss, tok, ',')) {
+            v.push_back(atof(tok.c_str()));
+        }
+        if (v.size() < 18) { continue; }
+        rows[static_cast<unsigned int>(v[1])] = v;
+    }
+    return !rows.empty();
+}
+
+///
+/// Compare tracked output against reference. Returns false if max delta rotation error exceeds tol.
+/// Heading and position are only compared if the reference has them (lab).
+///
+static bool compareDat(const string& out_fn, const string& ref_fn, double tol, bool lab)
+{
+    map<unsigned int, vector<double>> out, ref;
+    if (!readDat(out_fn, out)) {
+        LOG_ERR("Error! Could not read output data file (%s).", out_fn.c_str());
+        return false;
+    }
+    if (!readDat(ref_fn, ref)) {
+        LOG_ERR("Error! Could not read reference data file (%s).", ref_fn.c_str());
+        return false;
+    }
+
+    int nmatch = 0, nmissing = 0;
+    double sq_sum = 0, dr_max = 0, heading_max = 0;
+    for (auto& r : ref) {
+        auto it = out.find(r.first);
+        if (it == out.end()) { nmissing++; continue; }
+        const vector<double>& a = it->second;
+        const vector<double>& b = r.second;
+
+        double d2 = 0;
+        for (int c = 2; c <= 4; c++) {
+            d2 += (a[c] - b[c]) * (a[c] - b[c]);
+        }
+        sq_sum += d2;
+        dr_max = std::max(dr_max, sqrt(d2));
+
+        double dh = fabs(a[17] - b[17]);
+        heading_max = std::max(heading_max, std::min(dh, 2 * CM_PI - dh));
+        nmatch++;
+    }
+    int nextra = static_cast<int>(out.size()) - nmatch;
+
+    const vector<double>& a = out.rbegin()->second;
+    const vector<double>& b = ref.rbegin()->second;
+    double pos_err = sqrt((a[15] - b[15]) * (a[15] - b[15]) + (a[16] - b[16]) * (a[16] - b[16]));
+
+    bool ok = (nmissing == 0) && (nmatch > 0) && (dr_max <= tol);
+    PRINT("  Frames matched/missing/extra:  %d / %d / %d", nmatch, nmissing, nextra);
+    PRINT("  Delta rotation err rms/max:    %.3e / %.3e rad (tol %.1e)", nmatch ? sqrt(sq_sum / nmatch) : 0, dr_max, tol);
+    if (lab) {
+        PRINT("  Heading err max:               %.3e rad", heading_max);
+        PRINT("  Final position err:            %.3e rad", pos_err);
+    }
+    PRINT("  Accuracy:                      %s", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+///
+/// Write tracking config for a simulated ball (camera and ROI geometry from the source).
+///
+static string simConfig(const SimSource& sim, const string& spec, int n)
+{
+    ConfigParser cfg;
+    vector<double> roi_c = { 0, 0, 1 }, c2a_r = { 0, 0, 0 };
+    double vfov = sim.getVfov(), roi_r = sim.getBallRadius() * CM_D2R;
+    cfg.add("src_fn", spec);
+    cfg.add("vfov", vfov);
+    cfg.add("roi_c", roi_c);
+    cfg.add("roi_r", roi_r);
+    cfg.add("c2a_r", c2a_r);
+
+    string sim_fn = "fictrac-sim" + to_string(n) + ".txt";
+    if (cfg.write(sim_fn) <= 0) {
+        LOG_ERR("Error! Could not write simulation config file (%s).", sim_fn.c_str());
+        return "";
+    }
+    return sim_fn;
+}
+
+///
+/// Write copy of config with display/video output disabled and output redirected (plus any --set overrides).
+///
+static string benchConfig(const string& cfg_fn, const vector<pair<string, string>>& sets)
+{
+    ConfigParser cfg;
+    if (cfg.read(cfg_fn) <= 0) {
+        LOG_ERR("Error parsing config file (%s)!", cfg_fn.c_str());
+        return "";
+    }
+
+    string base = cfg_fn.substr(0, cfg_fn.find_last_of('.')) + "-bench";
+    cfg.add("do_display", "n");
+    cfg.add("save_raw", "n");
+    cfg.add("save_debug", "n");
+    cfg.add("data_fmt", "csv");
+    cfg.add("output_fn", base);
+    for (auto& kv : sets) {
+        cfg.add(kv.first, kv.second);
+    }
+
+    string bench_fn = base + ".txt";
+    if (cfg.write(bench_fn) <= 0) {
+        LOG_ERR("Error! Could not write benchmark config file (%s).", bench_fn.c_str());
+        return "";
+    }
+    return bench_fn;
+}
+
+
+int main(int argc, char *argv[])
+{
+    PRINT("///");
+    PRINT("/// FicTrac benchmark:\tReplays recorded videos through the tracker as fast as possible.\n///");
+    PRINT("/// Usage:\tfictrac_bench CONFIG_FN [-r REF_DAT] | --sim SPEC [--set KEY=VAL ...] [...] [-n ITERS] [--tol TOL] [-v LOG_VERBOSITY]\n///");
+    PRINT("/// \tCONFIG_FN\tPath to config file (display and video output are disabled).");
+    PRINT("/// \tREF_DAT\t\t[Optional] Reference data file to check tracking accuracy against.");
+    PRINT("/// \tSPEC\t\tTrack a simulated ball (sim:key=value,..., see SimSource.h) against its ground truth.");
+    PRINT("/// \tKEY=VAL\t\t[Optional] Config parameter override for the preceding run (e.g. q_factor=10).");
+    PRINT("/// \tITERS\t\t[Optional] Microbenchmark iterations (default %d, 0 to skip).", BENCH_ITERS_DEFAULT);
+    PRINT("/// \tTOL\t\t[Optional] Max allowed delta rotation error vs reference (default %.0e rad, %.0e rad for --sim).", BENCH_TOL_DEFAULT, BENCH_SIM_TOL_DEFAULT);
+    PRINT("///");
+    PRINT("/// Version: %d.%d.%d (build date: %s)", FICTRAC_VERSION_MAJOR, FICTRAC_VERSION_MIDDLE, FICTRAC_VERSION_MINOR, __DATE__);
+    PRINT("///\n");
+
+    /// Parse args.
+    string log_level = "warn";
+    struct Run {
+        string cfg_fn, ref_fn, sim;             // config and reference, or simulated source spec
+        vector<pair<string, string>> sets;      // config overrides
+    };
+    vector<Run> runs;
+    int iters = BENCH_ITERS_DEFAULT;
+    double tol = -1;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if ((arg == "--verbosity") || (arg == "-v") || (arg == "--ref") || (arg == "-r") || (arg == "--iters") || (arg == "-n") || (arg == "--tol") ||
+            (arg == "--sim") || (arg == "--set")) {
+            if (++i >= argc) {
+                LOG_ERR("%s requires one argument!", arg.c_str());
+                return -1;
+            }
+            if ((arg == "--verbosity") || (arg == "-v")) {
+                log_level = argv[i];
+            }
+            else if ((arg == "--ref") || (arg == "-r")) {
+                if (runs.empty() || !runs.back().sim.empty()) {
+                    LOG_ERR("-r/--ref must follow a config file!");
+                    return -1;
+                }
+                runs.back().ref_fn = argv[i];
+            }
+            else if (arg == "--sim") {
+                runs.push_back(Run());
+                runs.back().sim = argv[i];
+                if (!SimSource::isSim(runs.back().sim)) { runs.back().sim = "sim:" + runs.back().sim; }
+            }
+            else if (arg == "--set") {
+                string kv = argv[i];
+                size_t eq = kv.find('=');
+                if (runs.empty() || (eq == string::npos)) {
+                    LOG_ERR("--set KEY=VAL must follow a config file or --sim!");
+                    return -1;
+                }
+                runs.back().sets.push_back(make_pair(kv.substr(0, eq), kv.substr(eq + 1)));
+            }
+            else if ((arg == "--iters") || (arg == "-n")) {
+                iters = std::max(0, atoi(argv[i]));
+            }
+            else {
+                tol = atof(argv[i]);
+            }
+        }
+        else {
+            runs.push_back(Run());
+            runs.back().cfg_fn = arg;
+        }
+    }
+    if (runs.empty()) {
+        LOG_ERR("No config files specified!");
+        return -1;
+    }
+
+    /// Set logging level.
+    Logger::setVerbosity(log_level);
+
+    bool all_ok = true;
+    for (size_t k = 0; k < runs.size(); k++) {
+        Run& r = runs[k];
+        string cfg_fn = r.cfg_fn;
+        string ref_fn = r.ref_fn;
+
+        PRINT("\n----------------------------------------------------------------------");
+        PRINT("Benchmark: %s", r.sim.empty() ? cfg_fn.c_str() : r.sim.c_str());
+
+        /// Simulated ball: generated config, ground truth as reference.
+        if (!r.sim.empty()) {
+            SimSource sim(r.sim);
+            if (!sim.isOpen()) {
+                all_ok = false;
+                continue;
+            }
+            cfg_fn = simConfig(sim, r.sim, static_cast<int>(k));
+            ref_fn = cfg_fn.substr(0, cfg_fn.find_last_of('.')) + "-truth.dat";
+            if (cfg_fn.empty() || !sim.writeTruth(ref_fn)) {
+                all_ok = false;
+                continue;
+            }
+        }
+
+        string bench_fn = benchConfig(cfg_fn, r.sets);
+        if (bench_fn.empty()) {
+            all_ok = false;
+            continue;
+        }
+
+        Trackball tb(bench_fn);
+        double secs = 0;
+        unsigned int frames = 0;
+        string out_fn = TrackballBench::run(tb, secs, frames);
+        if (frames == 0) {
+            LOG_ERR("Error! No frames were tracked (%s).", cfg_fn.c_str());
+            all_ok = false;
+            continue;
+        }
+
+        PRINT("  Frames: %u in %.2f s (%.1f fps)", frames, secs, frames / std::max(secs, 1e-9));
+        TrackballBench::printStages(tb);
+
+        if (!ref_fn.empty()) {
+            const double run_tol = (tol >= 0) ? tol : (r.sim.empty() ? BENCH_TOL_DEFAULT : BENCH_SIM_TOL_DEFAULT);
+            all_ok &= compareDat(out_fn, ref_fn, run_tol, r.sim.empty());
+        }
+
+        if (iters > 0) {
+            PRINT("\n  Microbenchmarks (%d iterations):", iters);
+            TrackballBench::micro(tb, iters);
+        }
+    }
+    PRINT("\n----------------------------------------------------------------------");
+
+    return all_ok ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       fictrac_cols.cpp
+/// \brief      Convert between columnar (*.ftc), binary (*.bin) and text (*.dat) data logs.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "Logger.h"
+#include "ColumnLog.h"
+#include "BinaryRecord.h"
+#include "timing.h"
+#include "fictrac_version.h"
+
+#include <cstdio>
+#include <cstdlib>  // strtoul
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static string extension(const string& fn)
+{
+    size_t pos = fn.find_last_of('.');
+    return (pos == string::npos) ? "" : fn.substr(pos + 1);
+}
+
+///
+/// Same layout as the text data log written by Trackball::logData (see doc/data_header.txt).
+///
+static void writeCsv(std::ostream& os, const BinaryRecord& r)
+{
+    os << r.frame_cnt << ", ";
+    os << r.dr_cam[0] << ", " << r.dr_cam[1] << ", " << r.dr_cam[2] << ", " << r.err << ", ";
+    os << r.dr_lab[0] << ", " << r.dr_lab[1] << ", " << r.dr_lab[2] << ", ";
+    os << r.r_cam[0] << ", " << r.r_cam[1] << ", " << r.r_cam[2] << ", ";
+    os << r.r_lab[0] << ", " << r.r_lab[1] << ", " << r.r_lab[2] << ", ";
+    os << r.posx << ", " << r.posy << ", " << r.heading << ", ";
+    os << r.step_dir << ", " << r.step_mag << ", ";
+    os << r.intx << ", " << r.inty << ", ";
+    os << r.ts << ", " << r.seq << ", " << r.dts << ", " << r.ms << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    PRINT("///");
+    PRINT("/// fictrac_cols:\tConvert FicTrac data logs between columnar, binary and text formats.\n///");
+    PRINT("/// Usage:\tfictrac_cols IN_FN [OUT_FN] [--from FRAME] [--to FRAME] [-v LOG_VERBOSITY]\n///");
+    PRINT("/// \tIN_FN\t\tColumnar (*.ftc) or binary (*.bin) data log.");
+    PRINT("/// \tOUT_FN\t\t[Optional] Output file; *.ftc -> *.dat (default) or *.bin, *.bin -> *.ftc (default).");
+    PRINT("/// \tFRAME\t\t[Optional] Only convert frames in [--from, --to] (*.ftc input only).");
+    PRINT("/// \tLOG_VERBOSITY\t[Optional] One of DBG, INF, WRN, ERR.");
+    PRINT("///");
+    PRINT("/// Version: %d.%d.%d (build date: %s)", FICTRAC_VERSION_MAJOR, FICTRAC_VERSION_MIDDLE, FICTRAC_VERSION_MINOR, __DATE__);
+    PRINT("///\n");
+
+    /// Parse args.
+    string log_level = "info";
+    string in_fn, out_fn;
+    uint32_t frame0 = 0, frame1 = UINT32_MAX;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if ((arg == "--verbosity") || (arg == "-v")) {
+            if (++i < argc) {
+                log_level = argv[i];
+            }
+            else {
+                LOG_ERR("-v/--verbosity requires one argument (debug < info (default) < warn < error)!");
+                return -1;
+            }
+        }
+        else if ((arg == "--from") || (arg == "--to")) {
+            if (++i < argc) {
+                uint32_t f = static_cast<uint32_t>(strtoul(argv[i], nullptr, 10));
+                if (arg == "--from") { frame0 = f; } else { frame1 = f; }
+            }
+            else {
+                LOG_ERR("%s requires one argument (frame counter)!", arg.c_str());
+                return -1;
+            }
+        }
+        else if (in_fn.empty()) {
+            in_fn = arg;
+        }
+        else {
+            out_fn = arg;
+        }
+    }
+    if (in_fn.empty()) {
+        LOG_ERR("Error! No input data log specified.");
+        return -1;
+    }
+    const string in_ext = extension(in_fn);
+    if ((in_ext != "ftc") && (in_ext != "bin")) {
+        LOG_ERR("Error! Input data log must be columnar (*.ftc) or binary (*.bin).");
+        return -1;
+    }
+    if (out_fn.empty()) {
+        out_fn = in_fn.substr(0, in_fn.find_last_of('.')) + ((in_ext == "ftc") ? ".dat" : ".ftc");
+    }
+    const string out_ext = extension(out_fn);
+
+    /// Set logging level.
+    Logger::setVerbosity(log_level);
+
+    double t0 = ts_ms();
+    unsigned long long n = 0;
+
+    /// Binary -> columnar.
+    if (in_ext == "bin") {
+        if (out_ext != "ftc") {
+            LOG_ERR("Error! Binary data logs can only be converted to columnar (*.ftc).");
+            return -1;
+        }
+        FILE* in = fopen(in_fn.c_str(), "rb");
+        if (!in) {
+            LOG_ERR("Error! Could not open input data log (%s).", in_fn.c_str());
+            return -1;
+        }
+        ColumnLogWriter out;
+        if (!out.open(out_fn)) {
+            fclose(in);
+            return -1;
+        }
+        BinaryRecord rec;
+        while (fread(&rec, sizeof(rec), 1, in) == 1) {
+            if ((rec.magic != BinaryRecord::MAGIC) || (rec.size != sizeof(rec))) {
+                LOG_ERR("Error! Invalid record after %llu records (expected version %d).", n, BinaryRecord::VERSION);
+                break;
+            }
+            if (!out.append(rec)) {
+                LOG_ERR("Error! Failed writing record %llu.", n);
+                break;
+            }
+            n++;
+        }
+        out.close();
+        fclose(in);
+    }
+
+    /// Columnar -> binary or text.
+    else {
+        if ((out_ext != "dat") && (out_ext != "bin")) {
+            LOG_ERR("Error! Columnar data logs can only be converted to text (*.dat) or binary (*.bin).");
+            return -1;
+        }
+        ColumnLogReader in;
+        if (!in.open(in_fn)) {
+            return -1;
+        }
+        const bool bin = (out_ext == "bin");
+        std::ofstream out(out_fn, bin ? (std::ios::out | std::ios::binary) : std::ios::out);
+        if (!out.is_open()) {
+            LOG_ERR("Error! Could not open output data log (%s).", out_fn.c_str());
+            return -1;
+        }
+        out.precision(14);
+
+        vector<BinaryRecord> recs;
+        for (size_t c = in.findFrame(frame0); c < in.numChunks(); c++) {
+            if (in.chunk(c).frame0 > frame1) { break; }
+            recs.clear();
+            if (!in.readChunk(c, recs)) {
+                LOG_ERR("Error! Failed reading chunk %zu.", c);
+                break;
+            }
+            for (const auto& r : recs) {
+                if ((r.frame_cnt < frame0) || (r.frame_cnt > frame1)) { continue; }
+                if (bin) {
+                    out.write(reinterpret_cast<const char*>(&r), sizeof(r));
+                }
+                else {
+                    writeCsv(out, r);
+                }
+                n++;
+            }
+        }
+    }
+
+    double secs = (ts_ms() - t0) / 1000.;
+    PRINT("\nWrote %llu records to %s (%.1f s).", n, out_fn.c_str(), secs);
+    return 0;
+}
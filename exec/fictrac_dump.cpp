@@ -0,0 +1,103 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       fictrac_dump.cpp
+/// \brief      Convert a recorded video to a frame dump for fast (decode-free) replay.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "Logger.h"
+#include "CVSource.h"
+#include "FrameDump.h"
+#include "timing.h"
+#include "fictrac_version.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <string>
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    PRINT("///");
+    PRINT("/// fictrac_dump:\tConvert a recorded video to a FicTrac frame dump (Mono8 + timestamps).\n///");
+    PRINT("/// Usage:\tfictrac_dump VIDEO_FN [DUMP_FN] [-v LOG_VERBOSITY] [--hw]\n///");
+    PRINT("/// \tVIDEO_FN\tPath to input video file.");
+    PRINT("/// \tDUMP_FN\t\t[Optional] Output file (defaults to VIDEO_FN with .ftrd extension).");
+    PRINT("/// \tLOG_VERBOSITY\t[Optional] One of DBG, INF, WRN, ERR.");
+    PRINT("/// \t--hw\t\t[Optional] Request hardware accelerated decoding.");
+    PRINT("///");
+    PRINT("/// Version: %d.%d.%d (build date: %s)", FICTRAC_VERSION_MAJOR, FICTRAC_VERSION_MIDDLE, FICTRAC_VERSION_MINOR, __DATE__);
+    PRINT("///\n");
+
+    /// Parse args.
+    string log_level = "info";
+    string in_fn, out_fn;
+    bool hw_decode = false;
+    for (int i = 1; i < argc; ++i) {
+        if ((string(argv[i]) == "--verbosity") || (string(argv[i]) == "-v")) {
+            if (++i < argc) {
+                log_level = argv[i];
+            }
+            else {
+                LOG_ERR("-v/--verbosity requires one argument (debug < info (default) < warn < error)!");
+                return -1;
+            }
+        }
+        else if (string(argv[i]) == "--hw") {
+            hw_decode = true;
+        }
+        else if (in_fn.empty()) {
+            in_fn = argv[i];
+        }
+        else {
+            out_fn = argv[i];
+        }
+    }
+    if (in_fn.empty()) {
+        LOG_ERR("Error! No input video specified.");
+        return -1;
+    }
+    if (out_fn.empty()) {
+        out_fn = in_fn.substr(0, in_fn.find_last_of('.')) + ".ftrd";
+    }
+
+    /// Set logging level.
+    Logger::setVerbosity(log_level);
+
+    /// Greyscale decode where available (luma plane, no colour conversion).
+    CVSource source(in_fn, hw_decode, true);
+    if (!source.isOpen() || source.isLive()) {
+        LOG_ERR("Error! Could not open input video (%s).", in_fn.c_str());
+        return -1;
+    }
+
+    FrameDumpWriter dump;
+    if (!dump.open(out_fn, source.getWidth(), source.getHeight(), source.getFPS())) {
+        LOG_ERR("Error! Could not open output frame dump (%s).", out_fn.c_str());
+        return -1;
+    }
+
+    const int nframes = source.getFrameCount();
+    double t0 = ts_ms();
+    cv::Mat frame, grey;
+    while (source.grabBuffer(frame)) {
+        const cv::Mat* out = &frame;
+        if (frame.channels() != 1) {
+            cv::cvtColor(frame, grey, cv::COLOR_BGR2GRAY);
+            out = &grey;
+        }
+        if (!dump.write(*out, source.getTimestamp(), source.getMsSinceMidnight())) {
+            LOG_ERR("Error! Failed writing frame %llu.", static_cast<unsigned long long>(dump.getFrameCount()));
+            return -1;
+        }
+        if ((dump.getFrameCount() % 1000) == 0) {
+            LOG("Converted %llu / %d frames", static_cast<unsigned long long>(dump.getFrameCount()), nframes);
+        }
+    }
+    const unsigned long long n = dump.getFrameCount();
+    dump.close();
+
+    double secs = (ts_ms() - t0) / 1000.;
+    PRINT("\nWrote %llu frames to %s (%.1f s, %.1f fps).", n, out_fn.c_str(), secs, (secs > 0) ? n / secs : 0);
+    return 0;
+}
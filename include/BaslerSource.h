@@ -17,19 +17,34 @@
 
 class BaslerSource : public FrameSource {
 public:
-    BaslerSource(int index=0);
+    ///
+    /// native delivers Mono8/Bayer 8 bit frames as captured (1 channel, see getBayerType)
+    /// rather than converting every frame to BGR. Other pixel formats are still converted.
+    /// nbufs sets the number of driver buffers in flight (0 for SDK default).
+    ///
+    BaslerSource(int index=0, bool native=false, int nbufs=0);
     ~BaslerSource();
 
     double getFPS();
     bool setFPS(double);
 
     bool rewind() { return false; };
+    bool setAOI(int& x, int& y, int& w, int& h, int& bin);
+    bool getExposure(double& us, double& min_us, double& max_us);
+    bool setExposure(double& us);
+    bool getGain(double& db, double& min_db, double& max_db);
+    bool setGain(double& db);
     bool grab(cv::Mat& frame);
+    bool grabBuffer(cv::Mat& frame);
+    void releaseBuffer();
 
     private:
+    void syncClock();
+
     Pylon::CPylonImage _pylonImg;
     Pylon::CGrabResultPtr _ptrGrabResult;
     Pylon::CInstantCamera _cam;
+    bool _native;
 };
 
 #endif // BASLER_USB3
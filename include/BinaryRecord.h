@@ -0,0 +1,54 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       BinaryRecord.h
+/// \brief      Fixed-layout binary output record.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include <cstdint>
+
+///
+/// Binary equivalent of one line of the CSV data output (see doc/data_header.txt).
+/// Fields are stored in native (little endian) byte order with natural alignment,
+/// so the layout has no padding and can be cast/unpacked directly by clients.
+/// Clients should check magic and version, and may use size to skip records
+/// written by a newer version that only appends fields.
+///
+struct BinaryRecord
+{
+    static const uint32_t MAGIC = 0x43525446;  // "FTRC"
+    static const uint16_t VERSION = 2;    // 2: motion rates (see Extrapolate.h)
+
+    // header
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;                  // sizeof(BinaryRecord)
+
+    // counters
+    uint32_t frame_cnt;             // col 1
+    uint32_t seq;                   // col 23
+
+    // state
+    double dr_cam[3];               // cols 2-4
+    double err;                     // col 5
+    double dr_lab[3];               // cols 6-8
+    double r_cam[3];                // cols 9-11
+    double r_lab[3];                // cols 12-14
+    double posx, posy;              // cols 15-16
+    double heading;                 // col 17
+    double step_dir, step_mag;      // cols 18-19
+    double intx, inty;              // cols 20-21
+    double ts;                      // col 22
+    double dts;                     // col 24
+    double ms;                      // col 25
+
+    // motion over the last frame, for extrapolating to later times (version >= 2, see Extrapolate.h)
+    double w_lab[3];                // angular velocity (lab frame), rad/ms
+    double heading_rate;            // rad/ms
+    double velx_rate, vely_rate;    // animal frame speed (as intx/inty), rad/ms
+
+    BinaryRecord() : magic(MAGIC), version(VERSION), size(sizeof(BinaryRecord)) {}
+};
+
+static_assert(sizeof(BinaryRecord) == 16 + 29 * sizeof(double), "BinaryRecord must not contain padding");
@@ -14,20 +14,36 @@
 
 #include <memory>	// shared_ptr
 #include <cstdio>
+#include <string>
 
 class CVSource : public FrameSource {
 public:
-	CVSource(std::string input);
+	///
+	/// hw_decode requests hardware accelerated video decoding (OpenCV >= 4.5.2).
+	/// grey requests 8-bit greyscale frames straight from the decoder (luma plane,
+	/// via GStreamer) so the colour conversion can be skipped. Either falls back
+	/// to the default (software, BGR) decoding if unavailable.
+	///
+	CVSource(std::string input, bool hw_decode = false, bool grey = false);
 	virtual ~CVSource();
 
     virtual double getFPS();
 	virtual bool setFPS(double fps);
 	virtual bool rewind();
+	virtual bool setStartFrame(int frame);
+	virtual int getFrameCount();
 	virtual bool grab(cv::Mat& frame);
+	virtual bool grabBuffer(cv::Mat& frame);
+
+	/// Bayer input is demosaiced here, so grabbed frames are never mosaiced.
+	virtual BAYER_TYPE getBayerType() { return BAYER_NONE; }
 
 private:
 	std::shared_ptr<cv::VideoCapture> _cap;
 	cv::Mat _frame_cap;
 
-    bool _is_image;
+    bool _is_image, _grey;
+    int _start_frame;
+    double _file_fps, _prev_pos_ms;     // container frame rate/timestamp (video files)
+    double _pace_ts, _pace_fps, _pace_ms;   // playback rate correction (negative until the first frame)
 };
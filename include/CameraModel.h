@@ -8,6 +8,7 @@
 
 #include "typesvars.h"
 #include "SharedPointers.h"
+#include "Projection.h"
 
 #include <opencv2/opencv.hpp>
 
@@ -93,6 +94,14 @@ public:
 		return vectorToPixel((CmReal*)&point, x, y);
 	}
 
+	///
+	/// Parameters of the inline projection functor for this model (see
+	/// Projection.h). False if the model has no functor of that type.
+	///
+	virtual bool getProjection(proj::EquiArea& p) const { return false; }
+	virtual bool getProjection(proj::Rectilinear& p) const { return false; }
+	virtual bool getProjection(proj::Fisheye& p) const { return false; }
+
 	///
 	/// Same as above but converts to/from pixel array indices rather
 	/// than working with continuous values i.e. integer array index
@@ -215,3 +224,18 @@ protected:
 		return !((x < 0) || (x > _width) || (y < 0) || (y > _height));
 	}
 };
+
+namespace proj {
+
+///
+/// Fallback for models without a specialised functor (virtual call, exact).
+///
+struct Model
+{
+	const CameraModel* model;
+
+	bool operator()(const CmReal v[3], CmReal& x, CmReal& y) const { return model->vectorToPixel(v, x, y); }
+	bool index(const CmReal v[3], int& ix, int& iy) const { return model->vectorToPixelIndex(v, ix, iy); }
+};
+
+}
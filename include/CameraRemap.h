@@ -34,6 +34,17 @@ public:
 	CameraRemap(const CameraModelPtr& src, const CameraModelPtr& dst,
 			const RemapTransformPtr& trans=RemapTransformPtr());
 
+	///
+	/// Use previously computed maps (dst->width() * dst->height() each,
+	/// e.g. from a cache) rather than evaluating the models per pixel.
+	///
+	CameraRemap(const CameraModelPtr& src, const CameraModelPtr& dst,
+			const RemapTransformPtr& trans,
+			const std::vector<float>& mapX, const std::vector<float>& mapY);
+
+	const std::vector<float>& mapX() const { return _mapX; }
+	const std::vector<float>& mapY() const { return _mapY; }
+
 	CameraModelPtr& getSrc() { return _src; }
 	CameraModelPtr& getDst() { return _dst; }
 
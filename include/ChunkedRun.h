@@ -0,0 +1,52 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ChunkedRun.h
+/// \brief      Parallel reprocessing of one long recorded video in chunks.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <string>
+#include <memory>   // shared_ptr
+#include <vector>
+
+///
+/// Splits a recorded video into time chunks that are tracked concurrently.
+///
+/// A seed pass first tracks the start of the video to build a sphere surface
+/// template (unless the config already specifies sphere_map_fn). Every chunk
+/// is then started from that template and localised against it by a global
+/// search, so absolute orientations agree between chunks. Chunks overlap the
+/// previous chunk by a few frames. Integrated quantities (heading, x/y
+/// position, x/y motion, sequence counter) are aligned on the last overlap
+/// frame and stitched into a single data file, named as for a normal run.
+///
+class ChunkedRun
+{
+public:
+    ChunkedRun(std::string cfg_fn, int nchunks, int njobs = 0, std::shared_ptr<ThreadPool> pool = nullptr);
+    ~ChunkedRun() {}
+
+    /// Track all chunks and write the stitched data file. active is polled for user abort.
+    bool run(const bool& active);
+
+private:
+    struct Chunk {
+        int start, end;                 // output frame range [start, end)
+        int run_start;                  // first tracked frame (start - overlap)
+        std::string cfg_fn, data_fn;
+    };
+
+    bool seed(const bool& active, std::string& template_fn);
+    std::string writeConfig(const std::string& base, int frame_start, int frame_count, const std::string& template_fn);
+    bool trackAll(const bool& active);
+    bool stitch(const std::string& out_fn);
+
+private:
+    std::string _cfg_fn, _base_fn;
+    int _nchunks, _njobs;
+    std::shared_ptr<ThreadPool> _pool;
+    std::vector<Chunk> _chunks;
+};
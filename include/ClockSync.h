@@ -0,0 +1,52 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ClockSync.h
+/// \brief      Map device (camera) timestamps onto the host clock.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+///
+/// Tracks the offset (and drift) between a device clock and the host clock (ts_ms).
+///
+/// Preferred samples are latched device times bracketed by host times, taken
+/// every period. For devices that cannot latch their clock, frame arrival times
+/// are used instead: transfer delay only ever adds to the host time, so the
+/// smallest (host - device) offset seen in each period is the best estimate.
+///
+class ClockSync
+{
+public:
+    explicit ClockSync(double period_ms = 1000);
+    ~ClockSync() {}
+
+    /// Whether a new latch sample is due (or the clock has not been synced yet).
+    bool latchDue(double host_ms) const { return (_latch_ok && ((_last_latch < 0) || ((host_ms - _last_latch) >= _period))); }
+
+    /// Device time dev_ms was latched between host times host_before and host_after.
+    void addLatch(double dev_ms, double host_before, double host_after);
+
+    /// The device does not support latching (fall back to frame arrival times).
+    void latchFailed() { _latch_ok = false; }
+
+    /// Frame with device time dev_ms arrived at host time host_ms.
+    void addFrame(double dev_ms, double host_ms);
+
+    bool valid() const { return _valid; }
+
+    /// Device time in host ms (-1 if not synced yet).
+    double toHost(double dev_ms) const;
+
+private:
+    void update(double dev_ms, double offset, bool skew_est);
+
+private:
+    double _period;
+    bool _latch_ok, _valid;
+    double _last_latch;
+
+    double _offset, _skew, _dev_ref;    // host = dev + offset + skew * (dev - dev_ref)
+
+    /// Frame arrival window.
+    double _win_start, _win_offset, _win_dev;
+};
@@ -25,8 +25,8 @@ public:
 	CmPointT(const cv::Point& p) : x(p.x), y(p.y), z(0) {}
 	CmPointT(const cv::Point2f& p) : x(p.x), y(p.y), z(0) {}
 	CmPointT(const cv::Point3f& p) : x(p.x), y(p.y), z(p.z) {}
-	CmPointT(const CmPoint32f& p) : x(p.x), y(p.y), z(p.z) {}
-	CmPointT(const CmPoint64f& p) : x(p.x), y(p.y), z(p.z) {}
+	template <typename U>
+	CmPointT(const CmPointT<U>& p) : x(static_cast<T>(p.x)), y(static_cast<T>(p.y)), z(static_cast<T>(p.z)) {}   // not a copy ctor, so CmPointT stays trivially copyable
     CmPointT(T az, T el);
 
 	/// Allow implicit conversion of scalar to CmPointT for scaling
@@ -76,6 +76,17 @@ public:
     
     static cv::Mat_<T> omegaToMatrix(const CmPointT& omega);
     static CmPointT<T> matrixToOmega(const cv::Mat_<T>& m);
+    static CmPointT<T> matrixToOmega(const T m[9]);     // row major 3x3
+
+	///
+	/// As omegaToMatrix()/matrixToOmega(), for the per-frame (small) rotations
+	/// on the tracking hot path. Below ~0.1 rad a series expansion replaces the
+	/// normalise/trig calls (error < 1e-13), and it is also more accurate than
+	/// the acos() form of matrixToOmega() near zero. Larger rotations fall back
+	/// to the general path, so the result is always valid.
+	///
+	void omegaToMatrixSmall(double R[9]) const;
+	static CmPointT<T> matrixToOmegaSmall(const T m[9]);
     
     void omegaToAzElMag(T& az, T& el, T& mag) const;
 
@@ -228,3 +239,51 @@ inline const CmPoint64f operator^ (const CmPoint64f& lhs, const CmPoint64f& rhs)
 	{ return lhs.crs(rhs); }
 inline const CmPoint64f operator- (const CmPoint64f& p)
 	{ return CmPoint64f(-p.x, -p.y, -p.z); }
+
+///
+/// Fixed-size 3x3 double matrix (row major), e.g. rotation state that is
+/// updated every frame. Trivially copyable, never allocates.
+///
+struct CmMat33d {
+	double m[9];
+
+	CmMat33d() : m{ 1, 0, 0, 0, 1, 0, 0, 0, 1 } {}   // identity
+	explicit CmMat33d(const double* p) { for (int i = 0; i < 9; i++) { m[i] = p[i]; } }
+	explicit CmMat33d(const cv::Mat& M) { for (int i = 0; i < 9; i++) { m[i] = M.at<double>(i / 3, i % 3); } }
+
+	/// Rotation matrix for angle-axis omega (see CmPointT::omegaToMatrix).
+	static CmMat33d fromOmega(const CmPoint64f& omega) { CmMat33d R; omega.omegaToMatrix(R.m); return R; }
+	CmPoint64f toOmega() const { return CmPoint64f::matrixToOmega(m); }
+
+	/// As above, for small (frame-to-frame) rotations (see CmPointT::omegaToMatrixSmall).
+	static CmMat33d fromOmegaSmall(const CmPoint64f& omega) { CmMat33d R; omega.omegaToMatrixSmall(R.m); return R; }
+	CmPoint64f toOmegaSmall() const { return CmPoint64f::matrixToOmegaSmall(m); }
+
+	double& operator[] (unsigned i) { return m[i]; }
+	const double& operator[] (unsigned i) const { return m[i]; }
+	double* data() { return m; }
+	const double* data() const { return m; }
+
+	CmMat33d operator* (const CmMat33d& b) const
+	{
+		CmMat33d r;
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				r.m[3 * i + j] = m[3 * i] * b.m[j] + m[3 * i + 1] * b.m[3 + j] + m[3 * i + 2] * b.m[6 + j];
+			}
+		}
+		return r;
+	}
+
+	CmMat33d t() const
+	{
+		CmMat33d r;
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) { r.m[3 * i + j] = m[3 * j + i]; }
+		}
+		return r;
+	}
+
+	/// Copy into a (new) cv::Mat, for interop with OpenCV code.
+	cv::Mat toMat() const { return cv::Mat(3, 3, CV_64F, const_cast<double*>(m)).clone(); }
+};
@@ -0,0 +1,163 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ColumnLog.h
+/// \brief      Compressed, columnar data log (chunks of typed columns with a seek index).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "BinaryRecord.h"
+
+#include <cstdint>
+#include <cstdio>   // FILE
+#include <string>
+#include <vector>
+
+///
+/// Layout of a columnar data log (data_fmt = col, *.ftc).
+///
+/// The file header is followed by chunks of up to chunk_rows records. Each
+/// chunk holds one encoded block per BinaryRecord field (column): frame and
+/// sequence counters as uint32 deltas, every other field as the XOR of its
+/// IEEE bits with the previous row. Blocks are byte-shuffled (all first bytes,
+/// then all second bytes, ...), so the slowly changing high bytes form long
+/// runs, and then compressed (zstd if built with FICTRAC_ZSTD, else a
+/// built-in run-length coder). Every chunk starts with its frame and time
+/// range, and a chunk index with the same ranges is appended on close, so
+/// readers can seek straight to a frame or time. Readers of an unfinished log
+/// (no index) recover every complete chunk by scanning.
+///
+/// Columns are, in order, frame_cnt, seq and then the double fields of
+/// BinaryRecord (n_f64 of them, see colName), so fields appended to
+/// BinaryRecord become new columns.
+///
+namespace collog {
+
+static const uint32_t MAGIC = 0x4c435446;          // "FTCL"
+static const uint32_t CHUNK_MAGIC = 0x4b4e4843;    // "CHNK"
+static const uint32_t INDEX_MAGIC = 0x58444e49;    // "INDX"
+static const uint32_t END_MAGIC = 0x444e4546;      // "FEND"
+static const uint16_t VERSION = 1;
+static const uint32_t CHUNK_ROWS_DEFAULT = 4096;
+
+/// Integer columns (frame_cnt, seq), followed by the double columns.
+static const int NUM_U32 = 2;
+static const int NUM_F64 = (sizeof(BinaryRecord) - 16) / sizeof(double);
+static const int NUM_COLS = NUM_U32 + NUM_F64;
+
+enum Codec : uint8_t {
+    RAW = 0,
+    RLE = 1,
+    ZSTD = 2
+};
+
+struct Header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t hdr_size;          // sizeof(Header)
+    uint16_t n_u32, n_f64;      // columns
+    uint16_t rec_version;       // BinaryRecord::VERSION of the logged records
+    uint16_t reserved;
+    uint32_t chunk_rows;
+};
+
+struct ChunkHeader {
+    uint32_t magic;
+    uint32_t nrows;
+    uint32_t frame0, frame1;    // first/last frame counter
+    double ts0, ts1;            // first/last timestamp
+    uint64_t bytes;             // column blocks following this header
+};
+
+struct BlockHeader {
+    uint8_t codec;
+    uint8_t elem_size;
+    uint16_t reserved;
+    uint32_t raw_len, enc_len;
+};
+
+struct IndexEntry {
+    uint64_t offset;            // of ChunkHeader
+    uint32_t nrows;
+    uint32_t frame0, frame1;
+    uint32_t reserved;
+    double ts0, ts1;
+};
+
+/// Column names (see doc/data_header.txt).
+const char* colName(int c);
+
+} // namespace collog
+
+///
+/// Writer. Buffers chunk_rows records per chunk (preallocated), so only every
+/// chunk_rows-th append encodes and writes.
+///
+class ColumnLogWriter
+{
+public:
+    ColumnLogWriter();
+    ~ColumnLogWriter();
+
+    /// zstd_level is ignored unless built with FICTRAC_ZSTD (run-length coding otherwise).
+    bool open(const std::string& fn, uint32_t chunk_rows = collog::CHUNK_ROWS_DEFAULT, int zstd_level = 3);
+    bool isOpen() const { return _file != nullptr; }
+
+    bool append(const BinaryRecord& rec);
+
+    /// Write the pending chunk and the chunk index.
+    void close();
+
+private:
+    bool writeChunk();
+
+private:
+    FILE* _file;
+    uint32_t _chunk_rows, _nrows;
+    int _level;
+    uint64_t _offset;
+    std::vector<uint32_t> _u32[collog::NUM_U32];
+    std::vector<double> _f64[collog::NUM_F64];
+    std::vector<collog::IndexEntry> _index;
+    std::vector<uint8_t> _raw, _shuf, _enc, _chunk;
+};
+
+///
+/// Reader. Chunks are decoded as a whole (readChunk) or one column at a time
+/// (readColumn, skipping the other blocks).
+///
+class ColumnLogReader
+{
+public:
+    ColumnLogReader();
+    ~ColumnLogReader();
+
+    bool open(const std::string& fn);
+    bool isOpen() const { return _file != nullptr; }
+    void close();
+
+    size_t numChunks() const { return _index.size(); }
+    uint64_t numRows() const { return _nrows; }
+    const collog::IndexEntry& chunk(size_t i) const { return _index[i]; }
+
+    /// First chunk that may contain frame / ts (numChunks() if none).
+    size_t findFrame(uint32_t frame) const;
+    size_t findTime(double ts) const;
+
+    /// Records of chunk i, appended to out.
+    bool readChunk(size_t i, std::vector<BinaryRecord>& out);
+
+    /// Column c of chunk i (as doubles), appended to out.
+    bool readColumn(size_t i, int c, std::vector<double>& out);
+
+private:
+    bool readBlock(size_t nrows, int c, std::vector<uint8_t>& raw);
+    bool scanChunks();
+
+private:
+    FILE* _file;
+    collog::Header _hdr;
+    uint64_t _nrows;
+    std::vector<collog::IndexEntry> _index;
+    std::vector<uint8_t> _enc, _shuf, _raw;
+};
@@ -0,0 +1,35 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ColumnRecorder.h
+/// \brief      Columnar data log recorder (see ColumnLog.h).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "RecorderInterface.h"
+#include "ColumnLog.h"
+
+#include <string>
+#include <vector>
+
+///
+/// Takes BinaryRecords (possibly split across writes, as handed over by the
+/// Recorder's batching ring) and encodes them into a columnar log, so all
+/// encoding and compression happens on the Recorder's writer thread.
+///
+class ColumnRecorder : public RecorderInterface
+{
+public:
+    ColumnRecorder();
+    ~ColumnRecorder();
+
+    /// Interface to be overridden by implementations.
+    bool openRecord(std::string fn = "");
+    bool writeRecord(const std::string& s) { return writeRecord(s.data(), s.size()); }
+    bool writeRecord(const char* data, size_t len);
+    void closeRecord();
+
+private:
+    ColumnLogWriter _log;
+    std::vector<char> _pending;     // partial record
+};
@@ -0,0 +1,165 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       CompactRecord.h
+/// \brief      Compact fixed-point binary frames for low bandwidth (serial) output.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "BinaryRecord.h"
+
+#include <cstdint>
+#include <cstring>  // memcpy
+#include <cmath>    // llround
+#include <string>
+#include <vector>
+
+///
+/// A frame carries a selectable subset of the BinaryRecord fields as
+/// little endian fixed-point integers:
+///
+///   uint8     sync (0xA5, 0x5A)
+///   uint8     payload length (bytes from field mask up to the checksum)
+///   uint16    field mask (see Field), fields follow in mask bit order
+///   uint32    frame counter
+///   ...       int32 per value, value = round(field * scale)
+///   uint16    Fletcher-16 checksum of the payload
+///
+/// e.g. delta rotation (lab), heading and time of day is 2 + 1 + 2 + 4 + 5 * 4
+/// + 2 = 31 bytes, rather than ~300 for a CSV line.
+///
+namespace compact {
+
+const uint8_t SYNC0 = 0xA5;
+const uint8_t SYNC1 = 0x5A;
+
+/// Field groups, in frame order. Scale is per value (see fieldScale).
+enum Field : uint16_t {
+    DR_CAM  = 1 << 0,   // 3 values, rad * 1e6
+    ERR     = 1 << 1,   // 1 value, * 1e3
+    DR_LAB  = 1 << 2,   // 3 values, rad * 1e6
+    R_CAM   = 1 << 3,   // 3 values, rad * 1e6
+    R_LAB   = 1 << 4,   // 3 values, rad * 1e6
+    POS     = 1 << 5,   // 2 values (posx, posy), rad * 1e4
+    HEADING = 1 << 6,   // 1 value, rad * 1e6
+    STEP    = 1 << 7,   // 2 values (step_dir, step_mag), rad * 1e6
+    INT     = 1 << 8,   // 2 values (intx, inty), rad * 1e4
+    SEQ     = 1 << 9,   // 1 value, * 1
+    DTS     = 1 << 10,  // 1 value, ms * 1e3
+    MS      = 1 << 11   // 1 value (time of day), ms * 10
+};
+const int NUM_FIELDS = 12;
+
+const uint16_t FIELDS_DEFAULT = DR_LAB | POS | HEADING | MS;
+
+inline const char* fieldName(int i)
+{
+    static const char* names[NUM_FIELDS] = { "dr_cam", "err", "dr_lab", "r_cam", "r_lab", "pos", "heading", "step", "int", "seq", "dts", "ms" };
+    return ((i >= 0) && (i < NUM_FIELDS)) ? names[i] : "";
+}
+
+inline int fieldLen(int i)
+{
+    static const int lens[NUM_FIELDS] = { 3, 1, 3, 3, 3, 2, 1, 2, 2, 1, 1, 1 };
+    return ((i >= 0) && (i < NUM_FIELDS)) ? lens[i] : 0;
+}
+
+inline double fieldScale(int i)
+{
+    static const double scales[NUM_FIELDS] = { 1e6, 1e3, 1e6, 1e6, 1e6, 1e4, 1e6, 1e6, 1e4, 1, 1e3, 10 };
+    return ((i >= 0) && (i < NUM_FIELDS)) ? scales[i] : 0;
+}
+
+///
+/// Field mask from a comma/space separated list of field names. Unknown names are returned in bad.
+///
+inline uint16_t parseFields(const std::string& list, std::string& bad)
+{
+    uint16_t mask = 0;
+    bad.clear();
+    size_t beg = 0;
+    while (beg < list.size()) {
+        size_t end = list.find_first_of(", \t{}", beg);
+        if (end == std::string::npos) { end = list.size(); }
+        std::string name = list.substr(beg, end - beg);
+        beg = end + 1;
+        if (name.empty()) { continue; }
+        int i = 0;
+        for (; i < NUM_FIELDS; i++) {
+            if (name == fieldName(i)) { break; }
+        }
+        if (i < NUM_FIELDS) {
+            mask |= (1 << i);
+        } else {
+            bad += (bad.empty() ? "" : ", ") + name;
+        }
+    }
+    return mask;
+}
+
+///
+/// Frame size in bytes for a field mask.
+///
+inline size_t frameSize(uint16_t mask)
+{
+    size_t n = 2 + 1 + 2 + 4 + 2;
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        if (mask & (1 << i)) { n += 4 * fieldLen(i); }
+    }
+    return n;
+}
+
+inline uint16_t fletcher16(const uint8_t* p, size_t len)
+{
+    uint32_t a = 0, b = 0;
+    for (size_t i = 0; i < len; i++) {
+        a = (a + p[i]) % 255;
+        b = (b + a) % 255;
+    }
+    return static_cast<uint16_t>((b << 8) | a);
+}
+
+///
+/// Encode rec into buf (resized to frameSize(mask)). Out of range values saturate.
+///
+inline void encode(const BinaryRecord& rec, uint16_t mask, std::vector<uint8_t>& buf)
+{
+    buf.resize(frameSize(mask));
+    uint8_t* p = buf.data();
+    auto put = [&](const void* v, size_t n) { memcpy(p, v, n); p += n; };   // little endian hosts
+    auto fix = [&](double v, double scale) {
+        double s = v * scale;
+        int32_t q = (s >= 2147483647.0) ? INT32_MAX : (s <= -2147483648.0) ? INT32_MIN : static_cast<int32_t>(std::llround(s));
+        put(&q, sizeof(q));
+    };
+
+    *p++ = SYNC0;
+    *p++ = SYNC1;
+    *p++ = static_cast<uint8_t>(buf.size() - 5);
+    put(&mask, sizeof(mask));
+    put(&rec.frame_cnt, sizeof(rec.frame_cnt));
+
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        if (!(mask & (1 << i))) { continue; }
+        const double scl = fieldScale(i);
+        switch (1 << i) {
+        case DR_CAM:    fix(rec.dr_cam[0], scl); fix(rec.dr_cam[1], scl); fix(rec.dr_cam[2], scl); break;
+        case ERR:       fix(rec.err, scl); break;
+        case DR_LAB:    fix(rec.dr_lab[0], scl); fix(rec.dr_lab[1], scl); fix(rec.dr_lab[2], scl); break;
+        case R_CAM:     fix(rec.r_cam[0], scl); fix(rec.r_cam[1], scl); fix(rec.r_cam[2], scl); break;
+        case R_LAB:     fix(rec.r_lab[0], scl); fix(rec.r_lab[1], scl); fix(rec.r_lab[2], scl); break;
+        case POS:       fix(rec.posx, scl); fix(rec.posy, scl); break;
+        case HEADING:   fix(rec.heading, scl); break;
+        case STEP:      fix(rec.step_dir, scl); fix(rec.step_mag, scl); break;
+        case INT:       fix(rec.intx, scl); fix(rec.inty, scl); break;
+        case SEQ:       fix(rec.seq, scl); break;
+        case DTS:       fix(rec.dts, scl); break;
+        case MS:        fix(rec.ms, scl); break;
+        }
+    }
+
+    const uint16_t sum = fletcher16(buf.data() + 3, buf.size() - 5);
+    put(&sum, sizeof(sum));
+}
+
+}
@@ -17,6 +17,7 @@ SHARED_PTR(CameraModel);
 
 #include <vector>
 #include <string>
+#include <functional>
 
 class ConfigGui
 {
@@ -84,10 +85,14 @@ private:
 
     bool updateRt(const std::string& ref_str, cv::Mat& R, cv::Mat& t);
     //void drawC2ATransform(cv::Mat& disp_frame, const cv::Mat& ref_cnrs, const cv::Mat& R, const cv::Mat& t, const double& r, const CmPoint& c);
-    void drawC2AAxes(cv::Mat& disp_frame, const cv::Mat& R, const cv::Mat& t, const double& r, const CmPoint& c);
-    void drawC2ACorners(cv::Mat& disp_frame, const std::string& ref_str, const cv::Mat& R, const cv::Mat& t);
+    void drawC2AAxes(cv::Mat& disp_frame, const CameraModelPtr& cam_model, const cv::Mat& R, const cv::Mat& t, const double& r, const CmPoint& c);
+    void drawC2ACorners(cv::Mat& disp_frame, const CameraModelPtr& cam_model, const std::string& ref_str, const cv::Mat& R, const cv::Mat& t);
     bool saveC2ATransform(const std::string& ref_str, const cv::Mat& R, const cv::Mat& t);
 
+    /// Overlay drawing callback: target image, camera model and point scale for that image.
+    typedef std::function<void(cv::Mat&, const CameraModelPtr&, double)> Overlay;
+    void setDisplayFrame(const cv::Mat& frame);
+    void showFrame(const Overlay& overlay, bool zoom);
     void changeState(INPUT_MODE new_state);
     
 private:
@@ -95,7 +100,9 @@ private:
     ConfigParser _cfg;
     int _w, _h;
     float _disp_scl;
-    CameraModelPtr _cam_model;
+    cv::Mat _full_frame, _disp_base;    // full resolution and (cached) display resolution images
+    cv::Mat _disp_frame, _zoom_full, _zoom_frame;
+    CameraModelPtr _cam_model, _disp_model;
     INPUT_DATA _input_data;
 
     std::shared_ptr<FrameSource> _source;
@@ -23,6 +23,7 @@ public:
 
     /// File IO
     int read(std::string fn);
+    int readString(const std::string& cfg);     // in-memory config (not associated with a file)
     int write(std::string fn);
     int write() { return write(_fn); }
 
@@ -94,6 +95,8 @@ public:
     void printAll();
 
 private:
+    int parse(std::istream& f);
+
     std::string _fn;    // keep track of config filename
     std::map<std::string,std::string> _data;    // string data written/read to/from file
     std::vector<std::string> _comments;
@@ -0,0 +1,50 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       DirtyTiles.h
+/// \brief      Changed-region tracking for incremental sphere map copies.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+#include <cstdint>
+
+class TiledMap;
+
+///
+/// Records which 16x16 pixel tiles of a map have been written, so that copies
+/// of the map (matching map, draw snapshot) can be brought up to date by
+/// copying only the tiles changed since each copy was last updated.
+///
+/// Every tile carries the version at which it was last marked; each copy holds
+/// the version it was last updated at. Marking and updating must be serialised
+/// by the caller (same thread, or under the map lock).
+///
+class DirtyTiles
+{
+public:
+    static const int TILE_BITS = 4;
+    static const int TILE = 1 << TILE_BITS;
+
+    DirtyTiles(int w, int h);
+    ~DirtyTiles() {}
+
+    /// Flag pixel (x, y) as changed.
+    void mark(int x, int y) { _ver[(y >> TILE_BITS) * _tw + (x >> TILE_BITS)] = _cur; }
+
+    /// Flag whole map as changed.
+    void markAll();
+
+    /// Bring dst up to date with src, copying only tiles changed since ver (0 copies
+    /// everything) and updating ver. Optionally refresh the same regions of a tiled
+    /// mirror of dst. dst is only (re)allocated if it doesn't match src.
+    /// Returns the number of tiles copied.
+    int update(const cv::Mat& src, cv::Mat& dst, uint64_t& ver, TiledMap* tiles = nullptr);
+
+private:
+    int _w, _h, _tw, _th;
+    uint64_t _cur;
+    std::vector<uint64_t> _ver;
+};
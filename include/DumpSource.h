@@ -0,0 +1,54 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       DumpSource.h
+/// \brief      Replays a frame dump (see FrameDump.h) from a read-only file mapping.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "FrameSource.h"
+#include "FrameDump.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+///
+/// Frames are Mono8 and are not decoded: grabBuffer() wraps the mapped record
+/// directly (valid for the lifetime of the source), so replay is limited by
+/// I/O bandwidth. Timestamps are those of the original recording. Supports
+/// random access through setStartFrame()/rewind().
+///
+class DumpSource : public FrameSource {
+public:
+    DumpSource(std::string fn);
+    virtual ~DumpSource();
+
+    /// True if fn looks like a frame dump (by extension).
+    static bool isDump(const std::string& fn);
+
+    virtual double getFPS();
+    virtual bool rewind();
+    virtual bool setStartFrame(int frame);
+    virtual int getFrameCount() { return static_cast<int>(_nframes); }
+    virtual bool grab(cv::Mat& frame);
+    virtual bool grabBuffer(cv::Mat& frame);
+
+private:
+    const uint8_t* record(uint64_t i) const { return _base + _hdr.data_offset + i * _hdr.rec_size; }
+
+    framedump::Header _hdr;
+    const uint8_t* _base;       // mapped file
+    uint64_t _len;
+    uint64_t _nframes, _pos, _start_frame;
+    double _t0;                 // host time of first replayed frame (paced playback)
+
+#ifdef _WIN32
+    HANDLE _file, _mapping;
+#endif
+};
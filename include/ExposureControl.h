@@ -0,0 +1,62 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ExposureControl.h
+/// \brief      Closed-loop exposure/gain control from sphere ROI statistics.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "FrameSource.h"
+
+#include <memory>   // shared_ptr, unique_ptr
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+///
+/// Drives the mean grey level of the (unthresholded) sphere ROI towards a
+/// target by adjusting camera exposure, then gain once exposure is limited by
+/// the frame period. Saturated ROI pixels always pull exposure down.
+///
+/// The grabber thread only supplies statistics when wantStats() is set (once
+/// per period); device settings are written from the controller thread, so
+/// slow camera register writes never stall frame processing.
+///
+class ExposureControl
+{
+public:
+    /// target is the desired ROI mean (0-255), period_ms the minimum time between adjustments.
+    ExposureControl(std::shared_ptr<FrameSource> source, double target, double period_ms);
+    ~ExposureControl();
+
+    /// False if the source does not support manual exposure.
+    bool isActive() const { return _active; }
+
+    /// Grabber thread. Cheap check whether new statistics are due.
+    bool wantStats() const { return _want.load(std::memory_order_relaxed); }
+
+    /// Grabber thread. ROI mean grey level and fraction of saturated ROI pixels.
+    void update(double mean, double sat_frac);
+
+private:
+    /// Worker function.
+    void process();
+
+    std::shared_ptr<FrameSource> _source;
+    double _target, _period_ms;
+    double _exp_us, _exp_min, _exp_max;
+    double _gain_db, _gain_min, _gain_max;
+    bool _has_gain;
+
+    /// Latest statistics (grabber -> controller).
+    std::atomic_bool _want;
+    double _mean, _sat_frac;
+    bool _pending;
+
+    /// Thread stuff.
+    std::atomic_bool _active;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::unique_ptr<std::thread> _thread;
+};
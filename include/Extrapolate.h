@@ -0,0 +1,148 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       Extrapolate.h
+/// \brief      Header-only extrapolation of published state to a requested time (latency compensation).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "BinaryRecord.h"
+
+#include <cmath>
+
+///
+/// Each output state carries the motion over its last frame as rates (see
+/// BinaryRecord::w_lab, heading_rate, velx_rate, vely_rate) along with the
+/// capture timestamp of the frame (ts). A client rendering at a higher rate
+/// than the camera can then advance the most recent state to its own
+/// display time, rather than always showing a state that is at least one
+/// camera-plus-processing delay old:
+///
+///     BinaryRecord rec, now;
+///     if (shm.readLatest(rec) && extrap::extrapolate(rec, display_ts, now)) { ... now.r_lab, now.heading, now.posx ... }
+///
+/// The model is constant angular velocity in the lab frame, i.e. constant
+/// forward/sideways speed and turning rate for the animal, so the fictive
+/// path is advanced along an arc. Only the lab frame orientation (r_lab),
+/// heading, posx/posy and intx/inty are advanced. ts must be on the same
+/// clock as rec.ts (ms since epoch for live cameras, or the video timestamps).
+///
+namespace extrap {
+
+/// Extrapolation is clamped to this far (ms) from the capture timestamp.
+const double MAX_DT_MS_DEFAULT = 100;
+
+///
+/// Rotation vector (axis * angle) to row-major rotation matrix, see CmPoint64f::omegaToMatrix().
+///
+inline void omegaToMatrix(const double w[3], double R[9])
+{
+    const double t = std::sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+    double x = 1, y = 0, z = 0;
+    if (t > 0) { x = w[0] / t; y = w[1] / t; z = w[2] / t; }
+    const double c = std::cos(t), s = std::sin(t), d = 1 - c;
+    R[0] = c + d * x * x;       R[1] = d * x * y - s * z;   R[2] = d * x * z + s * y;
+    R[3] = d * x * y + s * z;   R[4] = c + d * y * y;       R[5] = d * y * z - s * x;
+    R[6] = d * x * z - s * y;   R[7] = d * y * z + s * x;   R[8] = c + d * z * z;
+}
+
+///
+/// Row-major rotation matrix to rotation vector, see CmPoint64f::matrixToOmega().
+///
+inline void matrixToOmega(const double R[9], double w[3])
+{
+    const double a[3] = { R[7] - R[5], R[2] - R[6], R[3] - R[1] };     // 2 sin(t) * axis
+    const double ct = std::fmax(-1.0, std::fmin(1.0, 0.5 * (R[0] + R[4] + R[8] - 1)));
+    const double t = std::acos(ct);
+    if (t < 1e-4) {
+        for (int i = 0; i < 3; i++) { w[i] = 0.5 * (1 + t * t / 6) * a[i]; }
+        return;
+    }
+    if (t < 3.1) {
+        const double k = t / (2 * std::sin(t));
+        for (int i = 0; i < 3; i++) { w[i] = k * a[i]; }
+        return;
+    }
+
+    /// Near pi - axis from the largest diagonal element, sign from the antisymmetric part.
+    int i = 0;
+    if (R[4] > R[0]) { i = 1; }
+    if (R[8] > R[4 * i]) { i = 2; }
+    const int j = (i + 1) % 3, k = (i + 2) % 3;
+    double v[3];
+    v[i] = std::sqrt(std::fmax(0.0, (R[4 * i] - ct) / (1 - ct)));
+    v[j] = (R[3 * j + i] + R[3 * i + j]) / (2 * v[i] * (1 - ct));
+    v[k] = (R[3 * k + i] + R[3 * i + k]) / (2 * v[i] * (1 - ct));
+    const double sgn = ((v[0] * a[0] + v[1] * a[1] + v[2] * a[2]) < 0) ? -1 : 1;
+    for (int n = 0; n < 3; n++) { w[n] = sgn * t * v[n]; }
+}
+
+///
+/// Advance lab frame orientation r_lab by dt ms at angular velocity w_lab (rad/ms).
+///
+inline void advance(const double r_lab[3], const double w_lab[3], double dt, double r_out[3])
+{
+    double dR[9], R[9], Rn[9];
+    const double dw[3] = { w_lab[0] * dt, w_lab[1] * dt, w_lab[2] * dt };
+    omegaToMatrix(dw, dR);
+    omegaToMatrix(r_lab, R);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            Rn[3 * i + j] = dR[3 * i] * R[j] + dR[3 * i + 1] * R[3 + j] + dR[3 * i + 2] * R[6 + j];     // pre-multiply, as for tracking
+        }
+    }
+    matrixToOmega(Rn, r_out);
+}
+
+///
+/// Advance heading by dt ms, and return the fictive position step (dx, dy) along the arc.
+///
+inline void advancePath(double heading, double heading_rate, double velx_rate, double vely_rate, double dt,
+    double& heading_out, double& dx, double& dy)
+{
+    /// World velocity is the animal frame velocity rotated by the (changing) heading.
+    const double h0 = heading, h1 = heading + heading_rate * dt;
+    double ix, iy, jx, jy;  // integral of R(h) over dt, as [ix jx; iy jy]
+    if (std::fabs(heading_rate * dt) > 1e-9) {
+        const double ds = (std::sin(h1) - std::sin(h0)) / heading_rate, dc = (std::cos(h1) - std::cos(h0)) / heading_rate;
+        ix = ds;    jx = dc;
+        iy = -dc;   jy = ds;
+    }
+    else {
+        ix = std::cos(h0) * dt;     jx = -std::sin(h0) * dt;
+        iy = std::sin(h0) * dt;     jy = std::cos(h0) * dt;
+    }
+    dx = ix * velx_rate + jx * vely_rate;
+    dy = iy * velx_rate + jy * vely_rate;
+
+    const double two_pi = 2 * 3.14159265358979323846;
+    heading_out = std::fmod(h1, two_pi);
+    if (heading_out < 0) { heading_out += two_pi; }
+}
+
+///
+/// Copy of rec advanced to ts (clamped to +/- max_dt ms from rec.ts). Returns false
+/// (out = rec) if rec carries no motion rates (written by an older version).
+///
+inline bool extrapolate(const BinaryRecord& rec, double ts, BinaryRecord& out, double max_dt = MAX_DT_MS_DEFAULT)
+{
+    out = rec;
+    if ((rec.version < 2) || (rec.size < sizeof(BinaryRecord))) { return false; }
+
+    double dt = ts - rec.ts;
+    if (dt > max_dt) { dt = max_dt; }
+    if (dt < -max_dt) { dt = -max_dt; }
+
+    advance(rec.r_lab, rec.w_lab, dt, out.r_lab);
+    double dx = 0, dy = 0;
+    advancePath(rec.heading, rec.heading_rate, rec.velx_rate, rec.vely_rate, dt, out.heading, dx, dy);
+    out.posx += dx;
+    out.posy += dy;
+    out.intx += rec.velx_rate * dt;
+    out.inty += rec.vely_rate * dt;
+    out.ts = rec.ts + dt;
+    out.ms = rec.ms + dt;
+    return true;
+}
+
+} // namespace extrap
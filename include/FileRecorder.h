@@ -13,14 +13,16 @@
 class FileRecorder : public RecorderInterface
 {
 public:
-    FileRecorder();
+    FileRecorder(bool binary = false);
     ~FileRecorder();
 
     /// Interface to be overridden by implementations.
     bool openRecord(std::string fn = "");
-    bool writeRecord(std::string s);
+    bool writeRecord(const std::string& s);
+    bool writeRecords(const char* a, size_t na, const char* b, size_t nb);
     void closeRecord();
 
 private:
     std::ofstream _file;
+    bool _binary;
 };
@@ -0,0 +1,104 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       FrameDump.h
+/// \brief      Lossless raw frame dump (memory-mapped sequential file of Mono8 frames).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+///
+/// Layout of a frame dump file.
+///
+/// A page-sized file header is followed by fixed-size frame records, so frame
+/// i starts at data_offset + i * rec_size (random access without an index).
+/// Each record is a FrameHeader followed by width * height Mono8 pixels
+/// (stride == width), padded to REC_ALIGN bytes. FrameHeader::seq is i + 1
+/// once record i is complete (0 in preallocated, unwritten space), and the
+/// file header nframes is updated periodically and on close, so a reader of an
+/// unfinished recording can still recover every complete frame.
+///
+namespace framedump {
+
+static const uint32_t MAGIC = 0x44525446;      // "FTRD"
+static const uint16_t VERSION = 1;
+static const uint64_t DATA_OFFSET = 4096;
+static const uint64_t REC_ALIGN = 64;
+
+struct Header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t hdr_size;          // sizeof(Header)
+    uint32_t width, height;     // Mono8, stride == width
+    uint64_t data_offset;       // first frame record
+    uint64_t rec_size;          // bytes per frame record
+    uint64_t nframes;           // complete frame records
+    double fps;
+};
+
+struct FrameHeader {
+    uint64_t seq;               // frame index + 1 (0 = not written)
+    double timestamp;           // source timestamp (ms)
+    double ms_since_midnight;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(Header) <= DATA_OFFSET, "frame dump header too large");
+
+inline uint64_t recordSize(uint32_t width, uint32_t height)
+{
+    uint64_t sz = sizeof(FrameHeader) + static_cast<uint64_t>(width) * height;
+    return ((sz + REC_ALIGN - 1) / REC_ALIGN) * REC_ALIGN;
+}
+
+} // namespace framedump
+
+///
+/// Appends frames to a frame dump through a sliding memory-mapped window, so
+/// writing a frame is a single copy into the page cache (no encode).
+///
+class FrameDumpWriter
+{
+public:
+    FrameDumpWriter();
+    ~FrameDumpWriter();
+
+    bool open(const std::string& fn, int width, int height, double fps);
+    bool isOpened() const { return _open; }
+
+    /// Append one frame (must be width x height, CV_8UC1).
+    bool write(const cv::Mat& frame, double timestamp, double ms_since_midnight);
+
+    /// Flush header and trim preallocated space.
+    void close();
+
+    uint64_t getFrameCount() const { return _hdr.nframes; }
+
+private:
+    bool mapWindow(uint64_t off);
+    void unmapWindow();
+    bool writeHeader();
+
+private:
+    bool _open;
+    framedump::Header _hdr;
+    uint64_t _gran;                 // mapping offset granularity
+    uint64_t _win_len;              // window size
+    uint64_t _win_off;              // file offset of current window
+    uint8_t* _win;                  // nullptr if not mapped
+    uint64_t _file_len;             // current (preallocated) file size
+
+#ifdef _WIN32
+    HANDLE _file, _mapping;
+#else
+    int _fd;
+#endif
+};
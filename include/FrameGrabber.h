@@ -9,15 +9,17 @@
 #include "CameraModel.h"
 #include "CameraRemap.h"
 #include "FrameSource.h"
+#include "ExposureControl.h"
+#include "SPSCRing.h"
 
 #include <opencv2/opencv.hpp>
 
 #include <memory>	// shared_ptr, unique_ptr
 #include <thread>
-#include <mutex>
-#include <condition_variable>
 #include <atomic>
-#include <deque>
+#include <mutex>
+#include <vector>
+#include <cstdint>
 
 ///
 /// 
@@ -32,7 +34,13 @@ public:
                     double                          thresh_win_pc,
                     std::string                     thresh_rgb_transform = "grey",
                     int                             max_buf_len = 1,
-                    int                             max_frame_cnt = -1
+                    int                             max_frame_cnt = -1,
+                    bool                            keep_src_frames = true,
+                    int                             spin_wait_us = 0,
+                    bool                            fused_prep = true,
+                    bool                            use_gpu = false,
+                    int                             held_src_frames = 0,
+                    std::shared_ptr<ExposureControl> exposure = nullptr    // fed with ROI statistics (optional)
     );
     ~FrameGrabber();
 
@@ -46,10 +54,39 @@ public:
         return getFrameSet(frame, remap, timestamp, ms_since_midnight, false);
     }
 
+    /// Number of processed frames waiting in the output queue.
+    size_t getQueueDepth() const { return _frame_q ? _frame_q->size() : 0; }
+
+    /// Number of frames dropped so far (skipped by getLatestFrameSet or lost to a full queue).
+    uint64_t getDropped() const { return _ndropped.load(std::memory_order_relaxed); }
+
+    const std::shared_ptr<FrameSource>& getSource() const { return _source; }
+
+    ///
+    /// Change the thresholding parameters (see constructor). Applied by the
+    /// grabber thread before the next frame is preprocessed.
+    ///
+    void setThreshold(double thresh_ratio, double thresh_win_pc);
+
 private:
     /// Worker function.
     void process();
 
+    /// Fused colour conversion and remap (only samples the source pixels used by the ROI).
+    void initFusedRemap();
+    void fusedRemap(const cv::Mat& src, cv::Mat& dst);
+    void fusedRemapBayer(const cv::Mat& src, cv::Mat& dst, BAYER_TYPE bayer);
+
+#if defined(FICTRAC_OPENCL)
+    /// Colour conversion, remap and adaptive thresholding on the OpenCL device.
+    void initOcl();
+    void oclRemap(const cv::Mat& src, BAYER_TYPE bayer);
+    void oclThreshold(cv::Mat& dst);
+#endif
+
+    /// Get a recycled (or new) buffer from pool.
+    cv::Mat acquire(std::vector<cv::Mat>& pool, size_t max_len, int rows, int cols, int type);
+
     std::shared_ptr<FrameSource> _source;
     CameraRemapPtr _remapper;
 
@@ -59,6 +96,12 @@ private:
 
     double _thresh_ratio;
     int _thresh_win, _thresh_rad;
+    void applyThreshold();
+
+    /// Pending setThreshold() (applied at the next frame boundary).
+    std::mutex _thresh_mutex;
+    std::atomic_bool _thresh_pending;
+    double _thresh_ratio_new, _thresh_win_pc_new;
     enum {
         GREY,
         RED,
@@ -67,14 +110,44 @@ private:
     } _thresh_rgb_transform;
 
     int _max_buf_len, _max_frame_cnt;
+    bool _keep_src_frames;
+
+    /// Auto exposure (ROI statistics of the unthresholded remap).
+    std::shared_ptr<ExposureControl> _exposure;
+    void updateExposure(const cv::Mat& remap);
+
+    /// Fixed-point bilinear sampling (as cv::remap) of each ROI pixel.
+    struct FusedPix {
+        int x, y;           // top-left source pixel (x < 0 if invalid)
+        uint8_t dx, dy;     // 1 if right/lower neighbour is within source image
+        uint16_t w[4];      // weights (sum to 1 << 15)
+    };
+    bool _fused_prep;
+    std::vector<FusedPix> _fused_lut;
+
+    /// OpenCL preprocessing (grabber thread only).
+    bool _use_ocl;
+#if defined(FICTRAC_OPENCL)
+    cv::UMat _u_src, _u_bgr, _u_grey, _u_remap, _u_blur;
+    cv::UMat _u_mask, _u_unmasked, _u_valid_max;
+    cv::UMat _u_min, _u_max, _u_win_min, _u_win_max;
+    cv::UMat _u_v, _u_a, _u_b, _u_thr;
+    cv::Mat _win_kernel;
+#endif
+
+    /// Buffer pools (grabber thread only).
+    std::vector<cv::Mat> _frame_pool, _remap_pool;
+    size_t _max_pool_len, _max_frame_pool_len;
 
     /// Thread stuff.
     std::atomic_bool _active;
     std::unique_ptr<std::thread> _thread;
-    std::mutex _qMutex;
-    std::condition_variable _qCond;
+    std::atomic<uint64_t> _ndropped;
 
-    /// Output queues.
-    std::deque<cv::Mat> _frame_q, _remap_q;
-    std::deque<double> _ts_q, _ms_q;
+    /// Output queue.
+    struct FrameSet {
+        cv::Mat frame, remap;
+        double timestamp, ms_since_midnight;
+    };
+    std::unique_ptr<SPSCRing<FrameSet>> _frame_q;
 };
@@ -6,13 +6,38 @@
 
 #pragma once
 
+#include "ClockSync.h"
+
 #include <opencv2/opencv.hpp>
 
+#include <algorithm>    // min, max
+#include <atomic>
+#include <cstdint>
+#include <cmath>        // fabs
+
+/// Sensor colour filter tile, named by its top-left 2x2 pixels (row major).
 enum BAYER_TYPE { BAYER_NONE, BAYER_RGGB, BAYER_GRBG, BAYER_GBRG, BAYER_BGGR };
 
+///
+/// cv::cvtColor code to demosaic a Bayer tile (-1 if BAYER_NONE). OpenCV names patterns by the
+/// second row's second and third pixels, i.e. sensor RGGB is COLOR_BayerBG2BGR.
+///
+inline int bayerCvtCode(BAYER_TYPE bayer_type, bool grey = false)
+{
+    switch (bayer_type) {
+    case BAYER_RGGB:    return grey ? cv::COLOR_BayerBG2GRAY : cv::COLOR_BayerBG2BGR;
+    case BAYER_GRBG:    return grey ? cv::COLOR_BayerGB2GRAY : cv::COLOR_BayerGB2BGR;
+    case BAYER_GBRG:    return grey ? cv::COLOR_BayerGR2GRAY : cv::COLOR_BayerGR2BGR;
+    case BAYER_BGGR:    return grey ? cv::COLOR_BayerRG2GRAY : cv::COLOR_BayerRG2BGR;
+    case BAYER_NONE:
+    default:            return -1;
+    }
+}
+
 class FrameSource {
 public:
-	FrameSource() : _open(false), _bayerType(BAYER_NONE), _width(-1), _height(-1), _timestamp(-1), _fps(-1), _live(true) {}
+	FrameSource() : _open(false), _bayerType(BAYER_NONE), _width(-1), _height(-1), _timestamp(-1), _fps(-1), _live(true),
+		_ndropped(0), _nincomplete(0), _frame_id(-1) {}
 	virtual ~FrameSource() {}
 
     virtual double getFPS() { return _fps; }
@@ -21,20 +46,112 @@ public:
         return false;   // we haven't actually done anything
     }
 	virtual bool rewind()=0;
+
+	///
+	/// Start (and rewind) playback at a given frame. Only supported by recorded sources.
+	///
+	virtual bool setStartFrame(int frame) { return frame == 0; }
+
+	/// Number of frames in a recorded source (-1 if unknown/live).
+	virtual int getFrameCount() { return -1; }
+
+	///
+	/// Ask the device to only stream a sub-window (x, y, w, h, in full resolution sensor
+	/// pixels) of the sensor, binned by bin x bin. On success the arguments are updated to
+	/// the window actually applied (which covers the requested window where possible) and
+	/// frames are (w / bin) x (h / bin). Only supported by some cameras.
+	///
+	virtual bool setAOI(int& x, int& y, int& w, int& h, int& bin) { return false; }
+
+	///
+	/// Manual exposure (us) and gain (dB) control, disabling any on-camera auto
+	/// exposure/gain. get returns the current value and limits, set updates the
+	/// argument to the value applied. Only supported by some cameras.
+	///
+	virtual bool getExposure(double& us, double& min_us, double& max_us) { return false; }
+	virtual bool setExposure(double& us) { return false; }
+	virtual bool getGain(double& db, double& min_db, double& max_db) { return false; }
+	virtual bool setGain(double& db) { return false; }
 	virtual bool grab(cv::Mat& frame)=0;
 
+	///
+	/// Zero-copy grab. Sources that can expose their (driver) buffers directly may
+	/// point frame at source-owned memory, which remains valid until releaseBuffer()
+	/// or the next grab. Otherwise the frame is grabbed into the supplied buffer.
+	///
+	virtual bool grabBuffer(cv::Mat& frame) { return grab(frame); }
+	virtual void releaseBuffer() {}
+
+	///
+	/// Unblock a grab that is waiting on the application or device (grab then returns
+	/// false). Called when the grabber is shut down.
+	///
+	virtual void interrupt() {}
+
 	bool isOpen() { return _open; }
 	int getWidth() { return _width; }
 	int getHeight() { return _height; }
 	double getTimestamp() { return _timestamp; }
     double getMsSinceMidnight() { return _ms_since_midnight; }
 	void setBayerType(BAYER_TYPE bayer_type) { _bayerType = bayer_type; }
+
+	/// Colour filter tile of 1 channel frames returned by grab (BAYER_NONE if frames are greyscale).
+	virtual BAYER_TYPE getBayerType() { return _bayerType; }
     bool isLive() { return _live; }
 
+	/// Frames lost before delivery (device/driver buffer overruns) and frames received incomplete.
+	uint64_t getDropped() const { return _ndropped.load(std::memory_order_relaxed); }
+	uint64_t getIncomplete() const { return _nincomplete.load(std::memory_order_relaxed); }
+
 protected:
+	///
+	/// Grow window [x, x + w) to offset/size increments, clipped to [0, max).
+	///
+	static void alignAOI(int& x, int& w, int off_inc, int size_inc, int max)
+	{
+		off_inc = std::max(1, off_inc);
+		size_inc = std::max(1, size_inc);
+		int x1 = std::min(max, x + w);
+		x = std::max(0, x - (x % off_inc));
+		w = x1 - x;
+		w = std::min(((w + size_inc - 1) / size_inc) * size_inc, max - (max % size_inc));
+		if ((x + w) > max) { x = std::max(0, (max - w) - ((max - w) % off_inc)); }
+	}
+
+	///
+	/// Timestamp frame from the device clock (dev_ms <= 0 if unavailable), mapped onto the
+	/// host clock. host_ms/host_msm are ts_ms()/ms_since_midnight() when the frame arrived.
+	///
+	void setDeviceTimestamp(double dev_ms, double host_ms, double host_msm)
+	{
+		double ts = host_ms;
+		if (dev_ms > 0) {
+			_clock.addFrame(dev_ms, host_ms);
+			double t = _clock.toHost(dev_ms);
+			if (_clock.valid() && (fabs(t - host_ms) < DEVICE_TS_MAX_ERR)) { ts = t; }
+		}
+		_timestamp = ts;
+		_ms_since_midnight = host_msm - (host_ms - ts);
+	}
+
+	/// Count gaps in the device frame counter.
+	void countFrameId(uint64_t id)
+	{
+		if ((_frame_id >= 0) && (id > static_cast<uint64_t>(_frame_id) + 1)) {
+			_ndropped.fetch_add(id - static_cast<uint64_t>(_frame_id) - 1, std::memory_order_relaxed);
+		}
+		_frame_id = static_cast<int64_t>(id);
+	}
+
+	static constexpr double DEVICE_TS_MAX_ERR = 1000;   // ms, fall back to host time beyond this
+
 	bool _open;
 	BAYER_TYPE _bayerType;
 	int _width, _height;
 	double _timestamp, _fps, _ms_since_midnight;
     bool _live;
+
+	ClockSync _clock;
+	std::atomic<uint64_t> _ndropped, _nincomplete;
+	int64_t _frame_id;
 };
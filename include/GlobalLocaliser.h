@@ -0,0 +1,57 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       GlobalLocaliser.h
+/// \brief      Parallel global localisation of current sphere ROI within surface map.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "Localiser.h"
+#include "SphereKernel.h"
+#include "ThreadPool.h"
+#include "OclScorer.h"
+#include "typesvars.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <memory>   // shared_ptr, unique_ptr
+#include <vector>
+
+///
+/// Relocalises the sphere when tracking is lost. Candidate absolute
+/// orientations on a coarse (angle-axis) grid covering all rotations are
+/// scored in parallel, then the best few candidates are refined in parallel
+/// using a bounded local search.
+///
+class GlobalLocaliser
+{
+public:
+    GlobalLocaliser(double grid_step, double tol, int max_evals,
+        CameraModelPtr sphere_model, const cv::Mat& sphere_map,
+        std::shared_ptr<std::vector<RoiPixel>> roi_pix, int nthreads = 0,
+        std::shared_ptr<ThreadPool> pool = nullptr,     // share an existing pool (ignores nthreads)
+        const TiledMap* sphere_tiles = nullptr,         // tiled mirror of sphere_map (optional)
+        bool use_gpu = false);                          // score grid on OpenCL device (FICTRAC_OPENCL builds)
+    ~GlobalLocaliser() {};
+
+    /// Returns best error and updates absolute orientation R_roi/r_roi.
+    double search(cv::Mat& roi_frame, CmMat33d& R_roi, CmPoint64f& r_roi);
+
+    unsigned getNumEval() const { return _nevals; }
+
+    /// Change the refinement tolerance and max evaluations (between searches).
+    void setLimits(double tol, int max_evals);
+
+private:
+    std::shared_ptr<ThreadPool> _pool;
+    std::unique_ptr<SphereKernel> _kernel;
+    std::vector<std::unique_ptr<Localiser>> _refine;
+    std::vector<CmPoint64f> _grid;
+    std::vector<double> _grid_err;
+    const cv::Mat _sphere_map;
+    const TiledMap* _tiles;
+    unsigned _nevals;
+#if defined(FICTRAC_OPENCL)
+    std::unique_ptr<OclScorer> _gpu;    // grid rotations resident on device
+#endif
+};
@@ -0,0 +1,57 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       LatencyHist.h
+/// \brief      Fixed-precision (log-linear) histogram for latency percentiles.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+///
+/// HDR-style histogram of non-negative values. Values are quantised to
+/// multiples of res and binned into SUB linear sub-buckets per power of two,
+/// so percentiles are accurate to within 1/SUB (~3%) of the value over the
+/// full 64 bit range. Memory use is fixed and record() never allocates.
+///
+/// Any number of threads may record concurrently; summarise() may be called
+/// from any other thread (with reset, counts are moved out atomically so no
+/// samples are lost between intervals).
+///
+class LatencyHist
+{
+public:
+    static const int SUB_BITS = 5;
+    static const int SUB = 1 << SUB_BITS;
+    static const int NBUCKETS = (64 - SUB_BITS + 1) * SUB;
+
+    struct Summary {
+        uint64_t count;
+        double mean, p50, p99, p999, max;
+    };
+
+    /// res is the value of one histogram unit (e.g. 1e-3 to record ms at us precision).
+    explicit LatencyHist(double res = 1e-3);
+    ~LatencyHist() {}
+
+    LatencyHist(LatencyHist const&) = delete;
+    void operator=(LatencyHist const&) = delete;
+
+    void record(double v);
+    void reset();
+
+    uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+
+    /// Count, mean, p50/p99/p99.9 and max (in units of recorded values).
+    Summary summarise(bool reset = false);
+
+private:
+    static int bucket(uint64_t u);
+    static uint64_t bucketMax(int b);
+
+private:
+    double _res;
+    std::atomic<uint64_t> _counts[NBUCKETS];
+    std::atomic<uint64_t> _count, _sum, _max;
+};
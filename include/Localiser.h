@@ -8,11 +8,13 @@
 
 #include "NLoptFunc.h"
 #include "CameraModel.h"
+#include "SphereKernel.h"
+#include "TiledMap.h"
 #include "typesvars.h"
 
 #include <opencv2/opencv.hpp>
 
-#include <memory>   // shared_ptr
+#include <memory>   // shared_ptr, unique_ptr
 #include <vector>
 
 ///
@@ -20,24 +22,99 @@
 ///
 class Localiser : public NLoptFunc
 {
+    friend class TrackballBench;    // exec/fictrac_bench.cpp
+
 public:
+    /// roi_w/roi_h give the ROI pixel layout for the pyramid (roi_h is the height of each
+    /// camera's ROI when several are stacked (cam_aux), 0 for a single ROI).
     Localiser(nlopt_algorithm alg, double bound, double tol, int max_evals,
         CameraModelPtr sphere_model, const cv::Mat& sphere_map,
-        const cv::Mat& roi_mask, std::shared_ptr<std::vector<double>> p1s_lut);
+        std::shared_ptr<std::vector<RoiPixel>> roi_pix, int roi_w = 0, int roi_h = 0, int pyr_levels = 0,
+        const TiledMap* sphere_tiles = nullptr);    // tiled mirror of sphere_map (optional)
     ~Localiser() {};
 
-    double search(cv::Mat& roi_frame, cv::Mat& R_roi, CmPoint64f& vx);
+    double search(cv::Mat& roi_frame, const CmMat33d& R_roi, CmPoint64f& vx);
+
+    /// Search within per-axis bound (|x - vx| <= bound) rather than the constructor bound.
+    double search(cv::Mat& roi_frame, const CmMat33d& R_roi, CmPoint64f& vx, const CmPoint64f& bound);
+
+    double getBound() const { return _bound; }
+
+    /// Change the default search bound, tolerance and max evaluations (between searches).
+    void setLimits(double bound, double tol, int max_evals);
+
+    ///
+    /// Stop scoring candidates early once their subsample error exceeds the best
+    /// score so far (this search level) by margin (fraction, <= 0 to disable).
+    /// See SphereKernel::testRotationBounded().
+    ///
+    void setEarlyExit(double margin) { _early_margin = margin; }
+
+    ///
+    /// Split scoring of each candidate rotation over team (nullptr to disable),
+    /// for search levels with at least min_pix ROI pixels. See SphereKernel::setTeam().
+    ///
+    void setTeam(ThreadTeam* team, int min_pix);
+
+    ///
+    /// Stop searches at deadline_ms (absolute, see ts_ms(), <= 0 to disable) and
+    /// return the best result so far. The coarse-to-fine search skips any finer
+    /// levels left at the deadline.
+    ///
+    void setDeadline(double deadline_ms) { _deadline = deadline_ms; }
+
+    /// Whether the last search was cut short by the deadline.
+    bool hitDeadline() const { return _hit_deadline; }
+
+    ///
+    /// Score n rotations x (3 values each, relative to absolute orientation R_roi,
+    /// as searched) against the full resolution map in a single sweep over the ROI.
+    ///
+    void testRotations(const cv::Mat& roi_frame, const CmMat33d& R_roi, const double* x, int n, double* err);
 
 private:
     double testRotation(const double x[3]);
-    virtual double objective(unsigned n, const double* x, double* grad) { return testRotation(x); }
+    void testRotations(const double* x, int n, double* err);    // current search level
+    void updatePyramid(const cv::Mat& roi_frame);
+    double testRotationGrad(const double x[3], double grad[3]);
+    virtual double objective(unsigned n, const double* x, double* grad) { return grad ? testRotationGrad(x, grad) : testRotation(x); }
 
 private:
     double _bound;
     const double* _R_roi;
     CameraModelPtr _sphere_model;
-    const cv::Mat _sphere_map, _roi_mask;
-    std::shared_ptr<std::vector<double>> _p1s_lut;
+    const cv::Mat _sphere_map;
+    const TiledMap* _tiles;
+    std::shared_ptr<std::vector<RoiPixel>> _roi_pix;
     cv::Mat _roi_frame;
-    int _roi_w, _roi_h;
+    std::unique_ptr<SphereKernel> _kernel;
+
+    /// Coarse-to-fine search.
+    struct PyrLevel {
+        int scl;                                // ROI downsampling factor
+        std::vector<int> members;               // fine ROI pixel indices (scl*scl per coarse pixel)
+        std::unique_ptr<SphereKernel> kernel;
+        cv::Mat roi_frame, sphere_map;          // roi_frame is 1 x num coarse pixels
+        std::vector<int> map_sum, map_cnt;
+    };
+    std::vector<PyrLevel> _pyr;                 // finest first
+    double _tol;
+    int _max_evals;
+
+    /// Early exit scoring.
+    double _early_margin;
+    double _best;                               // best full score at current level
+    long long _npix, _npix_full;                // ROI pixels scored / needed for full scores (last search)
+
+    /// Current search level.
+    const SphereKernel* _cur_kernel;
+    cv::Mat _cur_roi, _cur_map;
+    const TiledMap* _cur_tiles;                 // scored instead of _cur_map if set
+
+    /// Per-frame time budget.
+    double _deadline;
+    bool _hit_deadline;
+
+    /// Gradient based algorithm (interpolated objective, see SphereKernel::testRotationGrad).
+    bool _grad;
 };
@@ -12,13 +12,113 @@
 #include <memory>   // unique_ptr
 #include <string>
 #include <fstream>  // ofstream
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <tuple>
+#include <utility>  // index_sequence
+#include <type_traits>
+#include <cstdint>
+#include <cstring>  // memcpy, strlen
+#include <cstdio>   // snprintf
 
-#define LOG(fmt, ...) Logger::mprintf(Logger::INF, __FUNCTION__, fmt, ##__VA_ARGS__)    // ## required for gcc?
-#define LOG_DBG(fmt, ...) Logger::mprintf(Logger::DBG, __FUNCTION__, fmt, ##__VA_ARGS__)
-#define LOG_WRN(fmt, ...) Logger::mprintf(Logger::WRN, __FUNCTION__, fmt, ##__VA_ARGS__)
-#define LOG_ERR(fmt, ...) Logger::mprintf(Logger::ERR, __FUNCTION__, fmt, ##__VA_ARGS__)
-#define PRINT(fmt, ...) Logger::mprintf(Logger::PRT, __FUNCTION__, fmt, ##__VA_ARGS__)
+///
+/// Log calls below FICTRAC_LOG_MIN_LEVEL (0 = DBG, 1 = INF, 2 = WRN) are
+/// compiled out entirely (arguments are not evaluated). ERR and PRINT are
+/// always kept.
+///
+#ifndef FICTRAC_LOG_MIN_LEVEL
+#define FICTRAC_LOG_MIN_LEVEL 0
+#endif
 
+#if FICTRAC_LOG_MIN_LEVEL > 1
+#define LOG(fmt, ...) ((void)0)
+#else
+#define LOG(fmt, ...) Logger::log(Logger::INF, __FUNCTION__, fmt, ##__VA_ARGS__)    // ## required for gcc?
+#endif
+#if FICTRAC_LOG_MIN_LEVEL > 0
+#define LOG_DBG(fmt, ...) ((void)0)
+#else
+#define LOG_DBG(fmt, ...) Logger::log(Logger::DBG, __FUNCTION__, fmt, ##__VA_ARGS__)
+#endif
+#if FICTRAC_LOG_MIN_LEVEL > 2
+#define LOG_WRN(fmt, ...) ((void)0)
+#else
+#define LOG_WRN(fmt, ...) Logger::log(Logger::WRN, __FUNCTION__, fmt, ##__VA_ARGS__)
+#endif
+#define LOG_ERR(fmt, ...) Logger::log(Logger::ERR, __FUNCTION__, fmt, ##__VA_ARGS__)
+#define PRINT(fmt, ...) Logger::log(Logger::PRT, __FUNCTION__, fmt, ##__VA_ARGS__)
+
+
+namespace logdetail {
+
+/// Capture/replay of a single log argument (plain values are copied bitwise).
+template <typename T>
+struct Arg {
+    static_assert(std::is_trivially_copyable<T>::value, "Log arguments must be plain values or C strings!");
+    static size_t size(const T&) { return sizeof(T); }
+    static void put(uint8_t*& p, const T& v) { memcpy(p, &v, sizeof(T)); p += sizeof(T); }
+    static T get(const uint8_t*& p) { T v; memcpy(&v, p, sizeof(T)); p += sizeof(T); return v; }
+};
+
+/// C strings are copied, as they may not outlive the call.
+template <>
+struct Arg<const char*> {
+    static size_t size(const char* s) { return sizeof(uint32_t) + (s ? strlen(s) : 0) + 1; }
+    static void put(uint8_t*& p, const char* s) {
+        uint32_t n = s ? static_cast<uint32_t>(strlen(s)) : 0;
+        memcpy(p, &n, sizeof(n));
+        p += sizeof(n);
+        if (n > 0) { memcpy(p, s, n); }
+        p[n] = '\0';
+        p += n + 1;
+    }
+    static const char* get(const uint8_t*& p) {
+        uint32_t n = 0;
+        memcpy(&n, p, sizeof(n));
+        const char* s = reinterpret_cast<const char*>(p + sizeof(n));
+        p += sizeof(n) + n + 1;
+        return s;
+    }
+};
+template <> struct Arg<char*> : Arg<const char*> {};
+
+inline size_t argsSize() { return 0; }
+template <typename T, typename... Rest>
+size_t argsSize(const T& v, const Rest&... rest) { return Arg<T>::size(v) + argsSize(rest...); }
+
+inline void putArgs(uint8_t*&) {}
+template <typename T, typename... Rest>
+void putArgs(uint8_t*& p, const T& v, const Rest&... rest) { Arg<T>::put(p, v); putArgs(p, rest...); }
+
+template <typename Tuple, size_t... I>
+int applyFormat(char* out, size_t n, const char* fmt, const Tuple& t, std::index_sequence<I...>) {
+    return snprintf(out, n, fmt, std::get<I>(t)...);
+}
+
+/// Replay captured arguments through snprintf (runs on the log writer thread).
+template <typename... Args>
+int formatArgs(char* out, size_t n, const char* fmt, const uint8_t* p) {
+    std::tuple<decltype(Arg<Args>::get(p))...> t{ Arg<Args>::get(p)... };  // braced init is sequenced left to right
+    (void)p;
+    return applyFormat(out, n, fmt, t, std::index_sequence_for<Args...>{});
+}
+
+typedef int (*FormatFn)(char* out, size_t n, const char* fmt, const uint8_t* args);
+
+/// Deferred log msg, followed by its captured arguments.
+struct Record {
+    uint32_t size;                  // incl. args (0 marks a skip to the start of the buffer)
+    int lvl;
+    std::chrono::high_resolution_clock::time_point t;
+    const char* func;               // static strings only (__FUNCTION__ / format literals)
+    const char* fmt;
+    FormatFn format;
+};
+
+} // namespace logdetail
 
 
 class Logger
@@ -38,6 +138,12 @@ public:
         return v;
     };
 
+    /// Get/set log file verbosity (defaults to logging everything)
+    static LogLevel& fileVerbosity() {
+        static LogLevel v = DBG;
+        return v;
+    };
+
     /// Verbosity helper functions
     static void setVerbosity(LogLevel v) {
         verbosity() = v;
@@ -45,16 +151,76 @@ public:
 
     static void setVerbosity(std::string v);
 
-    /// Thread-safe printf wrapper
+    /// Would a msg at this level be printed or logged?
+    static bool enabled(LogLevel lvl) {
+        return (lvl == PRT) || (lvl >= verbosity()) || (lvl >= fileVerbosity());
+    }
+
+    /// Thread-safe printf wrapper (formats immediately).
     static void mprintf(LogLevel lvl, std::string func, std::string format, ...);
 
+    ///
+    /// Deferred printf: arguments are captured into a per-thread lock-free
+    /// buffer and formatted/written by the logger thread. Format strings must
+    /// be literals; string arguments must be C strings (they are copied).
+    ///
+    template <typename... Args>
+    static void log(LogLevel lvl, const char* func, const char* format, Args... args)
+    {
+        if (!enabled(lvl)) { return; }
+
+        size_t len = sizeof(logdetail::Record) + logdetail::argsSize(args...);
+        uint8_t* p = reserve(len);
+        if (!p) {
+            mprintf(lvl, func, format, args...);    // buffer full - fall back to blocking write
+            return;
+        }
+
+        logdetail::Record* r = reinterpret_cast<logdetail::Record*>(p);
+        r->size = static_cast<uint32_t>(len);
+        r->lvl = lvl;
+        r->t = std::chrono::high_resolution_clock::now();
+        r->func = func;
+        r->fmt = format;
+        r->format = &logdetail::formatArgs<Args...>;
+        p += sizeof(logdetail::Record);
+        logdetail::putArgs(p, args...);
+
+        commit(lvl >= WRN);     // routine msgs wait for the writer's next poll
+    }
+
 private:
     /// Hidden constructor to prevent direct instantiation
     Logger();
     ~Logger();
 
+    static Logger& instance();
+
+    /// Per-thread single producer/single consumer byte buffer.
+    struct ThreadBuffer {
+        std::vector<uint8_t> buf;
+        std::atomic<uint64_t> head, tail;   // bytes written/consumed
+        std::atomic_bool in_use;
+        uint64_t reserved;                  // producer only
+    };
+
+    static uint8_t* reserve(size_t len);
+    static void commit(bool wake);
+    ThreadBuffer* threadBuffer();
+
+    void process();
+    size_t drain();
+    void emit(LogLevel lvl, double t, const char* func, const char* msg, int len);
+
 private:
     std::unique_ptr<Recorder> _log;
     std::unique_ptr<Recorder> _cout;
     std::mutex _pMutex;
+
+    /// Deferred logging.
+    std::vector<std::unique_ptr<ThreadBuffer>> _buffers;
+    std::mutex _bufMutex;
+    std::condition_variable _wakeCond;
+    std::atomic_bool _sleeping, _kill;
+    std::unique_ptr<std::thread> _thread;
 };
@@ -0,0 +1,86 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       MotionModel.h
+/// \brief      Per-frame rotation predictors for seeding the local optimiser.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "CmPoint.h"
+
+#include <string>
+#include <memory>   // unique_ptr
+
+///
+/// Predicts the next relative sphere rotation (dr_roi) from previous results.
+/// The prediction seeds the local optimiser, and the per-axis bound sets the
+/// search box (guess +/- bound) and initial step size for the frame.
+///
+class MotionModel
+{
+public:
+    /// type is one of "lowpass", "constvel", "kalman" (nullptr if unknown).
+    /// max_bound is the full search range (opt_bound), tol the optimiser tolerance (opt_tol).
+    static std::unique_ptr<MotionModel> create(const std::string& type, double max_bound, double tol);
+
+    virtual ~MotionModel() {}
+
+    virtual void reset() = 0;
+
+    /// Predicted rotation and per-axis search bound for the next frame.
+    virtual void predict(CmPoint64f& dr, CmPoint64f& bound) = 0;
+
+    /// Feed back the optimised rotation (good = false for dropped frames).
+    virtual void update(const CmPoint64f& dr, bool good) = 0;
+
+    /// Change opt_bound/opt_tol (filter state is kept).
+    void setLimits(double max_bound, double tol) { _max_bound = max_bound; _tol = tol; }
+
+protected:
+    MotionModel(double max_bound, double tol) : _max_bound(max_bound), _tol(tol) {}
+
+    double _max_bound, _tol;
+};
+
+///
+/// Fixed low-pass filter of previous rotations, full search bound (original behaviour).
+///
+class LowPassModel : public MotionModel
+{
+public:
+    LowPassModel(double max_bound, double tol);
+
+    void reset();
+    void predict(CmPoint64f& dr, CmPoint64f& bound);
+    void update(const CmPoint64f& dr, bool good);
+
+private:
+    CmPoint64f _guess;
+};
+
+///
+/// Constant (per-frame) velocity and acceleration, tracked per axis by a
+/// Kalman filter on [v, a] (v only for constant velocity). The search box is
+/// scaled to the predicted/observed innovation and clipped to [min, opt_bound].
+///
+class KalmanModel : public MotionModel
+{
+public:
+    KalmanModel(double max_bound, double tol, bool use_accel);
+
+    void reset();
+    void predict(CmPoint64f& dr, CmPoint64f& bound);
+    void update(const CmPoint64f& dr, bool good);
+
+private:
+    struct Axis {
+        double v, a;            // state
+        double P[2][2];         // state covariance
+        double e2;              // smoothed squared innovation
+    };
+
+    bool _use_accel;
+    bool _init;
+    int _ngood;
+    Axis _ax[3];
+};
@@ -69,6 +69,7 @@ public:
 	void setXtol(double tol);   // absolute
     void setXtolRel(double tol);
 	void setMaxEval(unsigned n);
+	void setMaxTime(double secs);   // <= 0 for no limit
 
 	void getLowerBounds(double *lb);
 	void getUpperBounds(double *ub);
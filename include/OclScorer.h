@@ -0,0 +1,54 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       OclScorer.h
+/// \brief      OpenCL (cv::ocl) batched rotation scoring against the sphere surface map.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#if defined(FICTRAC_OPENCL)
+
+#include "typesvars.h"
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/ocl.hpp>
+
+#include <vector>
+
+///
+/// Device counterpart of SphereKernel for scoring many candidate orientations
+/// at once (one work-group per candidate). The ROI view vectors, candidate
+/// rotations and sphere map are kept resident on the device; only the ROI frame
+/// is uploaded per call, and the map when setMap() is called.
+///
+/// Uses the same projection and atan2 approximation as SphereKernel, so scores
+/// match the CPU path.
+///
+class OclScorer
+{
+public:
+    OclScorer(const std::vector<RoiPixel>& roi_pix, int map_w, int map_h);
+    ~OclScorer() {}
+
+    /// Kernel compiled and buffers allocated.
+    bool isOpen() const { return _open; }
+
+    /// Absolute orientations to score (row major 3x3, 9 values per candidate).
+    void setRotations(const std::vector<double>& m);
+    int numRotations() const { return _nrot; }
+
+    /// Upload sphere map (row major, continuous).
+    void setMap(const cv::Mat& sphere_map);
+
+    /// Avg squared diff error per candidate, or DBL_MAX if < 25% of valid pixels overlap seen map pixels.
+    bool score(const cv::Mat& roi_frame, std::vector<double>& err);
+
+private:
+    bool _open;
+    int _n, _nrot, _map_w, _map_h;
+    float _lon_scl, _lat_scl;
+    cv::ocl::Kernel _kernel;
+    cv::UMat _x, _y, _z, _idx, _rot, _map, _roi, _out;
+};
+
+#endif // FICTRAC_OPENCL
@@ -21,22 +21,40 @@
 
 class PGRSource : public FrameSource {
 public:
-	PGRSource(int index=0);
+	///
+	/// native delivers Mono8/Bayer 8 bit frames as captured (1 channel, see getBayerType)
+	/// rather than converting every frame to BGR. Other pixel formats are still converted.
+	/// nbufs sets the number of driver buffers in flight (0 for SDK default).
+	///
+	PGRSource(int index=0, bool native=false, int nbufs=0);
 	virtual ~PGRSource();
 
     virtual double getFPS();
 	virtual bool setFPS(double fps);
     virtual bool rewind() { return false; };
+	virtual bool setAOI(int& x, int& y, int& w, int& h, int& bin);
+	virtual bool getExposure(double& us, double& min_us, double& max_us);
+	virtual bool setExposure(double& us);
+	virtual bool getGain(double& db, double& min_db, double& max_db);
+	virtual bool setGain(double& db);
 	virtual bool grab(cv::Mat& frame);
+	virtual bool grabBuffer(cv::Mat& frame);
+	virtual void releaseBuffer();
 
 private:
 #if defined(PGR_USB3)
     Spinnaker::SystemPtr _system;
     Spinnaker::CameraList _camList;
     Spinnaker::CameraPtr _cam;
+    Spinnaker::ImagePtr _bgr_image;     // converted image wrapped by grabBuffer()
+    Spinnaker::ImagePtr _raw_image;     // native image wrapped by grabBuffer()
+
+    void syncClock();
 #elif defined(PGR_USB2)
     std::shared_ptr<FlyCapture2::Camera> _cam;
+    FlyCapture2::Image _bgr_image, _raw_image;
 #endif // PGR_USB2/3
+    bool _native;
 };
 
 #endif // PGR_USB2/3
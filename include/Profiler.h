@@ -0,0 +1,136 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       Profiler.h
+/// \brief      Optional profiler zone instrumentation (Tracy, Intel ITT or perf/ftrace markers).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+///
+/// Scoped zones around the main processing stages, for viewing in an external
+/// profiler. The backend is chosen at build time (cmake -DFICTRAC_PROFILER=
+/// tracy|itt|perf, which defines FICTRAC_PROFILE_TRACY/ITT/PERF); without one
+/// every macro expands to nothing (or the plain lock), so there is no cost.
+///
+///   PROFILE_ZONE(name)        zone until the end of the enclosing scope (name must be a string literal)
+///   PROFILE_THREAD(name)      name the calling thread
+///   PROFILE_FRAME()           mark the end of a tracked frame
+///   PROFILE_LOCK(l, name)     lock the (deferred) unique_lock l, with the wait as a zone
+///
+/// perf markers are written to the ftrace trace_marker file in the systrace
+/// format ("B|pid|name" / "E|pid"), e.g. for perf record -e ftrace:print, trace-cmd
+/// or Perfetto. The tracing filesystem must be writable by the FicTrac user.
+///
+
+#define PROFILE_CAT2(a, b) a##b
+#define PROFILE_CAT(a, b) PROFILE_CAT2(a, b)
+
+#if defined(FICTRAC_PROFILE_TRACY)
+
+#include <tracy/Tracy.hpp>
+
+#define PROFILE_ZONE(name) ZoneScopedN(name)
+#define PROFILE_THREAD(name) tracy::SetThreadName(name)
+#define PROFILE_FRAME() FrameMark
+
+#elif defined(FICTRAC_PROFILE_ITT)
+
+#include <ittnotify.h>
+
+namespace profiler {
+
+inline __itt_domain* domain()
+{
+    static __itt_domain* d = __itt_domain_create("FicTrac");
+    return d;
+}
+
+struct Zone {
+    Zone(__itt_string_handle* h) { __itt_task_begin(domain(), __itt_null, __itt_null, h); }
+    ~Zone() { __itt_task_end(domain()); }
+};
+
+inline void frame()
+{
+    __itt_frame_end_v3(domain(), nullptr);
+    __itt_frame_begin_v3(domain(), nullptr);
+}
+
+} // namespace profiler
+
+#define PROFILE_ZONE(name) \
+    static __itt_string_handle* PROFILE_CAT(_prof_h, __LINE__) = __itt_string_handle_create(name); \
+    profiler::Zone PROFILE_CAT(_prof_z, __LINE__)(PROFILE_CAT(_prof_h, __LINE__))
+#define PROFILE_THREAD(name) __itt_thread_set_name(name)
+#define PROFILE_FRAME() profiler::frame()
+
+#elif defined(FICTRAC_PROFILE_PERF) && defined(__linux__)
+
+#include <algorithm>    // min
+#include <atomic>
+#include <cstdio>       // snprintf
+#include <cstring>      // strncpy
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+namespace profiler {
+
+/// trace_marker (-1 if tracing is unavailable).
+inline int markerFd()
+{
+    static int fd = [] {
+        int f = ::open("/sys/kernel/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+        if (f < 0) { f = ::open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY | O_CLOEXEC); }
+        return f;
+    }();
+    return fd;
+}
+
+inline void mark(const char* fmt, const char* name, unsigned long long v = 0)
+{
+    const int fd = markerFd();
+    if (fd < 0) { return; }
+    char buf[128];
+    int len = snprintf(buf, sizeof(buf), fmt, static_cast<int>(getpid()), name, v);
+    if (len > 0) { (void)!::write(fd, buf, std::min(len, static_cast<int>(sizeof(buf)) - 1)); }
+}
+
+struct Zone {
+    Zone(const char* name) { mark("B|%d|%s", name); }
+    ~Zone() { mark("E|%d", ""); }
+};
+
+inline void thread(const char* name)
+{
+    char buf[16];   // thread names are limited to 15 chars
+    strncpy(buf, name, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    pthread_setname_np(pthread_self(), buf);
+}
+
+inline void frame()
+{
+    static std::atomic<unsigned long long> n(0);
+    mark("C|%d|%s|%llu", "frame", ++n);
+}
+
+} // namespace profiler
+
+#define PROFILE_ZONE(name) profiler::Zone PROFILE_CAT(_prof_z, __LINE__)(name)
+#define PROFILE_THREAD(name) profiler::thread(name)
+#define PROFILE_FRAME() profiler::frame()
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_THREAD(name) ((void)0)
+#define PROFILE_FRAME() ((void)0)
+
+#endif
+
+#if defined(FICTRAC_PROFILE_TRACY) || defined(FICTRAC_PROFILE_ITT) || (defined(FICTRAC_PROFILE_PERF) && defined(__linux__))
+#define PROFILE_LOCK(l, name) do { PROFILE_ZONE(name); (l).lock(); } while (0)
+#else
+#define PROFILE_LOCK(l, name) (l).lock()
+#endif
@@ -0,0 +1,166 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       Projection.h
+/// \brief      Devirtualised world to image projection for the built-in camera models.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "typesvars.h"
+
+#include <cmath>
+
+///
+/// Inline projection functors matching CameraModel::vectorToPixel() and
+/// vectorToPixelIndex() for the equi-area, rectilinear and fisheye models.
+/// They are filled by CameraModel::getProjection() and are meant to be used
+/// as template parameters in per-pixel loops, so that projection is inlined
+/// rather than reached through a virtual call per pixel. proj::Model (see
+/// CameraModel.h) wraps models without a specialised functor.
+///
+/// Functors are templated on the value type (float or double) and use the
+/// polynomial atan2_approx() rather than atan2/acos. Its max error is ~1e-5
+/// rad, so the projection error is ~1e-5 / (rad per pixel) pixels, e.g.
+/// < 0.002 px for a 1000 px wide sphere map (2pi / 1000 rad per pixel), and
+/// < 0.01 px for a fisheye ROI at 1e-3 rad per pixel. This is the same
+/// approximation as used for matching (see SphereKernel), so the sphere map
+/// is built and scored through identical pixel lookups.
+///
+namespace proj {
+
+/// atan(a) for a in [0,1], max error ~1e-5 rad.
+const float ATAN_C1 = 0.99997726f;
+const float ATAN_C3 = -0.33262347f;
+const float ATAN_C5 = 0.19354346f;
+const float ATAN_C7 = -0.11643287f;
+const float ATAN_C9 = 0.05265332f;
+const float ATAN_C11 = -0.01172120f;
+
+///
+/// Fast atan2(y, x).
+///
+template <typename T>
+inline T atan2_approx(T y, T x)
+{
+    const T ay = std::fabs(y), ax = std::fabs(x);
+    const T mx = ay > ax ? ay : ax;
+    const T mn = ay > ax ? ax : ay;
+    const T a = mx > 0 ? mn / mx : 0;
+    const T s = a * a;
+    T r = ((((((T(ATAN_C11) * s + T(ATAN_C9)) * s + T(ATAN_C7)) * s + T(ATAN_C5)) * s + T(ATAN_C3)) * s) + T(ATAN_C1)) * a;
+    if (ay > ax) { r = T(CM_PI_2) - r; }
+    if (x < 0) { r = T(CM_PI) - r; }
+    if (y < 0) { r = -r; }
+    return r;
+}
+
+///
+/// Continuous pixel position to pixel index, see CameraModel::vectorToPixelIndex().
+///
+template <typename T>
+inline void toIndex(T x, T y, int& ix, int& iy)
+{
+    ix = static_cast<int>(x);   // (x - 0.5) + 0.5
+    iy = static_cast<int>(y);
+}
+
+///
+/// See EquiAreaCameraModel. Assumes |lonLeft| <= pi and |latTop| <= pi/2
+/// (single wrap), which covers all maps created by FicTrac.
+///
+struct EquiArea
+{
+    CmReal lat_top, lat_per_pix, lat_wrap;
+    CmReal lon_left, lon_per_pix, lon_wrap;
+    int w, h;
+
+    template <typename T>
+    bool operator()(const T v[3], T& x, T& y) const
+    {
+        const T n = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        const T lat = -(v[1] / n) * T(CM_PI_2);
+        const T lon = atan2_approx(v[0], v[2]);
+        T plat = (lat - T(lat_top)) / T(lat_per_pix);
+        T plon = (lon - T(lon_left)) / T(lon_per_pix);
+        if (plon < 0) { plon += T(lon_wrap); } else if (plon >= T(lon_wrap)) { plon -= T(lon_wrap); }
+        if (plat < 0) { plat += T(lat_wrap); } else if (plat >= T(lat_wrap)) { plat -= T(lat_wrap); }
+        x = plon;
+        y = plat;
+        return !((x < 0) || (x > w) || (y < 0) || (y > h));
+    }
+
+    template <typename T>
+    bool index(const T v[3], int& ix, int& iy) const
+    {
+        T x, y;
+        bool ret = (*this)(v, x, y);
+        toIndex(x, y, ix, iy);
+        return ret;
+    }
+};
+
+///
+/// See RectilinearCameraModel.
+///
+struct Rectilinear
+{
+    CmReal f, xc, yc, r2max;
+    int w, h;
+
+    template <typename T>
+    bool operator()(const T v[3], T& x, T& y) const
+    {
+        if (v[2] <= 0) {
+            x = y = -1;
+            return false;
+        }
+        const T s = T(f) / v[2];
+        const T dx = v[0] * s, dy = v[1] * s;
+        x = dx + T(xc);
+        y = dy + T(yc);
+        return ((dx * dx + dy * dy) <= T(r2max)) && !((x < 0) || (x > w) || (y < 0) || (y > h));
+    }
+
+    template <typename T>
+    bool index(const T v[3], int& ix, int& iy) const
+    {
+        T x, y;
+        bool ret = (*this)(v, x, y);
+        toIndex(x, y, ix, iy);
+        return ret;
+    }
+};
+
+///
+/// See FisheyeCameraModel. The angle from forward is atan2(|xy|, z), which
+/// doesn't require the vector to be normalised.
+///
+struct Fisheye
+{
+    CmReal rad_per_pix, xc, yc, r2max;
+    int w, h;
+
+    template <typename T>
+    bool operator()(const T v[3], T& x, T& y) const
+    {
+        const T s2 = v[0] * v[0] + v[1] * v[1];
+        const T n2 = s2 + v[2] * v[2];
+        const T s = std::sqrt(s2);
+        const T R = atan2_approx(s, v[2]) / T(rad_per_pix);
+        const T xy_scl = (s2 > T(1e-14) * n2) ? R / s : 0;
+        x = v[0] * xy_scl + T(xc);
+        y = v[1] * xy_scl + T(yc);
+        return ((R * R) <= T(r2max)) && !((x < 0) || (x > w) || (y < 0) || (y > h));
+    }
+
+    template <typename T>
+    bool index(const T v[3], int& ix, int& iy) const
+    {
+        T x, y;
+        bool ret = (*this)(v, x, y);
+        toIndex(x, y, ix, iy);
+        return ret;
+    }
+};
+
+}
@@ -0,0 +1,59 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       PushSource.h
+/// \brief      Frame source fed by the application (embedded use).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "FrameSource.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+///
+/// Frames are pushed from the application's own acquisition code instead of
+/// being grabbed from a device or file. Pushed frames are not copied if they
+/// own (reference counted) data, so the application must not write to a
+/// pushed buffer afterwards; headers onto external memory are cloned.
+///
+/// Frames must be width x height, CV_8UC1 (grey or Bayer, see setBayerType())
+/// or CV_8UC3 (BGR). If tracking falls behind, the oldest queued frames are
+/// dropped (counted in getDropped()).
+///
+class PushSource : public FrameSource {
+public:
+    PushSource(int width, int height, double fps = -1, int max_queue = 2);
+    virtual ~PushSource();
+
+    ///
+    /// Queue a frame. ts_ms is the host timestamp (see ts_ms()) when the frame
+    /// was captured, ms_since_midnight the corresponding time of day; both
+    /// default to the time of the push. False if the frame is invalid or the
+    /// source has been closed.
+    ///
+    bool push(const cv::Mat& frame, double ts_ms = -1, double ms_since_midnight = -1);
+
+    /// End of stream. Frames already queued are still delivered.
+    void close();
+
+    virtual bool rewind() { return false; }
+    virtual bool grab(cv::Mat& frame);
+    virtual bool grabBuffer(cv::Mat& frame);
+    virtual void interrupt();
+
+private:
+    struct Frame {
+        cv::Mat frame;
+        double ts, ms;
+    };
+
+    int _max_queue;
+    std::deque<Frame> _queue;
+    bool _closed;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+};
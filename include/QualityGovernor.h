@@ -0,0 +1,43 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       QualityGovernor.h
+/// \brief      Steps tracking work down/up to sustain the source frame rate.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+///
+/// Watches per-frame processing time (relative to the frame period) and input
+/// queue depth, and picks a quality level. Level 0 is the configured settings;
+/// each higher level is cheaper (see Trackball::applyQuality()). The level is
+/// stepped down while the tracker is falling behind and back up once there is
+/// sustained headroom, with a hold time after each change so that the effect
+/// of one step is measured before taking the next.
+///
+class QualityGovernor
+{
+public:
+    static const int NUM_LEVELS = 5;
+
+    /// period_ms is the nominal frame period (<= 0 to measure it from frame timestamps).
+    QualityGovernor(double period_ms);
+
+    ///
+    /// Per frame. busy_ms is processing time (excluding waiting for the frame),
+    /// ts the frame timestamp and now the current time (both ms). Returns the
+    /// new level if it changed, otherwise -1.
+    ///
+    int update(double busy_ms, int queue, double ts, double now);
+
+    int level() const { return _level; }
+
+    /// Smoothed load (processing time / frame period) and queue depth.
+    double load() const { return _load; }
+    double queue() const { return _queue; }
+
+private:
+    double _period_ms, _prev_ts;
+    double _load, _queue;
+    int _level;
+    double _change_ts;
+};
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "RecorderInterface.h"
+#include "LatencyHist.h"
 
 #include <thread>
 #include <mutex>
@@ -15,22 +16,55 @@
 #include <memory>   // unique_ptr
 #include <deque>
 #include <string>
+#include <vector>
+#include <chrono>
 
 
 class Recorder
 {
 public:
-    Recorder(RecorderInterface::RecordType type, std::string fn = "");
+    ///
+    /// Batched mode: msgs are copied into a preallocated byte ring and the writer
+    /// thread drains everything pending in a single write. The writer flushes as
+    /// soon as flush_bytes are pending, or max_latency_ms after the first pending
+    /// byte (0 flushes as soon as possible, batching only what piled up meanwhile).
+    /// ring_size 0 keeps the msg queue (one write per msg, preserves msg
+    /// boundaries, e.g. for datagram sockets).
+    ///
+    struct Batching {
+        size_t ring_size;
+        size_t flush_bytes;
+        int max_latency_ms;
+
+        Batching(size_t ring = 0, size_t flush = 0, int latency_ms = 0)
+            : ring_size(ring), flush_bytes(flush), max_latency_ms(latency_ms) {}
+    };
+
+    ///
+    /// spin_us > 0 makes the writer poll for msgs for up to spin_us before
+    /// blocking (< 0 polls indefinitely), so a msg is picked up without a
+    /// condition variable wake-up. Msg queue mode only.
+    ///
+    Recorder(RecorderInterface::RecordType type, std::string fn = "", bool binary = false, Batching batch = Batching(), int spin_us = 0);
     ~Recorder();
 
     bool is_active() { return _active; }
     RecorderInterface::RecordType type() { return _record->type(); }
 
-    /// Add msg to msgQ for async writing.
-    bool addMsg(std::string msg);
+    /// Add msg to msgQ for async writing. If stamp_ms >= 0 (host clock, see ts_ms()),
+    /// the delay from stamp_ms until the msg has been written is recorded (see setLatencyHist()).
+    bool addMsg(const std::string& msg, double stamp_ms = -1) { return addMsg(msg.data(), msg.size(), stamp_ms); }
+
+    /// Copy raw bytes (e.g. a BinaryRecord) to msgQ for async writing.
+    bool addMsg(const void* data, size_t len, double stamp_ms = -1);
+
+    /// Histograms (ms) for stamped msgs, written from the writer thread. Msg queue mode only.
+    void setLatencyHist(LatencyHist* hist, LatencyHist* hist_int = nullptr);
 
 private:
     void processMsgQ();
+    void processRing();
+    bool addRing(const char* data, size_t len);
 
 private:
     std::atomic<bool> _active;
@@ -38,7 +72,29 @@ private:
     std::unique_ptr<RecorderInterface> _record;
 
     std::unique_ptr<std::thread> _thread;
-    std::deque<std::string> _msgQ;
+    struct Msg {
+        std::string buf;
+        double stamp;
+    };
+    std::deque<Msg> _msgQ;
+    std::vector<std::string> _freeQ;    // written msg buffers, recycled to avoid per-msg allocation
+    std::vector<std::string> _batchMsgs; // msgs drained together from _msgQ (see writeMsgs)
+    std::vector<double> _batchStamps;
     std::mutex _qMutex;
     std::condition_variable _qCond;
+
+    /// Polling writer (spin_us != 0).
+    int _spin_us;
+    std::atomic<size_t> _nqueued;       // mirrors _msgQ.size() for lock-free polling
+    bool _parked;                       // writer is blocked on _qCond
+
+    LatencyHist* _lat_hist;
+    LatencyHist* _lat_hist_int;
+
+    /// Batched mode.
+    Batching _batch;
+    std::vector<char> _ring;
+    uint64_t _rpos, _wpos;              // total bytes drained/added
+    std::chrono::steady_clock::time_point _pending_since;
+    std::condition_variable _spaceCond;
 };
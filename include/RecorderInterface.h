@@ -16,11 +16,14 @@ public:
         TERM,
         FILE,
         SOCK,
-        COM
+        TCP,
+        COM,
+        SHM,
+        COLS
     };
 
     RecorderInterface() : _open(false), _type(CLOSED) {}
-    ~RecorderInterface() { _open = false; _type = CLOSED; } // just to make sure
+    virtual ~RecorderInterface() { _open = false; _type = CLOSED; } // just to make sure (implementations close in their dstr)
 
     /// Delete the copy constructors we wish to block (public decs give better compiler error msgs)
     RecorderInterface(RecorderInterface const&) = delete;
@@ -31,7 +34,22 @@ public:
 
     /// Interface to be overridden by implementations.
     virtual bool openRecord(std::string f = "") = 0;
-    virtual bool writeRecord(std::string s) = 0;
+    virtual bool writeRecord(const std::string& s) = 0;
+    virtual bool writeRecord(const char* data, size_t len) { return writeRecord(std::string(data, len)); }
+
+    /// Write a batch of msgs (split in two parts at the end of the Recorder's ring).
+    virtual bool writeRecords(const char* a, size_t na, const char* b, size_t nb) {
+        bool ret = writeRecord(a, na);
+        if (nb > 0) { ret &= writeRecord(b, nb); }
+        return ret;
+    }
+
+    /// Write n separate msgs (e.g. one datagram each) in one go, if the implementation can.
+    virtual bool writeMsgs(const std::string* msgs, size_t n) {
+        bool ret = true;
+        for (size_t i = 0; i < n; i++) { ret &= writeRecord(msgs[i]); }
+        return ret;
+    }
     virtual void closeRecord() = 0;
 
 protected:
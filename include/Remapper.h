@@ -27,7 +27,7 @@ public:
 		LINEAR, /// default
 		CUBIC
 	};
-	void setInterpMode(InterpMode mode) { _mode = mode; }
+	void setInterpMode(InterpMode mode) { _mode = mode; invalidateMaps(); }
 
 	int getSrcW() { return _srcW; }
 	int getSrcH() { return _srcH; }
@@ -36,6 +36,13 @@ public:
 
 	virtual void apply(const cv::Mat& src, cv::Mat& dst);
 
+#if defined(FICTRAC_OPENCL)
+	///
+	/// Remap on the OpenCL device (fixed-point maps are uploaded once).
+	///
+	void apply(const cv::UMat& src, cv::UMat& dst);
+#endif
+
 	void applyC1(const unsigned char *src, unsigned char *dst,
 			int srcStep=0, int dstStep=0);
 	void applyC3(const unsigned char *src, unsigned char *dst,
@@ -69,6 +76,17 @@ public:
 	float * getMapX() { return _getMapX(); }
 	float * getMapY() { return _getMapY(); }
 
+	///
+	/// Must be called after modifying the maps, so that the cached
+	/// fixed-point maps are rebuilt before the next apply().
+	///
+	void invalidateMaps() {
+		_fixedMap1.release(); _fixedMap2.release();
+#if defined(FICTRAC_OPENCL)
+		_fixedMap1U.release(); _fixedMap2U.release();
+#endif
+	}
+
 
 protected:
 	Remapper(int srcW, int srcH, int dstW, int dstH);
@@ -108,4 +126,17 @@ protected:
 	InterpMode _mode;
 	int _srcW, _srcH;
 	int _dstW, _dstH;
+
+private:
+	///
+	/// Fixed-point maps (cv::convertMaps) cached from the float maps, cropped
+	/// to the bounding rect of valid destination pixels.
+	///
+	void _updateFixedMaps();
+
+	cv::Mat _fixedMap1, _fixedMap2;
+	cv::Rect _validRect;
+#if defined(FICTRAC_OPENCL)
+	cv::UMat _fixedMap1U, _fixedMap2U;
+#endif
 };
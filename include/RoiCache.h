@@ -0,0 +1,37 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       RoiCache.h
+/// \brief      Binary cache of the derived ROI state (remap tables, ROI mask, view rays).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "typesvars.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+///
+/// The ROI remap tables, ROI mask and ROI view rays only depend on the camera
+/// model, sphere ROI, ignore regions and ROI size. They are stored together
+/// with a hash of those inputs (see key()), so a cache written for a different
+/// configuration or frame size is simply ignored and rewritten.
+///
+struct RoiCache
+{
+    std::vector<float> map_x, map_y;    // CameraRemap tables (roi_w * roi_h)
+    cv::Mat roi_mask;                   // final ROI mask (CV_8UC1)
+    std::vector<RoiPixel> roi_pix;
+
+    /// 64 bit FNV-1a hash of the (canonical) description of all inputs.
+    static uint64_t key(const std::string& desc);
+
+    /// Load (via a read-only file mapping). Fails if absent, corrupt, or the key/sizes differ.
+    bool load(const std::string& fn, uint64_t key, int src_w, int src_h, int roi_w, int roi_h);
+
+    /// Write atomically (temporary file, then rename).
+    bool save(const std::string& fn, uint64_t key, int src_w, int src_h) const;
+};
@@ -0,0 +1,116 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       SPSCRing.h
+/// \brief      Lock-free single-producer/single-consumer ring buffer.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <utility>  // move
+
+///
+/// Fixed capacity ring buffer for exactly one producer and one consumer thread.
+/// push/pop are lock-free. Waiting either blocks straight away, or spins for
+/// up to spin_us before parking on a condition variable (spin_us < 0 spins
+/// until ready, i.e. busy-polls - only use with a dedicated core).
+///
+template <typename T>
+class SPSCRing
+{
+public:
+    SPSCRing(size_t capacity, int spin_us = 0)
+        : _buf(capacity + 1), _head(0), _tail(0), _spin_us(spin_us), _waiting(0) {}
+    ~SPSCRing() {}
+
+    size_t capacity() const { return _buf.size() - 1; }
+    size_t size() const {
+        size_t h = _head.load(std::memory_order_acquire), t = _tail.load(std::memory_order_acquire);
+        return (t >= h) ? (t - h) : (t + _buf.size() - h);
+    }
+    bool empty() const { return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire); }
+    bool full() const { return next(_tail.load(std::memory_order_acquire)) == _head.load(std::memory_order_acquire); }
+
+    void setSpin(int spin_us) { _spin_us = spin_us; }
+
+    /// Producer only. Returns false if full.
+    bool push(T&& v) {
+        size_t t = _tail.load(std::memory_order_relaxed);
+        size_t n = next(t);
+        if (n == _head.load(std::memory_order_acquire)) { return false; }
+        _buf[t] = std::move(v);
+        _tail.store(n, std::memory_order_seq_cst);
+        wake();
+        return true;
+    }
+
+    /// Consumer only. Returns false if empty.
+    bool pop(T& v) {
+        size_t h = _head.load(std::memory_order_relaxed);
+        if (h == _tail.load(std::memory_order_acquire)) { return false; }
+        v = std::move(_buf[h]);
+        _buf[h] = T();      // don't hold on to resources in empty slots
+        _head.store(next(h), std::memory_order_seq_cst);
+        wake();
+        return true;
+    }
+
+    /// Wait until there is something to pop (consumer) or space to push (producer), or until !active.
+    bool waitNotEmpty(const std::atomic_bool& active) { return wait([this]() { return !empty(); }, active); }
+    bool waitNotFull(const std::atomic_bool& active) { return wait([this]() { return !full(); }, active); }
+
+    /// Wake any waiting thread (e.g. after clearing active flag).
+    void notify() {
+        std::lock_guard<std::mutex> l(_mutex);
+        _cond.notify_all();
+    }
+
+private:
+    size_t next(size_t i) const { return (++i < _buf.size()) ? i : 0; }
+
+    void wake() {
+        if (_waiting.load(std::memory_order_seq_cst) > 0) { notify(); }
+    }
+
+    template <typename F>
+    bool wait(F ready, const std::atomic_bool& active) {
+        if (ready()) { return true; }
+
+        /// Spin.
+        if (_spin_us < 0) {
+            while (active) {
+                if (ready()) { return true; }
+            }
+            return ready();
+        }
+        else if (_spin_us > 0) {
+            auto t0 = std::chrono::steady_clock::now();
+            auto spin = std::chrono::microseconds(_spin_us);
+            while (active && ((std::chrono::steady_clock::now() - t0) < spin)) {
+                if (ready()) { return true; }
+            }
+        }
+
+        /// Park. Timeout guards against a lost wake-up.
+        std::unique_lock<std::mutex> l(_mutex);
+        _waiting++;
+        while (active && !ready()) {
+            _cond.wait_for(l, std::chrono::milliseconds(10));
+        }
+        _waiting--;
+        return ready();
+    }
+
+private:
+    std::vector<T> _buf;
+    alignas(64) std::atomic<size_t> _head;   // consumer
+    alignas(64) std::atomic<size_t> _tail;   // producer
+    alignas(64) int _spin_us;
+    std::atomic_int _waiting;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+};
@@ -11,11 +11,22 @@
 #ifdef _WIN32
 #include <SDKDDKVer.h>
 #endif
-#include <boost/asio/serial_port.hpp> 
+#include <boost/asio.hpp>
 
 #include <string>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <cstdint>
 
+///
+/// Writes are asynchronous (boost::asio, overlapped i/o on Windows) from the
+/// recorder's own i/o thread, and only the newest record is kept while the
+/// port is busy: a record that has not started transmitting when the next one
+/// arrives is dropped as stale (counted, and logged when the port is closed). At low baud rates
+/// the consumer therefore always receives the latest state at the highest
+/// rate the link allows, rather than an ever growing backlog.
+///
 class SerialRecorder : public RecorderInterface
 {
 public:
@@ -24,10 +35,22 @@ public:
 
     /// Interface to be overridden by implementations.
     bool openRecord(std::string port_baud);
-    bool writeRecord(std::string s);
+    bool writeRecord(const std::string& s) { return writeRecord(s.data(), s.size()); }
+    bool writeRecord(const char* data, size_t len);
+    bool writeRecords(const char* a, size_t na, const char* b, size_t nb);
     void closeRecord();
 
 private:
+    void send();
+
     std::string _port_name;
+    boost::asio::io_service _io_service;
+    std::unique_ptr<boost::asio::io_service::work> _work;
     std::shared_ptr<boost::asio::serial_port> _port;
+    std::unique_ptr<std::thread> _thread;
+
+    std::mutex _mutex;
+    std::string _next, _inflight;       // newest unsent record, record being sent (i/o thread)
+    bool _writing;
+    uint64_t _stale;                    // records dropped because a newer one arrived before they were sent
 };
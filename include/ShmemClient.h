@@ -0,0 +1,285 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ShmemClient.h
+/// \brief      Shared-memory output channel layout and header-only client.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "BinaryRecord.h"
+#include "Extrapolate.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>  // memcpy
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+///
+/// Layout of the shared-memory segment written by ShmemRecorder.
+///
+/// The segment holds a header followed by a ring of nslots BinaryRecords
+/// (state_ring_len, SLOTS_DEFAULT if not set). Each slot is guarded by its
+/// own sequence counter (seqlock): odd while being written, 2 * (n + 1) once
+/// record n is complete. head counts the records published so far, so record
+/// n lives in slot n % nslots. There is a single writer and any number of
+/// readers; readers never block the writer.
+///
+/// session counts writer opens and closes: it is odd while a tracker has the
+/// channel open and even once it has closed. A reader that sees it change is
+/// attached to a dead (or re-initialised) segment and must re-open the channel
+/// (see ShmemReader::stale).
+///
+namespace shmem {
+
+static const uint32_t MAGIC = 0x4d485346;      // "FSHM"
+static const uint16_t VERSION = 3;             // 2: variable number of slots, 3: writer session
+static const uint32_t SLOTS_DEFAULT = 256;
+static const uint32_t PAYLOAD_SIZE = 256;       // >= sizeof(BinaryRecord)
+
+static_assert(sizeof(BinaryRecord) <= PAYLOAD_SIZE, "BinaryRecord does not fit in shmem slot");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shmem channel requires lock-free 64 bit atomics");
+
+struct alignas(64) Slot {
+    std::atomic<uint64_t> seq;
+    uint32_t len;
+    uint8_t data[PAYLOAD_SIZE];
+};
+
+struct alignas(64) Header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t slot_size;                 // sizeof(Slot)
+    uint32_t nslots;
+    std::atomic<uint32_t> session;      // odd while the writer is open
+    alignas(64) std::atomic<uint64_t> head;
+};
+
+struct Segment {
+    Header hdr;
+    Slot* slots() { return reinterpret_cast<Slot*>(this + 1); }
+    const Slot* slots() const { return reinterpret_cast<const Slot*>(this + 1); }
+};
+
+static_assert(sizeof(Segment) % alignof(Slot) == 0, "shmem slots must follow the header aligned");
+
+/// Segment size in bytes for nslots slots.
+inline size_t segmentSize(uint32_t nslots)
+{
+    return sizeof(Segment) + static_cast<size_t>(nslots) * sizeof(Slot);
+}
+
+/// Platform name of shared-memory object for a given channel name.
+inline std::string objectName(const std::string& name)
+{
+#ifdef _WIN32
+    return "Local\\fictrac_" + name;
+#else
+    return "/fictrac_" + name;
+#endif
+}
+
+///
+/// Reader side of the shared-memory channel, for use by closed-loop clients.
+///
+///     ShmemReader shm("rig1");
+///     BinaryRecord rec;
+///     while (shm.is_open()) {
+///         if (shm.readLatest(rec)) { ... }    // or: while (shm.readNext(rec)) { ... }
+///         else if (shm.stale()) { shm.open("rig1"); }     // tracker closed or restarted
+///     }
+///
+/// Once the tracker closes or restarts, reads fail and stale() is set until the
+/// reader re-opens the channel (open() fails while no tracker has it open).
+///
+/// Renderers running faster than the camera can read the latest state advanced
+/// to their display time instead (see Extrapolate.h):
+///
+///     while (shm.is_open()) {
+///         if (shm.readPredicted(display_ts, rec)) { ... }
+///     }
+///
+/// and online analysis can pull recent history by frame or time range:
+///
+///     std::vector<BinaryRecord> hist;
+///     shm.readTimeRange(now_ts - 5000, now_ts, hist);   // last 5 s
+///
+class ShmemReader
+{
+public:
+    ShmemReader(const std::string& name = "") : _seg(nullptr), _size(0), _nslots(0), _session(0), _next(0), _dropped(0)
+#ifdef _WIN32
+        , _handle(NULL)
+#endif
+    {
+        if (!name.empty()) { open(name); }
+    }
+
+    ~ShmemReader() { close(); }
+
+    ShmemReader(ShmemReader const&) = delete;
+    void operator=(ShmemReader const&) = delete;
+
+    bool open(const std::string& name)
+    {
+        close();
+        std::string obj = objectName(name);
+#ifdef _WIN32
+        _handle = OpenFileMappingA(FILE_MAP_READ, FALSE, obj.c_str());
+        if (_handle == NULL) { return false; }
+        _seg = static_cast<const Segment*>(MapViewOfFile(_handle, FILE_MAP_READ, 0, 0, 0));    // whole mapping
+        if (_seg) {
+            MEMORY_BASIC_INFORMATION info;
+            _size = VirtualQuery(_seg, &info, sizeof(info)) ? info.RegionSize : 0;
+        }
+#else
+        int fd = shm_open(obj.c_str(), O_RDONLY, 0);
+        if (fd < 0) { return false; }
+        struct stat st;
+        _size = (fstat(fd, &st) == 0) ? static_cast<size_t>(st.st_size) : 0;
+        void* p = (_size >= sizeof(Segment)) ? mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        _seg = (p == MAP_FAILED) ? nullptr : static_cast<const Segment*>(p);
+#endif
+        if (_seg && ((_seg->hdr.magic != MAGIC) || (_seg->hdr.version != VERSION) || (_seg->hdr.slot_size != sizeof(Slot)) ||
+            (_seg->hdr.nslots == 0) || (_size < segmentSize(_seg->hdr.nslots)) ||
+            !(_seg->hdr.session.load(std::memory_order_acquire) & 1))) {
+            close();
+        }
+        if (_seg) {
+            _nslots = _seg->hdr.nslots;
+            _session = _seg->hdr.session.load(std::memory_order_acquire);
+            _next = _seg->hdr.head.load(std::memory_order_acquire);
+        }
+        return _seg != nullptr;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (_seg) { UnmapViewOfFile(_seg); }
+        if (_handle != NULL) { CloseHandle(_handle); _handle = NULL; }
+#else
+        if (_seg) { munmap(const_cast<Segment*>(_seg), _size); }
+#endif
+        _seg = nullptr;
+        _size = 0;
+        _nslots = 0;
+        _session = 0;
+    }
+
+    bool is_open() const { return _seg != nullptr; }
+
+    /// The writer this reader attached to has closed or re-initialised the segment - re-open to continue.
+    bool stale() const { return _seg && (_seg->hdr.session.load(std::memory_order_acquire) != _session); }
+
+    /// Number of records published so far.
+    uint64_t count() const { return _seg ? _seg->hdr.head.load(std::memory_order_acquire) : 0; }
+
+    /// Number of records overwritten before readNext() could see them.
+    uint64_t dropped() const { return _dropped; }
+
+    /// Copy most recent record. Returns false if nothing has been published yet.
+    bool readLatest(BinaryRecord& rec)
+    {
+        uint64_t n = count();
+        while ((n > 0) && !stale()) {
+            if (read(n - 1, rec)) { return true; }
+            n = count();
+        }
+        return false;
+    }
+
+    /// Most recent record advanced to ts (same clock as rec.ts, see extrap::extrapolate). Returns false if nothing has been published yet.
+    bool readPredicted(double ts, BinaryRecord& rec, double max_dt = extrap::MAX_DT_MS_DEFAULT)
+    {
+        BinaryRecord last;
+        if (!readLatest(last)) { return false; }
+        extrap::extrapolate(last, ts, rec, max_dt);
+        return true;
+    }
+
+    /// Copy next unread record (in order). Returns false if there is none.
+    bool readNext(BinaryRecord& rec)
+    {
+        while (!stale()) {
+            uint64_t n = count();
+            if (_next >= n) { return false; }
+            if (n - _next > _nslots) {  // lapped by writer
+                _dropped += n - _nslots - _next;
+                _next = n - _nslots;
+            }
+            if (read(_next, rec)) {
+                _next++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Records still in the ring with frame counter in [frame0, frame1], or timestamp (ms) in
+    /// [ts0, ts1], oldest first (see state_ring_len). Returns the number of records copied.
+    size_t readFrames(uint32_t frame0, uint32_t frame1, std::vector<BinaryRecord>& out) const
+    {
+        return readRange([](const BinaryRecord& r) { return static_cast<double>(r.frame_cnt); }, frame0, frame1, out);
+    }
+    size_t readTimeRange(double ts0, double ts1, std::vector<BinaryRecord>& out) const
+    {
+        return readRange([](const BinaryRecord& r) { return r.ts; }, ts0, ts1, out);
+    }
+
+private:
+    /// Binary search for the first record with key >= lo (records overwritten meanwhile count as too old), then copy up to hi.
+    template <typename Key>
+    size_t readRange(Key key, double lo, double hi, std::vector<BinaryRecord>& out) const
+    {
+        out.clear();
+        if (!_seg) { return 0; }
+        BinaryRecord rec;
+        const uint64_t n = count();
+        uint64_t l = (n > _nslots) ? (n - _nslots) : 0, r = n;
+        while (l < r) {
+            const uint64_t m = l + (r - l) / 2;
+            if (!read(m, rec) || (key(rec) < lo)) { l = m + 1; } else { r = m; }
+        }
+        for (uint64_t i = l; i < n; i++) {
+            if (!read(i, rec)) { continue; }    // overwritten since the search
+            if (key(rec) > hi) { break; }
+            out.push_back(rec);
+        }
+        return out.size();
+    }
+
+    /// Seqlock read of record n. Fails if the slot is being (or was) overwritten, or the segment is stale.
+    bool read(uint64_t n, BinaryRecord& rec) const
+    {
+        const Slot& s = _seg->slots()[n % _nslots];
+        const uint64_t want = 2 * (n + 1);
+        if (s.seq.load(std::memory_order_acquire) != want) { return false; }
+        uint32_t len = s.len;
+        memcpy(&rec, s.data, (len < sizeof(rec)) ? len : sizeof(rec));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return (s.seq.load(std::memory_order_relaxed) == want) && (_seg->hdr.session.load(std::memory_order_relaxed) == _session);
+    }
+
+private:
+    const Segment* _seg;
+    size_t _size;
+    uint32_t _nslots;
+    uint32_t _session;                  // writer session at open
+    uint64_t _next, _dropped;
+#ifdef _WIN32
+    HANDLE _handle;
+#endif
+};
+
+} // namespace shmem
@@ -0,0 +1,34 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ShmemRecorder.h
+/// \brief      Implementation of shared-memory recorder (see ShmemClient.h).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "RecorderInterface.h"
+#include "ShmemClient.h"
+
+#include <string>
+
+class ShmemRecorder : public RecorderInterface
+{
+public:
+    ShmemRecorder();
+    ~ShmemRecorder();
+
+    /// Interface to be overridden by implementations.
+    bool openRecord(std::string name);
+    bool writeRecord(const std::string& s) { return writeRecord(s.data(), s.size()); }
+    bool writeRecord(const char* data, size_t len);
+    void closeRecord();
+
+private:
+    std::string _name;
+    shmem::Segment* _seg;
+    size_t _size;
+    uint32_t _nslots;
+#ifdef _WIN32
+    HANDLE _handle;
+#endif
+};
@@ -0,0 +1,49 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       Sidecar.h
+/// \brief      Checksummed binary sidecars for large config blobs (sphere template, ignore polygons).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+///
+/// The text config (and template image) remain the source of truth. A sidecar
+/// stores the decoded/parsed form together with a key identifying its source
+/// (see fileKey()) and a checksum of the payload, and is loaded through a
+/// read-only file mapping. Stale, corrupt or missing sidecars simply fail to
+/// load and are rewritten from the source.
+///
+namespace sidecar {
+
+/// 64 bit FNV-1a hash.
+uint64_t hash(const void* data, size_t len, uint64_t h = 14695981039346656037ull);
+inline uint64_t hash(const std::string& s) { return hash(s.data(), s.size()); }
+
+/// Identifies the current contents of a file (path, size and modification time). 0 if missing.
+uint64_t fileKey(const std::string& fn);
+
+/// Sphere map template (CV_8UC1).
+bool loadMap(const std::string& fn, uint64_t key, cv::Mat& map);
+bool saveMap(const std::string& fn, uint64_t key, const cv::Mat& map);
+
+/// Polygons as parsed by ConfigParser::getVVecInt (e.g. roi_ignr).
+bool loadPolys(const std::string& fn, uint64_t key, std::vector<std::vector<int>>& polys);
+bool savePolys(const std::string& fn, uint64_t key, const std::vector<std::vector<int>>& polys);
+
+/// Tracking checkpoint (ckpt_period): sphere map and the orientation it was last updated at.
+struct Checkpoint {
+    double R_roi[9];        // absolute orientation (ROI frame)
+    double ts;              // timestamp of the frame
+    uint64_t cnt;           // frame counter
+    cv::Mat map;            // CV_8UC1
+};
+bool loadCheckpoint(const std::string& fn, uint64_t key, Checkpoint& ckpt);
+bool saveCheckpoint(const std::string& fn, uint64_t key, const Checkpoint& ckpt);
+
+}
@@ -0,0 +1,95 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       SimSource.h
+/// \brief      Renders a synthetic textured ball with a known rotation trajectory.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "FrameSource.h"
+#include "CmPoint.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+///
+/// Selected by a src_fn of the form sim:key=value,key=value,... (all optional):
+///
+///   w, h      image size (640x480)
+///   vfov      vertical field of view of the rectilinear camera, deg (45)
+///   r         angular radius of the ball, deg (0.8 * vfov / 2); the ball is centred
+///             on the optical axis, i.e. roi_c = [0,0,1] and roi_r = r (in rad)
+///   fps       nominal frame rate, used for timestamps (100)
+///   frames    number of frames (10000)
+///   speed     stddev of the random angular velocity, rad/frame (0.01)
+///   seed      random seed for texture, trajectory and noise (1)
+///   tex       texture detail, blobs across the ball (8)
+///   noise     stddev of additive pixel noise, grey levels (0)
+///   traj      file of per-frame rotations (wx wy wz, rad/frame, camera frame),
+///             repeated if shorter than frames; replaces the random trajectory
+///
+/// Frames are Mono8 and rendered on demand, as fast as possible unless a frame
+/// rate has been set (src_fps). The view vectors of the ball pixels are
+/// precomputed, so each frame costs one rotation and texture lookup per ball
+/// pixel. The whole trajectory is generated up front: frame i shows the ball
+/// rotated by getRotation(i) since frame i - 1 (zero for the first frame),
+/// which is what FicTrac reports as the delta rotation (camera frame) for that
+/// frame. Supports random access through setStartFrame()/rewind().
+///
+class SimSource : public FrameSource {
+public:
+    SimSource(const std::string& spec);
+    virtual ~SimSource() {}
+
+    /// True if src_fn names a simulated source (by prefix).
+    static bool isSim(const std::string& src_fn);
+
+    virtual double getFPS() { return (_fps > 0) ? _fps : _sim_fps; }
+    virtual bool rewind();
+    virtual bool setStartFrame(int frame);
+    virtual int getFrameCount() { return _nframes; }
+    virtual bool grab(cv::Mat& frame);
+    virtual bool grabBuffer(cv::Mat& frame);
+
+    /// Camera geometry of the rendered images (for the tracking config).
+    double getVfov() const { return _vfov; }
+    double getBallRadius() const { return _ball_r; }
+
+    /// Ground truth of frame i (rad): rotation since the previous frame and orientation since the first frame.
+    const CmPoint64f& getRotation(int i) const { return _dr[i]; }
+    const CmPoint64f& getOrientation(int i) const { return _r[i]; }
+
+    /// Ground truth in the data log layout (see doc/data_header.txt; columns that depend on the lab frame are 0).
+    bool writeTruth(const std::string& fn) const;
+
+private:
+    bool parse(const std::string& spec);
+    bool makeTrajectory();
+    void makeTexture();
+    void render(int i);
+
+private:
+    int _nframes, _pos, _start_frame;
+    double _vfov, _ball_r, _sim_fps, _speed, _noise;
+    int _tex_n;
+    unsigned int _seed;
+    std::string _traj_fn;
+
+    /// Ground truth.
+    std::vector<CmPoint64f> _dr, _r;
+    std::vector<CmMat33d> _R;
+
+    /// Ball pixels: unit surface normal (camera frame), shading and pixel index.
+    std::vector<float> _x, _y, _z, _shade;
+    std::vector<int> _idx;
+
+    std::vector<float> _tex;        // (tex_n + 1)^3 lattice of random values in [0, 1]
+    std::vector<int16_t> _noise_tab;
+
+    cv::Mat _frame;                 // rendered (clean) frame
+    cv::Mat _out;                   // with noise
+    double _t0, _msm0, _tpace;
+};
@@ -6,20 +6,24 @@
 
 #pragma once
 
-#if 0	// TCP sockets
-
-#ifdef __APPLE__ || __linux__ 
-#include "SocketRecorder_linux.h"
-#elif _WIN32
-#include "SocketRecorder_win.h"
-#endif
-
-#else	// UDP sockets
-
 #include "RecorderInterface.h"
 
 #include <boost/asio.hpp>
 
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/socket.h>     // mmsghdr
+#include <sys/uio.h>        // iovec
+#endif
+
+///
+/// Each msg is sent as one datagram to every destination. Destinations are a
+/// comma separated list of host:port (unicast or IPv4 multicast group, e.g.
+/// 239.0.0.1:2000). On Linux, batches of msgs to all destinations go out in a
+/// single sendmmsg() call from preallocated headers.
+///
 class SocketRecorder : public RecorderInterface
 {
 public:
@@ -28,16 +32,22 @@ public:
 
     /// Interface to be overridden by implementations.
     bool openRecord(std::string host_port);
-    bool writeRecord(std::string s);
+    bool writeRecord(const std::string& s) { return writeRecord(s.data(), s.size()); }
+    bool writeRecord(const char* data, size_t len);
+    bool writeMsgs(const std::string* msgs, size_t n);
     void closeRecord();
 
 private:
-    std::string _host;
-    int _port;
+    bool send(const char* const* data, const size_t* len, size_t n);
+
+    std::string _desc;      // destinations (for messages)
 
     boost::asio::io_service _io_service;
     boost::asio::ip::udp::socket _socket;
-    boost::asio::ip::udp::endpoint _endpoint;
-};
+    std::vector<boost::asio::ip::udp::endpoint> _endpoints;
 
+#ifdef __linux__
+    std::vector<mmsghdr> _mmsg;     // SOCK_BATCH_MAX x destinations
+    std::vector<iovec> _iov;        // SOCK_BATCH_MAX
 #endif
+};
@@ -0,0 +1,133 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       SphereKernel.h
+/// \brief      Vectorised rotation scoring kernel for the sphere surface map.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "typesvars.h"
+#include "TiledMap.h"
+#include "ThreadTeam.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+#include <cstdint>
+
+///
+/// Scores a candidate sphere orientation by rotating the (pre-computed) ROI
+/// view vectors into the sphere frame, projecting them into the equi-area
+/// surface map and accumulating the squared pixel difference.
+///
+/// The view vectors of valid ROI pixels are repacked as single precision SoA
+/// arrays. The equi-area projection is inlined (see
+/// EquiAreaCameraModel) and assumes the full-sphere map layout created by
+/// Trackball, i.e. createEquiArea(w, h, CM_PI_2, -CM_PI, CM_PI, -2 * CM_PI).
+///
+/// AVX2 (x86) and NEON (aarch64) code paths are selected at compile time,
+/// with a scalar fallback. All paths share the same atan2 approximation,
+/// which has max error ~1e-5 rad, i.e. < 0.1% of a map pixel at q_factor 20.
+///
+/// The map may be the row major cv::Mat or its TiledMap mirror (same result).
+///
+/// With a ThreadTeam (setTeam), single rotation scores over at least min_pix
+/// pixels are split into contiguous pixel chunks, one per team member. The
+/// integer partial sums are reduced in member order, so scores are identical
+/// to the single threaded result.
+///
+/// Pixels are stored in stratified order (every STRATA'th ROI pixel, strata in
+/// bit-reversed order), so the first 1/8, 1/4 and 1/2 of them are each an even
+/// subsample of the ROI. Full scores do not depend on the order.
+///
+class SphereKernel
+{
+public:
+    static const int STRATA = 8;
+
+    SphereKernel(const std::vector<RoiPixel>& roi_pix, int map_w, int map_h);
+    ~SphereKernel() {}
+
+    /// Number of valid ROI pixels.
+    int size() const { return static_cast<int>(_idx.size()); }
+
+    /// Score single rotations over >= min_pix pixels across team (nullptr to disable). Not thread safe.
+    void setTeam(ThreadTeam* team, int min_pix);
+
+    ///
+    /// Sum squared diff between ROI frame and sphere map for absolute
+    /// orientation m (row major 3x3, transpose is applied to rotate vectors).
+    /// Returns number of ROI pixels that fell on previously seen map pixels.
+    ///
+    int accumulate(const double m[9], const cv::Mat& roi_frame, const cv::Mat& sphere_map, int64_t& err) const;
+    int accumulate(const double m[9], const cv::Mat& roi_frame, const TiledMap& sphere_map, int64_t& err) const;
+
+    ///
+    /// Avg squared diff error, or DBL_MAX if < 25% of valid pixels overlap seen map pixels.
+    ///
+    double testRotation(const double m[9], const cv::Mat& roi_frame, const cv::Mat& sphere_map) const;
+    double testRotation(const double m[9], const cv::Mat& roi_frame, const TiledMap& sphere_map) const;
+
+    ///
+    /// As testRotation, but scores the 1/8, 1/4 and 1/2 subsamples first and
+    /// returns the subsample error as soon as it exceeds best * (1 + margin),
+    /// provided > 25% of the subsample overlaps seen map pixels. Otherwise
+    /// (and whenever error stays competitive) the result is the full score.
+    /// npix (optional) returns the number of ROI pixels scored.
+    ///
+    double testRotationBounded(const double m[9], const cv::Mat& roi_frame, const cv::Mat& sphere_map, double best, double margin, int* npix = nullptr) const;
+    double testRotationBounded(const double m[9], const cv::Mat& roi_frame, const TiledMap& sphere_map, double best, double margin, int* npix = nullptr) const;
+
+    ///
+    /// Batch versions for nrot orientations (9 values each) in a single sweep over
+    /// the ROI - each pixel's view vector and ROI value are loaded once and reused
+    /// for every rotation. Same results as scoring each rotation separately.
+    ///
+    void accumulateBatch(const double* m, int nrot, const cv::Mat& roi_frame, const cv::Mat& sphere_map, int64_t* err, int* good) const;
+    void accumulateBatch(const double* m, int nrot, const cv::Mat& roi_frame, const TiledMap& sphere_map, int64_t* err, int* good) const;
+    void testRotations(const double* m, int nrot, const cv::Mat& roi_frame, const cv::Mat& sphere_map, double* err) const;
+    void testRotations(const double* m, int nrot, const cv::Mat& roi_frame, const TiledMap& sphere_map, double* err) const;
+
+    ///
+    /// Differentiable score for gradient based searches. As testRotation, but the
+    /// (row major) map is sampled with bilinear interpolation and only ROI pixels
+    /// whose 4 neighbouring map pixels have all been seen are used. grad returns
+    /// the derivative of the score with respect to each rotation parameter, given
+    /// dm (3 row major 3x3 matrices), the derivatives of m with respect to each.
+    ///
+    double testRotationGrad(const double m[9], const double dm[27], const cv::Mat& roi_frame, const cv::Mat& sphere_map, double grad[3]) const;
+
+private:
+    template <bool TILED>
+    int accumulateT(int k0, int k1, const double m[9], const uint8_t* roi, const uint8_t* map, int map_step, const uint64_t* seen, int64_t& err) const;
+    template <bool TILED>
+    void accumulateScalar(int k0, int k1, const double m[9], const uint8_t* roi, const uint8_t* map, int map_step, const uint64_t* seen, int64_t& err, int& good) const;
+    template <bool TILED>
+    void accumulateBatchT(const double* m, int nrot, const uint8_t* roi, const uint8_t* map, int map_step, const uint64_t* seen, int64_t* err, int* good) const;
+    template <typename Map>
+    double testRotationT(const double m[9], const cv::Mat& roi_frame, const Map& sphere_map) const;
+    template <typename Map>
+    double testRotationBoundedT(const double m[9], const cv::Mat& roi_frame, const Map& sphere_map, double best, double margin, int* npix) const;
+    template <bool TILED>
+    int accumulateRangeT(int k0, int k1, const double m[9], const uint8_t* roi, const uint8_t* map, int map_step, const uint64_t* seen, int64_t& err) const;
+    int accumulateRange(int k0, int k1, const double m[9], const cv::Mat& roi_frame, const cv::Mat& sphere_map, int64_t& err) const;
+    int accumulateRange(int k0, int k1, const double m[9], const cv::Mat& roi_frame, const TiledMap& sphere_map, int64_t& err) const;
+    template <typename Map>
+    void testRotationsT(const double* m, int nrot, const cv::Mat& roi_frame, const Map& sphere_map, double* err) const;
+
+private:
+    std::vector<float> _x, _y, _z;  // normalised view vectors (sphere coords)
+    std::vector<int> _idx;          // ROI pixel index (i * roi_w + j)
+    std::vector<int> _subset;       // pixel counts of the 1/8, 1/4 and 1/2 subsamples
+    int _map_w, _map_h;
+    float _lon_scl, _lat_scl;
+
+    /// Intra-frame parallel scoring.
+    struct alignas(64) Partial {
+        int64_t err;
+        int good;
+    };
+    ThreadTeam* _team;
+    int _team_min;
+    mutable std::vector<Partial> _part;     // per team member
+};
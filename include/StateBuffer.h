@@ -0,0 +1,71 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       StateBuffer.h
+/// \brief      Lock-free double buffer for publishing state snapshots.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>      // memcpy
+#include <type_traits>
+
+///
+/// Single writer, any number of readers. The writer fills the slot that is
+/// not currently published and then flips the published index, so it never
+/// waits on readers. Each slot carries a sequence counter (odd while being
+/// written); a reader that was overtaken by two publishes during its copy
+/// sees the counter change and simply copies again.
+///
+/// T must be trivially copyable. Neither side allocates or takes a lock.
+///
+template <typename T>
+class StateBuffer
+{
+    static_assert(std::is_trivially_copyable<T>::value, "StateBuffer requires a trivially copyable type");
+
+public:
+    StateBuffer() : _pub(0) {
+        _slot[0].seq.store(0, std::memory_order_relaxed);
+        _slot[1].seq.store(0, std::memory_order_relaxed);
+    }
+    ~StateBuffer() {}
+
+    StateBuffer(StateBuffer const&) = delete;
+    void operator=(StateBuffer const&) = delete;
+
+    /// Writer only.
+    void publish(const T& v) {
+        const unsigned w = _pub.load(std::memory_order_relaxed) ^ 1;
+        Slot& s = _slot[w];
+        const uint64_t seq = s.seq.load(std::memory_order_relaxed);
+        s.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&s.val, &v, sizeof(T));
+        s.seq.store(seq + 2, std::memory_order_release);
+        _pub.store(w, std::memory_order_release);
+    }
+
+    /// Any thread. Returns the most recently published value (T() if none yet).
+    T read() const {
+        T v;
+        while (true) {
+            const Slot& s = _slot[_pub.load(std::memory_order_acquire)];
+            const uint64_t seq0 = s.seq.load(std::memory_order_acquire);
+            if (seq0 & 1) { continue; }
+            std::memcpy(&v, &s.val, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.seq.load(std::memory_order_relaxed) == seq0) { break; }
+        }
+        return v;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        T val;
+    };
+    Slot _slot[2];
+    std::atomic<unsigned> _pub;
+};
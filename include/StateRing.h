@@ -0,0 +1,81 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       StateRing.h
+/// \brief      Preallocated, time-indexed history of recent tracking states.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>  // size_t
+#include <cstdint>
+#include <vector>
+
+///
+/// Ring of the last capacity() output states, stored as one array per field
+/// (structure of arrays), so e.g. the heading over the last few seconds is a
+/// contiguous copy. Each state has a ring index (0, 1, ... in publish order);
+/// find*() map frame or timestamp ranges to index ranges and copy*() read
+/// them out.
+///
+/// Single writer (the tracking thread), any number of readers. push() never
+/// allocates, locks or waits. Readers validate against the writer's progress
+/// after copying and drop any states that were overwritten meanwhile (only
+/// ever the oldest ones), so they never see torn states.
+///
+class StateRing
+{
+public:
+    /// Per-state fields (see doc/data_header.txt). Frame and sequence counters are stored exactly as doubles.
+    enum Column {
+        FRAME, SEQ, TS, MS, ERR,
+        DR_LAB_X, DR_LAB_Y, DR_LAB_Z,
+        R_LAB_X, R_LAB_Y, R_LAB_Z,
+        W_LAB_X, W_LAB_Y, W_LAB_Z,
+        HEADING, POSX, POSY, INTX, INTY, STEP_DIR, STEP_MAG,
+        NUM_COLUMNS
+    };
+
+    struct State {
+        double v[NUM_COLUMNS];
+        double operator[](Column c) const { return v[c]; }
+        double& operator[](Column c) { return v[c]; }
+    };
+
+    explicit StateRing(size_t capacity);
+    ~StateRing() {}
+
+    StateRing(StateRing const&) = delete;
+    void operator=(StateRing const&) = delete;
+
+    size_t capacity() const { return _cap; }
+
+    /// Number of states pushed so far (ring index of the next state).
+    uint64_t count() const { return _head.load(std::memory_order_acquire); }
+
+    /// Writer only.
+    void push(const State& s);
+
+    /// Index range [first, last) of the states with ts (ms) in [ts0, ts1] or frame counter
+    /// in [frame0, frame1]. Returns false (empty range) if there are none in the ring.
+    bool findTime(double ts0, double ts1, uint64_t& first, uint64_t& last) const { return find(TS, ts0, ts1, first, last); }
+    bool findFrames(double frame0, double frame1, uint64_t& first, uint64_t& last) const { return find(FRAME, frame0, frame1, first, last); }
+
+    /// Copy states [first, last). States no longer in the ring are skipped, and first is
+    /// advanced to the first state copied. Returns the number of states copied.
+    size_t copy(uint64_t& first, uint64_t last, std::vector<State>& out) const;
+    size_t copyColumn(Column c, uint64_t& first, uint64_t last, std::vector<double>& out) const;
+
+private:
+    /// Oldest index that was not being overwritten while reading (call after reading).
+    uint64_t validFrom() const;
+
+    bool find(Column c, double lo, double hi, uint64_t& first, uint64_t& last) const;
+    double at(Column c, uint64_t i) const { return _col[c * _cap + (i % _cap)]; }
+
+private:
+    size_t _cap;
+    std::vector<double> _col;           // NUM_COLUMNS x capacity
+    alignas(64) std::atomic<uint64_t> _head;    // states published
+    alignas(64) std::atomic<uint64_t> _wr;      // states published or being written
+};
@@ -0,0 +1,62 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       TaskGraph.h
+/// \brief      Small dependency graph of one-off tasks (e.g. overlapped startup steps).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>   // unique_ptr
+#include <string>
+#include <vector>
+
+///
+/// Each task runs on its own thread as soon as the tasks it depends on have
+/// succeeded (tasks whose dependencies failed are skipped and fail too). Meant
+/// for a handful of coarse, blocking steps (opening files and devices), not for
+/// data-parallel work (see ThreadPool).
+///
+/// Tasks must only capture state that outlives the graph, or is owned by the
+/// task until waited on. The destructor waits for all tasks.
+///
+class TaskGraph
+{
+public:
+    typedef int Task;
+
+    TaskGraph() {}
+    ~TaskGraph() { waitAll(); }
+
+    TaskGraph(TaskGraph const&) = delete;
+    void operator=(TaskGraph const&) = delete;
+
+    /// Add a task, started once deps have completed. fn returns success.
+    Task add(const std::string& name, std::function<bool()> fn, const std::vector<Task>& deps = {});
+
+    /// Block until task t has completed, returning its success.
+    bool wait(Task t);
+    bool waitAll();
+
+private:
+    void start(Task t);     // _mutex held
+    struct Node;
+    void work(Node* n, Task t);
+
+private:
+    enum State { PENDING, RUNNING, DONE, FAILED };
+    struct Node {
+        std::string name;
+        std::function<bool()> fn;
+        std::vector<Task> deps;
+        State state;
+        std::unique_ptr<std::thread> thread;
+    };
+
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::vector<std::unique_ptr<Node>> _nodes;
+};
@@ -0,0 +1,74 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       TcpRecorder.h
+/// \brief      TCP streaming recorder (server) based on boost::asio.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "RecorderInterface.h"
+
+#include <boost/asio.hpp>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>   // shared_ptr, unique_ptr
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+///
+/// Listens for clients and streams every msg to each connected client, with
+/// TCP_NODELAY set. Writes are asynchronous (own i/o thread), so the caller
+/// never waits on the network. Each client has a bounded queue of msgs not yet
+/// handed to the socket; queued msgs are coalesced into a single write.
+///
+/// When a client's queue is full, either its oldest queued msg is dropped
+/// (default, bounded latency) or writeRecord() blocks until there is space
+/// (lossless, but only while the client keeps up on average). Msgs are never
+/// split, so clients always see whole records.
+///
+class TcpRecorder : public RecorderInterface
+{
+public:
+    TcpRecorder();
+    ~TcpRecorder();
+
+    /// Interface to be overridden by implementations.
+    /// host_port is host:port[@queue_len[:drop|block]], host being the address to listen on.
+    bool openRecord(std::string host_port);
+    bool writeRecord(const std::string& s) { return writeRecord(s.data(), s.size()); }
+    bool writeRecord(const char* data, size_t len);
+    void closeRecord();
+
+private:
+    struct Client {
+        boost::asio::ip::tcp::socket sock;
+        std::string addr;
+        std::deque<std::string> q;      // msgs waiting for the socket
+        std::string inflight;           // i/o thread only
+        bool writing, closed;
+        uint64_t dropped;
+
+        Client(boost::asio::io_service& io) : sock(io), writing(false), closed(false), dropped(0) {}
+    };
+
+    void accept();
+    void send(std::shared_ptr<Client> c);
+
+    std::string _desc;
+    size_t _max_queue;
+    bool _block;
+
+    boost::asio::io_service _io_service;
+    std::unique_ptr<boost::asio::io_service::work> _work;
+    boost::asio::ip::tcp::acceptor _acceptor;
+    std::unique_ptr<std::thread> _thread;
+
+    std::vector<std::shared_ptr<Client>> _clients;
+    std::vector<std::string> _free;     // recycled msg buffers
+    std::mutex _mutex;
+    std::condition_variable _cond;
+};
@@ -16,7 +16,8 @@ public:
 
     /// Interface to be overridden by implementations.
     bool openRecord(std::string ignore = "") { _open = true; return true; }
-    bool writeRecord(std::string s);
+    bool writeRecord(const std::string& s);
+    bool writeRecords(const char* a, size_t na, const char* b, size_t nb);
     void closeRecord() { _open = false; };
 
 private:
@@ -0,0 +1,54 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ThreadPool.h
+/// \brief      Simple persistent pool of worker threads for data-parallel jobs.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>   // unique_ptr
+#include <vector>
+
+///
+/// Runs fn(0..n-1) across a fixed set of worker threads. The calling thread
+/// also takes part, so a pool of size 1 simply runs the job inline.
+///
+/// A pool may be shared between several trackers; concurrent calls to run()
+/// are serialised, so jobs from different callers never interleave. Workers
+/// are only started by the first job that needs them, so an unused pool (e.g.
+/// shared by trackers that never run a global search) costs no threads.
+///
+class ThreadPool
+{
+public:
+    ThreadPool(int nthreads = 0, bool pin = false);   // nthreads <= 0 uses all hardware threads, pin binds worker i to core i
+    ~ThreadPool();
+
+    int size() const { return _size; }
+
+    /// Blocks until all n tasks have completed.
+    void run(int n, const std::function<void(int)>& fn);
+
+private:
+    void start();
+    void process(int core);
+    void work();
+
+private:
+    int _size;
+    bool _pin;
+    std::vector<std::unique_ptr<std::thread>> _workers;
+    std::mutex _mutex, _runMutex;
+    std::condition_variable _startCond, _doneCond;
+
+    const std::function<void(int)>* _fn;
+    int _n, _busy;
+    unsigned int _gen;
+    std::atomic_int _next;
+    bool _kill;
+};
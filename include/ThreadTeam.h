@@ -0,0 +1,55 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ThreadTeam.h
+/// \brief      Small team of spinning worker threads for fine-grained (intra-frame) parallel jobs.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>   // unique_ptr
+#include <vector>
+
+///
+/// Runs fn(0..size()-1), one call per team member, with the calling thread as
+/// member 0. Unlike ThreadPool, workers spin on the job counter for up to
+/// spin_us after each job (spin_us < 0 spins indefinitely) before parking, so
+/// back-to-back jobs (e.g. the ~50 objective evaluations of a frame) cost a
+/// few cache line transfers each rather than a scheduler wake-up per worker.
+///
+/// If the team is already busy (e.g. the pipeline output stage and the
+/// tracking thread both using it), run() simply calls every member's share
+/// on the calling thread, so callers never wait on each other.
+///
+class ThreadTeam
+{
+public:
+    /// nthreads includes the calling thread. Worker i (1..nthreads-1) is pinned to cores[(i - 1) % cores.size()] (if any).
+    ThreadTeam(int nthreads, const std::vector<int>& cores = std::vector<int>(), int spin_us = 100);
+    ~ThreadTeam();
+
+    int size() const { return static_cast<int>(_workers.size()) + 1; }
+
+    /// Blocks until all members have completed.
+    void run(const std::function<void(int)>& fn);
+
+private:
+    void process(int i, int core);
+
+private:
+    std::vector<std::unique_ptr<std::thread>> _workers;
+    const std::function<void(int)>* _fn;
+    int _spin_us;
+
+    alignas(64) std::atomic<unsigned int> _gen;     // job counter (wakes workers)
+    alignas(64) std::atomic_int _pending;           // workers still busy with current job
+    alignas(64) std::atomic_flag _busy = ATOMIC_FLAG_INIT;
+    std::atomic_int _parked;
+    std::atomic_bool _active;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+};
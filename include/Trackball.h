@@ -8,10 +8,25 @@
 
 #include "typesvars.h"
 #include "Localiser.h"
+#include "GlobalLocaliser.h"
+#include "MotionModel.h"
+#include "TiledMap.h"
+#include "DirtyTiles.h"
 #include "CameraModel.h"
+#include "CameraRemap.h"
 #include "Recorder.h"
+#include "BinaryRecord.h"
+#include "Extrapolate.h"
+#include "CompactRecord.h"
+#include "LatencyHist.h"
+#include "StateBuffer.h"
+#include "StateRing.h"
+#include "VideoEncoder.h"
 #include "FrameGrabber.h"
 #include "ConfigParser.h"
+#include "ThreadTeam.h"
+#include "QualityGovernor.h"
+#include "Sidecar.h"
 
 /// OpenCV individual includes required by gcc?
 #include <opencv2/highgui.hpp>
@@ -26,92 +41,152 @@
 #include <atomic>
 #include <deque>
 #include <vector>
+#include <string>
+#include <functional>
+#include <filesystem>
 
 ///
 /// Estimate track ball orientation and update surface map.
 ///
 class Trackball
 {
+    friend class TrackballBench;    // exec/fictrac_bench.cpp
+
 public:
     /// Data.
     struct DATA {
         // trackball state
         unsigned int cnt, seq;
         CmPoint64f dr_roi, r_roi;
-        cv::Mat R_roi;
+        CmMat33d R_roi;
         CmPoint64f dr_cam, r_cam;
-        cv::Mat R_cam;
+        CmMat33d R_cam;
         CmPoint64f dr_lab, r_lab;
-        cv::Mat R_lab;
+        CmMat33d R_lab;
         double ts, ms;
 
         double velx, vely, step_mag, step_dir, intx, inty, heading, posx, posy;
 
+        // motion over the last frame (per ms), for extrapolation (see Extrapolate.h, predictState)
+        CmPoint64f w_lab;
+        double heading_rate, velx_rate, vely_rate;
+
         // testing
         double dist, ang_dist, step_avg, step_var, evals_avg;
 
+        // search quality
+        bool budget_hit;    // search stopped at the opt_budget_ms deadline (best result so far)
+
         // constructors
         DATA()
             : cnt(0), seq(0),
             dr_roi(CmPoint64f(0, 0, 0)), r_roi(CmPoint64f(0, 0, 0)),
             dr_cam(CmPoint64f(0, 0, 0)), r_cam(CmPoint64f(0, 0, 0)),
             dr_lab(CmPoint64f(0, 0, 0)), r_lab(CmPoint64f(0, 0, 0)),
-            ts(-1),
+            ts(-1), ms(0),
             velx(0), vely(0),
             step_mag(0), step_dir(0),
             intx(0), inty(0),
             heading(0), posx(0), posy(0),
+            w_lab(CmPoint64f(0, 0, 0)),
+            heading_rate(0), velx_rate(0), vely_rate(0),
             dist(0), ang_dist(0),
             step_avg(0), step_var(0),
-            evals_avg(0)
-        {
-            R_roi = cv::Mat::eye(3, 3, CV_64F);
-            R_cam = cv::Mat::eye(3, 3, CV_64F);
-            R_lab = cv::Mat::eye(3, 3, CV_64F);
-        }
-
-        DATA(const DATA &d)
-            : cnt(d.cnt), seq(d.seq),
-            dr_roi(d.dr_roi), r_roi(d.r_roi),
-            dr_cam(d.dr_cam), r_cam(d.r_cam),
-            dr_lab(d.dr_lab), r_lab(d.r_lab),
-            ts(d.ts),
-            velx(d.velx), vely(d.vely),
-            step_mag(d.step_mag), step_dir(d.step_dir),
-            intx(d.intx), inty(d.inty),
-            heading(d.heading), posx(d.posx), posy(d.posy),
-            dist(d.dist), ang_dist(d.ang_dist),
-            step_avg(d.step_avg), step_var(d.step_var),
-            evals_avg(d.evals_avg)
-        {
-            R_roi = d.R_roi.clone();
-            R_cam = d.R_cam.clone();
-            R_lab = d.R_lab.clone();
-        }
+            evals_avg(0),
+            budget_hit(false)
+        {}
     };
 
+    ///
+    /// Frame buffers for the output callback. Headers onto FicTrac's own (pooled)
+    /// buffers - only valid during the callback, clone to keep. src_frame is the
+    /// remapped-from source frame, roi_frame the thresholded ROI and sphere_map the
+    /// current map (read-only). With auxiliary cameras (cam_aux), their ROIs are
+    /// stacked below the main camera's ROI in roi_frame.
+    ///
+    struct FrameViews {
+        cv::Mat src_frame, roi_frame, sphere_map;
+    };
+
+    ///
+    /// Called from the tracking thread (output stage if pipelined) for each good
+    /// output frame, after the data has been logged and published. views is null
+    /// unless frame views were requested. Blocks tracking, so keep it short.
+    ///
+    typedef std::function<void(const DATA& data, const FrameViews* views)> FrameCallback;
+
 public:
-    Trackball(std::string cfg_fn);
+    Trackball(std::string cfg_fn, std::shared_ptr<ThreadPool> pool = nullptr, std::string name = "", bool batch = false);
+
+    ///
+    /// Embedded use. Parameters are taken from cfg (not written back or watched),
+    /// frames from source if given (e.g. PushSource), otherwise from src_fn.
+    ///
+    Trackball(const ConfigParser& cfg, std::shared_ptr<FrameSource> source = nullptr,
+        FrameCallback callback = nullptr, bool callback_frames = false,
+        std::shared_ptr<ThreadPool> pool = nullptr, std::string name = "", bool batch = false);
     ~Trackball();
 
     bool isActive() { return _active; }
     void terminate() { _kill = true; }
-    std::shared_ptr<Trackball::DATA> getState();
+    /// Last output frame state. Lock-free and allocation-free, may be polled from any thread.
+    DATA getState() const { return _state.read(); }
+    /// Last output frame state advanced from its capture time (ts) to ts (same clock), see Extrapolate.h.
+    DATA predictState(double ts, double max_dt = extrap::MAX_DT_MS_DEFAULT) const;
+    /// History of the last state_ring_len output states (null if disabled), may be queried from any thread.
+    const StateRing* getStateRing() const { return _state_ring.get(); }
     void dumpStats();
     bool writeTemplate(std::string fn = "");
 
 private:
+    Trackball(std::shared_ptr<ThreadPool> pool, std::string name);
+    void init(std::shared_ptr<FrameSource> source, bool batch);
+
+    ///
+    /// Auxiliary cameras (cam_aux) viewing the same ball. Each has its own
+    /// source, camera model, sphere ROI and c2a transform (from its own config
+    /// file) and its own grabber, so preprocessing runs in parallel. Its valid
+    /// ROI pixels are appended to _roi_pix, with view vectors rotated into the
+    /// main camera's ROI frame and indices into its slot of the stacked ROI
+    /// frame, so all cameras are scored and mapped jointly against one map.
+    /// Frames are paired by timestamp: each main frame uses the aux frame within
+    /// _aux_sync_ms of it, older aux frames are dropped, and main frames with no
+    /// match (aux camera ahead) are skipped.
+    ///
+    struct AuxCamera {
+        std::string cfg_fn;
+        std::shared_ptr<FrameSource> source;
+        CameraModelPtr src_model, roi_model;
+        CameraRemapPtr remapper;
+        cv::Mat roi_mask;
+        std::unique_ptr<FrameGrabber> grabber;
+        cv::Mat src_frame, roi_frame;
+        double ts, ms;
+        bool pending;                   // frame grabbed but not yet paired with a main frame
+        int npix;
+    };
+    bool initAuxCamera(const std::string& cfg_fn, int slot, const CmPoint64f& roi_to_cam_r, AuxCamera& cam);
+    bool grabAux(bool& matched);
+    std::vector<std::unique_ptr<AuxCamera>> _aux;
+    double _aux_sync_ms;                // max main/aux frame timestamp difference (cam_aux_sync)
+    cv::Mat _roi_joint;                 // main and aux ROI frames, stacked (copy on write)
+
     /// Worker function.
     void process();
 
-    void resetData();
+    void resetData(DATA& data);
     void reset();
     double testRotation(const double x[3]);
     virtual double objective(unsigned n, const double* x, double* grad) { return testRotation(x); }
     bool doSearch(bool allow_global);
-    void updateSphere();
-    void updatePath();
-    bool logData();
+    void updateSphere(const CmMat33d& R_roi, const cv::Mat& roi_frame, cv::Mat& sphere_map);
+    template <typename Proj, typename Pix>
+    void updateSphereT(const Proj& proj, const std::vector<Pix>& roi_pix, const double m[9], const cv::Mat& roi_frame, cv::Mat& sphere_map, TiledMap* tiles);
+    static double roiView(const RoiPixel& p, int i) { return p.v[i]; }
+    static float roiView(const RoiPixelF& p, int i) { return (&p.x)[i]; }
+    void updatePath(DATA& data, bool reset);
+    bool logData(const DATA& data, double err);
+    void pushState(const DATA& data, double err);
 
 private:
     /// Drawing
@@ -119,24 +194,46 @@ private:
         unsigned int log_frame;
         cv::Mat src_frame, roi_frame, sphere_view, sphere_map;
         CmPoint64f dr_roi;
-        cv::Mat R_roi;
-        std::deque<cv::Mat> R_roi_hist;
-        std::deque<CmPoint64f> pos_heading_hist;
+        CmMat33d R_roi;
+        bool hist_reset;                        // clear draw histories before appending
+        std::vector<CmMat33d> R_roi_new;        // history entries since the previous snapshot
+        std::vector<CmPoint64f> pos_heading_new;
     };
 
+    void packageDrawData(const DATA& data, const cv::Mat& src_frame, const cv::Mat& roi_frame, const cv::Mat& sphere_map);
     bool updateCanvasAsync(std::shared_ptr<DrawData> data);
     void processDrawQ();
     void drawCanvas(std::shared_ptr<DrawData> data);
+    void drawPath(const std::vector<CmPoint64f>& pos_heading_new, bool reset);
 
     std::vector<std::shared_ptr<DrawData>> _drawQ;
     std::mutex _drawMutex;
     std::condition_variable _drawCond;
+    bool _drawIdle;                     // draw thread is waiting for data (snapshots are only built then)
 
     bool _do_display, _save_raw, _save_debug;
-    cv::Mat _sphere_view;
-    std::deque<cv::Mat> _R_roi_hist;
-    std::deque<CmPoint64f> _pos_heading_hist;
-    cv::VideoWriter _debug_vid, _raw_vid;
+    cv::Mat _sphere_view, _sphere_view_spare;   // written alternately while a snapshot holds the other
+    cv::Mat _draw_map;                  // draw snapshot of the sphere map (updated incrementally)
+    uint64_t _draw_map_ver;
+    std::vector<CmMat33d> _R_roi_new;        // history not yet handed to the draw thread
+    std::vector<CmPoint64f> _pos_heading_new;
+    bool _draw_hist_reset;
+    double _disp_period;                    // ms between display refreshes (0 = as fast as possible)
+    std::unique_ptr<VideoEncoder> _debug_vid, _raw_vid;
+    std::string _win_name;
+
+    /// Draw thread state. Histories are appended incrementally from snapshots;
+    /// the path cell is only fully redrawn when its view has to change.
+    cv::Mat _canvas, _draw_path;
+    std::deque<CmPoint64f> _draw_sphere_hist;  // R^T.up for each historic orientation R
+    std::deque<CmPoint64f> _draw_path_hist;
+    double _path_minx, _path_maxx, _path_miny, _path_maxy;    // current path cell view
+    int _path_trimmed;                      // points dropped since the last full path redraw
+    CameraModelPtr _draw_camera;            // source cell view (created on first draw)
+    CameraRemapPtr _draw_remapper;
+    cv::Mat _draw_mapX, _draw_mapY;         // sphere warp maps (previous -> current ROI)
+    cv::Mat _draw_prev_roi, _draw_warp_roi, _draw_diff_roi;
+    cv::Mat _draw_resize_roi, _draw_resize_diff, _draw_resize_view, _draw_resize_map;
 
     std::unique_ptr<std::thread> _drawThread;
 
@@ -147,13 +244,18 @@ private:
     CameraModelPtr _src_model, _roi_model, _sphere_model;
     RemapTransformPtr _cam_to_roi;
     cv::Mat _roi_to_cam_R, _cam_to_lab_R;
-    std::shared_ptr<std::vector<double>> _p1s_lut;
+    CmMat33d _cam_to_lab;              // copy of _cam_to_lab_R for per-frame use
+    std::shared_ptr<std::vector<RoiPixel>> _roi_pix;   // valid ROI pixels and view vectors (all cameras)
+    std::shared_ptr<std::vector<RoiPixel>> _roi_pix_main;  // main camera only (same as _roi_pix without cam_aux)
+    std::vector<RoiPixelF> _roi_pix_f;                  // single precision copy (opt_float), else empty
 
     /// Arrays.
     int _map_w, _map_h;
     int _roi_w, _roi_h;
     cv::Mat _src_frame, _roi_frame, _roi_mask;
     cv::Mat _sphere_map, _sphere_template;
+    std::unique_ptr<TiledMap> _sphere_tiles;    // tiled mirror of _sphere_map used for matching (map_tiled)
+    std::unique_ptr<DirtyTiles> _map_dirty;     // changed regions of the map written by updateSphere
 
     /// Sphere vars.
     double _sphere_rad, _r_d_ratio;
@@ -161,22 +263,133 @@ private:
     
     /// Optimisation.
     std::unique_ptr<Localiser> _localOpt, _globalOpt;
+    std::unique_ptr<GlobalLocaliser> _globalGrid;
+    std::shared_ptr<ThreadPool> _pool;      // shared worker pool (multi-tracker), may be null
+    std::unique_ptr<ThreadTeam> _team;      // intra-frame scoring/map update team (opt_team_threads), may be null
+    std::vector<int> _upd_idx;              // map offset per ROI pixel (parallel map update), -1 if outside map
     double _error_thresh, _err;
     bool _do_global_search;
+    bool _global_first;                     // global search pending for the first frame only (opt_global_first)
     int _max_bad_frames;
     int _nevals;
+    double _opt_bound, _opt_tol;
+    std::unique_ptr<MotionModel> _motion;   // seeds local search (guess and search box)
+    unsigned long long _opt_retries;        // searches repeated with the full bound
+
+    /// Recovery tier (opt_recover). Bad local results try a few cheap hypotheses
+    /// before escalating to the global search.
+    bool recoverSearch(const CmPoint64f& guess);
+    void buildRecoverSet();
+    bool _opt_recover;
+    std::vector<double> _recover_set;       // discrete relative rotations (3 values each)
+    CmPoint64f _last_good_dr;
+    unsigned long long _opt_recoveries;     // bad local results recovered without a global search
+    double _opt_budget;                     // per-frame local search time budget (ms, 0 if unlimited)
+    unsigned long long _opt_overruns;       // searches stopped at the time budget
+
+    /// Quality governor (quality_gov), steps down work when falling behind.
+    void applyQuality(int level);
+    std::unique_ptr<QualityGovernor> _governor;
+    int _opt_max_evals;                     // configured values (level 0)
+    bool _opt_early_exit;
+    bool _opt_grad;                         // gradient based local search (no early exit)
+    std::atomic_int _draw_every;            // display every n'th frame
 
     /// Program.
     bool _init, _reset, _clean_map;
+    bool _batch;                        // headless, as-fast-as-possible offline processing
+    unsigned int _cnt_offset;           // frame_start (added to output frame counters)
+
+    /// Frame-to-frame state (path integration, motion rates, log timestamps).
+    double _prev_heading, _prev_path_ts, _prev_log_ts;
+    double _prev_t6, _prev_ts, _fps_avg;    // frame rate report (negative until the first frame)
+
+    /// Live parameter changes (cfg_reload). The config file is polled from the
+    /// tracking thread and changes are applied between frames.
+    void checkReload(double ts);
+    void reloadParams();
+    bool _cfg_reload;
+    bool _cfg_sidecar;                  // binary sidecars for template/ignore polygons (see Sidecar.h)
+    std::string _cfg_fn;
+    std::filesystem::file_time_type _cfg_mtime;
+    double _cfg_check_ts;
+
+private:
+    /// Pipelined tracking.
+    /// The search stage (process) localises frame N+1 against _sphere_map while
+    /// the output stage (processPipe) integrates frame N into _sphere_map_work,
+    /// updates the path and logs. At most one frame is in flight, so the map
+    /// used for matching lags the integrated map by at most one tracked frame.
+    struct PipeJob {
+        DATA data;                      // search result (orientation, cnt/seq, timestamps)
+        cv::Mat src_frame, roi_frame;
+        double err;
+        bool good;
+    };
+
+    void processPipe();
+    void runPipeJob(std::shared_ptr<PipeJob> job);
+    void pushPipeJob(std::shared_ptr<PipeJob> job);
+    void waitPipeIdle();
+    void syncSphereMap();
+
+    bool _do_pipeline;
+    DATA _pipe_data;                    // output stage state (path integration)
+    cv::Mat _sphere_map_work;           // map written by the output stage
+    unsigned int _map_ver, _map_ver_sync;
+    uint64_t _map_dirty_sync;           // _map_dirty version of _sphere_map
+    std::shared_ptr<PipeJob> _pipeJob;
+    bool _pipeBusy, _pipeStop;
+    std::mutex _pipeMutex, _pipeMapMutex;
+    std::condition_variable _pipeCond;
+    std::unique_ptr<std::thread> _pipeThread;
+
+    /// Checkpointing (ckpt_period). The thread writing the map snapshots it (changed
+    /// tiles only) together with the orientation, _ckptThread writes it to disk, and
+    /// the next launch warm starts from it.
+    void checkpoint(const DATA& data, const cv::Mat& sphere_map);
+    void processCheckpoints();
+    bool loadCheckpoint();
+
+    double _ckpt_period, _ckpt_last;    // s, ms
+    std::string _ckpt_fn;
+    uint64_t _ckpt_key;                 // map size and ROI geometry the checkpoint is valid for
+    sidecar::Checkpoint _ckpt;          // owned by _ckptThread while _ckptPending
+    uint64_t _ckpt_map_ver;             // _map_dirty version of _ckpt.map
+    bool _ckptPending, _ckptStop;
+    std::mutex _ckptMutex;
+    std::condition_variable _ckptCond;
+    std::unique_ptr<std::thread> _ckptThread;
+
+    /// Instrumentation.
+    /// Stage timings (ms) and per-frame counters are binned into cumulative
+    /// histograms (reported by dumpStats) and interval histograms (reported
+    /// and cleared every stats_period seconds).
+    enum StatId { ST_GRAB, ST_OPT, ST_MAP, ST_PATH, ST_LOG, ST_DISP, ST_FRAME, ST_CAM_OUT, ST_EVALS, ST_QUEUE, ST_BOUND, ST_CAM_SOCK, NUM_STATS };
+    void recordStat(StatId id, double v);
+    void dumpLatency(bool interval);
+
+    std::unique_ptr<LatencyHist> _hist[NUM_STATS], _hist_int[NUM_STATS];
+    double _stats_period;               // s (0 = no periodic dumps)
+    bool _stats_sock, _live_src;
 
     /// Data
     DATA _data;
+    StateBuffer<DATA> _state;           // published after each output frame (see getState)
+    std::unique_ptr<StateRing> _state_ring;     // recent output states (see getStateRing)
+    FrameCallback _callback;            // in-process output (may be null)
+    bool _callback_frames;
 
     /// Data i/o.
     std::string _base_fn;
     std::unique_ptr<FrameGrabber> _frameGrabber;
-    bool _do_sock_output, _do_com_output;
-    std::unique_ptr<Recorder> _data_log, _data_sock, _data_com, _vid_frames;
+    bool _do_sock_output, _do_com_output, _do_shm_output;
+    bool _bin_log, _bin_sock, _bin_com;     // BinaryRecord (rather than CSV) output
+    bool _compact_com;                      // CompactRecord serial output
+    uint16_t _com_fields;
+    double _com_period, _com_next_ts;       // ms, serial output decimation (com_rate)
+    std::vector<uint8_t> _com_buf;
+    std::unique_ptr<Recorder> _data_log, _data_sock, _data_com, _data_shm, _vid_frames, _raw_frames;
 
     /// Thread stuff.
     std::atomic_bool _active, _kill, _do_reset;
@@ -0,0 +1,72 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       VideoEncoder.h
+/// \brief      Threaded video writer with a bounded frame queue.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#pragma once
+
+#include "SPSCRing.h"
+#include "FrameDump.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+#include <memory>   // unique_ptr
+#include <thread>
+#include <atomic>
+
+///
+/// Encodes frames on its own thread, so the producer never waits on the codec.
+/// Frames are queued by reference (no copy) - the producer must not modify a
+/// queued frame, e.g. check the Mat refcount before reusing its buffer.
+///
+/// Exactly one thread may call write(). Either it waits for queue space (no
+/// frames are lost), or full-queue frames are dropped and counted.
+///
+/// Frames go either to a cv::VideoWriter or, for lossless recording, to a
+/// frame dump (see FrameDump.h; colour frames are converted to Mono8 on the
+/// encoder thread).
+///
+class VideoEncoder
+{
+public:
+    explicit VideoEncoder(size_t queue_len = 8);
+    ~VideoEncoder();
+
+    /// threads > 0 requests that many encoder threads (FFmpeg backend), hw_accel a hardware encoder (OpenCV >= 4.5.2).
+    bool open(const std::string& fn, int fourcc, double fps, cv::Size size, bool is_color = true, int threads = 0, bool hw_accel = false);
+    bool openDump(const std::string& fn, double fps, cv::Size size);
+    bool isOpened() const { return _open; }
+
+    /// Queue frame for encoding. Returns false if the frame was dropped (only if !block).
+    bool write(const cv::Mat& frame, bool block = true) { return write(frame, 0, 0, block); }
+
+    /// As above, with source timestamps (stored by frame dumps).
+    bool write(const cv::Mat& frame, double timestamp, double ms_since_midnight, bool block = true);
+
+    /// Encode outstanding frames and close the file.
+    void close();
+
+    size_t getQueueDepth() const { return _q.size(); }
+    unsigned long long getWritten() const { return _written; }
+    unsigned long long getDropped() const { return _dropped; }
+
+private:
+    bool start();
+    void process();
+
+private:
+    struct Frame {
+        cv::Mat img;
+        double timestamp, ms_since_midnight;
+    };
+
+    cv::VideoWriter _writer;
+    std::unique_ptr<FrameDumpWriter> _dump;
+    cv::Mat _grey;      // encoder thread only
+    SPSCRing<Frame> _q;
+    std::atomic_bool _open, _active;
+    std::atomic<unsigned long long> _written, _dropped;
+    std::unique_ptr<std::thread> _thread;
+};
@@ -6,6 +6,11 @@
 
 #pragma once
 
+#include <functional>   // bind
+#include <memory>       // shared_ptr, unique_ptr
+#include <thread>
+#include <vector>
+
 ///
 /// Helper function to force getchar to take new key press.
 ///
@@ -22,3 +27,64 @@ bool SetProcessHighPriority();
 bool SetThreadVeryHighPriority();
 bool SetThreadHighPriority();
 bool SetThreadNormalPriority();
+
+///
+/// Pin calling thread to a single CPU core.
+///
+bool SetThreadAffinity(int core);
+bool SetThreadAffinity(const std::vector<int>& cores);   // any of cores (empty = no change)
+
+///
+/// Real-time (SCHED_FIFO on Linux, time critical on Windows) scheduling for the
+/// calling thread. prio_offset is subtracted from the maximum priority.
+///
+bool SetThreadRealtime(int prio_offset = 0);
+
+///
+/// Lock current and future process memory into RAM (Linux only).
+///
+bool LockProcessMemory();
+
+///
+/// Placement of each class of worker thread. Set by each tracker (before its
+/// threads are started) on the calling thread, and applied by each worker at
+/// startup via ApplyThreadClass(). Threads started with StartThread() inherit
+/// the placement of the thread that started them, so several trackers in one
+/// process each keep their own settings.
+///
+enum class ThreadClass { GRAB, TRACK, DRAW, IO, NUM };
+struct ThreadPlacement;
+typedef std::shared_ptr<const ThreadPlacement> ThreadPlacementPtr;
+
+void SetThreadClassConfig(ThreadClass c, const std::vector<int>& cores, bool realtime);
+bool ApplyThreadClass(ThreadClass c);
+std::vector<int> GetThreadClassCores(ThreadClass c);
+ThreadPlacementPtr GetThreadPlacement();            // calling thread's placement (may be null)
+void SetThreadPlacement(ThreadPlacementPtr place);
+
+///
+/// Start a thread running f(args...) with the calling thread's placement.
+///
+template <typename F, typename... Args>
+std::unique_ptr<std::thread> StartThread(F&& f, Args&&... args)
+{
+    return std::make_unique<std::thread>([place = GetThreadPlacement(), fn = std::bind(std::forward<F>(f), std::forward<Args>(args)...)]() mutable {
+        SetThreadPlacement(place);
+        fn();
+    });
+}
+
+///
+/// Pins the calling thread to cores for the lifetime of the object, then
+/// restores the previous affinity. Buffers allocated and first written within
+/// the scope are placed on the NUMA node of those cores (first touch).
+///
+class ScopedThreadAffinity
+{
+public:
+    ScopedThreadAffinity(const std::vector<int>& cores);
+    ~ScopedThreadAffinity();
+private:
+    bool _set;
+    std::vector<unsigned char> _prev;   // saved affinity (platform mask)
+};
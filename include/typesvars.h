@@ -15,3 +15,21 @@ const CmReal CM_PI   = 3.14159265358979323846;
 const CmReal CM_PI_2 = 1.57079632679489661923;
 const CmReal CM_R2D  = 180.0 / CM_PI;
 const CmReal CM_D2R  = CM_PI / 180.0;
+
+///
+/// Valid (sphere) ROI pixel and its corresponding unit view vector (sphere coords).
+///
+struct RoiPixel
+{
+    int idx;        // ROI pixel index (i * roi_w + j)
+    CmPoint64f v;
+};
+
+///
+/// Single precision RoiPixel (opt_float), half the size.
+///
+struct RoiPixelF
+{
+    float x, y, z;
+    int idx;
+};
@@ -17,14 +17,30 @@ using namespace std;
 using namespace cv;
 using namespace Pylon;
 
-BaslerSource::BaslerSource(int index)
+///
+/// Native 8 bit formats that can be passed through without conversion.
+///
+static bool nativeFormat(EPixelType type, BAYER_TYPE& bayer)
+{
+    switch (type) {
+    case PixelType_Mono8:       bayer = BAYER_NONE; return true;
+    case PixelType_BayerRG8:    bayer = BAYER_RGGB; return true;
+    case PixelType_BayerGR8:    bayer = BAYER_GRBG; return true;
+    case PixelType_BayerGB8:    bayer = BAYER_GBRG; return true;
+    case PixelType_BayerBG8:    bayer = BAYER_BGGR; return true;
+    default:                    return false;
+    }
+}
+
+BaslerSource::BaslerSource(int index, bool native, int nbufs)
+    : _native(native)
 {
     try {
         PylonInitialize();
         // create an instant camera object
         _cam.Attach(CTlFactory::GetInstance().CreateFirstDevice());
 
-        LOG("Opening Basler camera device: %s", _cam.GetDeviceInfo().GetModelName());
+        LOG("Opening Basler camera device: %s", _cam.GetDeviceInfo().GetModelName().c_str());
 
         // Allow all the names in the namespace GenApi to be used without qualification.
         using namespace GenApi;
@@ -32,8 +48,14 @@ BaslerSource::BaslerSource(int index)
         // Get the camera control object.
         INodeMap &control = _cam.GetNodeMap();
 
+        // Driver buffers in flight (frames are delivered oldest first, overruns show up as block ID gaps)
+        if (nbufs > 0) {
+            _cam.MaxNumBuffer.SetValue(nbufs);
+            LOG_DBG("Stream buffer count set to %d.", nbufs);
+        }
+
         // Start acquisition
-        _cam.StartGrabbing();
+        _cam.StartGrabbing(GrabStrategy_OneByOne);
 
         // Get some params
         const CIntegerPtr camWidth = control.GetNode("Width");
@@ -44,6 +66,9 @@ BaslerSource::BaslerSource(int index)
         _fps = getFPS();
 
         LOG("Basler camera initialised (%dx%d @ %.3f fps)!", _width, _height, _fps);
+        if (_native) {
+            LOG("Capturing native (Mono8/Bayer) frames where supported by the camera pixel format.");
+        }
 
 
         _open = true;
@@ -97,28 +122,237 @@ bool BaslerSource::setFPS(double fps)
     return ret;
 }
 
+///
+/// Grabbing is restarted to apply the new window.
+///
+bool BaslerSource::setAOI(int& x, int& y, int& w, int& h, int& bin)
+{
+    using namespace GenApi;
+
+    if (!_open || (bin < 1) || (w <= 0) || (h <= 0)) { return false; }
+
+    bool ret = false;
+    try {
+        releaseBuffer();
+        _cam.StopGrabbing();
+
+        INodeMap &control = _cam.GetNodeMap();
+        const CIntegerPtr camWidth = control.GetNode("Width");
+        const CIntegerPtr camHeight = control.GetNode("Height");
+        const CIntegerPtr camOffsetX = control.GetNode("OffsetX");
+        const CIntegerPtr camOffsetY = control.GetNode("OffsetY");
+        const CIntegerPtr camBinH = control.GetNode("BinningHorizontal");
+        const CIntegerPtr camBinV = control.GetNode("BinningVertical");
+
+        /// Binning first, so size/offset limits are in binned pixels.
+        if (bin > 1) {
+            if (IsWritable(camBinH) && IsWritable(camBinV)) {
+                camBinH->SetValue(bin);
+                camBinV->SetValue(bin);
+            } else {
+                LOG_WRN("Warning! Camera does not support binning.");
+            }
+        }
+        bin = IsReadable(camBinH) ? max(1, static_cast<int>(camBinH->GetValue())) : 1;
+
+        camOffsetX->SetValue(0);
+        camOffsetY->SetValue(0);
+        int bx = x / bin, by = y / bin, bw = (x + w + bin - 1) / bin - bx, bh = (y + h + bin - 1) / bin - by;
+        alignAOI(bx, bw, static_cast<int>(camOffsetX->GetInc()), static_cast<int>(camWidth->GetInc()), static_cast<int>(camWidth->GetMax()));
+        alignAOI(by, bh, static_cast<int>(camOffsetY->GetInc()), static_cast<int>(camHeight->GetInc()), static_cast<int>(camHeight->GetMax()));
+        camWidth->SetValue(bw);
+        camHeight->SetValue(bh);
+        camOffsetX->SetValue(bx);
+        camOffsetY->SetValue(by);
+
+        x = bx * bin;
+        y = by * bin;
+        w = bw * bin;
+        h = bh * bin;
+        ret = true;
+    }
+    catch (const GenericException &e) {
+        LOG_ERR("Error setting camera AOI! Error was: %s", e.GetDescription());
+    }
+
+    try {
+        _cam.StartGrabbing(GrabStrategy_OneByOne);
+        INodeMap &control = _cam.GetNodeMap();
+        const CIntegerPtr camWidth = control.GetNode("Width");
+        const CIntegerPtr camHeight = control.GetNode("Height");
+        _width = camWidth->GetValue();
+        _height = camHeight->GetValue();
+    }
+    catch (const GenericException &e) {
+        LOG_ERR("Error restarting acquisition! Error was: %s", e.GetDescription());
+        _open = false;
+        return false;
+    }
+
+    if (ret) {
+        _fps = getFPS();
+        LOG("Camera AOI set to %dx%d+%d+%d (bin %d) - frames are now %dx%d @ %.3f fps.", w, h, x, y, bin, _width, _height, _fps);
+    }
+    return ret;
+}
+
+///
+/// Float feature nodes (first of names that exists).
+///
+static GenApi::CFloatPtr floatNode(GenApi::INodeMap& control, std::initializer_list<const char*> names)
+{
+    for (auto n : names) {
+        GenApi::CFloatPtr p = control.GetNode(n);
+        if (GenApi::IsAvailable(p)) { return p; }
+    }
+    return GenApi::CFloatPtr();
+}
+
+///
+/// Switch off an auto feature (e.g. ExposureAuto) if present.
+///
+static void autoOff(GenApi::INodeMap& control, const char* name)
+{
+    GenApi::CEnumerationPtr p = control.GetNode(name);
+    if (GenApi::IsWritable(p)) { p->FromString("Off"); }
+}
+
+bool BaslerSource::getExposure(double& us, double& min_us, double& max_us)
+{
+    if (!_open) { return false; }
+    try {
+        GenApi::CFloatPtr p = floatNode(_cam.GetNodeMap(), { "ExposureTime", "ExposureTimeAbs" });
+        if (!GenApi::IsReadable(p)) { return false; }
+        us = p->GetValue();
+        min_us = p->GetMin();
+        max_us = p->GetMax();
+        return true;
+    }
+    catch (const GenericException &e) {
+        LOG_ERR("Error reading camera exposure! Error was: %s", e.GetDescription());
+    }
+    return false;
+}
+
+bool BaslerSource::setExposure(double& us)
+{
+    if (!_open) { return false; }
+    try {
+        GenApi::INodeMap &control = _cam.GetNodeMap();
+        autoOff(control, "ExposureAuto");
+        GenApi::CFloatPtr p = floatNode(control, { "ExposureTime", "ExposureTimeAbs" });
+        if (!GenApi::IsWritable(p)) { return false; }
+        p->SetValue(max(p->GetMin(), min(p->GetMax(), us)));
+        us = p->GetValue();
+        return true;
+    }
+    catch (const GenericException &e) {
+        LOG_ERR("Error setting camera exposure! Error was: %s", e.GetDescription());
+    }
+    return false;
+}
+
+bool BaslerSource::getGain(double& db, double& min_db, double& max_db)
+{
+    if (!_open) { return false; }
+    try {
+        GenApi::CFloatPtr p = floatNode(_cam.GetNodeMap(), { "Gain", "GainAbs" });
+        if (!GenApi::IsReadable(p)) { return false; }
+        db = p->GetValue();
+        min_db = p->GetMin();
+        max_db = p->GetMax();
+        return true;
+    }
+    catch (const GenericException &e) {
+        LOG_ERR("Error reading camera gain! Error was: %s", e.GetDescription());
+    }
+    return false;
+}
+
+bool BaslerSource::setGain(double& db)
+{
+    if (!_open) { return false; }
+    try {
+        GenApi::INodeMap &control = _cam.GetNodeMap();
+        autoOff(control, "GainAuto");
+        GenApi::CFloatPtr p = floatNode(control, { "Gain", "GainAbs" });
+        if (!GenApi::IsWritable(p)) { return false; }
+        p->SetValue(max(p->GetMin(), min(p->GetMax(), db)));
+        db = p->GetValue();
+        return true;
+    }
+    catch (const GenericException &e) {
+        LOG_ERR("Error setting camera gain! Error was: %s", e.GetDescription());
+    }
+    return false;
+}
+
+///
+/// Periodically latch device clock against the host clock.
+///
+void BaslerSource::syncClock()
+{
+    using namespace GenApi;
+
+    double t0 = ts_ms();
+    if (!_clock.latchDue(t0)) { return; }
+
+    try {
+        INodeMap &control = _cam.GetNodeMap();
+        const CCommandPtr camLatch = control.GetNode("TimestampLatch");
+        const CIntegerPtr camLatchValue = control.GetNode("TimestampLatchValue");
+        if (!IsWritable(camLatch) || !IsReadable(camLatchValue)) {
+            LOG_WRN("Warning! Camera does not support timestamp latching - estimating clock offset from frame arrival times.");
+            _clock.latchFailed();
+            return;
+        }
+        camLatch->Execute();
+        double t1 = ts_ms();
+        _clock.addLatch(camLatchValue->GetValue() * 1e-6, t0, t1);
+    }
+    catch (const GenericException &e) {
+        LOG_WRN("Warning! Unable to latch camera timestamp (%s) - estimating clock offset from frame arrival times.", e.GetDescription());
+        _clock.latchFailed();
+    }
+}
+
 bool BaslerSource::grab(cv::Mat& frame)
+{
+    Mat buf;
+    if (!grabBuffer(buf)) { return false; }
+    buf.copyTo(frame);
+    releaseBuffer();
+    return true;
+}
+
+///
+/// Frame wraps converted Pylon image (or native grab result) until releaseBuffer() (or next grab).
+///
+bool BaslerSource::grabBuffer(cv::Mat& frame)
 {
     if (!_open) { return false; }
 
+    releaseBuffer();
+
     // Set grab timeout
     long int timeout = _fps > 0 ? max(static_cast<long int>(1000), static_cast<long int>(1000. / _fps)) : 1000; // set capture timeout to at least 1000 ms
     try {
         _cam.RetrieveResult(timeout, _ptrGrabResult, TimeoutHandling_ThrowException);
         double ts = ts_ms();    // backup, in case the device timestamp is junk
-        //_timestamp = pgr_image->GetTimeStamp();   // TODO: extract timestamp
+        double msm = ms_since_midnight();
+        countFrameId(_ptrGrabResult->GetBlockID());
         if (!_ptrGrabResult->GrabSucceeded()) {
+            _nincomplete.fetch_add(1, memory_order_relaxed);
             LOG_ERR("Error! Image capture failed (%d: %s).", _ptrGrabResult->GetErrorCode(), _ptrGrabResult->GetErrorDescription().c_str());
             // release the original image pointer
             _ptrGrabResult.Release();
             return false;
         }
-        else { // TODO: no getNumChannels method found, use GetPixelType() instead.
-            LOG_DBG("Frame captured %dx%dx%d @ %f (%f)", _ptrGrabResult->GetWidth(), _ptrGrabResult->GetHeight(), _ptrGrabResult->GetPixelType(), _timestamp, ts);
-        }
-        if (_timestamp <= 0) {
-            _timestamp = ts;
-        }
+
+        // Device timestamp (ns ticks on USB3 cameras) on host clock
+        syncClock();
+        setDeviceTimestamp(_ptrGrabResult->GetTimeStamp() * 1e-6, ts, msm);
+        LOG_DBG("Frame captured %dx%dx%d @ %f (%f)", _ptrGrabResult->GetWidth(), _ptrGrabResult->GetHeight(), _ptrGrabResult->GetPixelType(), _timestamp, ts);
     }
     catch (const GenericException &e) {
         LOG_ERR("Error grabbing frame! Error was: %s", e.GetDescription());
@@ -128,12 +362,21 @@ bool BaslerSource::grab(cv::Mat& frame)
     }
 
     try {
+        // Pass native frame through (grab result held until releaseBuffer)
+        BAYER_TYPE bayer = BAYER_NONE;
+        if (_native && nativeFormat(_ptrGrabResult->GetPixelType(), bayer)) {
+            _bayerType = bayer;
+            size_t step = _ptrGrabResult->GetWidth() + _ptrGrabResult->GetPaddingX();
+            frame = Mat(_height, _width, CV_8UC1, (uint8_t*)_ptrGrabResult->GetBuffer(), step);
+            return true;
+        }
+        _bayerType = BAYER_NONE;
+
         // Convert image
         Pylon::CImageFormatConverter formatConverter;
         formatConverter.Convert(_pylonImg, _ptrGrabResult);
 
-        Mat tmp(_height, _width, CV_8UC3, (uint8_t*)_pylonImg.GetBuffer()); 
-        tmp.copyTo(frame);
+        frame = Mat(_height, _width, CV_8UC3, (uint8_t*)_pylonImg.GetBuffer());
 
         // release the original image pointer
         _ptrGrabResult.Release();
@@ -148,4 +391,15 @@ bool BaslerSource::grab(cv::Mat& frame)
     return true;
 }
 
+///
+///
+///
+void BaslerSource::releaseBuffer()
+{
+    if (_ptrGrabResult.IsValid()) {
+        _ptrGrabResult.Release();   // return buffer to the grab engine
+    }
+    // converted buffer is reused by next conversion
+}
+
 #endif // BASLER_USB3
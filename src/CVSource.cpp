@@ -16,15 +16,57 @@
 #include <opencv2/videoio.hpp>
 
 #include <exception>
+#include <vector>
 
 using cv::Mat;
 
+/// VideoCapture open params (incl. CAP_PROP_HW_ACCELERATION) were added in OpenCV 4.5.2.
+#if (CV_VERSION_MAJOR > 4) || ((CV_VERSION_MAJOR == 4) && ((CV_VERSION_MINOR > 5) || ((CV_VERSION_MINOR == 5) && (CV_VERSION_REVISION >= 2))))
+#define CV_HAS_HW_DECODE
+#endif
+
+///
+/// Open video file, trying a greyscale (luma only) GStreamer pipeline and/or hardware decode first if requested.
+///
+static std::shared_ptr<cv::VideoCapture> openVideo(const std::string& input, bool hw_decode, bool& grey)
+{
+    std::shared_ptr<cv::VideoCapture> cap;
+
+    if (grey) {
+        // decodebin picks hardware decoders (VA-API, NVDEC, ..) where installed; GRAY8 conversion just keeps the Y plane
+        std::string pipeline = "filesrc location=\"" + input + "\" ! decodebin ! videoconvert ! video/x-raw,format=GRAY8 ! appsink sync=false";
+        cap = std::make_shared<cv::VideoCapture>(pipeline, cv::CAP_GSTREAMER);
+        if (cap->isOpened()) {
+            LOG("Using greyscale decode (GStreamer).");
+            return cap;
+        }
+        LOG_WRN("Warning! Greyscale decode unavailable (requires OpenCV with GStreamer) - using default decode.");
+        grey = false;
+    }
+
+    if (hw_decode) {
+#ifdef CV_HAS_HW_DECODE
+        std::vector<int> params = { cv::CAP_PROP_HW_ACCELERATION, cv::VIDEO_ACCELERATION_ANY };
+        cap = std::make_shared<cv::VideoCapture>(input, cv::CAP_ANY, params);
+        if (cap->isOpened() && (cap->get(cv::CAP_PROP_HW_ACCELERATION) != cv::VIDEO_ACCELERATION_NONE)) {
+            LOG("Using hardware accelerated decode (type %d).", static_cast<int>(cap->get(cv::CAP_PROP_HW_ACCELERATION)));
+            return cap;
+        }
+        LOG_WRN("Warning! Hardware accelerated decode unavailable - using software decode.");
+#else
+        LOG_WRN("Warning! Hardware accelerated decode requires OpenCV >= 4.5.2 - using software decode.");
+#endif
+    }
+
+    return std::make_shared<cv::VideoCapture>(input);
+}
+
 
 ///
 /// Constructor.
 ///
-CVSource::CVSource(std::string input)
-    : _is_image(false)
+CVSource::CVSource(std::string input, bool hw_decode, bool grey)
+    : _is_image(false), _grey(false), _start_frame(0), _file_fps(-1), _prev_pos_ms(-1), _pace_ts(-1), _pace_fps(-1), _pace_ms(-1)
 {
     LOG_DBG("Source is: %s", input.c_str());
     Mat test_frame;
@@ -45,13 +87,16 @@ CVSource::CVSource(std::string input)
         try {
             // then try loading as video file
             LOG_DBG("Trying source as video file...");
-            _cap = std::shared_ptr<cv::VideoCapture>(new cv::VideoCapture(input));
+            _grey = grey;
+            _cap = openVideo(input, hw_decode, _grey);
             if (!_cap->isOpened()) { throw 0; }
             *_cap >> test_frame;
             if (test_frame.empty()) { throw 0; }
             LOG("Using source type: video file.");
             _open = true;
             _live = false;
+            _grey &= test_frame.channels() == 1;
+            _file_fps = _cap->get(cv::CAP_PROP_FPS);
         }
         catch (...) {
             try {
@@ -139,17 +184,55 @@ bool CVSource::rewind()
 {
     bool ret = false;
 	if (_open && _cap) {
-        if (!_cap->set(cv::CAP_PROP_POS_FRAMES, 0)) {
+        _prev_pos_ms = -1;
+        _pace_ts = -1;
+        if (!_cap->set(cv::CAP_PROP_POS_FRAMES, _start_frame)) {
             LOG_WRN("Warning! Failed to rewind source.");
         } else { ret = true; }
 	}
     return ret;
 }
 
+///
+/// Playback (and rewind) starts from this frame. Only supported by video files.
+///
+bool CVSource::setStartFrame(int frame)
+{
+    if (!_open || !_cap || _is_image || _live) { return frame == 0; }
+    if (frame < 0) { return false; }
+    _start_frame = frame;
+    return rewind();
+}
+
+///
+/// Number of frames in video file.
+///
+int CVSource::getFrameCount()
+{
+    if (!_open || _live) { return -1; }
+    if (_is_image) { return 1; }
+    return static_cast<int>(_cap->get(cv::CAP_PROP_FRAME_COUNT));
+}
+
 ///
 /// Capture and retrieve frame from source.
 ///
 bool CVSource::grab(cv::Mat& frame)
+{
+    Mat buf = frame;
+    if (!grabBuffer(buf)) { return false; }
+    if (buf.data == _frame_cap.data) {
+        buf.copyTo(frame);
+    } else {
+        frame = buf;
+    }
+    return true;
+}
+
+///
+/// Colour frames wrap the capture buffer (valid until next grab).
+///
+bool CVSource::grabBuffer(cv::Mat& frame)
 {
 	if( !_open ) { return false; }
 	if( !_is_image && !_cap->read(_frame_cap) ) {
@@ -158,44 +241,43 @@ bool CVSource::grab(cv::Mat& frame)
 	}
     double ts = ts_ms();    // backup, in case the device timestamp is junk
     _ms_since_midnight = ms_since_midnight();
-	_timestamp = _cap->get(cv::CAP_PROP_POS_MSEC);
+	_timestamp = _is_image ? -1 : _cap->get(cv::CAP_PROP_POS_MSEC);
     LOG_DBG("Frame captured %dx%d%d @ %f (t_sys: %f ms, t_day: %f ms)", _frame_cap.cols, _frame_cap.rows, _frame_cap.channels(), _timestamp, ts, _ms_since_midnight);
-    if (_timestamp <= 0) {
+    if (!_live && !_is_image) {
+        /// Video files: container timestamp (first frame is 0 ms), else frame index / container fps.
+        if (!(_timestamp >= 0) || ((_prev_pos_ms >= 0) && (_timestamp <= _prev_pos_ms))) {     // missing or not advancing
+            double idx = _cap->get(cv::CAP_PROP_POS_FRAMES) - 1;
+            _timestamp = ((idx >= 0) && (_file_fps > 0)) ? (1000. * idx / _file_fps) : ts;
+        }
+        _prev_pos_ms = _timestamp;
+    }
+    else if (_timestamp <= 0) {
         _timestamp = ts;
     }
 
 	if( _frame_cap.channels() == 1 ) {
-		switch( _bayerType ) {
-			case BAYER_BGGR:
-				cv::cvtColor(_frame_cap, frame, cv::COLOR_BayerBG2BGR);
-				break;
-			case BAYER_GBRG:
-				cv::cvtColor(_frame_cap, frame, cv::COLOR_BayerGB2BGR);
-				break;
-			case BAYER_GRBG:
-				cv::cvtColor(_frame_cap, frame, cv::COLOR_BayerGR2BGR);
-				break;
-			case BAYER_RGGB:
-				cv::cvtColor(_frame_cap, frame, cv::COLOR_BayerRG2BGR);
-				break;
-			case BAYER_NONE:
-			default:
-				cv::cvtColor(_frame_cap, frame, cv::COLOR_GRAY2BGR);
-				break;
+		if (_bayerType != BAYER_NONE) {
+			cv::cvtColor(_frame_cap, frame, bayerCvtCode(_bayerType, _grey));
+		} else if (_grey) {
+			frame = _frame_cap;     // luma plane straight from decoder
+		} else {
+			cv::cvtColor(_frame_cap, frame, cv::COLOR_GRAY2BGR);
 		}
 	} else {
-        _frame_cap.copyTo(frame);
+        frame = _frame_cap;
 	}
 
     /// Correct average frame rate when reading from file.
     if (!_live && (_fps > 0)) {
-        static double prev_ts = ts - (1000/_fps);
-        static double av_fps = _fps;      // initially 40 Hz
-        static double sleep_ms = 1000/_fps;
-        av_fps = 0.15 * av_fps + 0.85 * (1000 / (ts - prev_ts));
-        sleep_ms *= 0.25 * (av_fps / _fps) + 0.75;
-        sleep(static_cast<long>(round(sleep_ms)));
-        prev_ts = ts;
+        if (_pace_ts < 0) {
+            _pace_ts = ts - (1000/_fps);
+            _pace_fps = _fps;
+            _pace_ms = 1000/_fps;
+        }
+        _pace_fps = 0.15 * _pace_fps + 0.85 * (1000 / (ts - _pace_ts));
+        _pace_ms *= 0.25 * (_pace_fps / _fps) + 0.75;
+        sleep(static_cast<long>(round(_pace_ms)));
+        _pace_ts = ts;
     }
 
 	return true;
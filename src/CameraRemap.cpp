@@ -28,6 +28,25 @@ CameraRemap::CameraRemap(
 	setTransform(_trans);
 }
 
+///
+/// Constructor (precomputed maps).
+///
+CameraRemap::CameraRemap(
+	const CameraModelPtr& src,
+	const CameraModelPtr& dst,
+	const RemapTransformPtr& trans,
+	const std::vector<float>& mapX,
+	const std::vector<float>& mapY)
+	: Remapper(src->width(), src->height(), dst->width(), dst->height()),
+	_src(src), _dst(dst), _trans(trans), _mapX(mapX), _mapY(mapY)
+{
+	if ((_mapX.size() != static_cast<size_t>(_dstW * _dstH)) || (_mapY.size() != static_cast<size_t>(_dstW * _dstH))) {
+		_mapX.resize(_dstW * _dstH);
+		_mapY.resize(_dstW * _dstH);
+		setTransform(_trans);
+	}
+}
+
 ///
 /// Recompute image mapping with a different transformation.
 ///
@@ -59,4 +78,7 @@ void CameraRemap::setTransform(RemapTransformPtr trans)
 			}
 		}
 	}
+
+	/// Rebuild cached fixed-point maps on next apply().
+	invalidateMaps();
 }
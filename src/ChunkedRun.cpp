@@ -0,0 +1,299 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ChunkedRun.cpp
+/// \brief      Parallel reprocessing of one long recorded video in chunks.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "ChunkedRun.h"
+
+#include "Trackball.h"
+#include "CVSource.h"
+#include "DumpSource.h"
+#include "SimSource.h"
+#include "ConfigParser.h"
+#include "CmPoint.h"
+#include "Logger.h"
+#include "timing.h"
+#include "misc.h"
+
+#include <fstream>
+#include <sstream>
+#include <cstdlib>  // atof
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+const int CHUNK_SEED_FRAMES = 1000;     // frames tracked to build the seed template
+const int CHUNK_OVERLAP = 50;           // frames each chunk re-tracks from the end of the previous chunk
+const int CHUNK_NCOLS = 25;             // see doc/data_header.txt
+
+/// Data file columns (doc/data_header.txt numbering).
+enum { COL_CNT = 1, COL_POSX = 15, COL_POSY = 16, COL_HEADING = 17, COL_INTX = 20, COL_INTY = 21, COL_SEQ = 23 };
+
+///
+/// Read CSV data file rows (cols 1-25, index 0 unused).
+///
+static bool readRows(const string& fn, vector<vector<double>>& rows)
+{
+    ifstream f(fn);
+    if (!f.is_open()) { return false; }
+
+    string line;
+    while (getline(f, line)) {
+        vector<double> v(1, 0);
+        stringstream ss(line);
+        string tok;
+        while (getline(ss, tok, ',')) {
+            v.push_back(atof(tok.c_str()));
+        }
+        if (static_cast<int>(v.size()) < CHUNK_NCOLS + 1) { continue; }
+        rows.push_back(v);
+    }
+    return true;
+}
+
+///
+///
+///
+ChunkedRun::ChunkedRun(string cfg_fn, int nchunks, int njobs, shared_ptr<ThreadPool> pool)
+    : _cfg_fn(cfg_fn), _nchunks(std::max(1, nchunks)), _njobs(njobs), _pool(pool)
+{
+    if (_njobs <= 0) {
+        int ncores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        _njobs = std::max(1, ncores / 2);   // each tracker runs grab and track threads
+    }
+}
+
+///
+///
+///
+bool ChunkedRun::run(const bool& active)
+{
+    ConfigParser cfg;
+    if (cfg.read(_cfg_fn) <= 0) {
+        LOG_ERR("Error parsing config file (%s)!", _cfg_fn.c_str());
+        return false;
+    }
+
+    /// Chunks need a seekable recorded video (or frame dump).
+    string src_fn = cfg("src_fn");
+    const bool is_dump = DumpSource::isDump(src_fn);
+    const bool is_sim = SimSource::isSim(src_fn);
+    int nframes = -1;
+    {
+        unique_ptr<FrameSource> source;
+        if (is_dump) {
+            source = make_unique<DumpSource>(src_fn);
+        } else if (is_sim) {
+            source = make_unique<SimSource>(src_fn);
+        } else {
+            source = make_unique<CVSource>(src_fn);
+        }
+        if (source->isOpen() && !source->isLive()) {
+            nframes = source->getFrameCount();
+        }
+    }
+    if (nframes <= 0) {
+        LOG_ERR("Error! Chunked processing requires a recorded video with known length (%s).", src_fn.c_str());
+        return false;
+    }
+
+    _base_fn = cfg("output_fn");
+    if (_base_fn.empty()) {
+        _base_fn = is_sim ? "fictrac" : src_fn.substr(0, src_fn.length() - (is_dump ? 5 : 4));
+    }
+
+    /// Seed template.
+    string template_fn;
+    if (!cfg.getStr("sphere_map_fn", template_fn) || template_fn.empty()) {
+        if (!seed(active, template_fn)) { return false; }
+    }
+    LOG("Seeding chunks with sphere template %s.", template_fn.c_str());
+
+    /// Split video.
+    int nchunks = std::min(_nchunks, nframes);
+    int len = (nframes + nchunks - 1) / nchunks;
+    _chunks.clear();
+    for (int k = 0; k < nchunks; k++) {
+        Chunk c;
+        c.start = k * len;
+        c.end = std::min(nframes, c.start + len);
+        if (c.start >= c.end) { break; }
+        c.run_start = std::max(0, c.start - ((k > 0) ? CHUNK_OVERLAP : 0));
+
+        string base = _base_fn + "-chunk" + to_string(k);
+        c.cfg_fn = writeConfig(base, c.run_start, c.end - c.run_start, template_fn);
+        c.data_fn = base + "-" + execTime() + ".dat";
+        if (c.cfg_fn.empty()) { return false; }
+        _chunks.push_back(c);
+    }
+    LOG("Tracking %d frames as %d chunks, %d at a time.", nframes, static_cast<int>(_chunks.size()), _njobs);
+
+    if (!trackAll(active)) { return false; }
+
+    return stitch(_base_fn + "-" + execTime() + ".dat");
+}
+
+///
+/// Track the start of the video to build a sphere template.
+///
+bool ChunkedRun::seed(const bool& active, string& template_fn)
+{
+    string base = _base_fn + "-seed";
+    string cfg_fn = writeConfig(base, 0, CHUNK_SEED_FRAMES, "");
+    if (cfg_fn.empty()) { return false; }
+
+    LOG("Building seed template from the first %d frames.", CHUNK_SEED_FRAMES);
+
+    Trackball tracker(cfg_fn, _pool, "seed", true);
+    while (tracker.isActive()) {
+        if (!active) {
+            tracker.terminate();
+            return false;
+        }
+        sleep(250);
+    }
+    if (!tracker.writeTemplate()) { return false; }
+
+    template_fn = base + "-template.png";
+    return true;
+}
+
+///
+/// Write config for one pass over [frame_start, frame_start + frame_count).
+///
+string ChunkedRun::writeConfig(const string& base, int frame_start, int frame_count, const string& template_fn)
+{
+    ConfigParser cfg;
+    if (cfg.read(_cfg_fn) <= 0) {
+        LOG_ERR("Error parsing config file (%s)!", _cfg_fn.c_str());
+        return "";
+    }
+
+    cfg.add("output_fn", base);
+    cfg.add("frame_start", frame_start);
+    cfg.add("frame_count", frame_count);
+    cfg.add("do_display", "n");
+    cfg.add("save_raw", "n");
+    cfg.add("save_debug", "n");
+    cfg.add("data_fmt", "csv");
+    if (!template_fn.empty()) {
+        cfg.add("sphere_map_fn", template_fn);
+        cfg.add("opt_global_first", "y");   // localise first frame against template
+    }
+
+    string fn = base + "-config.txt";
+    if (cfg.write(fn) <= 0) {
+        LOG_ERR("Error! Could not write chunk config file (%s).", fn.c_str());
+        return "";
+    }
+    return fn;
+}
+
+///
+/// Run chunk trackers, at most _njobs at once.
+///
+bool ChunkedRun::trackAll(const bool& active)
+{
+    vector<unique_ptr<Trackball>> trackers;
+    size_t next = 0;
+    while (true) {
+        while (active && (next < _chunks.size()) && (static_cast<int>(trackers.size()) < _njobs)) {
+            trackers.push_back(make_unique<Trackball>(_chunks[next].cfg_fn, _pool, "chunk " + to_string(next), true));
+            next++;
+        }
+
+        for (auto it = trackers.begin(); it != trackers.end(); ) {
+            if (!active) {
+                (*it)->terminate();
+            }
+            if ((*it)->isActive()) {
+                ++it;
+            } else {
+                it = trackers.erase(it);    // closes (flushes) data file
+            }
+        }
+
+        if (trackers.empty() && (!active || (next >= _chunks.size()))) { break; }
+        sleep(250);
+    }
+    return active;
+}
+
+///
+/// Join chunk data files, aligning each chunk to the previous one on their last common frame.
+///
+bool ChunkedRun::stitch(const string& out_fn)
+{
+    vector<vector<double>> out;
+    for (size_t k = 0; k < _chunks.size(); k++) {
+        const Chunk& c = _chunks[k];
+        vector<vector<double>> rows;
+        if (!readRows(c.data_fn, rows) || rows.empty()) {
+            LOG_ERR("Error! Could not read chunk data file (%s).", c.data_fn.c_str());
+            return false;
+        }
+
+        /// Offsets that map this chunk's integrated quantities onto the stitched output.
+        double dh = 0, dseq = 0;
+        double ax = 0, ay = 0, bx = 0, by = 0, dix = 0, diy = 0;
+        if (!out.empty()) {
+            const vector<double>* a = nullptr;
+            const vector<double>* b = nullptr;
+            for (auto rb = rows.rbegin(); (rb != rows.rend()) && !a; ++rb) {
+                if ((*rb)[COL_CNT] >= c.start) { continue; }
+                for (auto ra = out.rbegin(); ra != out.rend(); ++ra) {
+                    if ((*ra)[COL_CNT] == (*rb)[COL_CNT]) { a = &(*ra); b = &(*rb); break; }
+                    if ((*ra)[COL_CNT] < (*rb)[COL_CNT]) { break; }
+                }
+            }
+            if (!a) {
+                LOG_WRN("Warning! No common frame between chunks %d and %d - path may be discontinuous!", static_cast<int>(k) - 1, static_cast<int>(k));
+                a = &out.back();
+                b = &rows.front();
+            }
+            dh = (*a)[COL_HEADING] - (*b)[COL_HEADING];
+            ax = (*a)[COL_POSX];
+            ay = (*a)[COL_POSY];
+            bx = (*b)[COL_POSX];
+            by = (*b)[COL_POSY];
+            dix = (*a)[COL_INTX] - (*b)[COL_INTX];
+            diy = (*a)[COL_INTY] - (*b)[COL_INTY];
+            dseq = (*a)[COL_SEQ] - (*b)[COL_SEQ];
+            LOG_DBG("Aligned chunk %d on frame %.0f (heading offset %f rad).", static_cast<int>(k), (*a)[COL_CNT], dh);
+        }
+
+        for (auto& r : rows) {
+            if ((r[COL_CNT] < c.start) || (r[COL_CNT] >= c.end)) { continue; }
+            if (k > 0) {
+                CmPoint64f d(r[COL_POSX] - bx, r[COL_POSY] - by, 0);
+                d.rotateAboutNorm(CmPoint64f(0, 0, 1), dh);
+                r[COL_POSX] = ax + d[0];
+                r[COL_POSY] = ay + d[1];
+
+                double h = fmod(r[COL_HEADING] + dh, 2 * CM_PI);
+                r[COL_HEADING] = (h < 0) ? h + 2 * CM_PI : h;
+
+                r[COL_INTX] += dix;
+                r[COL_INTY] += diy;
+                r[COL_SEQ] += dseq;
+            }
+            out.push_back(r);
+        }
+    }
+
+    ofstream f(out_fn);
+    if (!f.is_open()) {
+        LOG_ERR("Error! Unable to open output data file (%s).", out_fn.c_str());
+        return false;
+    }
+    f.precision(14);
+    for (auto& r : out) {
+        for (int i = 1; i <= CHUNK_NCOLS; i++) {
+            f << r[i] << ((i < CHUNK_NCOLS) ? ", " : "\n");
+        }
+    }
+    LOG("Wrote %d stitched frames to %s.", static_cast<int>(out.size()), out_fn.c_str());
+    return true;
+}
@@ -0,0 +1,84 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ClockSync.cpp
+/// \brief      Map device (camera) timestamps onto the host clock.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "ClockSync.h"
+
+#include "Logger.h"
+
+#include <cmath>    // fabs
+
+const double CLOCK_MAX_SKEW = 1e-3;     // reject drift estimates above 1 ms/s (device clock reset?)
+
+///
+///
+///
+ClockSync::ClockSync(double period_ms)
+    : _period(period_ms), _latch_ok(true), _valid(false), _last_latch(-1),
+    _offset(0), _skew(0), _dev_ref(0),
+    _win_start(-1), _win_offset(0), _win_dev(0)
+{
+}
+
+///
+///
+///
+void ClockSync::addLatch(double dev_ms, double host_before, double host_after)
+{
+    _last_latch = host_after;
+    if (host_after < host_before) { return; }
+
+    LOG_DBG("Device clock latched at %.3f ms (host %.3f ms, +/- %.3f ms).", dev_ms, 0.5 * (host_before + host_after), 0.5 * (host_after - host_before));
+    update(dev_ms, 0.5 * (host_before + host_after) - dev_ms, true);
+}
+
+///
+///
+///
+void ClockSync::addFrame(double dev_ms, double host_ms)
+{
+    if (_latch_ok) { return; }
+
+    const double offset = host_ms - dev_ms;
+    if ((_win_start < 0) || (offset < _win_offset)) {
+        if (_win_start < 0) { _win_start = host_ms; }
+        _win_offset = offset;
+        _win_dev = dev_ms;
+    }
+
+    /// First estimate straight away, then once per period.
+    if (!_valid || ((host_ms - _win_start) >= _period)) {
+        update(_win_dev, _win_offset, false);   // arrival jitter is too large to estimate drift
+        _win_start = -1;
+    }
+}
+
+///
+///
+///
+void ClockSync::update(double dev_ms, double offset, bool skew_est)
+{
+    if (skew_est && _valid && (dev_ms > _dev_ref)) {
+        double skew = (offset - _offset) / (dev_ms - _dev_ref);
+        if (fabs(skew) < CLOCK_MAX_SKEW) {
+            _skew = skew;
+        } else {
+            LOG_WRN("Warning! Device clock jumped by %.3f ms - resyncing.", offset - _offset);
+            _skew = 0;
+        }
+    }
+    _offset = offset;
+    _dev_ref = dev_ms;
+    _valid = true;
+}
+
+///
+///
+///
+double ClockSync::toHost(double dev_ms) const
+{
+    if (!_valid) { return -1; }
+    return dev_ms + _offset + _skew * (dev_ms - _dev_ref);
+}
@@ -261,7 +261,7 @@ cv::Mat_<T> CmPointT<T>::omegaToMatrix(const CmPointT<T>& omega)
 {
     CmPointT<T> v = omega;
 	T angle = v.normalise();
-    static double R[9];
+    double R[9];
 	angleUnitAxisToMatrix<double>(std::cos(angle), std::sin(angle), v, R);
     return (cv::Mat_<T>(3,3) << R[0], R[1], R[2], R[3], R[4], R[5], R[6], R[7], R[8]);
 }
@@ -286,6 +286,19 @@ CmPointT<T> CmPointT<T>::matrixToOmega(const cv::Mat_<T>& m)
         angle*(m.template at<T>(1,0) - m.template at<T>(0,1)));
 }
 
+template <typename T>
+CmPointT<T> CmPointT<T>::matrixToOmega(const T m[9])
+{
+    // make sure m is not ill-conditioned
+    double angle = acos(clamp((m[0] + m[4] + m[8] - 1) / 2.0, -1.0, 1.0));
+    double sin_angle = sin(angle);
+    if( sin_angle != 0 ) { angle /= 2.0*sin_angle; }
+    return CmPointT<T>(
+        angle*(m[7] - m[5]),
+        angle*(m[2] - m[6]),
+        angle*(m[3] - m[1]));
+}
+
 template <typename T>
 void CmPointT<T>::omegaToAzElMag(T& az, T& el, T& mag) const
 {
@@ -382,6 +395,55 @@ CmPointT<T> CmPointT<T>::getRotatedAboutOrthVec(T angle) const
     return tmp;
 }
 
+///
+/// R = I + a[w] + b[w]^2, with a = sin(t)/t and b = (1 - cos(t))/t^2. The
+/// series are truncated after the t^6 terms, so the error is < t^8/9!.
+///
+template <typename T>
+void CmPointT<T>::omegaToMatrixSmall(double R[9]) const
+{
+	const double x = this->x, y = this->y, z = this->z;
+	const double xx = x*x, yy = y*y, zz = z*z;
+	const double t2 = xx + yy + zz;
+	double a, b;
+	if (t2 < 1e-2) {
+		a = 1 - t2/6 * (1 - t2/20 * (1 - t2/42));
+		b = 0.5 * (1 - t2/12 * (1 - t2/30 * (1 - t2/56)));
+	} else {
+		const double t = std::sqrt(t2);
+		a = std::sin(t) / t;
+		b = (1 - std::cos(t)) / t2;
+	}
+	const double ax = a*x, ay = a*y, az = a*z;
+	const double bxy = b*x*y, bxz = b*x*z, byz = b*y*z;
+	R[0] = 1 - b*(yy + zz);
+	R[1] = bxy - az;
+	R[2] = bxz + ay;
+	R[3] = bxy + az;
+	R[4] = 1 - b*(xx + zz);
+	R[5] = byz - ax;
+	R[6] = bxz - ay;
+	R[7] = byz + ax;
+	R[8] = 1 - b*(xx + yy);
+}
+
+///
+/// w = asin(s)/s * v, with v = vee(R - R^T)/2 and s = |v| = sin(t), for t < pi/2.
+///
+template <typename T>
+CmPointT<T> CmPointT<T>::matrixToOmegaSmall(const T m[9])
+{
+	const double vx = 0.5 * (m[7] - m[5]);
+	const double vy = 0.5 * (m[2] - m[6]);
+	const double vz = 0.5 * (m[3] - m[1]);
+	const double s2 = vx*vx + vy*vy + vz*vz;
+	if ((s2 >= 1e-4) || ((m[0] + m[4] + m[8]) <= 1)) {
+		return matrixToOmega(m);
+	}
+	const double k = 1 + s2/6 * (1 + s2*9/20 * (1 + s2*25/42));
+	return CmPointT<T>(k*vx, k*vy, k*vz);
+}
+
 ///-----------------------------------------------------------------------------
 /// Explicitly instantiate supported types.
 ///-----------------------------------------------------------------------------
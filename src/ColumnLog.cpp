@@ -0,0 +1,535 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ColumnLog.cpp
+/// \brief      Compressed, columnar data log (chunks of typed columns with a seek index).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "ColumnLog.h"
+
+#include "Logger.h"
+
+#ifdef FICTRAC_ZSTD
+#include <zstd.h>
+#endif
+
+#include <cstring>      // memcpy
+#include <algorithm>    // min
+
+using namespace std;
+using namespace collog;
+
+/// Max run/literal lengths of the run-length coder.
+const size_t RLE_MAX_RUN = 130;
+const size_t RLE_MAX_LIT = 128;
+
+const size_t REC_F64_OFFSET = 16;   // first double field of BinaryRecord
+const int F64_TS = 20;              // ts, as double column index (see colName)
+
+///
+///
+///
+const char* collog::colName(int c)
+{
+    static const char* names[] = {
+        "frame_cnt", "seq",
+        "dr_cam_x", "dr_cam_y", "dr_cam_z", "err",
+        "dr_lab_x", "dr_lab_y", "dr_lab_z",
+        "r_cam_x", "r_cam_y", "r_cam_z",
+        "r_lab_x", "r_lab_y", "r_lab_z",
+        "posx", "posy", "heading", "step_dir", "step_mag", "intx", "inty",
+        "ts", "dts", "ms",
+        "w_lab_x", "w_lab_y", "w_lab_z", "heading_rate", "velx_rate", "vely_rate"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == NUM_COLS, "column names out of date");
+    return ((c >= 0) && (c < NUM_COLS)) ? names[c] : "";
+}
+
+static bool seek64(FILE* f, uint64_t off)
+{
+#ifdef _WIN32
+    return _fseeki64(f, static_cast<__int64>(off), SEEK_SET) == 0;
+#else
+    return fseeko(f, static_cast<off_t>(off), SEEK_SET) == 0;
+#endif
+}
+
+static uint64_t fileSize(FILE* f)
+{
+#ifdef _WIN32
+    _fseeki64(f, 0, SEEK_END);
+    return static_cast<uint64_t>(_ftelli64(f));
+#else
+    fseeko(f, 0, SEEK_END);
+    return static_cast<uint64_t>(ftello(f));
+#endif
+}
+
+///
+/// PackBits-style: control c < 128 is followed by c + 1 literal bytes, c >= 128 by one byte repeated (c - 128) + 3 times.
+///
+static void rleEncode(const uint8_t* src, size_t n, vector<uint8_t>& dst)
+{
+    dst.clear();
+    size_t i = 0, lit = 0;     // literal run starts at i - lit
+    auto flushLit = [&]() {
+        const uint8_t* p = src + i - lit;
+        while (lit > 0) {
+            size_t k = std::min(lit, RLE_MAX_LIT);
+            dst.push_back(static_cast<uint8_t>(k - 1));
+            dst.insert(dst.end(), p, p + k);
+            p += k;
+            lit -= k;
+        }
+    };
+    while (i < n) {
+        size_t r = 1;
+        while ((i + r < n) && (r < RLE_MAX_RUN) && (src[i + r] == src[i])) { r++; }
+        if (r >= 3) {
+            flushLit();
+            dst.push_back(static_cast<uint8_t>(128 + (r - 3)));
+            dst.push_back(src[i]);
+            i += r;
+        }
+        else {
+            i++;
+            lit++;
+        }
+    }
+    flushLit();
+}
+
+static bool rleDecode(const uint8_t* src, size_t n, uint8_t* dst, size_t len)
+{
+    size_t i = 0, o = 0;
+    while (i < n) {
+        const uint8_t c = src[i++];
+        if (c < 128) {
+            size_t k = c + 1;
+            if ((i + k > n) || (o + k > len)) { return false; }
+            memcpy(dst + o, src + i, k);
+            i += k;
+            o += k;
+        }
+        else {
+            size_t k = (c - 128) + 3;
+            if ((i >= n) || (o + k > len)) { return false; }
+            memset(dst + o, src[i++], k);
+            o += k;
+        }
+    }
+    return o == len;
+}
+
+///
+/// Compress n shuffled bytes into a block (header + payload), falling back to raw if that's smaller.
+///
+static void encodeBlock(const uint8_t* src, size_t n, uint8_t elem, int level, vector<uint8_t>& tmp, vector<uint8_t>& out)
+{
+    BlockHeader bh = { RAW, elem, 0, static_cast<uint32_t>(n), static_cast<uint32_t>(n) };
+    const uint8_t* payload = src;
+
+#ifdef FICTRAC_ZSTD
+    tmp.resize(ZSTD_compressBound(n));
+    size_t len = ZSTD_compress(tmp.data(), tmp.size(), src, n, level);
+    if (!ZSTD_isError(len) && (len < n)) {
+        bh.codec = ZSTD;
+        bh.enc_len = static_cast<uint32_t>(len);
+        payload = tmp.data();
+    }
+#else
+    (void)level;
+    rleEncode(src, n, tmp);
+    if (tmp.size() < n) {
+        bh.codec = RLE;
+        bh.enc_len = static_cast<uint32_t>(tmp.size());
+        payload = tmp.data();
+    }
+#endif
+
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&bh);
+    out.insert(out.end(), p, p + sizeof(bh));
+    out.insert(out.end(), payload, payload + bh.enc_len);
+}
+
+///
+///
+///
+ColumnLogWriter::ColumnLogWriter()
+    : _file(nullptr), _chunk_rows(CHUNK_ROWS_DEFAULT), _nrows(0), _level(3), _offset(0)
+{
+}
+
+///
+///
+///
+ColumnLogWriter::~ColumnLogWriter()
+{
+    close();
+}
+
+///
+///
+///
+bool ColumnLogWriter::open(const string& fn, uint32_t chunk_rows, int zstd_level)
+{
+    close();
+
+    _file = fopen(fn.c_str(), "wb");
+    if (!_file) {
+        LOG_ERR("Error! Could not open columnar data log (%s).", fn.c_str());
+        return false;
+    }
+    _chunk_rows = std::max<uint32_t>(chunk_rows, 1);
+    _level = zstd_level;
+    _nrows = 0;
+    _index.clear();
+    for (auto& c : _u32) { c.resize(_chunk_rows); }
+    for (auto& c : _f64) { c.resize(_chunk_rows); }
+
+    Header h = { MAGIC, VERSION, sizeof(Header), NUM_U32, NUM_F64, BinaryRecord::VERSION, 0, _chunk_rows };
+    if (fwrite(&h, sizeof(h), 1, _file) != 1) {
+        LOG_ERR("Error! Could not write columnar data log header (%s).", fn.c_str());
+        fclose(_file);
+        _file = nullptr;
+        return false;
+    }
+    _offset = sizeof(h);
+    return true;
+}
+
+///
+///
+///
+bool ColumnLogWriter::append(const BinaryRecord& rec)
+{
+    if (!_file) { return false; }
+
+    _u32[0][_nrows] = rec.frame_cnt;
+    _u32[1][_nrows] = rec.seq;
+    const double* f = reinterpret_cast<const double*>(reinterpret_cast<const uint8_t*>(&rec) + REC_F64_OFFSET);
+    for (int c = 0; c < NUM_F64; c++) {
+        _f64[c][_nrows] = f[c];
+    }
+
+    if (++_nrows < _chunk_rows) { return true; }
+    return writeChunk();
+}
+
+///
+///
+///
+bool ColumnLogWriter::writeChunk()
+{
+    if (_nrows == 0) { return true; }
+    const size_t n = _nrows;
+    _nrows = 0;
+
+    _chunk.clear();
+    for (int c = 0; c < NUM_COLS; c++) {
+        /// Deltas (counters) or XOR with the previous value (doubles).
+        const size_t elem = (c < NUM_U32) ? 4 : 8;
+        _raw.resize(n * elem);
+        if (c < NUM_U32) {
+            uint32_t prev = 0, *d = reinterpret_cast<uint32_t*>(_raw.data());
+            for (size_t i = 0; i < n; i++) {
+                d[i] = _u32[c][i] - prev;
+                prev = _u32[c][i];
+            }
+        }
+        else {
+            uint64_t prev = 0, *d = reinterpret_cast<uint64_t*>(_raw.data());
+            for (size_t i = 0; i < n; i++) {
+                uint64_t b;
+                memcpy(&b, &_f64[c - NUM_U32][i], sizeof(b));
+                d[i] = b ^ prev;
+                prev = b;
+            }
+        }
+
+        /// Byte shuffle.
+        _shuf.resize(_raw.size());
+        for (size_t i = 0; i < n; i++) {
+            for (size_t k = 0; k < elem; k++) {
+                _shuf[k * n + i] = _raw[i * elem + k];
+            }
+        }
+
+        encodeBlock(_shuf.data(), _shuf.size(), static_cast<uint8_t>(elem), _level, _enc, _chunk);
+    }
+
+    ChunkHeader ch;
+    ch.magic = CHUNK_MAGIC;
+    ch.nrows = static_cast<uint32_t>(n);
+    ch.frame0 = _u32[0][0];
+    ch.frame1 = _u32[0][n - 1];
+    ch.ts0 = _f64[F64_TS][0];
+    ch.ts1 = _f64[F64_TS][n - 1];
+    ch.bytes = _chunk.size();
+
+    IndexEntry e = { _offset, ch.nrows, ch.frame0, ch.frame1, 0, ch.ts0, ch.ts1 };
+    if ((fwrite(&ch, sizeof(ch), 1, _file) != 1) || (fwrite(_chunk.data(), 1, _chunk.size(), _file) != _chunk.size())) {
+        LOG_ERR("Error! Could not write columnar data log chunk.");
+        return false;
+    }
+    fflush(_file);
+    _index.push_back(e);
+    _offset += sizeof(ch) + _chunk.size();
+    return true;
+}
+
+///
+///
+///
+void ColumnLogWriter::close()
+{
+    if (!_file) { return; }
+
+    writeChunk();
+
+    const uint32_t magic = INDEX_MAGIC, n = static_cast<uint32_t>(_index.size());
+    fwrite(&magic, sizeof(magic), 1, _file);
+    fwrite(&n, sizeof(n), 1, _file);
+    if (n > 0) { fwrite(_index.data(), sizeof(IndexEntry), n, _file); }
+    fwrite(&_offset, sizeof(_offset), 1, _file);
+    fwrite(&END_MAGIC, sizeof(END_MAGIC), 1, _file);
+
+    fclose(_file);
+    _file = nullptr;
+}
+
+///
+///
+///
+ColumnLogReader::ColumnLogReader()
+    : _file(nullptr), _nrows(0)
+{
+    memset(&_hdr, 0, sizeof(_hdr));
+}
+
+///
+///
+///
+ColumnLogReader::~ColumnLogReader()
+{
+    close();
+}
+
+///
+///
+///
+bool ColumnLogReader::open(const string& fn)
+{
+    close();
+
+    _file = fopen(fn.c_str(), "rb");
+    if (!_file) {
+        LOG_ERR("Error! Could not open columnar data log (%s).", fn.c_str());
+        return false;
+    }
+    if ((fread(&_hdr, sizeof(_hdr), 1, _file) != 1) || (_hdr.magic != MAGIC) || (_hdr.version != VERSION) || (_hdr.hdr_size != sizeof(Header))) {
+        LOG_ERR("Error! Not a columnar data log, or unsupported version (%s).", fn.c_str());
+        close();
+        return false;
+    }
+
+    /// Chunk index from the trailer, or by scanning an unfinished log.
+    const uint64_t size = fileSize(_file);
+    uint64_t idx_off = 0;
+    uint32_t end = 0, magic = 0, n = 0;
+    bool indexed = (size >= sizeof(Header) + sizeof(idx_off) + sizeof(end)) &&
+        seek64(_file, size - sizeof(idx_off) - sizeof(end)) &&
+        (fread(&idx_off, sizeof(idx_off), 1, _file) == 1) && (fread(&end, sizeof(end), 1, _file) == 1) && (end == END_MAGIC) &&
+        seek64(_file, idx_off) && (fread(&magic, sizeof(magic), 1, _file) == 1) && (magic == INDEX_MAGIC) &&
+        (fread(&n, sizeof(n), 1, _file) == 1);
+    if (indexed) {
+        _index.resize(n);
+        indexed = (n == 0) || (fread(_index.data(), sizeof(IndexEntry), n, _file) == n);
+    }
+    if (!indexed) {
+        LOG_WRN("Warning! Columnar data log has no chunk index (unfinished recording?) - scanning chunks.");
+        if (!scanChunks()) {
+            close();
+            return false;
+        }
+    }
+
+    _nrows = 0;
+    for (const auto& e : _index) { _nrows += e.nrows; }
+    return true;
+}
+
+///
+///
+///
+bool ColumnLogReader::scanChunks()
+{
+    _index.clear();
+    const uint64_t size = fileSize(_file);
+    uint64_t off = _hdr.hdr_size;
+    ChunkHeader ch;
+    while ((off + sizeof(ch) <= size) && seek64(_file, off) && (fread(&ch, sizeof(ch), 1, _file) == 1) &&
+        (ch.magic == CHUNK_MAGIC) && (off + sizeof(ch) + ch.bytes <= size)) {
+        IndexEntry e = { off, ch.nrows, ch.frame0, ch.frame1, 0, ch.ts0, ch.ts1 };
+        _index.push_back(e);
+        off += sizeof(ch) + ch.bytes;
+    }
+    return true;
+}
+
+///
+///
+///
+void ColumnLogReader::close()
+{
+    if (_file) { fclose(_file); }
+    _file = nullptr;
+    _index.clear();
+    _nrows = 0;
+}
+
+///
+///
+///
+size_t ColumnLogReader::findFrame(uint32_t frame) const
+{
+    auto it = lower_bound(_index.begin(), _index.end(), frame, [](const IndexEntry& e, uint32_t f) { return e.frame1 < f; });
+    return static_cast<size_t>(it - _index.begin());
+}
+
+size_t ColumnLogReader::findTime(double ts) const
+{
+    auto it = lower_bound(_index.begin(), _index.end(), ts, [](const IndexEntry& e, double t) { return e.ts1 < t; });
+    return static_cast<size_t>(it - _index.begin());
+}
+
+///
+/// Read and decode the next block (file positioned at its BlockHeader) into raw values.
+///
+bool ColumnLogReader::readBlock(size_t nrows, int c, vector<uint8_t>& raw)
+{
+    BlockHeader bh;
+    if (fread(&bh, sizeof(bh), 1, _file) != 1) { return false; }
+    const size_t elem = (c < _hdr.n_u32) ? 4 : 8;
+    if ((bh.elem_size != elem) || (bh.raw_len != nrows * elem)) { return false; }
+
+    _enc.resize(bh.enc_len);
+    if ((bh.enc_len > 0) && (fread(_enc.data(), 1, bh.enc_len, _file) != bh.enc_len)) { return false; }
+    _shuf.resize(bh.raw_len);
+    switch (bh.codec) {
+    case RAW:
+        if (bh.enc_len != bh.raw_len) { return false; }
+        memcpy(_shuf.data(), _enc.data(), bh.raw_len);
+        break;
+    case RLE:
+        if (!rleDecode(_enc.data(), bh.enc_len, _shuf.data(), bh.raw_len)) { return false; }
+        break;
+    case ZSTD:
+#ifdef FICTRAC_ZSTD
+        if (ZSTD_decompress(_shuf.data(), bh.raw_len, _enc.data(), bh.enc_len) != bh.raw_len) { return false; }
+        break;
+#else
+        LOG_ERR("Error! Columnar data log is zstd compressed - rebuild with FICTRAC_ZSTD to read it.");
+        return false;
+#endif
+    default:
+        return false;
+    }
+
+    /// Unshuffle and undo deltas (counters) / XOR (doubles).
+    raw.resize(bh.raw_len);
+    for (size_t i = 0; i < nrows; i++) {
+        for (size_t k = 0; k < elem; k++) {
+            raw[i * elem + k] = _shuf[k * nrows + i];
+        }
+    }
+    if (elem == 4) {
+        uint32_t* d = reinterpret_cast<uint32_t*>(raw.data());
+        for (size_t i = 1; i < nrows; i++) { d[i] += d[i - 1]; }
+    }
+    else {
+        uint64_t* d = reinterpret_cast<uint64_t*>(raw.data());
+        for (size_t i = 1; i < nrows; i++) { d[i] ^= d[i - 1]; }
+    }
+    return true;
+}
+
+///
+///
+///
+bool ColumnLogReader::readChunk(size_t i, vector<BinaryRecord>& out)
+{
+    if (!_file || (i >= _index.size())) { return false; }
+
+    ChunkHeader ch;
+    if (!seek64(_file, _index[i].offset) || (fread(&ch, sizeof(ch), 1, _file) != 1) || (ch.magic != CHUNK_MAGIC)) {
+        LOG_ERR("Error! Corrupt columnar data log chunk %d.", static_cast<int>(i));
+        return false;
+    }
+
+    const size_t n = ch.nrows, base = out.size();
+    BinaryRecord rec;
+    rec.version = _hdr.rec_version;
+    memset(reinterpret_cast<uint8_t*>(&rec) + 8, 0, sizeof(rec) - 8);     // fields missing from older logs read as 0
+    out.resize(base + n, rec);
+
+    const int ncols = _hdr.n_u32 + _hdr.n_f64;
+    for (int c = 0; c < ncols; c++) {
+        if (!readBlock(n, c, _raw)) {
+            LOG_ERR("Error! Corrupt columnar data log chunk %d (column %d).", static_cast<int>(i), c);
+            out.resize(base);
+            return false;
+        }
+        if (c < _hdr.n_u32) {
+            if (c >= NUM_U32) { continue; }
+            const uint32_t* d = reinterpret_cast<const uint32_t*>(_raw.data());
+            for (size_t k = 0; k < n; k++) { (c == 0 ? out[base + k].frame_cnt : out[base + k].seq) = d[k]; }
+        }
+        else {
+            const int f = c - _hdr.n_u32;
+            if (f >= NUM_F64) { continue; }     // field added after this build
+            for (size_t k = 0; k < n; k++) {
+                memcpy(reinterpret_cast<uint8_t*>(&out[base + k]) + REC_F64_OFFSET + f * sizeof(double), &_raw[k * sizeof(double)], sizeof(double));
+            }
+        }
+    }
+    return true;
+}
+
+///
+///
+///
+bool ColumnLogReader::readColumn(size_t i, int c, vector<double>& out)
+{
+    if (!_file || (i >= _index.size()) || (c < 0) || (c >= _hdr.n_u32 + _hdr.n_f64)) { return false; }
+
+    ChunkHeader ch;
+    if (!seek64(_file, _index[i].offset) || (fread(&ch, sizeof(ch), 1, _file) != 1) || (ch.magic != CHUNK_MAGIC)) {
+        LOG_ERR("Error! Corrupt columnar data log chunk %d.", static_cast<int>(i));
+        return false;
+    }
+
+    /// Skip preceding blocks.
+    uint64_t off = _index[i].offset + sizeof(ch);
+    for (int k = 0; k < c; k++) {
+        BlockHeader bh;
+        if (fread(&bh, sizeof(bh), 1, _file) != 1) { return false; }
+        off += sizeof(bh) + bh.enc_len;
+        if (!seek64(_file, off)) { return false; }
+    }
+
+    const size_t n = ch.nrows;
+    if (!readBlock(n, c, _raw)) {
+        LOG_ERR("Error! Corrupt columnar data log chunk %d (column %d).", static_cast<int>(i), c);
+        return false;
+    }
+    const size_t base = out.size();
+    out.resize(base + n);
+    if (c < _hdr.n_u32) {
+        const uint32_t* d = reinterpret_cast<const uint32_t*>(_raw.data());
+        for (size_t k = 0; k < n; k++) { out[base + k] = d[k]; }
+    }
+    else {
+        memcpy(&out[base], _raw.data(), n * sizeof(double));
+    }
+    return true;
+}
@@ -0,0 +1,86 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ColumnRecorder.cpp
+/// \brief      Columnar data log recorder (see ColumnLog.h).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "ColumnRecorder.h"
+
+#include "Logger.h"
+
+#include <cstring>      // memcpy
+#include <algorithm>    // min
+
+using namespace std;
+
+///
+///
+///
+ColumnRecorder::ColumnRecorder()
+{
+    _type = COLS;
+    _pending.reserve(sizeof(BinaryRecord));
+}
+
+///
+///
+///
+ColumnRecorder::~ColumnRecorder()
+{
+    closeRecord();
+}
+
+///
+///
+///
+bool ColumnRecorder::openRecord(std::string fn)
+{
+    _pending.clear();
+    return (_open = _log.open(fn));
+}
+
+///
+///
+///
+bool ColumnRecorder::writeRecord(const char* data, size_t len)
+{
+    if (!_open) { return false; }
+
+    bool ret = true;
+    BinaryRecord rec;
+    while (len > 0) {
+        /// Complete a record split across writes, else take whole records straight from data.
+        const char* p = data;
+        if (!_pending.empty() || (len < sizeof(rec))) {
+            size_t k = std::min(len, sizeof(rec) - _pending.size());
+            _pending.insert(_pending.end(), data, data + k);
+            data += k;
+            len -= k;
+            if (_pending.size() < sizeof(rec)) { break; }
+            p = _pending.data();
+        }
+        else {
+            data += sizeof(rec);
+            len -= sizeof(rec);
+        }
+
+        memcpy(&rec, p, sizeof(rec));
+        _pending.clear();
+        if ((rec.magic != BinaryRecord::MAGIC) || (rec.size != sizeof(rec))) {
+            LOG_ERR("Error! Columnar data log received an invalid record - dropping.");
+            ret = false;
+            continue;
+        }
+        ret &= _log.append(rec);
+    }
+    return ret;
+}
+
+///
+///
+///
+void ColumnRecorder::closeRecord()
+{
+    _open = false;
+    _log.close();
+}
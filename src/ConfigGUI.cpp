@@ -29,6 +29,10 @@
 #include <iostream> // getline, stoi
 #include <cstdio>   // getchar
 #include <exception>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 
 using cv::Mat;
 using cv::Point2d;
@@ -41,7 +45,9 @@ using std::string;
 ///
 const int       ZOOM_DIM    = 600;
 const double    ZOOM_SCL    = 1.0 / 10.0;
-const int       MAX_DISP_DIM    = -1;
+const int       MAX_DISP_DIM    = 1280;
+const int       ENH_FRAMES      = 0;
+const double    ENH_MAX_SECS    = 30;
 
 const int NCOLOURS = 6;
 cv::Scalar COLOURS[NCOLOURS] = {
@@ -139,14 +145,92 @@ void onMouseEvent(int event, int x, int y, int f, void* ptr)
 ///
 /// Create a zoomed ROI.
 ///
-void createZoomROI(Mat& zoom_roi, const Mat& frame, const Point2d& pt, int orig_dim)
+cv::Rect zoomRect(const cv::Size& size, const Point2d& pt, int orig_dim)
 {
-    int x = frame.cols/2;
-    if (pt.x >= 0) { x = clamp(int(pt.x - orig_dim/2 + 0.5), int(orig_dim/2), frame.cols - 1 - orig_dim); }
-    int y = frame.rows/2;
-    if (pt.y >= 0) { y = clamp(int(pt.y - orig_dim/2 + 0.5), 0, frame.rows - 1 - orig_dim); }
-    Mat crop_rect = frame(cv::Rect(x, y, orig_dim, orig_dim));
-    cv::resize(crop_rect, zoom_roi, zoom_roi.size());
+    int x = size.width/2;
+    if (pt.x >= 0) { x = clamp(int(pt.x - orig_dim/2 + 0.5), int(orig_dim/2), size.width - 1 - orig_dim); }
+    int y = size.height/2;
+    if (pt.y >= 0) { y = clamp(int(pt.y - orig_dim/2 + 0.5), 0, size.height - 1 - orig_dim); }
+    return cv::Rect(x, y, orig_dim, orig_dim);
+}
+
+///
+/// Per-pixel range (max - min) of frames from source, starting with frame.
+/// Recorded sources with more than nframes frames are sampled at nframes evenly
+/// spaced frames, otherwise consecutive frames are used (for at most ENH_MAX_SECS).
+/// Frames are decoded on a separate thread while the previous frame is accumulated.
+///
+void enhanceFrame(FrameSource& source, Mat& frame, int nframes)
+{
+    Mat minimg = frame.clone();
+    Mat maximg = frame.clone();
+
+    const int total = source.getFrameCount();
+    const int step = ((nframes > 0) && !source.isLive() && (total > nframes)) ? (total / nframes) : 0;
+
+    /// Two frame buffers, passed back and forth between decoder and accumulator.
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Mat> full, empty(2);
+    bool done = false, stop = false;
+
+    std::thread decoder([&]() {
+        auto t0 = elapsed_secs();
+        int n = 1;
+        while (true) {
+            Mat buf;
+            {
+                std::unique_lock<std::mutex> l(mutex);
+                cond.wait(l, [&]() { return !empty.empty() || stop; });
+                if (stop) { break; }
+                buf = empty.front();
+                empty.pop_front();
+            }
+
+            bool ok = ((nframes <= 0) || (n < nframes)) && ((elapsed_secs() - t0) <= ENH_MAX_SECS);    // drop out after max 30s (avoid infinite loop when running live)
+            if (ok && (step > 0)) { ok = source.setStartFrame(n * step); }
+            ok = ok && source.grab(buf) && (buf.size() == frame.size()) && (buf.type() == frame.type());
+            n++;
+
+            std::lock_guard<std::mutex> l(mutex);
+            if (!ok) {
+                done = true;
+                cond.notify_all();
+                break;
+            }
+            full.push_back(buf);
+            cond.notify_all();
+        }
+    });
+
+    int count = 1;
+    while (true) {
+        Mat buf;
+        {
+            std::unique_lock<std::mutex> l(mutex);
+            cond.wait(l, [&]() { return !full.empty() || done; });
+            if (full.empty()) { break; }
+            buf = full.front();
+            full.pop_front();
+        }
+
+        cv::min(minimg, buf, minimg);
+        cv::max(maximg, buf, maximg);
+        count++;
+
+        std::lock_guard<std::mutex> l(mutex);
+        empty.push_back(buf);
+        cond.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> l(mutex);
+        stop = true;
+        cond.notify_all();
+    }
+    decoder.join();
+
+    LOG_DBG("Enhanced config image from %d frames.", count);
+    cv::subtract(maximg, minimg, frame);
 }
 
 ///
@@ -192,8 +276,10 @@ ConfigGui::ConfigGui(string config_fn)
     _w = _source->getWidth();
     _h = _source->getHeight();
     _disp_scl = -1;
-    if ((MAX_DISP_DIM > 0) && (std::max(_w,_h) > MAX_DISP_DIM)) {
-        _disp_scl = MAX_DISP_DIM / static_cast<float>(std::max(_w,_h));
+    int max_disp_dim = MAX_DISP_DIM;
+    _cfg.getInt("cfg_disp_dim", max_disp_dim);
+    if ((max_disp_dim > 0) && (std::max(_w,_h) > max_disp_dim)) {
+        _disp_scl = max_disp_dim / static_cast<float>(std::max(_w,_h));
         _input_data.ptScl = 1.0 / _disp_scl;
     }
 
@@ -216,6 +302,17 @@ ConfigGui::ConfigGui(string config_fn)
         _cam_model = CameraModel::createRectilinear(_w, _h, vfov * CM_D2R);
     }
 
+    /// Same camera at display resolution, for drawing overlays on the downscaled image.
+    _disp_model = _cam_model;
+    if (_disp_scl > 0) {
+        const int dw = static_cast<int>(_w * _disp_scl + 0.5), dh = static_cast<int>(_h * _disp_scl + 0.5);
+        if (fisheye) {
+            _disp_model = CameraModel::createFisheye(dw, dh, vfov * CM_D2R / (double)dh, 360 * CM_D2R);
+        } else {
+            _disp_model = CameraModel::createRectilinear(dw, dh, vfov * CM_D2R);
+        }
+    }
+
     /// Create base file name for output files.
     _base_fn = _cfg("output_fn");
     if (_base_fn.empty()) {
@@ -331,7 +428,7 @@ bool ConfigGui::updateRt(const string& ref_str, Mat& R, Mat& t)
 ///
 ///
 ///
-void ConfigGui::drawC2ACorners(Mat& disp_frame, const string& ref_str, const Mat& R, const Mat& t)
+void ConfigGui::drawC2ACorners(Mat& disp_frame, const CameraModelPtr& cam_model, const string& ref_str, const Mat& R, const Mat& t)
 {
     // make x4 mat for projecting corners
     Mat T(3, 4, CV_64F);
@@ -352,20 +449,61 @@ void ConfigGui::drawC2ACorners(Mat& disp_frame, const string& ref_str, const Mat
     Mat p = R * ref_cnrs + T;
 
     // draw re-projected reference corners
-    drawRectCorners(disp_frame, _cam_model, p, Scalar(0, 255, 0));
+    drawRectCorners(disp_frame, cam_model, p, Scalar(0, 255, 0));
 }
 
 ///
 ///
 ///
-void ConfigGui::drawC2AAxes(Mat& disp_frame, const Mat& R, const Mat& t, const double& r, const CmPoint& c)
+void ConfigGui::drawC2AAxes(Mat& disp_frame, const CameraModelPtr& cam_model, const Mat& R, const Mat& t, const double& r, const CmPoint& c)
 {
     // draw re-projected animal axes.
     if (r > 0) {
         double scale = 1.0 / tan(r);
         Mat so = (cv::Mat_<double>(3, 1) << c.x, c.y, c.z) * scale;
-        drawAxes(disp_frame, _cam_model, R, so, Scalar(0, 0, 255));
-        drawAnimalAxis(disp_frame, _cam_model, R, so, r, Scalar(255, 0, 0));
+        drawAxes(disp_frame, cam_model, R, so, Scalar(0, 0, 255));
+        drawAnimalAxis(disp_frame, cam_model, R, so, r, Scalar(255, 0, 0));
+    }
+}
+
+///
+/// Set the (enhanced, normalised) config image. For large sensors it is downscaled
+/// here, once, and every redraw starts from a copy of the cached display image.
+///
+void ConfigGui::setDisplayFrame(const Mat& frame)
+{
+    _full_frame = frame;
+    if (_disp_scl > 0) {
+        cv::resize(frame, _disp_base, cv::Size(_disp_model->width(), _disp_model->height()), 0, 0, cv::INTER_AREA);
+        _zoom_full = frame.clone();
+    } else {
+        _disp_base = frame;
+    }
+    _zoom_frame.create(ZOOM_DIM, ZOOM_DIM, CV_8UC3);
+}
+
+///
+/// Draw overlays on a copy of the display image and show it in the config window.
+/// With zoom, the zoom window is cut from a full resolution copy of the image, of
+/// which only the zoomed region is restored before the overlays are redrawn.
+///
+void ConfigGui::showFrame(const Overlay& overlay, bool zoom)
+{
+    _disp_base.copyTo(_disp_frame);
+    overlay(_disp_frame, _disp_model, (_disp_scl > 0) ? _disp_scl : 1);
+    cv::imshow("configGUI", _disp_frame);
+
+    if (zoom) {
+        const int scaled_zoom_dim = static_cast<int>(ZOOM_DIM * ZOOM_SCL + 0.5);
+        const cv::Rect rect = zoomRect(_full_frame.size(), _input_data.cursorPt, scaled_zoom_dim);
+        if (_disp_scl > 0) {
+            _full_frame(rect).copyTo(_zoom_full(rect));
+            overlay(_zoom_full, _cam_model, 1);
+            cv::resize(_zoom_full(rect), _zoom_frame, _zoom_frame.size());
+        } else {
+            cv::resize(_disp_frame(rect), _zoom_frame, _zoom_frame.size());
+        }
+        cv::imshow("zoomROI", _zoom_frame);
     }
 }
 
@@ -413,38 +551,31 @@ bool ConfigGui::run()
         return false;
     }
 
-    // convert to RGB
-    if (frame.channels() == 1) {
-        cv::cvtColor(frame, frame, cv::COLOR_GRAY2BGR);
-    }
-
     /// Optionally enhance frame for config
     bool do_enhance = false;
     _cfg.getBool("enh_cfg_disp", do_enhance);
     if (do_enhance) {
         LOG("Enhancing config image ..");
-        Mat maximg = frame.clone();
-        Mat minimg = frame.clone();
-        auto t0 = elapsed_secs();
-        while (_source->grab(frame)) {
-            for (int i = 0; i < _h; i++) {
-                uint8_t* pmin = minimg.ptr(i);
-                uint8_t* pmax = maximg.ptr(i);
-                const uint8_t* pimg = frame.ptr(i);
-                for (int j = 0; j < _w * 3; j++) {
-                    uint8_t p = pimg[j];
-                    if (p > pmax[j]) { pmax[j] = p; }
-                    if (p < pmin[j]) { pmin[j] = p; }
-                }
-            }
+        int enh_frames = ENH_FRAMES;
+        _cfg.getInt("enh_cfg_frames", enh_frames);
+        enhanceFrame(*_source, frame, enh_frames);
+    }
 
-            // Drop out after max 30s (avoid infinite loop when running live)
-            auto t1 = elapsed_secs();
-            if ((t1 - t0) > 30) { break; }
+    // convert to RGB
+    if (frame.channels() == 1) {
+        cv::cvtColor(frame, frame, cv::COLOR_GRAY2BGR);
+    }
+
+    // normalise displayed image (once; each redraw starts from a copy)
+    {
+        double min, max;
+        cv::minMaxLoc(frame, &min, &max);
+        if (max > min) {
+            frame.convertTo(frame, -1, 255 / (max - min), -min * 255 / (max - min));
         }
-        frame = maximg - minimg;
     }
-    
+    setDisplayFrame(frame);
+
     /// Display/input loop.
 	Mat R, t;
     CmPoint c;
@@ -457,21 +588,27 @@ bool ConfigGui::run()
     vector<vector<int>> cfg_polys;
 	changeState(CIRC_INIT);
     const int click_rad = std::max(int(_w/150+0.5), 5);
-    Mat disp_frame, zoom_frame(ZOOM_DIM, ZOOM_DIM, CV_8UC3);
-    const int scaled_zoom_dim = static_cast<int>(ZOOM_DIM * ZOOM_SCL + 0.5);
-    bool open = true;
-    while (open && (key != 0x1b)) {    // esc
-        /// Create frame for drawing.
-        //cv::cvtColor(_frame, disp_frame, CV_GRAY2RGB);
-        disp_frame = frame.clone();
 
-        // normalise displayed image
-        {
-            double min, max;
-            cv::minMaxLoc(disp_frame, &min, &max);
-            disp_frame = (disp_frame - min) * 255 / (max - min);
+    /// Overlays, drawn on an image at scale s (points are in full resolution pixels).
+    auto clickRad = [&](double s) { return std::max(int(click_rad * s + 0.5), 1); };
+    auto drawClicks = [&](Mat& img, const vector<Point2d>& pts, double s) {
+        for (auto click : pts) {
+            cv::circle(img, click * s, clickRad(s), Scalar(255,255,0), 1, cv::LINE_AA);
         }
-        
+    };
+    auto drawIgnr = [&](Mat& img, double s) {
+        for (unsigned int i = 0; i < _input_data.ignrPts.size(); i++) {
+            for (unsigned int j = 0; j < _input_data.ignrPts[i].size(); j++) {
+                if (i == _input_data.ignrPts.size()-1) {
+                    cv::circle(img, _input_data.ignrPts[i][j] * s, clickRad(s), COLOURS[i%NCOLOURS], 1, cv::LINE_AA);
+                }
+                cv::line(img, _input_data.ignrPts[i][j] * s, _input_data.ignrPts[i][(j+1)%_input_data.ignrPts[i].size()] * s, COLOURS[i%NCOLOURS], 1, cv::LINE_AA);
+            }
+        }
+    };
+
+    bool open = true;
+    while (open && (key != 0x1b)) {    // esc
         int in;
         string str;
         switch (_input_data.mode)
@@ -524,13 +661,10 @@ bool ConfigGui::run()
                         
                 /// Draw fitted circumference.
                 if (r > 0) {
-                    drawCircle_camModel(disp_frame, _cam_model, c, r, Scalar(255,0,0), false);
-        
                     /// Display.
-                    if (_disp_scl > 0) {
-                        cv::resize(disp_frame, disp_frame, cv::Size(), _disp_scl, _disp_scl);
-                    }
-                    cv::imshow("configGUI", disp_frame);
+                    showFrame([&](Mat& img, const CameraModelPtr& model, double s) {
+                        drawCircle_camModel(img, model, c, r, Scalar(255,0,0), false);
+                    }, false);
                     cv::waitKey(100);   //FIXME: why do we have to wait so long to make sure the frame is drawn?
                             
                     printf("\n\n\n  Sphere ROI configuration was found in the config file.\n  You can keep it, or discard it and reconfigure.\n");
@@ -583,26 +717,17 @@ bool ConfigGui::run()
                     _input_data.newEvent = false;
                 }
                 
-                /// Draw previous clicks.
-                for (auto click : _input_data.circPts) {
-                    cv::circle(disp_frame, click, click_rad, Scalar(255,255,0), 1, cv::LINE_AA);
-                }
-                
-                /// Draw fitted circumference.
-                if (r > 0) { drawCircle_camModel(disp_frame, _cam_model, c, r, Scalar(255,0,0), false); }
-                
-                /// Draw cursor location.
-                drawCursor(disp_frame, _input_data.cursorPt, Scalar(0,255,0));
-                
-                /// Create zoomed window.
-                createZoomROI(zoom_frame, disp_frame, _input_data.cursorPt, scaled_zoom_dim);
-                
-                /// Display.
-                cv::imshow("zoomROI", zoom_frame);
-                if (_disp_scl > 0) {
-                    cv::resize(disp_frame, disp_frame, cv::Size(), _disp_scl, _disp_scl);
-                }
-                cv::imshow("configGUI", disp_frame);
+                /// Display (and zoomed window).
+                showFrame([&](Mat& img, const CameraModelPtr& model, double s) {
+                    /// Draw previous clicks.
+                    drawClicks(img, _input_data.circPts, s);
+
+                    /// Draw fitted circumference.
+                    if (r > 0) { drawCircle_camModel(img, model, c, r, Scalar(255,0,0), false); }
+
+                    /// Draw cursor location.
+                    drawCursor(img, _input_data.cursorPt * s, Scalar(0,255,0));
+                }, true);
                 key = cv::waitKey(5);
                 
                 /// State machine logic.
@@ -661,21 +786,10 @@ bool ConfigGui::run()
                         if (!tmp.empty()) { _input_data.ignrPts.push_back(tmp); }
                     }
                     
-                    /// Draw previous clicks.
-                    for (unsigned int i = 0; i < _input_data.ignrPts.size(); i++) {
-                        for (unsigned int j = 0; j < _input_data.ignrPts[i].size(); j++) {
-                            if (i == _input_data.ignrPts.size()-1) {
-                                cv::circle(disp_frame, _input_data.ignrPts[i][j], click_rad, COLOURS[i%NCOLOURS], 1, cv::LINE_AA);
-                            }
-                            cv::line(disp_frame, _input_data.ignrPts[i][j], _input_data.ignrPts[i][(j+1)%_input_data.ignrPts[i].size()], COLOURS[i%NCOLOURS], 1, cv::LINE_AA);
-                        }
-                    }
-                    
-                    /// Display.
-                    if (_disp_scl > 0) {
-                        cv::resize(disp_frame, disp_frame, cv::Size(), _disp_scl, _disp_scl);
-                    }
-                    cv::imshow("configGUI", disp_frame);
+                    /// Display previous clicks.
+                    showFrame([&](Mat& img, const CameraModelPtr& model, double s) {
+                        drawIgnr(img, s);
+                    }, false);
                     cv::waitKey(100);   //FIXME: why do we have to wait so long to make sure the frame is drawn?
                     
                     printf("\n\n\n  Ignore region points were found in the config file.\n  You can discard these points and re-run config or keep the existing points.\n");
@@ -717,31 +831,17 @@ bool ConfigGui::run()
             
             /// Input ignore regions.
             case IGNR_PTS:
-                /// Draw previous clicks.
-                for (unsigned int i = 0; i < _input_data.ignrPts.size(); i++) {
-                    for (unsigned int j = 0; j < _input_data.ignrPts[i].size(); j++) {
-                        if (i == _input_data.ignrPts.size()-1) {
-                            cv::circle(disp_frame, _input_data.ignrPts[i][j], click_rad, COLOURS[i%NCOLOURS], 1, cv::LINE_AA);
-                        }
-                        cv::line(disp_frame, _input_data.ignrPts[i][j], _input_data.ignrPts[i][(j+1)%_input_data.ignrPts[i].size()], COLOURS[i%NCOLOURS], 1, cv::LINE_AA);
-                    }
-                }
-                
-                /// Draw fitted circumference.
-                if (r > 0) { drawCircle_camModel(disp_frame, _cam_model, c, r, Scalar(255,0,0), false); }
-                
-                /// Draw cursor location.
-                drawCursor(disp_frame, _input_data.cursorPt, Scalar(0,255,0));
-                
-                /// Create zoomed window.
-                createZoomROI(zoom_frame, disp_frame, _input_data.cursorPt, scaled_zoom_dim);
-                
-                /// Display.
-                cv::imshow("zoomROI", zoom_frame);
-                if (_disp_scl > 0) {
-                    cv::resize(disp_frame, disp_frame, cv::Size(), _disp_scl, _disp_scl);
-                }
-                cv::imshow("configGUI", disp_frame);
+                /// Display (and zoomed window).
+                showFrame([&](Mat& img, const CameraModelPtr& model, double s) {
+                    /// Draw previous clicks.
+                    drawIgnr(img, s);
+
+                    /// Draw fitted circumference.
+                    if (r > 0) { drawCircle_camModel(img, model, c, r, Scalar(255,0,0), false); }
+
+                    /// Draw cursor location.
+                    drawCursor(img, _input_data.cursorPt * s, Scalar(0,255,0));
+                }, true);
                 key = cv::waitKey(5);
                 
                 /// State machine logic.
@@ -843,22 +943,17 @@ bool ConfigGui::run()
                     break;
                 }
 
-                /// Draw previous clicks.
-                for (auto click : _input_data.sqrPts) {
-                    cv::circle(disp_frame, click, click_rad, Scalar(255, 255, 0), 1, cv::LINE_AA);
-                }
-
-                /// Draw reference corners.
-                drawC2ACorners(disp_frame, c2a_src, R, t);
+				/// Display.
+                showFrame([&](Mat& img, const CameraModelPtr& model, double s) {
+                    /// Draw previous clicks.
+                    drawClicks(img, _input_data.sqrPts, s);
 
-                /// Draw axes.
-                drawC2AAxes(disp_frame, R, t, r, c);
+                    /// Draw reference corners.
+                    drawC2ACorners(img, model, c2a_src, R, t);
 
-				/// Display.
-                if (_disp_scl > 0) {
-                    cv::resize(disp_frame, disp_frame, cv::Size(), _disp_scl, _disp_scl);
-                }
-				cv::imshow("configGUI", disp_frame);
+                    /// Draw axes.
+                    drawC2AAxes(img, model, R, t, r, c);
+                }, false);
 				cv::waitKey(100);   //FIXME: why do we have to wait so long to make sure the frame is drawn?
 
 				printf("\n\n\n  A camera-animal transform was found in the config file.\n  You can keep the existing transform, or discard and re-run config.\n");
@@ -968,33 +1063,26 @@ bool ConfigGui::run()
             /// Define animal coordinate frame.
             case R_XY:
             
-                /// Draw previous clicks.
-                for (auto click : _input_data.sqrPts) {
-                    cv::circle(disp_frame, click, click_rad, Scalar(255,255,0), 1, cv::LINE_AA);
+                /// Update axes.
+                if ((_input_data.sqrPts.size() == 4) && _input_data.newEvent) {
+                    updateRt(c2a_src, R, t);
+                    _input_data.newEvent = false;
                 }
-                
-                /// Draw axes.
-                if (_input_data.sqrPts.size() == 4) {
-                    if (_input_data.newEvent) {
-                        updateRt(c2a_src, R, t);
-                        _input_data.newEvent = false;
+
+                /// Display (and zoomed window).
+                showFrame([&](Mat& img, const CameraModelPtr& model, double s) {
+                    /// Draw previous clicks.
+                    drawClicks(img, _input_data.sqrPts, s);
+
+                    /// Draw axes.
+                    if (_input_data.sqrPts.size() == 4) {
+                        drawC2ACorners(img, model, c2a_src, R, t);
+                        drawC2AAxes(img, model, R, t, r, c);
                     }
-                    drawC2ACorners(disp_frame, c2a_src, R, t);
-                    drawC2AAxes(disp_frame, R, t, r, c);
-                }
-                
-                /// Draw cursor location.
-                drawCursor(disp_frame, _input_data.cursorPt, Scalar(0,255,0));
-                
-                /// Create zoomed window.
-                createZoomROI(zoom_frame, disp_frame, _input_data.cursorPt, scaled_zoom_dim);
-                
-                /// Display.
-                cv::imshow("zoomROI", zoom_frame);
-                if (_disp_scl > 0) {
-                    cv::resize(disp_frame, disp_frame, cv::Size(), _disp_scl, _disp_scl);
-                }
-                cv::imshow("configGUI", disp_frame);
+
+                    /// Draw cursor location.
+                    drawCursor(img, _input_data.cursorPt * s, Scalar(0,255,0));
+                }, true);
                 key = cv::waitKey(5);
                 
                 /// State machine logic.
@@ -1024,33 +1112,26 @@ bool ConfigGui::run()
             /// Define animal coordinate frame.
             case R_YZ:
                 
-                /// Draw previous clicks.
-                for (auto click : _input_data.sqrPts) {
-                    cv::circle(disp_frame, click, click_rad, Scalar(255,255,0), 1, cv::LINE_AA);
+                /// Update axes.
+                if ((_input_data.sqrPts.size() == 4) && _input_data.newEvent) {
+                    updateRt(c2a_src, R, t);
+                    _input_data.newEvent = false;
                 }
-                
-                /// Draw axes.
-                if (_input_data.sqrPts.size() == 4) {
-                    if (_input_data.newEvent) {
-                        updateRt(c2a_src, R, t);
-                        _input_data.newEvent = false;
+
+                /// Display (and zoomed window).
+                showFrame([&](Mat& img, const CameraModelPtr& model, double s) {
+                    /// Draw previous clicks.
+                    drawClicks(img, _input_data.sqrPts, s);
+
+                    /// Draw axes.
+                    if (_input_data.sqrPts.size() == 4) {
+                        drawC2ACorners(img, model, c2a_src, R, t);
+                        drawC2AAxes(img, model, R, t, r, c);
                     }
-                    drawC2ACorners(disp_frame, c2a_src, R, t);
-                    drawC2AAxes(disp_frame, R, t, r, c);
-                }
-                
-                /// Draw cursor location.
-                drawCursor(disp_frame, _input_data.cursorPt, Scalar(0,255,0));
-                
-                /// Create zoomed window.
-                createZoomROI(zoom_frame, disp_frame, _input_data.cursorPt, scaled_zoom_dim);
-                
-                /// Display.
-                cv::imshow("zoomROI", zoom_frame);
-                if (_disp_scl > 0) {
-                    cv::resize(disp_frame, disp_frame, cv::Size(), _disp_scl, _disp_scl);
-                }
-                cv::imshow("configGUI", disp_frame);
+
+                    /// Draw cursor location.
+                    drawCursor(img, _input_data.cursorPt * s, Scalar(0,255,0));
+                }, true);
                 key = cv::waitKey(5);
                 
                 /// State machine logic.
@@ -1080,33 +1161,26 @@ bool ConfigGui::run()
             /// Define animal coordinate frame.
             case R_XZ:
                 
-                /// Draw previous clicks.
-                for (auto click : _input_data.sqrPts) {
-                    cv::circle(disp_frame, click, click_rad, Scalar(255,255,0), 1, cv::LINE_AA);
+                /// Update axes.
+                if ((_input_data.sqrPts.size() == 4) && _input_data.newEvent) {
+                    updateRt(c2a_src, R, t);
+                    _input_data.newEvent = false;
                 }
-                
-                /// Draw axes.
-                if (_input_data.sqrPts.size() == 4) {
-                    if (_input_data.newEvent) {
-                        updateRt(c2a_src, R, t);
-                        _input_data.newEvent = false;
+
+                /// Display (and zoomed window).
+                showFrame([&](Mat& img, const CameraModelPtr& model, double s) {
+                    /// Draw previous clicks.
+                    drawClicks(img, _input_data.sqrPts, s);
+
+                    /// Draw axes.
+                    if (_input_data.sqrPts.size() == 4) {
+                        drawC2ACorners(img, model, c2a_src, R, t);
+                        drawC2AAxes(img, model, R, t, r, c);
                     }
-                    drawC2ACorners(disp_frame, c2a_src, R, t);
-                    drawC2AAxes(disp_frame, R, t, r, c);
-                }
-                
-                /// Draw cursor location.
-                drawCursor(disp_frame, _input_data.cursorPt, Scalar(0,255,0));
-                
-                /// Create zoomed window.
-                createZoomROI(zoom_frame, disp_frame, _input_data.cursorPt, scaled_zoom_dim);
-                
-                /// Display.
-                cv::imshow("zoomROI", zoom_frame);
-                if (_disp_scl > 0) {
-                    cv::resize(disp_frame, disp_frame, cv::Size(), _disp_scl, _disp_scl);
-                }
-                cv::imshow("configGUI", disp_frame);
+
+                    /// Draw cursor location.
+                    drawCursor(img, _input_data.cursorPt * s, Scalar(0,255,0));
+                }, true);
                 key = cv::waitKey(5);
                 
                 /// State machine logic.
@@ -1190,7 +1264,7 @@ bool ConfigGui::run()
 
 	/// Save config image
 	//cv::cvtColor(_frame, disp_frame, CV_GRAY2RGB);
-    disp_frame = frame.clone();
+    Mat disp_frame = frame.clone();
 
 	// draw fitted circumference
 	if (r > 0) {
@@ -1198,20 +1272,13 @@ bool ConfigGui::run()
 	}
 
 	// draw ignore regions
-	for (unsigned int i = 0; i < _input_data.ignrPts.size(); i++) {
-		for (unsigned int j = 0; j < _input_data.ignrPts[i].size(); j++) {
-			if (i == _input_data.ignrPts.size() - 1) {
-				cv::circle(disp_frame, _input_data.ignrPts[i][j], click_rad, COLOURS[i%NCOLOURS], 1, cv::LINE_AA);
-			}
-			cv::line(disp_frame, _input_data.ignrPts[i][j], _input_data.ignrPts[i][(j + 1) % _input_data.ignrPts[i].size()], COLOURS[i%NCOLOURS], 1, cv::LINE_AA);
-		}
-	}
+	drawIgnr(disp_frame, 1);
 
 	// draw animal coordinate frame
 	if (_input_data.sqrPts.size() == 4) {
-        drawC2ACorners(disp_frame, c2a_src, R, t);
+        drawC2ACorners(disp_frame, _cam_model, c2a_src, R, t);
 	}
-    drawC2AAxes(disp_frame, R, t, r, c);
+    drawC2AAxes(disp_frame, _cam_model, R, t, r, c);
 
 	// write image to disk
 	string cfg_img_fn = _base_fn + "-configImg.png";
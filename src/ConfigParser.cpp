@@ -58,6 +58,32 @@ int ConfigParser::read(string fn)
     
     _fn = fn;   // save file name for debugging
 
+    int ret = parse(f);
+
+    /// Clean up
+    f.close();
+
+    return ret;
+}
+
+///
+/// Parse config from a string (same format as a config file).
+///
+int ConfigParser::readString(const string& cfg)
+{
+    LOG("Parsing config string ..");
+
+    std::istringstream ss(cfg);
+    _fn.clear();    // nothing to write back to
+
+    return parse(ss);
+}
+
+///
+///
+///
+int ConfigParser::parse(std::istream& f)
+{
     /// Parse to map
     string line;
     _data.clear();
@@ -87,10 +113,7 @@ int ConfigParser::read(string fn)
         LOG_DBG("Extracted key: |%s|  val: |%s|", key.c_str(), val.c_str());
     }
 
-    /// Clean up
-    f.close();
-
-    LOG("Config file parsed (%d key/value pairs).", _data.size());
+    LOG("Config parsed (%d key/value pairs).", _data.size());
 
     return static_cast<int>(_data.size());
 }
@@ -111,7 +134,7 @@ int ConfigParser::write(string fn)
     f << "## FicTrac v" << FICTRAC_VERSION_MAJOR << "." << FICTRAC_VERSION_MIDDLE << "." << FICTRAC_VERSION_MINOR << " config file (build date " << __DATE__ << ")" << std::endl;
 
     /// Write map
-    static char tmps[4096];
+    char tmps[4096];
     for (auto& it : _data) {
         // warning: super long str vals will cause overwrite error!
         try { sprintf(tmps, "%-16s : %s\n", it.first.c_str(), it.second.c_str()); }
@@ -0,0 +1,71 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       DirtyTiles.cpp
+/// \brief      Changed-region tracking for incremental sphere map copies.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "DirtyTiles.h"
+
+#include "TiledMap.h"
+#include "Logger.h"
+
+#include <algorithm>    // fill, min
+
+using cv::Mat;
+using cv::Rect;
+
+///
+///
+///
+DirtyTiles::DirtyTiles(int w, int h)
+    : _w(w), _h(h), _tw((w + TILE - 1) >> TILE_BITS), _th((h + TILE - 1) >> TILE_BITS), _cur(1)
+{
+    _ver.assign(_tw * _th, _cur);
+}
+
+///
+///
+///
+void DirtyTiles::markAll()
+{
+    std::fill(_ver.begin(), _ver.end(), _cur);
+}
+
+///
+/// Runs of changed tiles along a tile row are copied as one region.
+///
+int DirtyTiles::update(const Mat& src, Mat& dst, uint64_t& ver, TiledMap* tiles)
+{
+    if ((src.cols != _w) || (src.rows != _h)) {
+        LOG_ERR("Error! Map does not match dirty tile map (%dx%d)!", _w, _h);
+        return 0;
+    }
+
+    int ncopied = 0;
+    if ((ver == 0) || (dst.size() != src.size()) || (dst.type() != src.type())) {
+        src.copyTo(dst);
+        if (tiles) { tiles->fromMat(dst); }
+        ncopied = _tw * _th;
+    } else {
+        for (int ti = 0; ti < _th; ti++) {
+            const uint64_t* pver = &_ver[ti * _tw];
+            for (int tj = 0; tj < _tw; ) {
+                if (pver[tj] <= ver) { tj++; continue; }
+                int tk = tj + 1;
+                while ((tk < _tw) && (pver[tk] > ver)) { tk++; }
+
+                const int x = tj << TILE_BITS, y = ti << TILE_BITS;
+                Rect r(x, y, std::min(tk << TILE_BITS, _w) - x, std::min(TILE, _h - y));
+                src(r).copyTo(dst(r));
+                if (tiles) { tiles->fromMat(dst, r); }
+
+                ncopied += tk - tj;
+                tj = tk;
+            }
+        }
+    }
+
+    /// Tiles marked from now on are newer than this copy.
+    ver = _cur++;
+    return ncopied;
+}
@@ -0,0 +1,206 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       DumpSource.cpp
+/// \brief      Replays a frame dump (see FrameDump.h) from a read-only file mapping.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "DumpSource.h"
+
+#include "Logger.h"
+#include "timing.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>      // memcpy, memset
+#include <cmath>        // round
+#include <algorithm>    // min
+
+using cv::Mat;
+using namespace std;
+using namespace framedump;
+
+const string DUMP_EXT = ".ftrd";
+
+///
+///
+///
+bool DumpSource::isDump(const string& fn)
+{
+    return (fn.size() > DUMP_EXT.size()) && (fn.compare(fn.size() - DUMP_EXT.size(), DUMP_EXT.size(), DUMP_EXT) == 0);
+}
+
+///
+/// Map the whole file and validate the header.
+///
+DumpSource::DumpSource(string fn)
+    : _base(nullptr), _len(0), _nframes(0), _pos(0), _start_frame(0), _t0(-1)
+#ifdef _WIN32
+    , _file(INVALID_HANDLE_VALUE), _mapping(NULL)
+#endif
+{
+    LOG_DBG("Source is: %s", fn.c_str());
+    memset(&_hdr, 0, sizeof(_hdr));
+    _live = false;
+
+#ifdef _WIN32
+    _file = CreateFileA(fn.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (_file == INVALID_HANDLE_VALUE) {
+        LOG_ERR("Error! Could not open frame dump %s (err = %d).", fn.c_str(), GetLastError());
+        return;
+    }
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(_file, &sz) || (sz.QuadPart < static_cast<LONGLONG>(DATA_OFFSET))) {
+        LOG_ERR("Error! Frame dump %s is too short.", fn.c_str());
+        return;
+    }
+    _len = static_cast<uint64_t>(sz.QuadPart);
+    _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (_mapping == NULL) {
+        LOG_ERR("Error! Could not map frame dump %s (err = %d).", fn.c_str(), GetLastError());
+        return;
+    }
+    _base = static_cast<const uint8_t*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (_base == NULL) {
+        LOG_ERR("Error! Could not map frame dump %s (err = %d).", fn.c_str(), GetLastError());
+        return;
+    }
+#else
+    int fd = ::open(fn.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERR("Error! Could not open frame dump %s.", fn.c_str());
+        return;
+    }
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (st.st_size < static_cast<off_t>(DATA_OFFSET))) {
+        LOG_ERR("Error! Frame dump %s is too short.", fn.c_str());
+        ::close(fd);
+        return;
+    }
+    _len = static_cast<uint64_t>(st.st_size);
+    void* p = mmap(nullptr, _len, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        LOG_ERR("Error! Could not map frame dump %s.", fn.c_str());
+        _len = 0;
+        return;
+    }
+    madvise(p, _len, MADV_SEQUENTIAL);
+    _base = static_cast<const uint8_t*>(p);
+#endif
+
+    memcpy(&_hdr, _base, sizeof(_hdr));
+    if ((_hdr.magic != MAGIC) || (_hdr.version != VERSION) || (_hdr.hdr_size != sizeof(Header)) ||
+        (_hdr.width == 0) || (_hdr.height == 0) || (_hdr.rec_size < recordSize(_hdr.width, _hdr.height)) || (_hdr.data_offset < sizeof(Header)))
+    {
+        LOG_ERR("Error! %s is not a valid frame dump.", fn.c_str());
+        return;
+    }
+
+    /// Complete records (the header count lags if the recording was not closed).
+    const uint64_t nrec = (_len > _hdr.data_offset) ? (_len - _hdr.data_offset) / _hdr.rec_size : 0;
+    _nframes = std::min(_hdr.nframes, nrec);
+    while (_nframes < nrec) {
+        FrameHeader fh;
+        memcpy(&fh, record(_nframes), sizeof(fh));
+        if (fh.seq != (_nframes + 1)) { break; }
+        _nframes++;
+    }
+    if (_nframes != _hdr.nframes) {
+        LOG_WRN("Warning! Frame dump %s was not closed cleanly - recovered %llu frames.", fn.c_str(), static_cast<unsigned long long>(_nframes));
+    }
+    if (_nframes == 0) {
+        LOG_ERR("Error! Frame dump %s contains no frames.", fn.c_str());
+        return;
+    }
+
+    _width = _hdr.width;
+    _height = _hdr.height;
+    _open = true;
+    LOG("Frame dump source initialised (%dx%d, %llu frames, recorded @ %.3f fps)!", _width, _height, static_cast<unsigned long long>(_nframes), _hdr.fps);
+}
+
+///
+///
+///
+DumpSource::~DumpSource()
+{
+#ifdef _WIN32
+    if (_base) { UnmapViewOfFile(_base); }
+    if (_mapping) { CloseHandle(_mapping); }
+    if (_file != INVALID_HANDLE_VALUE) { CloseHandle(_file); }
+#else
+    if (_base) { munmap(const_cast<uint8_t*>(_base), _len); }
+#endif
+}
+
+///
+/// Recorded frame rate (unless a playback rate has been set).
+///
+double DumpSource::getFPS()
+{
+    return (_fps > 0) ? _fps : _hdr.fps;
+}
+
+///
+///
+///
+bool DumpSource::rewind()
+{
+    if (!_open) { return false; }
+    _pos = _start_frame;
+    _t0 = -1;
+    return true;
+}
+
+///
+/// Random access - any frame is a fixed offset into the file.
+///
+bool DumpSource::setStartFrame(int frame)
+{
+    if (!_open || (frame < 0) || (static_cast<uint64_t>(frame) >= _nframes)) { return false; }
+    _start_frame = frame;
+    return rewind();
+}
+
+///
+///
+///
+bool DumpSource::grab(cv::Mat& frame)
+{
+    Mat buf;
+    if (!grabBuffer(buf)) { return false; }
+    buf.copyTo(frame);
+    return true;
+}
+
+///
+/// Wraps the mapped record (no copy).
+///
+bool DumpSource::grabBuffer(cv::Mat& frame)
+{
+    if (!_open || (_pos >= _nframes)) { return false; }
+
+    const uint8_t* rec = record(_pos);
+    FrameHeader fh;
+    memcpy(&fh, rec, sizeof(fh));
+    _timestamp = fh.timestamp;
+    _ms_since_midnight = fh.ms_since_midnight;
+    frame = Mat(_height, _width, CV_8UC1, const_cast<uint8_t*>(rec + sizeof(FrameHeader)));
+
+    /// Paced playback if a frame rate was requested (src_fps), else as fast as possible.
+    if (_fps > 0) {
+        double t = ts_ms();
+        if (_t0 < 0) { _t0 = t; }
+        double wait = _t0 + 1000. * (_pos - _start_frame) / _fps - t;
+        if (wait >= 1) { sleep(static_cast<long>(round(wait))); }
+    }
+
+    LOG_DBG("Frame %llu replayed @ %f (t_day: %f ms)", static_cast<unsigned long long>(_pos), _timestamp, _ms_since_midnight);
+    _pos++;
+    return true;
+}
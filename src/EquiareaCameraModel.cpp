@@ -23,6 +23,8 @@ public:
 		CmReal lonLeft, CmReal lonExtent);
 	virtual bool pixelToVector(CmReal x, CmReal y, CmReal direction[3]) const;
 	virtual bool vectorToPixel(const CmReal point[3], CmReal& x, CmReal& y) const;
+	using CameraModel::getProjection;
+	virtual bool getProjection(proj::EquiArea& p) const;
 	/// validPixel() is any within the image area, so use default method
 
 	///
@@ -108,3 +110,20 @@ bool EquiAreaCameraModel::vectorToPixel(
 
 	return _validXY(x,y);
 }
+
+///
+/// Inline projection (single wrap only, see proj::EquiArea).
+///
+bool EquiAreaCameraModel::getProjection(proj::EquiArea& p) const
+{
+	if ((fabs(_lonLeft) > CM_PI) || (fabs(_latTop) > CM_PI_2)) { return false; }
+	p.lat_top = _latTop;
+	p.lat_per_pix = _latPerPixel;
+	p.lat_wrap = _latPixelsPerWrap;
+	p.lon_left = _lonLeft;
+	p.lon_per_pix = _lonPerPixel;
+	p.lon_wrap = _lonPixelsPerWrap;
+	p.w = _width;
+	p.h = _height;
+	return true;
+}
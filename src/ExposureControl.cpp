@@ -0,0 +1,153 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ExposureControl.cpp
+/// \brief      Closed-loop exposure/gain control from sphere ROI statistics.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "ExposureControl.h"
+
+#include "Logger.h"
+#include "misc.h"
+
+#include <cmath>
+#include <algorithm>    // min, max
+#include <chrono>
+
+using namespace std;
+
+const double AE_DEADBAND = 0.05;        // fraction of target
+const double AE_DAMPING = 0.5;          // fraction of the (log) error corrected per step
+const double AE_STEP_MIN = 0.5;         // largest single step down/up (brightness scale)
+const double AE_STEP_MAX = 2.0;
+const double AE_SAT_MAX = 0.01;         // saturated ROI fraction that forces a step down
+const double AE_SAT_SCALE = 0.7;
+const double AE_FRAME_PC = 0.95;        // max exposure as fraction of the frame period
+
+///
+///
+///
+ExposureControl::ExposureControl(shared_ptr<FrameSource> source, double target, double period_ms)
+    : _source(source), _target(target), _period_ms(std::max(period_ms, 1.0)),
+    _exp_us(0), _exp_min(0), _exp_max(0), _gain_db(0), _gain_min(0), _gain_max(0), _has_gain(false),
+    _want(false), _mean(0), _sat_frac(0), _pending(false), _active(false)
+{
+    if (!_source || !_source->isLive() || !_source->getExposure(_exp_us, _exp_min, _exp_max) || (_exp_max <= _exp_min)) {
+        LOG_WRN("Warning! Frame source does not support exposure control - auto exposure (ae_target) disabled.");
+        return;
+    }
+    _has_gain = _source->getGain(_gain_db, _gain_min, _gain_max) && (_gain_max > _gain_min);
+
+    /// Take over from any on-camera auto exposure.
+    if (!_source->setExposure(_exp_us)) {
+        LOG_WRN("Warning! Unable to set camera exposure - auto exposure (ae_target) disabled.");
+        return;
+    }
+    if (_has_gain && !_source->setGain(_gain_db)) {
+        _has_gain = false;
+    }
+
+    LOG("Auto exposure enabled (target ROI mean %.0f, exposure %.0f us [%.0f, %.0f]%s).", _target, _exp_us, _exp_min, _exp_max,
+        _has_gain ? ", with gain" : "");
+
+    _active = true;
+    _want = true;
+    _thread = StartThread(&ExposureControl::process, this);
+}
+
+///
+///
+///
+ExposureControl::~ExposureControl()
+{
+    {
+        lock_guard<mutex> l(_mutex);
+        _active = false;
+        _want = false;
+    }
+    _cond.notify_all();
+    if (_thread && _thread->joinable()) {
+        _thread->join();
+    }
+}
+
+///
+///
+///
+void ExposureControl::update(double mean, double sat_frac)
+{
+    {
+        lock_guard<mutex> l(_mutex);
+        _mean = mean;
+        _sat_frac = sat_frac;
+        _pending = true;
+        _want = false;
+    }
+    _cond.notify_all();
+}
+
+///
+/// Brightness is treated as linear in exposure time and in linear gain.
+///
+void ExposureControl::process()
+{
+    if (!SetThreadNormalPriority()) {
+        LOG_ERR("Error! Exposure control thread unable to set thread priority!");
+    }
+    if (!ApplyThreadClass(ThreadClass::IO)) {
+        LOG_WRN("Warning! Unable to apply exposure control thread placement (cpus_io)!");
+    }
+
+    const auto period = chrono::microseconds(static_cast<long long>(1000 * _period_ms));
+
+    unique_lock<mutex> l(_mutex);
+    while (_active) {
+        /// Wait for statistics.
+        _cond.wait(l, [&] { return _pending || !_active; });
+        if (!_active) { break; }
+        const double mean = _mean, sat_frac = _sat_frac;
+        _pending = false;
+        l.unlock();
+
+        /// Brightness correction for this step.
+        double scale = 1;
+        if (sat_frac > AE_SAT_MAX) {
+            scale = AE_SAT_SCALE;
+        }
+        else if (fabs(mean - _target) > (AE_DEADBAND * _target)) {
+            scale = pow(_target / std::max(mean, 1.0), AE_DAMPING);
+        }
+        scale = std::min(AE_STEP_MAX, std::max(AE_STEP_MIN, scale));
+
+        if (scale != 1) {
+            /// Exposure is also limited by the frame period.
+            const double fps = _source->getFPS();
+            const double exp_max = (fps > 0) ? std::min(_exp_max, AE_FRAME_PC * 1e6 / fps) : _exp_max;
+            double exp_us = _exp_us, gain_db = _gain_db;
+            if (scale > 1) {
+                /// Exposure first (less noise), then gain.
+                exp_us = std::min(exp_max, _exp_us * scale);
+                if (_has_gain) {
+                    const double rem = scale * _exp_us / exp_us;
+                    gain_db = std::min(_gain_max, _gain_db + 20 * log10(rem));
+                }
+            }
+            else {
+                /// Gain first, then exposure.
+                if (_has_gain) {
+                    gain_db = std::max(_gain_min, _gain_db + 20 * log10(scale));
+                    scale /= pow(10, (gain_db - _gain_db) / 20);
+                }
+                exp_us = std::max(_exp_min, _exp_us * scale);
+            }
+
+            if ((exp_us != _exp_us) && _source->setExposure(exp_us)) { _exp_us = exp_us; }
+            if (_has_gain && (gain_db != _gain_db) && _source->setGain(gain_db)) { _gain_db = gain_db; }
+            LOG_DBG("Auto exposure: ROI mean %.1f (saturated %.2f%%) -> exposure %.0f us, gain %.1f dB", mean, 100 * sat_frac, _exp_us, _gain_db);
+        }
+
+        /// Rate limit.
+        l.lock();
+        _cond.wait_for(l, period, [&] { return !_active; });
+        _want = _active.load();
+    }
+}
@@ -11,7 +11,8 @@
 ///
 ///
 ///
-FileRecorder::FileRecorder()
+FileRecorder::FileRecorder(bool binary)
+    : _binary(binary)
 {
     _type = FILE;
 }
@@ -29,7 +30,7 @@ FileRecorder::~FileRecorder()
 ///
 bool FileRecorder::openRecord(std::string fn)
 {
-    _file.open(fn);
+    _file.open(fn, _binary ? (std::ios::out | std::ios::binary) : std::ios::out);
     _open = _file.is_open();
     if (!_open) {
         std::cerr << "Error! FileRecorder could not open output file (" << fn << ")!" << std::endl;
@@ -40,7 +41,7 @@ bool FileRecorder::openRecord(std::string fn)
 ///
 ///
 ///
-bool FileRecorder::writeRecord(std::string s)
+bool FileRecorder::writeRecord(const std::string& s)
 {
     if (!_open) { return false; }
     _file << s;
@@ -48,6 +49,18 @@ bool FileRecorder::writeRecord(std::string s)
     return true;
 }
 
+///
+/// Write batch with a single flush.
+///
+bool FileRecorder::writeRecords(const char* a, size_t na, const char* b, size_t nb)
+{
+    if (!_open) { return false; }
+    _file.write(a, na);
+    _file.write(b, nb);
+    _file.flush();
+    return true;
+}
+
 ///
 ///
 ///
@@ -22,6 +22,8 @@ public:
 	virtual bool pixelToVector(CmReal x, CmReal y, CmReal direction[3]) const;
 	virtual bool vectorToPixel(const CmReal point[3], CmReal& x, CmReal& y) const;
 	virtual bool validPixel(CmReal x, CmReal y) const;
+	using CameraModel::getProjection;
+	virtual bool getProjection(proj::Fisheye& p) const;
 	virtual CmReal getFOV() const {
 		return _imageCircleFOV;
 	}
@@ -113,3 +115,17 @@ bool FisheyeCameraModel::validPixel(CmReal x, CmReal y) const
 	CmReal dy = y - _yc;
 	return _validPixel(x, y, dx*dx + dy*dy);
 }
+
+///
+/// Inline projection.
+///
+bool FisheyeCameraModel::getProjection(proj::Fisheye& p) const
+{
+	p.rad_per_pix = _radPerPixel;
+	p.xc = _xc;
+	p.yc = _yc;
+	p.r2max = _imageCircleR2;
+	p.w = _width;
+	p.h = _height;
+	return true;
+}
@@ -0,0 +1,261 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       FrameDump.cpp
+/// \brief      Lossless raw frame dump (memory-mapped sequential file of Mono8 frames).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "FrameDump.h"
+
+#include "Logger.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>      // memcpy, memset
+#include <algorithm>    // max
+
+using namespace std;
+using namespace framedump;
+
+/// Size of the mapped window (the file is extended a window at a time).
+const uint64_t WINDOW_BYTES = 64ull << 20;
+
+///
+///
+///
+FrameDumpWriter::FrameDumpWriter()
+    : _open(false), _gran(4096), _win_len(0), _win_off(0), _win(nullptr), _file_len(0)
+#ifdef _WIN32
+    , _file(INVALID_HANDLE_VALUE), _mapping(NULL)
+#else
+    , _fd(-1)
+#endif
+{
+    memset(&_hdr, 0, sizeof(_hdr));
+}
+
+///
+///
+///
+FrameDumpWriter::~FrameDumpWriter()
+{
+    close();
+}
+
+///
+///
+///
+bool FrameDumpWriter::open(const string& fn, int width, int height, double fps)
+{
+    close();
+
+    if ((width <= 0) || (height <= 0)) {
+        LOG_ERR("Error! Invalid frame dump size (%dx%d).", width, height);
+        return false;
+    }
+
+    memset(&_hdr, 0, sizeof(_hdr));
+    _hdr.magic = MAGIC;
+    _hdr.version = VERSION;
+    _hdr.hdr_size = sizeof(Header);
+    _hdr.width = width;
+    _hdr.height = height;
+    _hdr.data_offset = DATA_OFFSET;
+    _hdr.rec_size = recordSize(width, height);
+    _hdr.nframes = 0;
+    _hdr.fps = fps;
+
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    _gran = si.dwAllocationGranularity;
+
+    _file = CreateFileA(fn.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (_file == INVALID_HANDLE_VALUE) {
+        LOG_ERR("Error! Could not open frame dump %s (err = %d).", fn.c_str(), GetLastError());
+        return false;
+    }
+#else
+    _gran = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+
+    _fd = ::open(fn.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (_fd < 0) {
+        LOG_ERR("Error! Could not open frame dump %s.", fn.c_str());
+        return false;
+    }
+#endif
+    _file_len = 0;
+    _open = true;
+
+    if (!writeHeader()) {
+        LOG_ERR("Error! Could not write frame dump header (%s).", fn.c_str());
+        close();
+        return false;
+    }
+
+    LOG_DBG("Opened frame dump %s (%dx%d, %llu bytes/frame).", fn.c_str(), width, height, static_cast<unsigned long long>(_hdr.rec_size));
+    return true;
+}
+
+///
+/// Map the window containing the record at file offset off (extending the file as needed).
+///
+bool FrameDumpWriter::mapWindow(uint64_t off)
+{
+    unmapWindow();
+
+    /// Publish progress so far before moving on.
+    writeHeader();
+
+    const uint64_t base = (off / _gran) * _gran;
+    const uint64_t need = off - base + _hdr.rec_size;
+    const uint64_t len = ((std::max(WINDOW_BYTES, need) + _gran - 1) / _gran) * _gran;
+    const uint64_t end = base + len;
+
+#ifdef _WIN32
+    if (end > _file_len) {
+        /// A larger mapping extends the file.
+        if (_mapping) { CloseHandle(_mapping); }
+        _mapping = CreateFileMappingA(_file, NULL, PAGE_READWRITE, static_cast<DWORD>(end >> 32), static_cast<DWORD>(end & 0xFFFFFFFF), NULL);
+        if (_mapping == NULL) {
+            LOG_ERR("Error! Could not extend frame dump (err = %d).", GetLastError());
+            return false;
+        }
+        _file_len = end;
+    }
+    void* p = MapViewOfFile(_mapping, FILE_MAP_WRITE, static_cast<DWORD>(base >> 32), static_cast<DWORD>(base & 0xFFFFFFFF), static_cast<SIZE_T>(len));
+    if (p == NULL) {
+        LOG_ERR("Error! Could not map frame dump (err = %d).", GetLastError());
+        return false;
+    }
+#else
+    if (end > _file_len) {
+        if (ftruncate(_fd, static_cast<off_t>(end)) != 0) {
+            LOG_ERR("Error! Could not extend frame dump.");
+            return false;
+        }
+        _file_len = end;
+    }
+    void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, static_cast<off_t>(base));
+    if (p == MAP_FAILED) {
+        LOG_ERR("Error! Could not map frame dump.");
+        return false;
+    }
+    madvise(p, len, MADV_SEQUENTIAL);
+#endif
+
+    _win = static_cast<uint8_t*>(p);
+    _win_off = base;
+    _win_len = len;
+    return true;
+}
+
+///
+///
+///
+void FrameDumpWriter::unmapWindow()
+{
+    if (!_win) { return; }
+#ifdef _WIN32
+    UnmapViewOfFile(_win);
+#else
+    munmap(_win, _win_len);     // dirty pages are written back by the OS
+#endif
+    _win = nullptr;
+}
+
+///
+///
+///
+bool FrameDumpWriter::writeHeader()
+{
+#ifdef _WIN32
+    OVERLAPPED ov = {};
+    DWORD n = 0;
+    return WriteFile(_file, &_hdr, sizeof(_hdr), &n, &ov) && (n == sizeof(_hdr));
+#else
+    return pwrite(_fd, &_hdr, sizeof(_hdr), 0) == static_cast<ssize_t>(sizeof(_hdr));
+#endif
+}
+
+///
+///
+///
+bool FrameDumpWriter::write(const cv::Mat& frame, double timestamp, double ms_since_midnight)
+{
+    if (!_open) { return false; }
+    if ((frame.cols != static_cast<int>(_hdr.width)) || (frame.rows != static_cast<int>(_hdr.height)) || (frame.type() != CV_8UC1)) {
+        LOG_ERR("Error! Frame dump expects %dx%d Mono8 frames (got %dx%d, type %d).", _hdr.width, _hdr.height, frame.cols, frame.rows, frame.type());
+        return false;
+    }
+
+    const uint64_t off = _hdr.data_offset + _hdr.nframes * _hdr.rec_size;
+    if (!_win || (off < _win_off) || ((off + _hdr.rec_size) > (_win_off + _win_len))) {
+        if (!mapWindow(off)) {
+            close();
+            return false;
+        }
+    }
+
+    uint8_t* rec = _win + (off - _win_off);
+    uint8_t* pix = rec + sizeof(FrameHeader);
+    if (frame.isContinuous()) {
+        memcpy(pix, frame.data, _hdr.width * _hdr.height);
+    } else {
+        for (int r = 0; r < frame.rows; r++) {
+            memcpy(pix + r * _hdr.width, frame.ptr(r), _hdr.width);
+        }
+    }
+
+    /// Record header (marks the record complete) after the pixels.
+    FrameHeader fh;
+    fh.seq = _hdr.nframes + 1;
+    fh.timestamp = timestamp;
+    fh.ms_since_midnight = ms_since_midnight;
+    fh.reserved = 0;
+    memcpy(rec, &fh, sizeof(fh));
+
+    _hdr.nframes++;
+    return true;
+}
+
+///
+///
+///
+void FrameDumpWriter::close()
+{
+    if (!_open) { return; }
+
+    unmapWindow();
+    const uint64_t len = _hdr.data_offset + _hdr.nframes * _hdr.rec_size;
+
+#ifdef _WIN32
+    if (_mapping) {
+        CloseHandle(_mapping);
+        _mapping = NULL;
+    }
+    writeHeader();
+    LARGE_INTEGER pos;
+    pos.QuadPart = static_cast<LONGLONG>(len);
+    if (!SetFilePointerEx(_file, pos, NULL, FILE_BEGIN) || !SetEndOfFile(_file)) {
+        LOG_WRN("Warning! Could not trim frame dump (err = %d).", GetLastError());
+    }
+    CloseHandle(_file);
+    _file = INVALID_HANDLE_VALUE;
+#else
+    writeHeader();
+    if (ftruncate(_fd, static_cast<off_t>(len)) != 0) {
+        LOG_WRN("Warning! Could not trim frame dump.");
+    }
+    ::close(_fd);
+    _fd = -1;
+#endif
+
+    _file_len = 0;
+    _open = false;
+    LOG_DBG("Closed frame dump (%llu frames).", static_cast<unsigned long long>(_hdr.nframes));
+}
@@ -10,19 +10,89 @@
 
 #include "Logger.h"
 #include "misc.h"
+#include "Profiler.h"
 
 /// OpenCV individual includes required by gcc?
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>  
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/videoio.hpp>
+#if defined(FICTRAC_OPENCL)
+#include <opencv2/core/ocl.hpp>
+#endif
 
 #include <cmath>    // round
 #include <string>
+#include <algorithm>    // min, max
 
 using cv::Mat;
 using namespace std;
 
+/// Frame queue length when max_buf_len is unbounded.
+const int MAX_QUEUE_LEN_DEFAULT = 64;
+
+/// Fixed-point remap/colour conversion, as used by cv::remap (INTER_LINEAR) and cv::cvtColor (BGR2GRAY).
+const int REMAP_FRAC_BITS = 5;
+const int REMAP_COEF_BITS = 15;
+const int GREY_SHIFT = 14;
+const int GREY_B = 1868, GREY_G = 9617, GREY_R = 4899;
+
+namespace {
+
+struct MaxOp { uint8_t operator()(uint8_t a, uint8_t b) const { return (a > b) ? a : b; } };
+struct MinOp { uint8_t operator()(uint8_t a, uint8_t b) const { return (a < b) ? a : b; } };
+
+///
+/// Sliding window (centred, width win) min/max over a sequence of n elements, each a
+/// vector of len bytes, using the van Herk/Gil-Werman algorithm (3 ops per element,
+/// independent of win). Window is clipped at the ends (i.e. padded with neutral).
+///
+template <typename Op>
+void slidingWindow(const uint8_t* src, uint8_t* dst, int n, int len, int win, uint8_t neutral, Op op,
+    vector<uint8_t>& g, vector<uint8_t>& h)
+{
+    const int rad = (win - 1) / 2;
+    const int np = n + 2 * rad;     // padded length
+    g.resize(np * len);
+    h.resize(np * len);
+
+    /// Forward/backward running min/max within blocks of win elements.
+    for (int p = 0; p < np; p++) {
+        const int e = p - rad;
+        const uint8_t* in = ((e >= 0) && (e < n)) ? &src[e * len] : nullptr;
+        uint8_t* pg = &g[p * len];
+        if ((p % win) == 0) {
+            for (int x = 0; x < len; x++) { pg[x] = in ? in[x] : neutral; }
+        } else {
+            const uint8_t* pprev = pg - len;
+            if (in) { for (int x = 0; x < len; x++) { pg[x] = op(pprev[x], in[x]); } }
+            else { for (int x = 0; x < len; x++) { pg[x] = pprev[x]; } }
+        }
+    }
+    for (int p = np - 1; p >= 0; p--) {
+        const int e = p - rad;
+        const uint8_t* in = ((e >= 0) && (e < n)) ? &src[e * len] : nullptr;
+        uint8_t* ph = &h[p * len];
+        if (((p % win) == (win - 1)) || (p == (np - 1))) {
+            for (int x = 0; x < len; x++) { ph[x] = in ? in[x] : neutral; }
+        } else {
+            const uint8_t* pnext = ph + len;
+            if (in) { for (int x = 0; x < len; x++) { ph[x] = op(pnext[x], in[x]); } }
+            else { for (int x = 0; x < len; x++) { ph[x] = pnext[x]; } }
+        }
+    }
+
+    /// Window [p, p + win - 1] in padded coords spans at most two blocks.
+    for (int e = 0; e < n; e++) {
+        const uint8_t* ph = &h[e * len];
+        const uint8_t* pg = &g[(e + win - 1) * len];
+        uint8_t* out = &dst[e * len];
+        for (int x = 0; x < len; x++) { out[x] = op(ph[x], pg[x]); }
+    }
+}
+
+} // namespace
+
 ///
 ///
 ///
@@ -33,8 +103,14 @@ FrameGrabber::FrameGrabber( shared_ptr<FrameSource> source,
                             double                  thresh_win_pc,
                             string                  thresh_rgb_transform,
                             int                     max_buf_len,
-                            int                     max_frame_cnt
-)   : _source(source), _remapper(remapper), _remap_mask(remap_mask), _active(false)
+                            int                     max_frame_cnt,
+                            bool                    keep_src_frames,
+                            int                     spin_wait_us,
+                            bool                    fused_prep,
+                            bool                    use_gpu,
+                            int                     held_src_frames,
+                            shared_ptr<ExposureControl> exposure
+)   : _source(source), _remapper(remapper), _remap_mask(remap_mask), _thresh_pending(false), _keep_src_frames(keep_src_frames), _exposure(exposure), _fused_prep(fused_prep), _use_ocl(false), _active(false), _ndropped(0)
 {
     /// Quick sizes.
     _w = _remapper->getSrcW();
@@ -71,9 +147,32 @@ FrameGrabber::FrameGrabber( shared_ptr<FrameSource> source,
     _max_buf_len = max_buf_len;
     _max_frame_cnt = max_frame_cnt;
 
+    /// Device preprocessing (replaces the fused/reference CPU paths).
+    if (use_gpu) {
+#if defined(FICTRAC_OPENCL)
+        initOcl();
+#else
+        LOG_WRN("Warning! Built without OpenCL support (FICTRAC_OPENCL) - preprocessing frames on the CPU.");
+#endif
+    }
+
+    /// Fused preprocessing.
+    if (_fused_prep && !_use_ocl) {
+        initFusedRemap();
+    }
+
+    /// Output queue.
+    _frame_q = make_unique<SPSCRing<FrameSet>>((_max_buf_len > 0) ? _max_buf_len : MAX_QUEUE_LEN_DEFAULT, spin_wait_us);
+
+    /// Buffers in flight: one being processed, full queue, one held by consumer (+1 spare).
+    _max_pool_len = _frame_q->capacity() + 3;
+
+    /// Source frames may also be held downstream (e.g. queued for video encoding).
+    _max_frame_pool_len = _max_pool_len + std::max(held_src_frames, 0);
+
     /// Thread stuff.
     _active = true;
-    _thread = std::make_unique<std::thread>(&FrameGrabber::process, this);
+    _thread = StartThread(&FrameGrabber::process, this);
 }
 
 ///
@@ -83,10 +182,9 @@ FrameGrabber::~FrameGrabber()
 {
     LOG("Closing input stream");
 
-    unique_lock<mutex> l(_qMutex);
     _active = false;
-    _qCond.notify_all();
-    l.unlock();
+    _frame_q->notify();
+    _source->interrupt();
 
     if (_thread && _thread->joinable()) {
         _thread->join();
@@ -98,76 +196,262 @@ FrameGrabber::~FrameGrabber()
 ///
 bool FrameGrabber::getFrameSet(Mat& frame, Mat& remap, double& timestamp, double& ms_since_midnight, bool latest)
 {
-    unique_lock<mutex> l(_qMutex);
-    while (_active && (_frame_q.size() == 0)) {
-        _qCond.wait(l);
-    }
-    size_t n = _frame_q.size();
-    if (!_active && (n == 0)) {   // n test allows us to finish processing the queue before quitting
+    /// Wait for frame set (allows us to finish processing the queue before quitting).
+    FrameSet fs;
+    if (!_frame_q->waitNotEmpty(_active) || !_frame_q->pop(fs)) {
         LOG_DBG("No more processed frames in queue!");
+        return false;
+    }
 
-        // shouldn't be needed - but just in case :-)
-        _qCond.notify_all();
+    if (latest) {
+        // drop unused frames
+        int ndrop = 0;
+        while (_frame_q->pop(fs)) { ndrop++; }
 
-        // mutex unlocked in unique_lock dstr
-        return false;
+        if (ndrop > 0) {
+            _ndropped.fetch_add(ndrop, std::memory_order_relaxed);
+            LOG_WRN("Warning! Dropping %d frame/s from input processed frame queue!", ndrop);
+        }
+    }
+    else {
+        size_t n = _frame_q->size();
+        if (n > 0) {
+            LOG_DBG("%zd frames remaining in processed frame queue.", n);
+        }
     }
-    
-    // must be frame_q.size() > 0 to get here (can be !_active)
 
-    if ((n != _remap_q.size()) || (n != _ts_q.size()) || (n != _ms_q.size())) {
-        LOG_ERR("Error! Input processed frame queues are misaligned!");
-        
-        // drop all frames
-        _frame_q.clear();
-        _remap_q.clear();
-        _ts_q.clear();
-        _ms_q.clear();
+    frame = fs.frame;
+    remap = fs.remap;
+    timestamp = fs.timestamp;
+    ms_since_midnight = fs.ms_since_midnight;
 
-        // wake processing thread
-        _qCond.notify_all();
+    return true;
+}
 
-        // mutex unlocked in unique_lock dstr
-        return false;
+///
+/// Pre-compute source pixel and interpolation weights for each ROI pixel.
+///
+void FrameGrabber::initFusedRemap()
+{
+    const float* mapx = _remapper->getMapX();
+    const float* mapy = _remapper->getMapY();
+    if (!mapx || !mapy) {
+        LOG_WRN("Warning! Remap tables unavailable - disabling fused preprocessing.");
+        _fused_prep = false;
+        return;
     }
 
-    if (latest) {
-        frame = _frame_q.back();
-        remap = _remap_q.back();
-        timestamp = _ts_q.back();
-        ms_since_midnight = _ms_q.back();
-        
-        if (n > 1) {
-            LOG_WRN("Warning! Dropping %d frame/s from input processed frame queues!", n - 1);
+    const int tab_sz = 1 << REMAP_FRAC_BITS;
+    _fused_lut.resize(_rw * _rh);
+    for (int i = 0; i < _rw * _rh; i++) {
+        FusedPix& p = _fused_lut[i];
+        int ix = static_cast<int>(lrintf(mapx[i] * tab_sz));
+        int iy = static_cast<int>(lrintf(mapy[i] * tab_sz));
+        p.x = ix >> REMAP_FRAC_BITS;
+        p.y = iy >> REMAP_FRAC_BITS;
+        if ((p.x < 0) || (p.y < 0) || (p.x >= _w) || (p.y >= _h)) {
+            p.x = -1;   // remap border (constant 0)
+            continue;
         }
+        int fx = ix & (tab_sz - 1), fy = iy & (tab_sz - 1);
+        p.dx = ((p.x + 1) < _w) ? 1 : 0;
+        p.dy = ((p.y + 1) < _h) ? 1 : 0;
+
+        // bilinear weights are exact multiples of 1 << (15 - 2 * 5)
+        const int scl = 1 << (REMAP_COEF_BITS - 2 * REMAP_FRAC_BITS);
+        p.w[0] = static_cast<uint16_t>((tab_sz - fx) * (tab_sz - fy) * scl);
+        p.w[1] = static_cast<uint16_t>(fx * (tab_sz - fy) * scl);
+        p.w[2] = static_cast<uint16_t>((tab_sz - fx) * fy * scl);
+        p.w[3] = static_cast<uint16_t>(fx * fy * scl);
+    }
+    LOG_DBG("Fused preprocessing enabled (%d ROI pixels).", _rw * _rh);
+}
 
-        // drop unused frames
-        _frame_q.clear();
-        _remap_q.clear();
-        _ts_q.clear();
-        _ms_q.clear();
+///
+/// Equivalent to cvtColor/mixChannels on the full source frame followed by remap,
+/// but only touches the source pixels needed for the ROI. Greyscale sources are sampled directly.
+///
+void FrameGrabber::fusedRemap(const Mat& src, Mat& dst)
+{
+    const uint8_t* psrc = src.data;
+    const size_t step = src.step;
+    const int cn = src.channels();
+    const int c = (cn == 1) ? 0 : (_thresh_rgb_transform == RED) ? 2 : (_thresh_rgb_transform == GREEN) ? 1 : 0;
+    const bool grey = (_thresh_rgb_transform == GREY) && (cn == 3);
+
+    auto val = [&](const uint8_t* p) -> int {
+        return grey ? ((p[0] * GREY_B + p[1] * GREY_G + p[2] * GREY_R + (1 << (GREY_SHIFT - 1))) >> GREY_SHIFT) : p[c];
+    };
+
+    const FusedPix* lut = _fused_lut.data();
+    for (int i = 0; i < _rh; i++) {
+        uint8_t* pdst = dst.ptr(i);
+        for (int j = 0; j < _rw; j++, lut++) {
+            if (lut->x < 0) {
+                pdst[j] = 0;
+                continue;
+            }
+            const uint8_t* p00 = psrc + lut->y * step + lut->x * cn;
+            const uint8_t* p01 = p00 + lut->dx * cn;
+            const uint8_t* p10 = p00 + lut->dy * step;
+            const uint8_t* p11 = p10 + lut->dx * cn;
+            int v = lut->w[0] * val(p00) + lut->w[1] * val(p01) + lut->w[2] * val(p10) + lut->w[3] * val(p11);
+            pdst[j] = static_cast<uint8_t>((v + (1 << (REMAP_COEF_BITS - 1))) >> REMAP_COEF_BITS);
+        }
     }
-    else {
-        frame = _frame_q.front();
-        remap = _remap_q.front();
-        timestamp = _ts_q.front();
-        ms_since_midnight = _ms_q.front();
-
-        _frame_q.pop_front();
-        _remap_q.pop_front();
-        _ts_q.pop_front();
-        _ms_q.pop_front();
-
-        if (n > 1) {
-            LOG_DBG("%d frames remaining in processed frame queue.", _frame_q.size());
+}
+
+///
+/// As fusedRemap, but for raw Bayer frames. Each source pixel takes its colour from the
+/// 2x2 filter tile containing it (nearest same-colour sites, greens averaged), so the
+/// mosaic is only read at the ROI source pixels and never demosaiced in full.
+///
+void FrameGrabber::fusedRemapBayer(const Mat& src, Mat& dst, BAYER_TYPE bayer)
+{
+    const uint8_t* psrc = src.data;
+    const size_t step = src.step;
+
+    /// Red site within tile (blue is diagonally opposite, greens on the other diagonal).
+    const int rx = ((bayer == BAYER_GRBG) || (bayer == BAYER_BGGR)) ? 1 : 0;
+    const int ry = ((bayer == BAYER_GBRG) || (bayer == BAYER_BGGR)) ? 1 : 0;
+    const size_t off_r = ry * step + rx;
+    const size_t off_b = (1 - ry) * step + (1 - rx);
+    const size_t off_g0 = ry * step + (1 - rx);
+    const size_t off_g1 = (1 - ry) * step + rx;
+    const int xmax = (_w - 2) & ~1, ymax = (_h - 2) & ~1;
+
+    auto val = [&](int x, int y) -> int {
+        const uint8_t* t = psrc + std::min(y & ~1, ymax) * step + std::min(x & ~1, xmax);
+        switch (_thresh_rgb_transform) {
+        case RED:   return t[off_r];
+        case BLUE:  return t[off_b];
+        case GREEN: return (t[off_g0] + t[off_g1] + 1) >> 1;
+        case GREY:
+        default:
+            return (2 * t[off_r] * GREY_R + (t[off_g0] + t[off_g1]) * GREY_G + 2 * t[off_b] * GREY_B + (1 << GREY_SHIFT)) >> (GREY_SHIFT + 1);
         }
+    };
+
+    const FusedPix* lut = _fused_lut.data();
+    for (int i = 0; i < _rh; i++) {
+        uint8_t* pdst = dst.ptr(i);
+        for (int j = 0; j < _rw; j++, lut++) {
+            if (lut->x < 0) {
+                pdst[j] = 0;
+                continue;
+            }
+            const int x1 = lut->x + lut->dx, y1 = lut->y + lut->dy;
+            int v = lut->w[0] * val(lut->x, lut->y) + lut->w[1] * val(x1, lut->y) + lut->w[2] * val(lut->x, y1) + lut->w[3] * val(x1, y1);
+            pdst[j] = static_cast<uint8_t>((v + (1 << (REMAP_COEF_BITS - 1))) >> REMAP_COEF_BITS);
+        }
+    }
+}
+
+#if defined(FICTRAC_OPENCL)
+///
+///
+///
+void FrameGrabber::initOcl()
+{
+    if (!cv::ocl::haveOpenCL()) {
+        LOG_WRN("Warning! No OpenCL device available - preprocessing frames on the CPU.");
+        return;
+    }
+    cv::ocl::setUseOpenCL(true);
+    if (!cv::ocl::useOpenCL()) {
+        LOG_WRN("Warning! Unable to enable OpenCL - preprocessing frames on the CPU.");
+        return;
     }
 
-    // wake processing thread
-    _qCond.notify_all();
+    /// Resident mask and window kernel.
+    _remap_mask.copyTo(_u_mask);
+    cv::bitwise_not(_u_mask, _u_unmasked);
+    _win_kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(_thresh_win, _thresh_win));
 
-    // mutex unlocked in unique_lock dstr
-    return true;
+    _use_ocl = true;
+    LOG("Preprocessing frames on OpenCL device %s.", cv::ocl::Device::getDefault().name().c_str());
+}
+
+///
+/// Grey (or single channel) ROI image into _u_remap.
+///
+void FrameGrabber::oclRemap(const Mat& src, BAYER_TYPE bayer)
+{
+    src.copyTo(_u_src);
+
+    const cv::UMat* colour = &_u_src;
+    if (bayer != BAYER_NONE) {
+        cv::cvtColor(_u_src, _u_bgr, bayerCvtCode(bayer));
+        colour = &_u_bgr;
+    }
+
+    if (colour->channels() == 1) {
+        _remapper->apply(*colour, _u_remap);
+    } else {
+        switch (_thresh_rgb_transform) {
+        case RED:   cv::extractChannel(*colour, _u_grey, 2); break;
+        case GREEN: cv::extractChannel(*colour, _u_grey, 1); break;
+        case BLUE:  cv::extractChannel(*colour, _u_grey, 0); break;
+        case GREY:
+        default:    cv::cvtColor(*colour, _u_grey, cv::COLOR_BGR2GRAY); break;
+        }
+        _remapper->apply(_u_grey, _u_remap);
+    }
+}
+
+///
+/// Same adaptive threshold as the CPU path: window min/max (dilate/erode ignore
+/// pixels outside the image, matching the clipped sliding window) of the blurred
+/// ROI, then v is white if ratio * (v - min) > (max - v).
+///
+void FrameGrabber::oclThreshold(Mat& dst)
+{
+    cv::medianBlur(_u_remap, _u_blur, 3);
+
+    /// Window min/max inputs - ignore masked and overexposed (max only) pixels.
+    cv::compare(_u_blur, cv::Scalar::all(255), _u_valid_max, cv::CMP_LT);
+    cv::bitwise_and(_u_valid_max, _u_mask, _u_valid_max);
+    _u_max.create(_rh, _rw, CV_8UC1);
+    _u_max.setTo(cv::Scalar::all(0));
+    _u_blur.copyTo(_u_max, _u_valid_max);
+    _u_min.create(_rh, _rw, CV_8UC1);
+    _u_min.setTo(cv::Scalar::all(255));
+    _u_blur.copyTo(_u_min, _u_mask);
+
+    cv::dilate(_u_max, _u_win_max, _win_kernel);
+    cv::erode(_u_min, _u_win_min, _win_kernel);
+
+    // apply thresholding
+    _u_remap.convertTo(_u_v, CV_32F);
+    _u_win_min.convertTo(_u_a, CV_32F);
+    cv::subtract(_u_v, _u_a, _u_a);
+    cv::multiply(_u_a, cv::Scalar::all(_thresh_ratio), _u_a);
+    _u_win_max.convertTo(_u_b, CV_32F);
+    cv::subtract(_u_b, _u_v, _u_b);
+    cv::compare(_u_a, _u_b, _u_thr, cv::CMP_GT);
+    _u_thr.setTo(cv::Scalar::all(128), _u_unmasked);
+
+    _u_thr.copyTo(dst);     // into pooled buffer
+}
+#endif
+
+///
+/// Buffers are free for reuse once only the pool holds a reference.
+///
+Mat FrameGrabber::acquire(vector<Mat>& pool, size_t max_len, int rows, int cols, int type)
+{
+    for (auto& m : pool) {
+        if (m.u && (m.u->refcount == 1) && (m.rows == rows) && (m.cols == cols) && (m.type() == type)) {
+            return m;
+        }
+    }
+
+    Mat m(rows, cols, type);
+    if (pool.size() < max_len) {
+        pool.push_back(m);
+        LOG_DBG("Frame buffer pool size increased (%zd).", pool.size());
+    }
+    return m;
 }
 
 ///
@@ -175,9 +459,73 @@ bool FrameGrabber::getFrameSet(Mat& frame, Mat& remap, double& timestamp, double
 ///
 void FrameGrabber::terminate()
 {
-    unique_lock<mutex> l(_qMutex);
     _active = false;
-    _qCond.notify_all();
+    _frame_q->notify();
+}
+
+///
+/// Mean and saturated fraction of valid ROI pixels.
+///
+void FrameGrabber::updateExposure(const Mat& remap)
+{
+    uint64_t sum = 0, n = 0, nsat = 0;
+    for (int i = 0; i < _rh; i++) {
+        const uint8_t* pmask = _remap_mask.ptr(i);
+        const uint8_t* pgrey = remap.ptr(i);
+        for (int j = 0; j < _rw; j++) {
+            if (pmask[j] != 255) { continue; }
+            sum += pgrey[j];
+            nsat += (pgrey[j] == 255);
+            n++;
+        }
+    }
+    if (n > 0) {
+        _exposure->update(static_cast<double>(sum) / n, static_cast<double>(nsat) / n);
+    }
+}
+
+///
+///
+///
+void FrameGrabber::setThreshold(double thresh_ratio, double thresh_win_pc)
+{
+    std::lock_guard<std::mutex> l(_thresh_mutex);
+    _thresh_ratio_new = thresh_ratio;
+    _thresh_win_pc_new = thresh_win_pc;
+    _thresh_pending.store(true, std::memory_order_release);
+}
+
+///
+/// Grabber thread only.
+///
+void FrameGrabber::applyThreshold()
+{
+    double thresh_ratio, thresh_win_pc;
+    {
+        std::lock_guard<std::mutex> l(_thresh_mutex);
+        thresh_ratio = _thresh_ratio_new;
+        thresh_win_pc = _thresh_win_pc_new;
+        _thresh_pending.store(false, std::memory_order_relaxed);
+    }
+
+    if (thresh_ratio > 0) {
+        _thresh_ratio = thresh_ratio;
+    } else {
+        LOG_WRN("Invalid thresh_ratio parameter (%f)! Keeping %f", thresh_ratio, _thresh_ratio);
+    }
+    if ((thresh_win_pc >= 0) && (thresh_win_pc <= 1.0)) {
+        _thresh_win = static_cast<int>(round(thresh_win_pc*_rw)) | 0x01;
+        _thresh_rad = static_cast<int>((_thresh_win - 1) / 2);
+#if defined(FICTRAC_OPENCL)
+        if (_use_ocl) {
+            _win_kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(_thresh_win, _thresh_win));
+        }
+#endif
+    } else {
+        LOG_WRN("Invalid thresh_win parameter (%f)! Keeping window size %d", thresh_win_pc, _thresh_win);
+    }
+
+    LOG_DBG("Thresholding updated (ratio: %f, window size: %d)", _thresh_ratio, _thresh_win);
 }
 
 ///
@@ -185,6 +533,13 @@ void FrameGrabber::terminate()
 ///
 void FrameGrabber::process()
 {
+    PROFILE_THREAD("FrameGrabber");
+
+    /// Placement first, so the working buffers are allocated on the local NUMA node.
+    if (!ApplyThreadClass(ThreadClass::GRAB)) {
+        LOG_WRN("Warning! Unable to apply frame grabbing thread placement (cpus_grab, rt_sched)!");
+    }
+
     /// Init storage arrays
     Mat frame_grey(_h, _w, CV_8UC1);
     frame_grey.setTo(cv::Scalar::all(0));
@@ -197,8 +552,9 @@ void FrameGrabber::process()
     Mat thresh_max(_rh, _rw, CV_8UC1);
     thresh_max.setTo(cv::Scalar::all(0));
 
-    auto win_max_hist = std::make_unique<uint8_t[]>(_thresh_win);
-    auto win_min_hist = std::make_unique<uint8_t[]>(_thresh_win);
+    Mat win_max(_rh, _rw, CV_8UC1);
+    Mat win_min(_rh, _rw, CV_8UC1);
+    vector<uint8_t> win_g, win_h;
 
     /// Rewind to video start.
     _source->rewind();
@@ -216,174 +572,186 @@ void FrameGrabber::process()
     int cnt = 0;
     while (_active) {
         /// Wait until we need to capture a new frame.
-        unique_lock<mutex> l(_qMutex);
-        while (_active && (_max_buf_len > 0) && (_frame_q.size() >= _max_buf_len)) {
-            _qCond.wait(l);
+        {
+            PROFILE_ZONE("FrameGrabber::wait");
+            if (!_frame_q->waitNotFull(_active) || !_active) { break; }
         }
-        l.unlock();
-        if (!_active) { break; }
 
-        /// Capture new frame.
-        Mat frame_bgr(_h, _w, CV_8UC3);
-        frame_bgr.setTo(cv::Scalar::all(0));
-        if (!_source->grab(frame_bgr) || ((_max_frame_cnt > 0) && (++cnt > _max_frame_cnt))) {
+        /// Capture new frame (source may wrap its own buffer rather than copying into ours).
+        Mat frame_bgr = acquire(_frame_pool, _max_frame_pool_len, _h, _w, CV_8UC3);
+        Mat frame_src = frame_bgr;
+        bool grabbed = false;
+        {
+            PROFILE_ZONE("FrameGrabber::grab");
+            grabbed = _source->grabBuffer(frame_src);
+        }
+        if (!grabbed || ((_max_frame_cnt > 0) && (++cnt > _max_frame_cnt))) {
             if ((_max_frame_cnt > 0) && (++cnt > _max_frame_cnt)) {
                 LOG("Max frame count (%d) reached!", _max_frame_cnt);
-            } else {
+            } else if (_active) {
                 LOG_ERR("Error grabbing new frame!");
             }
+            _source->releaseBuffer();
             _active = false;
-            l.lock();   // predicate check and wait are not atomic in other thread, so if we don't lock before notifying, notification could be dropped.
-            _qCond.notify_all();
-            l.unlock();
+            _frame_q->notify();
             break;
         }
         double timestamp = _source->getTimestamp();
         double ms_since_midnight = _source->getMsSinceMidnight();
 
-        /// Create output remap image in the loop.
-        Mat remap_grey(_rh, _rw, CV_8UC1);
-        remap_grey.setTo(cv::Scalar::all(128));
+        /// Pick up parameter changes between frames.
+        if (_thresh_pending.load(std::memory_order_acquire)) {
+            applyThreshold();
+        }
 
-        /// Vars for cached min/max.
-        int win_it = 0;
-        memset(win_max_hist.get(), 0, _thresh_win);
-        memset(win_min_hist.get(), 0, _thresh_win);
+        /// Output remap image.
+        Mat remap_grey = acquire(_remap_pool, _max_pool_len, _rh, _rw, CV_8UC1);
 
         /// Create grey ROI frame.
-        int from_to[2] = { 0, 0 };
-        switch (_thresh_rgb_transform) {
-        case RED:
-            from_to[0] = 2; from_to[1] = 0;
-            cv::mixChannels(&frame_bgr, 1, &frame_grey, 1, from_to, 1);
-            break;
-
-        case GREEN:
-            from_to[0] = 1; from_to[1] = 0;
-            cv::mixChannels(&frame_bgr, 1, &frame_grey, 1, from_to, 1);
-            break;
+        const bool fused = !_use_ocl && _fused_prep && ((frame_src.type() == CV_8UC3) || (frame_src.type() == CV_8UC1)) && (frame_src.cols == _w) && (frame_src.rows == _h) && (_w >= 2) && (_h >= 2);
+        const BAYER_TYPE bayer = (frame_src.channels() == 1) ? _source->getBayerType() : BAYER_NONE;
+        {
+            PROFILE_ZONE("FrameGrabber::remap");
+            if (!_use_ocl && !fused && (bayer != BAYER_NONE)) {
+                /// Demosaic full frame for the reference path.
+                cv::cvtColor(frame_src, frame_bgr, bayerCvtCode(bayer));
+                frame_src = frame_bgr;
+            }
 
-        case BLUE:
-            from_to[0] = 0; from_to[1] = 0;
-            cv::mixChannels(&frame_bgr, 1, &frame_grey, 1, from_to, 1);
-            break;
+            if (_use_ocl) {
+#if defined(FICTRAC_OPENCL)
+                oclRemap(frame_src, bayer);
+#endif
+            }
+            else if (fused && (bayer != BAYER_NONE)) {
+                fusedRemapBayer(frame_src, remap_grey, bayer);
+            }
+            else if (fused) {
+                fusedRemap(frame_src, remap_grey);
+            }
+            else if (frame_src.channels() == 1) {
+                /// Greyscale source (colour transform does not apply).
+                remap_grey.setTo(cv::Scalar::all(128));
+                _remapper->apply(frame_src, remap_grey);
+            }
+            else {
+                /// Reference path.
+                remap_grey.setTo(cv::Scalar::all(128));
+                int from_to[2] = { 0, 0 };
+                switch (_thresh_rgb_transform) {
+                case RED:
+                    from_to[0] = 2; from_to[1] = 0;
+                    cv::mixChannels(&frame_src, 1, &frame_grey, 1, from_to, 1);
+                    break;
+
+                case GREEN:
+                    from_to[0] = 1; from_to[1] = 0;
+                    cv::mixChannels(&frame_src, 1, &frame_grey, 1, from_to, 1);
+                    break;
+
+                case BLUE:
+                    from_to[0] = 0; from_to[1] = 0;
+                    cv::mixChannels(&frame_src, 1, &frame_grey, 1, from_to, 1);
+                    break;
+
+                case GREY:
+                default:
+                    cv::cvtColor(frame_src, frame_grey, cv::COLOR_BGR2GRAY);
+                    break;
+                }
+                _remapper->apply(frame_grey, remap_grey);
+            }
+        }
 
-        case GREY:
-        default:
-            cv::cvtColor(frame_bgr, frame_grey, cv::COLOR_BGR2GRAY);
-            break;
+        /// Done with source buffer.
+        if (!_keep_src_frames) {
+            frame_bgr = Mat();
+        } else if (frame_src.channels() == 1) {
+            cv::cvtColor(frame_src, frame_bgr, (bayer != BAYER_NONE) ? bayerCvtCode(bayer) : cv::COLOR_GRAY2BGR);    // display/raw video expect colour frames
+        } else if (frame_src.data != frame_bgr.data) {
+            frame_src.copyTo(frame_bgr);
         }
-        _remapper->apply(frame_grey, remap_grey);
-
-        /// Blur image before calculating region min/max values.
-        medianBlur(remap_grey, remap_blur, 3);
-
-        thresh_min.setTo(cv::Scalar::all(255));
-        thresh_max.setTo(cv::Scalar::all(0));
-
-        /** cached min/max **/
-        // pre-fill first col
-        uint8_t max = 0, min = 255;
-        for (int i = 0; i < _thresh_rad; i++) {		// last row is computed in next block (before testing)
-            max = 0; min = 255;
-            const uint8_t* pmask = _remap_mask.ptr(i);
-            uint8_t* pgrey = remap_blur.ptr(i);
-            for (int j = 0; j <= _thresh_rad; j++) {
-                if (pmask[j] < 255) { continue; }
-                const uint8_t& g = pgrey[j];
-                if ((g > max) && (g < 255)) { max = g; }	// ignore overexposed regions
-                if (g < min) { min = g; }
+        frame_src = Mat();
+        _source->releaseBuffer();
+
+        /// Auto exposure statistics (rate limited by the controller).
+        if (_exposure && _exposure->wantStats()) {
+#if defined(FICTRAC_OPENCL)
+            if (_use_ocl) {
+                _u_remap.copyTo(remap_grey);    // overwritten by the thresholded result below
             }
-            win_max_hist[win_it] = max;
-            win_min_hist[win_it] = min;
-            win_it++;
+#endif
+            updateExposure(remap_grey);
         }
 
-        // compute window min/max
-        uint8_t* pthrmax = thresh_max.data;
-        uint8_t* pthrmin = thresh_min.data;
-        for (int j = 0; j < _rw; j++) {
-            for (int i = 0; i < _rh; i++) {
-
-                // add row
-                max = 0; min = 255;
-                if ((i + _thresh_rad) < _rh) {
-                    const uint8_t* pmask = _remap_mask.ptr(i + _thresh_rad);
-                    const uint8_t* pgrey = remap_blur.ptr(i + _thresh_rad);
-                    for (int s = -_thresh_rad; s <= _thresh_rad; s++) {
-                        const int js = j + s;
-                        if ((js < 0) || (js >= _rw)) { continue; }
-                        if (pmask[js] < 255) { continue; }
-                        const uint8_t& g = pgrey[js];
-                        if ((g > max) && (g < 255)) { max = g; }	// ignore overexposed regions
-                        if (g < min) { min = g; }
-                    }
-                }
-                else {
-                    // pre-fill next cols
-                    const uint8_t* pmask = _remap_mask.ptr(i + _thresh_rad - _rh);
-                    uint8_t* pgrey = remap_blur.ptr(i + _thresh_rad - _rh);
-                    for (int s = -_thresh_rad; s <= _thresh_rad; s++) {
-                        const int js = j + s + 1;
-                        if ((js < 0) || (js >= _rw)) { continue; }
-                        if (pmask[js] < 255) { continue; }
-                        const uint8_t& g = pgrey[js];
-                        if ((g > max) && (g < 255)) { max = g; }	// ignore overexposed regions
-                        if (g < min) { min = g; }
+        {
+            PROFILE_ZONE("FrameGrabber::threshold");
+            if (_use_ocl) {
+#if defined(FICTRAC_OPENCL)
+                oclThreshold(remap_grey);
+#endif
+            } else {
+                /// Blur image before calculating region min/max values.
+                medianBlur(remap_grey, remap_blur, 3);
+
+                /// Window min/max inputs - ignore masked and overexposed (max only) pixels.
+                for (int i = 0; i < _rh; i++) {
+                    const uint8_t* pmask = _remap_mask.ptr(i);
+                    const uint8_t* pgrey = remap_blur.ptr(i);
+                    uint8_t* pmax = thresh_max.ptr(i);
+                    uint8_t* pmin = thresh_min.ptr(i);
+                    for (int j = 0; j < _rw; j++) {
+                        const bool valid = pmask[j] == 255;
+                        pmax[j] = (valid && (pgrey[j] < 255)) ? pgrey[j] : 0;
+                        pmin[j] = valid ? pgrey[j] : 255;
                     }
                 }
-                win_max_hist[win_it] = max;
-                win_min_hist[win_it] = min;
-
-                // find window max/min
-                max = 0; min = 255;
-                for (int k = 0; k < _thresh_win; k++) {
-                    int ik = i + _thresh_rad - k;
-                    if ((ik >= _rh) || (ik < 0)) { continue; }
-                    int wk = win_it - k;
-                    if (wk < 0) { wk += _thresh_win; }
-                    uint8_t mx = win_max_hist[wk];
-                    if (mx > max) { max = mx; }
-                    uint8_t mn = win_min_hist[wk];
-                    if (mn < min) { min = mn; }
-                }
-                pthrmax[i*thresh_max.step + j] = max;
-                pthrmin[i*thresh_min.step + j] = min;
-                if (++win_it >= _thresh_win) { win_it -= _thresh_win; }
-            }
-        }
 
-        // apply thresholding
-        for (int i = 0; i < _rh; i++) {
-            const uint8_t* pmask = _remap_mask.ptr(i);
-            uint8_t* premap = remap_grey.ptr(i);
-            uint8_t* pthrmin = thresh_min.ptr(i);
-            uint8_t* pthrmax = thresh_max.ptr(i);
-            for (int j = 0; j < _rw; j++) {
-                if (pmask[j] != 255) {
-                    premap[j] = 128;
-                    continue;
-                }
-                if ((_thresh_ratio*(premap[j] - pthrmin[j])) <= (pthrmax[j] - premap[j])) {
-                    premap[j] = 0;
+                /// Separable sliding window min/max (clipped to ROI).
+                for (int i = 0; i < _rh; i++) {
+                    slidingWindow(thresh_max.ptr(i), win_max.ptr(i), _rw, 1, _thresh_win, uint8_t(0), MaxOp(), win_g, win_h);
+                    slidingWindow(thresh_min.ptr(i), win_min.ptr(i), _rw, 1, _thresh_win, uint8_t(255), MinOp(), win_g, win_h);
                 }
-                else {
-                    premap[j] = 255;
+                slidingWindow(win_max.data, thresh_max.data, _rh, _rw, _thresh_win, uint8_t(0), MaxOp(), win_g, win_h);
+                slidingWindow(win_min.data, thresh_min.data, _rh, _rw, _thresh_win, uint8_t(255), MinOp(), win_g, win_h);
+
+                // apply thresholding
+                for (int i = 0; i < _rh; i++) {
+                    const uint8_t* pmask = _remap_mask.ptr(i);
+                    uint8_t* premap = remap_grey.ptr(i);
+                    uint8_t* pthrmin = thresh_min.ptr(i);
+                    uint8_t* pthrmax = thresh_max.ptr(i);
+                    for (int j = 0; j < _rw; j++) {
+                        if (pmask[j] != 255) {
+                            premap[j] = 128;
+                            continue;
+                        }
+                        if ((_thresh_ratio*(premap[j] - pthrmin[j])) <= (pthrmax[j] - premap[j])) {
+                            premap[j] = 0;
+                        }
+                        else {
+                            premap[j] = 255;
+                        }
+                    }
                 }
             }
         }
 
-        /// Re-obtain lock and add processed frame to queue.
-        l.lock();
-        _frame_q.push_back(frame_bgr);
-        _remap_q.push_back(remap_grey);
-        _ts_q.push_back(timestamp);
-        _ms_q.push_back(ms_since_midnight);
-        _qCond.notify_all();
-        size_t q_size = _frame_q.size();
-        l.unlock();
+        /// Add processed frame set to queue.
+        FrameSet fs;
+        fs.frame = frame_bgr;
+        fs.remap = remap_grey;
+        fs.timestamp = timestamp;
+        fs.ms_since_midnight = ms_since_midnight;
+        frame_bgr = Mat();
+        remap_grey = Mat();
+        if (!_frame_q->push(move(fs))) {
+            LOG_ERR("Error! Input processed frame queue is full - dropping frame!");
+            _ndropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
         
-        LOG_DBG("Processed frame added to input queue (l = %zd).", q_size);
+        LOG_DBG("Processed frame added to input queue (l = %zd).", _frame_q->size());
     }
 
     LOG_DBG("Stopping frame grabbing loop!");
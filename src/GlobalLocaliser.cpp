@@ -0,0 +1,149 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       GlobalLocaliser.cpp
+/// \brief      Parallel global localisation of current sphere ROI within surface map.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "GlobalLocaliser.h"
+
+#include "Logger.h"
+
+#include <algorithm>    // sort, min
+#include <numeric>      // iota
+#include <cfloat>       // DBL_MAX
+
+using cv::Mat;
+using namespace std;
+
+/// Number of grid candidates scored per task.
+const int GRID_CHUNK = 64;
+
+///
+///
+///
+GlobalLocaliser::GlobalLocaliser(double grid_step, double tol, int max_evals,
+    CameraModelPtr sphere_model, const Mat& sphere_map,
+    shared_ptr<vector<RoiPixel>> roi_pix, int nthreads,
+    shared_ptr<ThreadPool> pool, const TiledMap* sphere_tiles, bool use_gpu)
+    : _pool(pool ? pool : make_shared<ThreadPool>(nthreads)), _sphere_map(sphere_map), _tiles(sphere_tiles), _nevals(0)
+{
+    _kernel = unique_ptr<SphereKernel>(new SphereKernel(*roi_pix, _sphere_map.cols, _sphere_map.rows));
+
+    /// Angle-axis grid covering all rotations (|r| <= pi).
+    int n = static_cast<int>(ceil(CM_PI / grid_step));
+    for (int i = -n; i <= n; i++) {
+        for (int j = -n; j <= n; j++) {
+            for (int k = -n; k <= n; k++) {
+                CmPoint64f r(i * grid_step, j * grid_step, k * grid_step);
+                if (r.len() > CM_PI + 0.5 * grid_step) { continue; }
+                _grid.push_back(r);
+            }
+        }
+    }
+    _grid_err.resize(_grid.size(), DBL_MAX);
+
+    /// Grid scoring on device (refinement stays on the CPU).
+    if (use_gpu) {
+#if defined(FICTRAC_OPENCL)
+        _gpu = make_unique<OclScorer>(*roi_pix, _sphere_map.cols, _sphere_map.rows);
+        if (_gpu->isOpen()) {
+            vector<double> m(9 * _grid.size());
+            for (size_t i = 0; i < _grid.size(); i++) {
+                _grid[i].omegaToMatrix(&m[9 * i]);
+            }
+            _gpu->setRotations(m);
+        } else {
+            LOG_WRN("Warning! Falling back to CPU global search.");
+            _gpu.reset();
+        }
+#else
+        LOG_WRN("Warning! Built without OpenCL support (FICTRAC_OPENCL) - using CPU global search.");
+#endif
+    }
+
+    /// One local refinement per thread, bounded to a grid cell around each candidate.
+    for (int i = 0; i < _pool->size(); i++) {
+        _refine.push_back(make_unique<Localiser>(
+            NLOPT_LN_BOBYQA, grid_step, tol, max_evals,
+            sphere_model, _sphere_map,
+            roi_pix, 0, 0, 0, _tiles));
+    }
+
+    LOG_DBG("Global search grid: %d candidates (step %.3f rad) using %d threads.", static_cast<int>(_grid.size()), grid_step, _pool->size());
+}
+
+///
+/// Refinements stay bounded to a grid cell.
+///
+void GlobalLocaliser::setLimits(double tol, int max_evals)
+{
+    for (auto& r : _refine) {
+        r->setLimits(r->getBound(), tol, max_evals);
+    }
+}
+
+///
+///
+///
+double GlobalLocaliser::search(Mat& roi_frame, CmMat33d& R_roi, CmPoint64f& r_roi)
+{
+    /// Score coarse grid.
+    const int ngrid = static_cast<int>(_grid.size());
+    bool scored = false;
+#if defined(FICTRAC_OPENCL)
+    if (_gpu) {
+        _gpu->setMap(_sphere_map);
+        scored = _gpu->score(roi_frame, _grid_err);
+    }
+#endif
+    if (!scored) {
+        /// Each chunk is scored in one sweep over the ROI.
+        _pool->run((ngrid + GRID_CHUNK - 1) / GRID_CHUNK, [&](int c) {
+            double m[9 * GRID_CHUNK];
+            const int i0 = c * GRID_CHUNK, nc = std::min(ngrid, i0 + GRID_CHUNK) - i0;
+            for (int i = 0; i < nc; i++) {
+                _grid[i0 + i].omegaToMatrix(&m[9 * i]);
+            }
+            if (_tiles) {
+                _kernel->testRotations(m, nc, roi_frame, *_tiles, &_grid_err[i0]);
+            } else {
+                _kernel->testRotations(m, nc, roi_frame, _sphere_map, &_grid_err[i0]);
+            }
+        });
+    }
+    _nevals = ngrid;
+
+    /// Select best candidates.
+    const int nref = std::min(static_cast<int>(_refine.size()), ngrid);
+    vector<int> idx(ngrid);
+    iota(idx.begin(), idx.end(), 0);
+    partial_sort(idx.begin(), idx.begin() + nref, idx.end(), [&](int a, int b) { return _grid_err[a] < _grid_err[b]; });
+
+    if (_grid_err[idx[0]] == DBL_MAX) {
+        LOG_DBG("Global search failed - insufficient overlap with surface map.");
+        return DBL_MAX;
+    }
+
+    /// Refine best candidates around their grid orientation.
+    vector<CmMat33d> R(nref);
+    vector<CmPoint64f> dr(nref, CmPoint64f(0, 0, 0));
+    vector<double> err(nref, DBL_MAX);
+    _pool->run(nref, [&](int i) {
+        R[i] = CmMat33d::fromOmega(_grid[idx[i]]);
+        err[i] = _refine[i]->search(roi_frame, R[i], dr[i]);
+    });
+
+    int best = 0;
+    for (int i = 0; i < nref; i++) {
+        _nevals += _refine[i]->getNumEval();
+        if (err[i] < err[best]) { best = i; }
+    }
+
+    /// Refined rotation is relative to candidate orientation.
+    R_roi = CmMat33d::fromOmega(dr[best]) * R[best];
+    r_roi = R_roi.toOmega();
+
+    LOG_DBG("Global search: grid err = %.3e  refined err = %.3e  (evals = %d)", _grid_err[idx[best]], err[best], _nevals);
+
+    return err[best];
+}
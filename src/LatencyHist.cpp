@@ -0,0 +1,120 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       LatencyHist.cpp
+/// \brief      Fixed-precision (log-linear) histogram for latency percentiles.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "LatencyHist.h"
+
+#include <cmath>
+#include <algorithm>    // min
+
+using namespace std;
+
+///
+///
+///
+LatencyHist::LatencyHist(double res)
+    : _res(res > 0 ? res : 1)
+{
+    for (int i = 0; i < NBUCKETS; i++) {
+        _counts[i].store(0, memory_order_relaxed);
+    }
+    _count.store(0, memory_order_relaxed);
+    _sum.store(0, memory_order_relaxed);
+    _max.store(0, memory_order_relaxed);
+}
+
+///
+/// Values < SUB map to linear buckets, larger values keep their top SUB_BITS + 1 bits.
+///
+int LatencyHist::bucket(uint64_t u)
+{
+    if (u < SUB) { return static_cast<int>(u); }
+    int msb = 63;
+    while (!(u >> msb)) { msb--; }
+    int shift = msb - SUB_BITS;
+    return (shift + 1) * SUB + static_cast<int>((u >> shift) & (SUB - 1));
+}
+
+///
+/// Largest value that maps to bucket b.
+///
+uint64_t LatencyHist::bucketMax(int b)
+{
+    if (b < SUB) { return b; }
+    int shift = b / SUB - 1;
+    uint64_t lo = (static_cast<uint64_t>(SUB + (b % SUB))) << shift;
+    return lo + ((uint64_t(1) << shift) - 1);
+}
+
+///
+///
+///
+void LatencyHist::record(double v)
+{
+    if (!(v >= 0)) { v = 0; }   // also catches NaN
+    double q = std::round(v / _res);
+    uint64_t u = q < 1.8e19 ? static_cast<uint64_t>(q) : UINT64_MAX;
+
+    _counts[bucket(u)].fetch_add(1, memory_order_relaxed);
+    _count.fetch_add(1, memory_order_relaxed);
+    _sum.fetch_add(u, memory_order_relaxed);
+
+    uint64_t m = _max.load(memory_order_relaxed);
+    while ((u > m) && !_max.compare_exchange_weak(m, u, memory_order_relaxed)) {}
+}
+
+///
+///
+///
+void LatencyHist::reset()
+{
+    for (int i = 0; i < NBUCKETS; i++) {
+        _counts[i].store(0, memory_order_relaxed);
+    }
+    _count.store(0, memory_order_relaxed);
+    _sum.store(0, memory_order_relaxed);
+    _max.store(0, memory_order_relaxed);
+}
+
+///
+///
+///
+LatencyHist::Summary LatencyHist::summarise(bool reset)
+{
+    static thread_local uint64_t counts[NBUCKETS];
+
+    Summary s = {};
+    uint64_t n = 0;
+    for (int i = 0; i < NBUCKETS; i++) {
+        counts[i] = reset ? _counts[i].exchange(0, memory_order_relaxed) : _counts[i].load(memory_order_relaxed);
+        n += counts[i];
+    }
+    uint64_t sum = reset ? _sum.exchange(0, memory_order_relaxed) : _sum.load(memory_order_relaxed);
+    uint64_t max = reset ? _max.exchange(0, memory_order_relaxed) : _max.load(memory_order_relaxed);
+    if (reset) {
+        _count.exchange(0, memory_order_relaxed);
+    }
+
+    s.count = n;
+    if (n == 0) { return s; }
+
+    s.mean = _res * sum / n;
+    s.max = _res * max;
+
+    /// Walk cumulative counts once for all percentiles (report bucket upper bound, clipped to max).
+    const double pc[3] = { 0.5, 0.99, 0.999 };
+    double* out[3] = { &s.p50, &s.p99, &s.p999 };
+    uint64_t cum = 0;
+    int k = 0;
+    for (int i = 0; (i < NBUCKETS) && (k < 3); i++) {
+        cum += counts[i];
+        while ((k < 3) && (cum >= static_cast<uint64_t>(std::ceil(pc[k] * n)))) {
+            *out[k++] = _res * std::min(bucketMax(i), max);
+        }
+    }
+    while (k < 3) { *out[k++] = s.max; }
+
+    return s;
+}
@@ -7,17 +7,30 @@
 #include "Localiser.h"
 
 #include "Logger.h"
+#include "Profiler.h"
+#include "timing.h"
+
+#include <map>
+#include <algorithm>  // fill, min
+#include <cfloat>     // DBL_MAX
 
 using cv::Mat;
 using namespace std;
 
+static void absOrientation(const double x[3], const double* rmat, double m[9]);
+
+const double OPT_MIN_TIME_MS = 0.05;    // time allowed for a first level search started at/after the deadline
+
 ///
 ///
 ///
 Localiser::Localiser(nlopt_algorithm alg, double bound, double tol, int max_evals,
     CameraModelPtr sphere_model, const Mat& sphere_map,
-    const Mat& roi_mask, shared_ptr<vector<double>> p1s_lut)
-    : _bound(bound), _sphere_model(sphere_model), _sphere_map(sphere_map), _roi_mask(roi_mask), _p1s_lut(p1s_lut)
+    shared_ptr<vector<RoiPixel>> roi_pix, int roi_w, int roi_h, int pyr_levels, const TiledMap* sphere_tiles)
+    : _bound(bound), _sphere_model(sphere_model), _sphere_map(sphere_map), _tiles(sphere_tiles), _roi_pix(roi_pix), _tol(tol), _max_evals(max_evals),
+    _early_margin(0), _best(DBL_MAX), _npix(0), _npix_full(0), _cur_tiles(nullptr),
+    _deadline(-1), _hit_deadline(false),
+    _grad((alg == NLOPT_LD_LBFGS) || (alg == NLOPT_LD_MMA) || (alg == NLOPT_LD_SLSQP))
 {
     init(alg, 3);
     setXtol(tol);
@@ -27,44 +40,239 @@ Localiser::Localiser(nlopt_algorithm alg, double bound, double tol, int max_eval
         setPopulation(1e3);
     }
 
-    _roi_w = _roi_mask.cols;
-    _roi_h = _roi_mask.rows;
+    /// Pack valid ROI view vectors for fast scoring.
+    _kernel = unique_ptr<SphereKernel>(new SphereKernel(*_roi_pix, _sphere_map.cols, _sphere_map.rows));
+    _cur_kernel = _kernel.get();
+
+    /// Build coarse levels.
+    if ((pyr_levels > 0) && (roi_w <= 0)) {
+        LOG_WRN("Warning! ROI width required for pyramid search - disabling pyramid.");
+        pyr_levels = 0;
+    }
+    for (int l = 1; l <= pyr_levels; l++) {
+        const int scl = 1 << l;
+        const int cw = (roi_w + scl - 1) / scl;
+        int map_w = _sphere_map.cols / scl, map_h = _sphere_map.rows / scl;
+        if ((map_w < 4) || (map_h < 4)) {
+            LOG_WRN("Warning! Sphere map too small for %d pyramid levels - using %d.", pyr_levels, l - 1);
+            break;
+        }
+
+        /// Group fine ROI pixels into scl x scl blocks. Blocks don't span stacked camera ROIs.
+        const int ch = (roi_h > 0) ? ((roi_h + scl - 1) / scl) : 0;
+        map<int, vector<int>> blocks;   // coarse idx -> list of roi_pix indices
+        for (int k = 0; k < static_cast<int>(_roi_pix->size()); k++) {
+            int idx = (*_roi_pix)[k].idx, row = idx / roi_w;
+            int ci = (roi_h > 0) ? ((row / roi_h) * ch + (row % roi_h) / scl) : (row / scl), cj = (idx % roi_w) / scl;
+            blocks[ci * cw + cj].push_back(k);
+        }
+
+        PyrLevel lvl;
+        lvl.scl = scl;
+        vector<RoiPixel> pix;
+        for (const auto& b : blocks) {
+            if (static_cast<int>(b.second.size()) < (scl * scl)) { continue; }    // only use fully valid blocks
+
+            RoiPixel p;
+            p.idx = static_cast<int>(pix.size());
+            p.v = CmPoint64f(0, 0, 0);
+            for (int k : b.second) {
+                p.v += (*_roi_pix)[k].v;
+                lvl.members.push_back((*_roi_pix)[k].idx);
+            }
+            p.v.normalise();
+            pix.push_back(p);
+        }
+        if (pix.empty()) {
+            LOG_WRN("Warning! ROI too small for %d pyramid levels - using %d.", pyr_levels, l - 1);
+            break;
+        }
+
+        lvl.kernel = unique_ptr<SphereKernel>(new SphereKernel(pix, map_w, map_h));
+        lvl.roi_frame.create(1, static_cast<int>(pix.size()), CV_8UC1);
+        lvl.sphere_map.create(map_h, map_w, CV_8UC1);
+        lvl.map_sum.resize(map_w * map_h);
+        lvl.map_cnt.resize(map_w * map_h);
+        _pyr.push_back(move(lvl));
+
+        LOG_DBG("Pyramid level %d: %d ROI pixels, %dx%d sphere map.", l, static_cast<int>(pix.size()), map_w, map_h);
+    }
+}
+
+///
+/// Downsample current ROI frame and surface map into coarse levels.
+///
+void Localiser::updatePyramid(const Mat& roi_frame)
+{
+    const int map_w = _sphere_map.cols, map_h = _sphere_map.rows;
+    for (auto& lvl : _pyr) {
+        /// ROI - average fine pixels in each block.
+        const int s2 = lvl.scl * lvl.scl;
+        uint8_t* proi = lvl.roi_frame.data;
+        for (int k = 0, m = 0; k < lvl.roi_frame.cols; k++) {
+            int sum = 0;
+            for (int e = m + s2; m < e; m++) {
+                sum += roi_frame.data[lvl.members[m]];
+            }
+            proi[k] = static_cast<uint8_t>((sum + s2 / 2) / s2);
+        }
+
+        /// Sphere map - average only previously seen (!= 128) fine map pixels.
+        const int cw = lvl.sphere_map.cols, ch = lvl.sphere_map.rows;
+        std::fill(lvl.map_sum.begin(), lvl.map_sum.end(), 0);
+        std::fill(lvl.map_cnt.begin(), lvl.map_cnt.end(), 0);
+        for (int i = 0; i < map_h; i++) {
+            const uint8_t* pmap = _sphere_map.ptr(i);
+            int ci = std::min(ch - 1, i * ch / map_h);
+            for (int j = 0; j < map_w; j++) {
+                if (pmap[j] == 128) { continue; }
+                int c = ci * cw + std::min(cw - 1, j * cw / map_w);
+                lvl.map_sum[c] += pmap[j];
+                lvl.map_cnt[c]++;
+            }
+        }
+        for (int i = 0; i < ch; i++) {
+            uint8_t* pmap = lvl.sphere_map.ptr(i);
+            for (int j = 0; j < cw; j++) {
+                int c = i * cw + j;
+                if (lvl.map_cnt[c] == 0) {
+                    pmap[j] = 128;
+                } else {
+                    int v = (lvl.map_sum[c] + lvl.map_cnt[c] / 2) / lvl.map_cnt[c];
+                    pmap[j] = static_cast<uint8_t>((v == 128) ? 129 : v);  // 128 is reserved for unseen
+                }
+            }
+        }
+    }
+}
+
+///
+///
+///
+void Localiser::setLimits(double bound, double tol, int max_evals)
+{
+    _bound = bound;
+    _tol = tol;
+    _max_evals = max_evals;
+    setXtol(tol);
+    setMaxEval(max_evals);
 }
 
 ///
 ///
 ///
-double Localiser::search(Mat& roi_frame, Mat& R_roi, CmPoint64f& vx)
+void Localiser::setTeam(ThreadTeam* team, int min_pix)
 {
+    _kernel->setTeam(team, min_pix);
+    for (auto& lvl : _pyr) {
+        lvl.kernel->setTeam(team, min_pix);
+    }
+}
+
+///
+///
+///
+double Localiser::search(Mat& roi_frame, const CmMat33d& R_roi, CmPoint64f& vx)
+{
+    return search(roi_frame, R_roi, vx, CmPoint64f(_bound, _bound, _bound));
+}
+
+///
+///
+///
+double Localiser::search(Mat& roi_frame, const CmMat33d& R_roi, CmPoint64f& vx, const CmPoint64f& vbound)
+{
+    PROFILE_ZONE("Localiser::search");
+
     /// Save current state.
     _roi_frame = roi_frame;
-    _R_roi = reinterpret_cast<double*>(R_roi.data);
+    _R_roi = R_roi.data();
     double x[3] = { vx[0], vx[1], vx[2] };
+    unsigned nevals = 0;
+    _npix = _npix_full = 0;
+    _hit_deadline = false;
 
-    /// Constrain search to bound around guess.
-    double lb[3] = { x[0] - _bound, x[1] - _bound, x[2] - _bound };
-    double ub[3] = { x[0] + _bound, x[1] + _bound, x[2] + _bound };
-    setLowerBounds(lb);
-    setUpperBounds(ub);
+    /// Coarse-to-fine, starting from coarsest level. Search bound is halved at each finer level.
+    updatePyramid(roi_frame);
+    double bound[3] = { vbound[0], vbound[1], vbound[2] };
+    for (int l = static_cast<int>(_pyr.size()); l >= 0; l--) {
+        if (l > 0) {
+            PyrLevel& lvl = _pyr[l - 1];
+            _cur_kernel = lvl.kernel.get();
+            _cur_roi = lvl.roi_frame;
+            _cur_map = lvl.sphere_map;
+            _cur_tiles = nullptr;
+            setXtol(_tol * lvl.scl);
+        } else {
+            _cur_kernel = _kernel.get();
+            _cur_roi = _roi_frame;
+            _cur_map = _sphere_map;
+            _cur_tiles = _tiles;
+            setXtol(_tol);
+        }
+
+        /// Constrain search to bound around guess. Initial step is a quarter of the box
+        /// (NLopt's default for bounded searches), so it shrinks with the bound.
+        double lb[3] = { x[0] - bound[0], x[1] - bound[1], x[2] - bound[2] };
+        double ub[3] = { x[0] + bound[0], x[1] + bound[1], x[2] + bound[2] };
+        double dx[3] = { 0.5 * bound[0], 0.5 * bound[1], 0.5 * bound[2] };
+        setLowerBounds(lb);
+        setUpperBounds(ub);
+        setInitialStep(dx);
+
+        /// Remaining time budget. The first level always runs (for at least one step).
+        if (_deadline > 0) {
+            double rem = _deadline - ts_ms();
+            if ((rem <= 0) && (nevals > 0)) {
+                _hit_deadline = true;
+                break;
+            }
+            setMaxTime(std::max(rem, OPT_MIN_TIME_MS) / 1000);
+        } else {
+            setMaxTime(0);
+        }
+
+        /// Run optimisation.
+        _best = DBL_MAX;
+        if (optimize(x) == NLOPT_MAXTIME_REACHED) { _hit_deadline = true; }
+        getOptX(x);
+        nevals += getNumEval();
+
+        for (int i = 0; i < 3; i++) { bound[i] *= 0.5; }
+        if (_hit_deadline) { break; }
+    }
+    _nEval = nevals;    // total over all levels
+
+    /// Report the (nearest pixel) full resolution score used everywhere else, e.g. against opt_max_err.
+    double f = getOptF();
+    if (_grad || (_hit_deadline && (_cur_kernel != _kernel.get()))) {
+        double m[9];
+        absOrientation(x, _R_roi, m);
+        f = _tiles ? _kernel->testRotation(m, _roi_frame, *_tiles) : _kernel->testRotation(m, _roi_frame, _sphere_map);
+    }
+
+    if ((_early_margin > 0) && (_npix_full > 0)) {
+        LOG_DBG("Early exit scoring: %.1f%% of ROI pixels scored over %u evals.", 100. * _npix / _npix_full, nevals);
+    }
+
+    /// Don't hold on to (pooled) frame buffer.
+    _roi_frame.release();
+    _cur_roi.release();
 
-    /// Run optimisation.
-    optimize(x);
-    getOptX(x);
     vx.copy(x);
-    return getOptF();
+    return f;
 }
 
 ///
+/// Absolute orientation m (camera frame) after relative rotation x about R.
 ///
-///
-double Localiser::testRotation(const double x[3])
+static void absOrientation(const double x[3], const double* rmat, double m[9])
 {
-    static double lmat[9];
+    double lmat[9];
     CmPoint64f tmp(x[0], x[1], x[2]);
-    tmp.omegaToMatrix(lmat);            // relative rotation in camera frame
-    const double* rmat = _R_roi;        // pre-multiply to orientation matrix
-    static double m[9];                 // absolute orientation in camera frame
+    tmp.omegaToMatrixSmall(lmat);       // relative rotation in camera frame
 
+    /// Pre-multiply to orientation matrix.
     m[0] = lmat[0] * rmat[0] + lmat[1] * rmat[3] + lmat[2] * rmat[6];
     m[1] = lmat[0] * rmat[1] + lmat[1] * rmat[4] + lmat[2] * rmat[7];
     m[2] = lmat[0] * rmat[2] + lmat[1] * rmat[5] + lmat[2] * rmat[8];
@@ -86,50 +294,126 @@ double Localiser::testRotation(const double x[3])
     See here for explanation of pre- vs post-multiplying:
     http://www.me.unm.edu/~starr/teaching/me582/postmultiply.pdf
 
-    The orientation matrix transpose is used below to rotate the vectors and not the axes.
+    The orientation matrix transpose is used (see SphereKernel) to rotate the vectors and not the axes.
     */
+}
 
-    double err = 0;
-    double p2s[3];
-    int cnt = 0, good = 0;
-    int px = 0, py = 0;
-    for (int i = 0; i < _roi_h; i++) {
-        const uint8_t* pmask = _roi_mask.ptr(i);
-        const uint8_t* proi = _roi_frame.ptr(i);
-        const double* v = &(*_p1s_lut)[i * _roi_w * 3];
-        for (int j = 0; j < _roi_w; j++) {
-            if (pmask[j] < 255) { continue; }
-            cnt++;
-
-            // rotate point about rotation axis (sphere coords)
-            int jjj = 3 * j;
-            //p2s[0] = m[0] * v[jjj + 0] + m[1] * v[jjj + 1] + m[2] * v[jjj + 2];
-            //p2s[1] = m[3] * v[jjj + 0] + m[4] * v[jjj + 1] + m[5] * v[jjj + 2];
-            //p2s[2] = m[6] * v[jjj + 0] + m[7] * v[jjj + 1] + m[8] * v[jjj + 2];
-            // transpose
-            p2s[0] = m[0] * v[jjj + 0] + m[3] * v[jjj + 1] + m[6] * v[jjj + 2];
-            p2s[1] = m[1] * v[jjj + 0] + m[4] * v[jjj + 1] + m[7] * v[jjj + 2];
-            p2s[2] = m[2] * v[jjj + 0] + m[5] * v[jjj + 1] + m[8] * v[jjj + 2];
-
-            // map vector in sphere coords to pixel
-            //if (!_sphere_model->vectorToPixelIndex(p2s, px, py)) { continue; }
-            _sphere_model->vectorToPixelIndex(p2s, px, py);  // sphere model is spherical, so pixel should never fall outside valid area
-
-            int r = proi[j];
-            int s = _sphere_map.data[py * _sphere_map.step + px];
-            if (s == 128) { continue; }
-            err += (r - s) * (r - s);
-            good++;     // number of test pixels that correspond to previously seen pixels
+///
+/// As absOrientation, plus dm (3 x 3x3) the derivative of m with respect to each
+/// of x. For L = exp([x]), dL/dx_i = (x_i [x] + [x cross (I - L) e_i]) L / |x|^2
+/// (Gallego & Yezzi, 2015), which tends to [e_i] as |x| -> 0.
+///
+static void absOrientationGrad(const double x[3], const double* rmat, double m[9], double dm[27])
+{
+    absOrientation(x, rmat, m);
+
+    double lmat[9];
+    CmPoint64f tmp(x[0], x[1], x[2]);
+    tmp.omegaToMatrixSmall(lmat);
+    const double n2 = x[0] * x[0] + x[1] * x[1] + x[2] * x[2];
+
+    auto skew = [](const double v[3], double k[9]) {
+        k[0] = 0;       k[1] = -v[2];   k[2] = v[1];
+        k[3] = v[2];    k[4] = 0;       k[5] = -v[0];
+        k[6] = -v[1];   k[7] = v[0];    k[8] = 0;
+    };
+    auto mul = [](const double a[9], const double b[9], double c[9]) {
+        for (int r = 0; r < 3; r++) {
+            for (int c2 = 0; c2 < 3; c2++) {
+                c[3 * r + c2] = a[3 * r] * b[c2] + a[3 * r + 1] * b[3 + c2] + a[3 * r + 2] * b[6 + c2];
+            }
+        }
+    };
+
+    double kx[9];
+    skew(x, kx);
+    for (int i = 0; i < 3; i++) {
+        double d[9], dl[9];
+        if (n2 < 1e-16) {
+            const double e[3] = { i == 0 ? 1. : 0., i == 1 ? 1. : 0., i == 2 ? 1. : 0. };
+            skew(e, d);
+            mul(d, lmat, dl);
+        } else {
+            /// (I - L) e_i is column i of I - L.
+            const double c[3] = { (i == 0) - lmat[i], (i == 1) - lmat[3 + i], (i == 2) - lmat[6 + i] };
+            const double xc[3] = { x[1] * c[2] - x[2] * c[1], x[2] * c[0] - x[0] * c[2], x[0] * c[1] - x[1] * c[0] };
+            double k[9];
+            skew(xc, k);
+            for (int j = 0; j < 9; j++) { k[j] = (x[i] * kx[j] + k[j]) / n2; }
+            mul(k, lmat, dl);
         }
+        mul(dl, rmat, &dm[9 * i]);      // pre-multiplied as in absOrientation
     }
+}
 
-    //LOG_DBG("%d: Tested %.3f %.3f %.3f   total err = %.3e  valid pixels = %d/%d", getNumEval(), x[0], x[1], x[2], err, good, cnt);
+///
+/// No profiler zone: called once per evaluation (~50 per frame, opt_max_evals),
+/// which would clutter the timeline - the Localiser::search zone covers them.
+///
+double Localiser::testRotation(const double x[3])
+{
+    double m[9];                        // absolute orientation in camera frame
+    absOrientation(x, _R_roi, m);
 
-    /// Compute avg squared diff error.
-    if ((cnt > 0) && (good > (0.25 * static_cast<double>(cnt)))) {
-        err /= good;
+    /// Score rotated ROI against surface map (see SphereKernel).
+    if (_early_margin > 0) {
+        int npix = 0;
+        double err = _cur_tiles ?
+            _cur_kernel->testRotationBounded(m, _cur_roi, *_cur_tiles, _best, _early_margin, &npix) :
+            _cur_kernel->testRotationBounded(m, _cur_roi, _cur_map, _best, _early_margin, &npix);
+        _npix += npix;
+        _npix_full += _cur_kernel->size();
+        if ((npix == _cur_kernel->size()) && (err < _best)) { _best = err; }   // only full scores become the incumbent
+        return err;
+    }
+    if (_cur_tiles) {
+        return _cur_kernel->testRotation(m, _cur_roi, *_cur_tiles);
+    }
+    return _cur_kernel->testRotation(m, _cur_roi, _cur_map);
+}
+
+///
+/// Interpolated score and gradient for gradient based searches (see SphereKernel).
+///
+double Localiser::testRotationGrad(const double x[3], double grad[3])
+{
+    double m[9], dm[27];
+    absOrientationGrad(x, _R_roi, m, dm);
+    return _cur_kernel->testRotationGrad(m, dm, _cur_roi, _cur_map, grad);
+}
+
+///
+///
+///
+void Localiser::testRotations(const double* x, int n, double* err)
+{
+    PROFILE_ZONE("Localiser::testRotations");
+
+    vector<double> m(9 * n);
+    for (int i = 0; i < n; i++) {
+        absOrientation(&x[3 * i], _R_roi, &m[9 * i]);
+    }
+
+    if (_cur_tiles) {
+        _cur_kernel->testRotations(m.data(), n, _cur_roi, *_cur_tiles, err);
     } else {
-        err = DBL_MAX;
+        _cur_kernel->testRotations(m.data(), n, _cur_roi, _cur_map, err);
     }
-    return err;
+}
+
+///
+///
+///
+void Localiser::testRotations(const Mat& roi_frame, const CmMat33d& R_roi, const double* x, int n, double* err)
+{
+    _R_roi = R_roi.data();
+    _cur_kernel = _kernel.get();
+    _cur_roi = roi_frame;
+    _cur_map = _sphere_map;
+    _cur_tiles = _tiles;
+
+    testRotations(x, n, err);
+
+    /// Don't hold on to (pooled) frame buffer.
+    _cur_roi.release();
 }
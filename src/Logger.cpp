@@ -6,29 +6,69 @@
 
 #include "Logger.h"
 
+#include "Profiler.h"
 #include "timing.h"
 
 #include <cstdio>   // vsnprintf
 #include <cstdarg>  // va_list, va_start, va_end
 #include <iostream> // cout
+#include <algorithm> // min, stable_sort
 
 using namespace std;
 
+/// Batched log writers (see Recorder::Batching).
+const size_t LOG_RING_SIZE = 1 << 20;
+const int LOG_FILE_FLUSH_MS = 50;   // log file can lag a little
+const int LOG_TERM_FLUSH_MS = 0;    // console asap
+
+/// Deferred logging.
+const size_t LOG_THREAD_BUF_SIZE = 1 << 16;     // per producer thread
+const int LOG_WAKE_MS = 10;         // writer re-checks buffers at least this often
+const int LOG_FULL_RETRIES = 1000;  // yield this many times for writer to free space before blocking
+
+/// Producer thread's buffer, released for re-use when the thread exits.
+struct ThreadBufferHandle {
+    std::atomic_bool* in_use = nullptr;
+    void* buf = nullptr;
+    ~ThreadBufferHandle() { if (in_use) { *in_use = false; } }
+};
+static thread_local ThreadBufferHandle tl_buf;
+
 Logger::Logger()
+    : _sleeping(false), _kill(false)
 {
     // create log writer
     string fn = string("fictrac-") + execTime() + ".log";
-    _log = make_unique<Recorder>(RecorderInterface::RecordType::FILE, fn);
-    _cout = make_unique<Recorder>(RecorderInterface::RecordType::TERM);
+    _log = make_unique<Recorder>(RecorderInterface::RecordType::FILE, fn, false, Recorder::Batching(LOG_RING_SIZE, 0, LOG_FILE_FLUSH_MS));
+    _cout = make_unique<Recorder>(RecorderInterface::RecordType::TERM, "", false, Recorder::Batching(LOG_RING_SIZE, 0, LOG_TERM_FLUSH_MS));
     if (_log->is_active() && _cout->is_active()) {
         cout << "Initialised logging to " << fn << endl;
     } else {
         cerr << "Error opening log file (" << fn << ") or cout stream!" << endl;
     }
+
+    _thread = make_unique<thread>(&Logger::process, this);
 }
 
 Logger::~Logger()
 {
+    {
+        lock_guard<mutex> l(_bufMutex);
+        _kill = true;
+    }
+    _wakeCond.notify_all();
+    if (_thread && _thread->joinable()) {
+        _thread->join();
+    }
+}
+
+///
+/// *the* logger instance
+///
+Logger& Logger::instance()
+{
+    static Logger log;
+    return log;
 }
 
 void Logger::setVerbosity(std::string v) {
@@ -53,29 +93,216 @@ void Logger::setVerbosity(std::string v) {
 /// Thread-safe printf wrapper.
 void Logger::mprintf(LogLevel lvl, string func, string format, ...)
 {
-    static Logger log;   // *the* logger instance
+    Logger& log = instance();
 
     static const int buf_size = 1024;
     static char buf[buf_size];
 
+    if (!enabled(lvl)) { return; }
+
     // not re-entrant
     lock_guard<mutex> l1(log._pMutex);
 
     // expand args
     va_list args;
     va_start(args, format);
-    vsnprintf(buf, buf_size, format.c_str(), args);
+    int len = vsnprintf(buf, buf_size, format.c_str(), args);
     va_end(args);
 
+    log.emit(lvl, elapsed_secs(), func.c_str(), buf, len);
+}
+
+///
+/// Print and log a formatted msg (caller holds _pMutex).
+///
+void Logger::emit(LogLevel lvl, double t, const char* func, const char* msg, int len)
+{
+    static const int buf_size = 1024;
+    char line[buf_size + 256];
+
+    if (len < 0) { len = 0; }
+    if (len >= buf_size) { len = buf_size - 1; }    // truncated
+
     // print and log
-    if ((int)lvl >= (int)verbosity()) {
+    if ((lvl == PRT) || (lvl >= verbosity())) {
         // async printing to console
-        log._cout->addMsg(string(buf) + "\n");
+        memcpy(line, msg, len);
+        line[len] = '\n';
+        _cout->addMsg(line, len + 1);
     }
 
     // don't log display text to file (but log everything else)
-    if (lvl != PRT) {
+    if ((lvl != PRT) && (lvl >= fileVerbosity())) {
         // async logging to file (with additional info)
-        log._log->addMsg(to_string(elapsed_secs()) + " " + func + " [" + log.LogLevelStrings[lvl] + "] " + buf + "\n");
+        int n = snprintf(line, sizeof(line), "%f %s [%s] %.*s\n", t, func, LogLevelStrings[lvl], len, msg);
+        if (n > 0) {
+            _log->addMsg(line, std::min(n, static_cast<int>(sizeof(line)) - 1));
+        }
+    }
+}
+
+///
+/// Calling thread's buffer (registered on first use).
+///
+Logger::ThreadBuffer* Logger::threadBuffer()
+{
+    if (tl_buf.buf) { return static_cast<ThreadBuffer*>(tl_buf.buf); }
+
+    lock_guard<mutex> l(_bufMutex);
+    ThreadBuffer* tb = nullptr;
+    for (auto& b : _buffers) {      // re-use buffer of an exited thread
+        bool expected = false;
+        if ((b->head == b->tail) && b->in_use.compare_exchange_strong(expected, true)) {
+            tb = b.get();
+            break;
+        }
+    }
+    if (!tb) {
+        _buffers.push_back(make_unique<ThreadBuffer>());
+        tb = _buffers.back().get();
+        tb->buf.resize(LOG_THREAD_BUF_SIZE);
+        tb->head = tb->tail = 0;
+        tb->in_use = true;
+    }
+    tb->reserved = 0;
+    tl_buf.in_use = &tb->in_use;
+    tl_buf.buf = tb;
+    return tb;
+}
+
+///
+/// Reserve contiguous space for a record in calling thread's buffer.
+/// Returns nullptr if the buffer stays full.
+///
+uint8_t* Logger::reserve(size_t len)
+{
+    Logger& log = instance();
+    ThreadBuffer* tb = log.threadBuffer();
+
+    const uint64_t size = tb->buf.size();
+    len = (len + 7) & ~size_t(7);   // keep records aligned
+    if (len > size / 2) { return nullptr; }
+
+    uint64_t head = tb->head.load(memory_order_relaxed);
+    uint64_t pos = head % size;
+    uint64_t skip = (pos + len > size) ? (size - pos) : 0;
+
+    for (int i = 0; (head + skip + len - tb->tail.load(memory_order_acquire)) > size; i++) {
+        if (i >= LOG_FULL_RETRIES) { return nullptr; }
+        if (log._sleeping) { log._wakeCond.notify_one(); }
+        this_thread::yield();
     }
+
+    if (skip > 0) {
+        reinterpret_cast<logdetail::Record*>(&tb->buf[pos])->size = 0;  // wrap marker
+        pos = 0;
+    }
+    tb->reserved = skip + len;
+    return &tb->buf[pos];
+}
+
+///
+/// Publish reserved record to the writer thread (and wake it if requested).
+///
+void Logger::commit(bool wake)
+{
+    Logger& log = instance();
+    ThreadBuffer* tb = static_cast<ThreadBuffer*>(tl_buf.buf);
+
+    tb->head.store(tb->head.load(memory_order_relaxed) + tb->reserved, memory_order_seq_cst);
+    if (wake && log._sleeping.load(memory_order_seq_cst)) {
+        lock_guard<mutex> l(log._bufMutex);
+        log._wakeCond.notify_one();
+    }
+}
+
+///
+/// Format pending records of all threads (in time order). Returns number of records written.
+///
+size_t Logger::drain()
+{
+    PROFILE_ZONE("Logger::drain");
+
+    struct Pending {
+        const logdetail::Record* r;
+        ThreadBuffer* tb;
+    };
+    static vector<Pending> pending;     // writer thread only
+    static vector<pair<ThreadBuffer*, uint64_t>> heads;
+    pending.clear();
+    heads.clear();
+
+    /// Collect published records.
+    {
+        lock_guard<mutex> l(_bufMutex);
+        for (auto& b : _buffers) {
+            ThreadBuffer* tb = b.get();
+            const uint64_t size = tb->buf.size();
+            uint64_t tail = tb->tail.load(memory_order_relaxed);
+            uint64_t head = tb->head.load(memory_order_acquire);
+            while (tail < head) {
+                uint64_t pos = tail % size;
+                const logdetail::Record* r = reinterpret_cast<const logdetail::Record*>(&tb->buf[pos]);
+                if (r->size == 0) {
+                    tail += size - pos;
+                    continue;
+                }
+                pending.push_back({ r, tb });
+                tail += (r->size + 7) & ~uint64_t(7);
+            }
+            heads.push_back({ tb, head });
+        }
+    }
+    if (pending.empty()) {
+        for (auto& h : heads) { h.first->tail.store(h.second, memory_order_release); }
+        return 0;
+    }
+
+    /// Merge threads by timestamp (each thread's records are already in order).
+    stable_sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b) { return a.r->t < b.r->t; });
+
+    static const int buf_size = 1024;
+    static char buf[buf_size];
+    {
+        lock_guard<mutex> l(_pMutex);
+        for (auto& p : pending) {
+            const logdetail::Record* r = p.r;
+            int len = r->format(buf, buf_size, r->fmt, reinterpret_cast<const uint8_t*>(r + 1));
+            double t = chrono::duration_cast<chrono::duration<double>>(r->t - _t0).count();
+            emit(static_cast<LogLevel>(r->lvl), t, r->func, buf, len);
+        }
+    }
+
+    /// Release buffer space.
+    for (auto& h : heads) { h.first->tail.store(h.second, memory_order_release); }
+    return pending.size();
+}
+
+///
+/// Writer thread for deferred logging.
+///
+void Logger::process()
+{
+    PROFILE_THREAD("Logger");
+
+    while (true) {
+        drain();
+
+        unique_lock<mutex> l(_bufMutex);
+        if (_kill) { break; }
+        _sleeping.store(true, memory_order_seq_cst);
+
+        /// Re-check (producers only notify when they see us sleeping).
+        bool any = false;
+        for (auto& b : _buffers) {
+            if (b->head.load(memory_order_seq_cst) != b->tail.load(memory_order_relaxed)) { any = true; break; }
+        }
+        if (!any) {
+            _wakeCond.wait_for(l, chrono::milliseconds(LOG_WAKE_MS));
+        }
+        _sleeping = false;
+    }
+
+    /// Flush anything logged during shutdown.
+    drain();
 }
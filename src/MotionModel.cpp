@@ -0,0 +1,192 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       MotionModel.cpp
+/// \brief      Per-frame rotation predictors for seeding the local optimiser.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "MotionModel.h"
+
+#include <cmath>
+#include <algorithm>    // min, max
+
+using namespace std;
+
+const double LOWPASS_GAIN = 0.9;
+
+const double KF_PROC_SD_V = 0.02;       // rad/frame, per frame
+const double KF_PROC_SD_A = 0.005;      // rad/frame^2, per frame
+const double KF_MEAS_TOL_SCL = 5;       // measurement sd, in multiples of opt_tol
+const double KF_P0_A = 1e-4;            // initial acceleration variance
+const double KF_E2_GAIN = 0.1;          // innovation smoothing
+const int KF_WARMUP = 5;                // good frames before the search box is shrunk
+const double KF_BOUND_SIGMA = 4;        // search box half-width, in innovation sd
+const double KF_BOUND_MIN_TOL = 10;     // minimum search box, in multiples of opt_tol ...
+const double KF_BOUND_MIN_FRAC = 0.1;   // ... and as a fraction of opt_bound
+
+///
+///
+///
+unique_ptr<MotionModel> MotionModel::create(const string& type, double max_bound, double tol)
+{
+    if (type == "lowpass") {
+        return unique_ptr<MotionModel>(new LowPassModel(max_bound, tol));
+    } else if (type == "constvel") {
+        return unique_ptr<MotionModel>(new KalmanModel(max_bound, tol, false));
+    } else if (type == "kalman") {
+        return unique_ptr<MotionModel>(new KalmanModel(max_bound, tol, true));
+    }
+    return nullptr;
+}
+
+///
+///
+///
+LowPassModel::LowPassModel(double max_bound, double tol)
+    : MotionModel(max_bound, tol)
+{
+    reset();
+}
+
+///
+///
+///
+void LowPassModel::reset()
+{
+    _guess = CmPoint64f(0, 0, 0);
+}
+
+///
+///
+///
+void LowPassModel::predict(CmPoint64f& dr, CmPoint64f& bound)
+{
+    dr = _guess;
+    bound = CmPoint64f(_max_bound, _max_bound, _max_bound);
+}
+
+///
+///
+///
+void LowPassModel::update(const CmPoint64f& dr, bool good)
+{
+    if (good) {
+        _guess = LOWPASS_GAIN * dr + (1 - LOWPASS_GAIN) * _guess;
+    } else {
+        _guess = CmPoint64f(0, 0, 0);
+    }
+}
+
+///
+///
+///
+KalmanModel::KalmanModel(double max_bound, double tol, bool use_accel)
+    : MotionModel(max_bound, tol), _use_accel(use_accel)
+{
+    reset();
+}
+
+///
+///
+///
+void KalmanModel::reset()
+{
+    _init = false;
+    _ngood = 0;
+    for (int i = 0; i < 3; i++) {
+        Axis& ax = _ax[i];
+        ax.v = ax.a = 0;
+        ax.P[0][0] = ax.P[1][1] = ax.P[0][1] = ax.P[1][0] = 0;
+        ax.e2 = 0;
+    }
+}
+
+///
+/// x' = F x, with F = [1 1; 0 1] (or [1 0; 0 0] without acceleration).
+///
+void KalmanModel::predict(CmPoint64f& dr, CmPoint64f& bound)
+{
+    if (!_init) {
+        dr = CmPoint64f(0, 0, 0);
+        bound = CmPoint64f(_max_bound, _max_bound, _max_bound);
+        return;
+    }
+
+    const double R = (KF_MEAS_TOL_SCL * _tol) * (KF_MEAS_TOL_SCL * _tol);
+    const double min_bound = std::min(_max_bound, std::max(KF_BOUND_MIN_TOL * _tol, KF_BOUND_MIN_FRAC * _max_bound));
+    for (int i = 0; i < 3; i++) {
+        const Axis& ax = _ax[i];
+        dr[i] = _use_accel ? (ax.v + ax.a) : ax.v;
+
+        if (_ngood < KF_WARMUP) {
+            bound[i] = _max_bound;
+            continue;
+        }
+
+        /// Predicted innovation variance, or observed if the model is underestimating it.
+        double Pvv = ax.P[0][0] + KF_PROC_SD_V * KF_PROC_SD_V;
+        if (_use_accel) {
+            Pvv += 2 * ax.P[0][1] + ax.P[1][1];
+        }
+        double sd = sqrt(std::max(Pvv + R, ax.e2));
+        bound[i] = std::min(_max_bound, std::max(min_bound, KF_BOUND_SIGMA * sd));
+    }
+}
+
+///
+///
+///
+void KalmanModel::update(const CmPoint64f& dr, bool good)
+{
+    if (!good) {
+        reset();    // as for low-pass, restart from zero motion
+        return;
+    }
+
+    const double R = (KF_MEAS_TOL_SCL * _tol) * (KF_MEAS_TOL_SCL * _tol);
+    if (!_init) {
+        for (int i = 0; i < 3; i++) {
+            Axis& ax = _ax[i];
+            ax.v = dr[i];
+            ax.a = 0;
+            ax.P[0][0] = R;
+            ax.P[1][1] = _use_accel ? KF_P0_A : 0;
+            ax.P[0][1] = ax.P[1][0] = 0;
+            ax.e2 = 0;
+        }
+        _init = true;
+        _ngood = 1;
+        return;
+    }
+
+    const double qv = KF_PROC_SD_V * KF_PROC_SD_V, qa = _use_accel ? KF_PROC_SD_A * KF_PROC_SD_A : 0;
+    for (int i = 0; i < 3; i++) {
+        Axis& ax = _ax[i];
+
+        /// Time update.
+        double v = ax.v, a = ax.a;
+        double P00 = ax.P[0][0], P01 = ax.P[0][1], P11 = ax.P[1][1];
+        if (_use_accel) {
+            v += a;
+            P00 += 2 * P01 + P11;
+            P01 += P11;
+        } else {
+            a = 0;
+            P01 = P11 = 0;
+        }
+        P00 += qv;
+        P11 += qa;
+
+        /// Measurement update (z = v).
+        double y = dr[i] - v;
+        double S = P00 + R;
+        double K0 = P00 / S, K1 = P01 / S;
+        ax.v = v + K0 * y;
+        ax.a = a + K1 * y;
+        ax.P[0][0] = (1 - K0) * P00;
+        ax.P[0][1] = ax.P[1][0] = (1 - K0) * P01;
+        ax.P[1][1] = P11 - K1 * P01;
+
+        ax.e2 += KF_E2_GAIN * (y * y - ax.e2);
+    }
+    _ngood++;
+}
@@ -133,6 +133,9 @@ void NLoptFunc::setXtolRel(double tol)
 void NLoptFunc::setMaxEval(unsigned n)
 	{ nlopt_set_maxeval(_opt, n); }
 
+void NLoptFunc::setMaxTime(double secs)
+	{ nlopt_set_maxtime(_opt, secs); }
+
 unsigned NLoptFunc::getNumEval()
 	{ return _nEval; }
 
@@ -0,0 +1,194 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       OclScorer.cpp
+/// \brief      OpenCL (cv::ocl) batched rotation scoring against the sphere surface map.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#if defined(FICTRAC_OPENCL)
+
+#include "OclScorer.h"
+
+#include "Logger.h"
+
+#include <cfloat>   // DBL_MAX
+#include <cstdint>
+
+using cv::Mat;
+using cv::UMat;
+using namespace std;
+
+/// Work-group size (power of 2).
+const int OCL_GROUP = 256;
+
+///
+/// See SphereKernel::accumulateScalar(). Error sums are reduced as 64 bit and
+/// returned as (lo, hi, good) int triplets.
+///
+static const char* OCL_SCORE_SRC = R"CLC(
+#define K_PI 3.14159265358979f
+#define K_PI_2 1.57079632679490f
+
+inline float atan2_approx(float y, float x)
+{
+    float ay = fabs(y), ax = fabs(x);
+    float mx = ay > ax ? ay : ax;
+    float mn = ay > ax ? ax : ay;
+    float a = mx > 0 ? mn / mx : 0;
+    float s = a * a;
+    float r = ((((((-0.01172120f * s + 0.05265332f) * s - 0.11643287f) * s + 0.19354346f) * s - 0.33262347f) * s) + 0.99997726f) * a;
+    if (ay > ax) { r = K_PI_2 - r; }
+    if (x < 0) { r = K_PI - r; }
+    if (y < 0) { r = -r; }
+    return r;
+}
+
+__kernel void score(__global const float* vx, __global const float* vy, __global const float* vz,
+    __global const int* vidx, int n, __global const uchar* roi,
+    __global const uchar* map, int map_w, int map_h, float lon_scl, float lat_scl,
+    __global const float* rot, __global int* out)
+{
+    __local long lerr[GROUP];
+    __local int lgood[GROUP];
+
+    const int c = get_group_id(0), lid = get_local_id(0);
+    __global const float* m = rot + 9 * c;
+
+    long err = 0;
+    int good = 0;
+    for (int k = lid; k < n; k += GROUP) {
+        float px = m[0] * vx[k] + m[3] * vy[k] + m[6] * vz[k];
+        float py = m[1] * vx[k] + m[4] * vy[k] + m[7] * vz[k];
+        float pz = m[2] * vx[k] + m[5] * vy[k] + m[8] * vz[k];
+        int ix = (int)((K_PI - atan2_approx(px, pz)) * lon_scl);
+        int iy = (int)((py + 1.f) * lat_scl);
+        if (ix >= map_w) { ix -= map_w; }
+        if (iy >= map_h) { iy -= map_h; }
+        ix = clamp(ix, 0, map_w - 1);
+        iy = clamp(iy, 0, map_h - 1);
+        int s = map[iy * map_w + ix];
+        if (s == 128) { continue; }
+        int r = roi[vidx[k]];
+        err += (r - s) * (r - s);
+        good++;
+    }
+    lerr[lid] = err;
+    lgood[lid] = good;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int s = GROUP / 2; s > 0; s >>= 1) {
+        if (lid < s) {
+            lerr[lid] += lerr[lid + s];
+            lgood[lid] += lgood[lid + s];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0) {
+        out[3 * c + 0] = (int)(lerr[0] & 0xFFFFFFFF);
+        out[3 * c + 1] = (int)(lerr[0] >> 32);
+        out[3 * c + 2] = lgood[0];
+    }
+}
+)CLC";
+
+///
+///
+///
+OclScorer::OclScorer(const vector<RoiPixel>& roi_pix, int map_w, int map_h)
+    : _open(false), _n(static_cast<int>(roi_pix.size())), _nrot(0), _map_w(map_w), _map_h(map_h)
+{
+    if (!cv::ocl::haveOpenCL()) {
+        LOG_WRN("Warning! No OpenCL device available for rotation scoring.");
+        return;
+    }
+    cv::ocl::setUseOpenCL(true);
+
+    cv::String err;
+    cv::ocl::ProgramSource src(OCL_SCORE_SRC);
+    if (!_kernel.create("score", src, cv::format("-D GROUP=%d", OCL_GROUP), &err) || _kernel.empty()) {
+        LOG_ERR("Error! Could not build OpenCL scoring kernel (%s).", err.c_str());
+        return;
+    }
+
+    /// Resident view vectors (see SphereKernel).
+    Mat x(1, _n, CV_32FC1), y(1, _n, CV_32FC1), z(1, _n, CV_32FC1), idx(1, _n, CV_32SC1);
+    for (int k = 0; k < _n; k++) {
+        x.at<float>(k) = static_cast<float>(roi_pix[k].v.x);
+        y.at<float>(k) = static_cast<float>(roi_pix[k].v.y);
+        z.at<float>(k) = static_cast<float>(roi_pix[k].v.z);
+        idx.at<int>(k) = roi_pix[k].idx;
+    }
+    x.copyTo(_x);
+    y.copyTo(_y);
+    z.copyTo(_z);
+    idx.copyTo(_idx);
+
+    _lon_scl = static_cast<float>(_map_w / (2 * CM_PI));
+    _lat_scl = static_cast<float>(_map_h / 2.0);
+
+    const cv::ocl::Device& dev = cv::ocl::Device::getDefault();
+    LOG("Scoring rotations on OpenCL device %s (%d ROI pixels).", dev.name().c_str(), _n);
+    _open = true;
+}
+
+///
+///
+///
+void OclScorer::setRotations(const vector<double>& m)
+{
+    _nrot = static_cast<int>(m.size() / 9);
+    Mat rot(1, 9 * _nrot, CV_32FC1);
+    for (int i = 0; i < 9 * _nrot; i++) {
+        rot.at<float>(i) = static_cast<float>(m[i]);
+    }
+    rot.copyTo(_rot);
+    _out.create(1, 3 * _nrot, CV_32SC1);
+}
+
+///
+///
+///
+void OclScorer::setMap(const Mat& sphere_map)
+{
+    if ((sphere_map.cols != _map_w) || (sphere_map.rows != _map_h) || (sphere_map.type() != CV_8UC1)) {
+        LOG_ERR("Error! Sphere map does not match OpenCL scorer (%dx%d)!", _map_w, _map_h);
+        return;
+    }
+    (sphere_map.isContinuous() ? sphere_map : sphere_map.clone()).reshape(1, 1).copyTo(_map);
+}
+
+///
+///
+///
+bool OclScorer::score(const Mat& roi_frame, vector<double>& err)
+{
+    if (!_open || (_nrot <= 0) || _map.empty()) { return false; }
+    if (!roi_frame.isContinuous()) {
+        LOG_ERR("Error! OpenCL scorer requires a continuous ROI frame!");
+        return false;
+    }
+    roi_frame.reshape(1, 1).copyTo(_roi);
+
+    _kernel.args(
+        cv::ocl::KernelArg::PtrReadOnly(_x), cv::ocl::KernelArg::PtrReadOnly(_y), cv::ocl::KernelArg::PtrReadOnly(_z),
+        cv::ocl::KernelArg::PtrReadOnly(_idx), _n, cv::ocl::KernelArg::PtrReadOnly(_roi),
+        cv::ocl::KernelArg::PtrReadOnly(_map), _map_w, _map_h, _lon_scl, _lat_scl,
+        cv::ocl::KernelArg::PtrReadOnly(_rot), cv::ocl::KernelArg::PtrWriteOnly(_out));
+
+    size_t global = static_cast<size_t>(_nrot) * OCL_GROUP, local = OCL_GROUP;
+    if (!_kernel.run(1, &global, &local, true)) {
+        LOG_ERR("Error! OpenCL scoring kernel failed!");
+        return false;
+    }
+
+    Mat out = _out.getMat(cv::ACCESS_READ);
+    const int* pout = out.ptr<int>();
+    err.resize(_nrot);
+    for (int c = 0; c < _nrot; c++) {
+        int64_t e = (static_cast<int64_t>(pout[3 * c + 1]) << 32) | static_cast<uint32_t>(pout[3 * c + 0]);
+        int good = pout[3 * c + 2];
+        err[c] = ((_n > 0) && (good > (0.25 * static_cast<double>(_n)))) ? static_cast<double>(e) / good : DBL_MAX;
+    }
+    return true;
+}
+
+#endif // FICTRAC_OPENCL
@@ -11,6 +11,8 @@
 #include "Logger.h"
 #include "timing.h"
 
+#include <algorithm>    // min, max
+
 #if defined(PGR_USB3)
 #include "SpinGenApi/SpinnakerGenApi.h"
 using namespace Spinnaker;
@@ -20,7 +22,42 @@ using namespace FlyCapture2;
 
 using cv::Mat;
 
-PGRSource::PGRSource(int index)
+///
+/// Native 8 bit formats that can be passed through without conversion.
+///
+#if defined(PGR_USB3)
+static bool nativeFormat(const ImagePtr& img, BAYER_TYPE& bayer)
+{
+    switch (img->GetPixelFormat()) {
+    case PixelFormat_Mono8:     bayer = BAYER_NONE; return true;
+    case PixelFormat_BayerRG8:  bayer = BAYER_RGGB; return true;
+    case PixelFormat_BayerGR8:  bayer = BAYER_GRBG; return true;
+    case PixelFormat_BayerGB8:  bayer = BAYER_GBRG; return true;
+    case PixelFormat_BayerBG8:  bayer = BAYER_BGGR; return true;
+    default:                    return false;
+    }
+}
+#elif defined(PGR_USB2)
+static bool nativeFormat(const Image& img, BAYER_TYPE& bayer)
+{
+    if (img.GetPixelFormat() == PIXEL_FORMAT_MONO8) {
+        bayer = BAYER_NONE;
+        return true;
+    }
+    if (img.GetPixelFormat() != PIXEL_FORMAT_RAW8) { return false; }
+    switch (img.GetBayerTileFormat()) {
+    case RGGB:  bayer = BAYER_RGGB; break;
+    case GRBG:  bayer = BAYER_GRBG; break;
+    case GBRG:  bayer = BAYER_GBRG; break;
+    case BGGR:  bayer = BAYER_BGGR; break;
+    default:    bayer = BAYER_NONE; break;  // raw mono sensor
+    }
+    return true;
+}
+#endif // PGR_USB2/3
+
+PGRSource::PGRSource(int index, bool native, int nbufs)
+    : _native(native)
 {
     try {
 #if defined(PGR_USB3)
@@ -80,6 +117,24 @@ PGRSource::PGRSource(int index)
             LOG_DBG("Acquisition mode set to continuous.");
         }
 
+        // set driver buffers in flight (oldest frames delivered first, overruns show up as frame ID gaps)
+        if (nbufs > 0) {
+            Spinnaker::GenApi::INodeMap& sNodeMap = _cam->GetTLStreamNodeMap();
+            Spinnaker::GenApi::CEnumerationPtr ptrBufCountMode = sNodeMap.GetNode("StreamBufferCountMode");
+            Spinnaker::GenApi::CIntegerPtr ptrBufCount = sNodeMap.GetNode("StreamBufferCountManual");
+            Spinnaker::GenApi::CEnumerationPtr ptrBufHandling = sNodeMap.GetNode("StreamBufferHandlingMode");
+            if (IsAvailable(ptrBufCountMode) && IsWritable(ptrBufCountMode) && IsAvailable(ptrBufCount) && IsWritable(ptrBufCount)) {
+                ptrBufCountMode->SetIntValue(ptrBufCountMode->GetEntryByName("Manual")->GetValue());
+                ptrBufCount->SetValue(std::min(static_cast<int64_t>(nbufs), ptrBufCount->GetMax()));
+                LOG_DBG("Stream buffer count set to %d.", static_cast<int>(ptrBufCount->GetValue()));
+            } else {
+                LOG_WRN("Warning! Unable to set stream buffer count.");
+            }
+            if (IsAvailable(ptrBufHandling) && IsWritable(ptrBufHandling)) {
+                ptrBufHandling->SetIntValue(ptrBufHandling->GetEntryByName("OldestFirst")->GetValue());
+            }
+        }
+
         // Begin acquiring images
         _cam->BeginAcquisition();
 
@@ -115,6 +170,17 @@ PGRSource::PGRSource(int index)
             LOG_DBG("Connected to PGR camera (%s/%s max res: %s)", camInfo.modelName, camInfo.sensorInfo, camInfo.sensorResolution);
         }
 
+        if (nbufs > 0) {
+            FC2Config config;
+            if (_cam->GetConfiguration(&config) == PGRERROR_OK) {
+                config.numBuffers = nbufs;
+                config.grabMode = BUFFER_FRAMES;
+                if (_cam->SetConfiguration(&config) != PGRERROR_OK) {
+                    LOG_WRN("Warning! Unable to set driver buffer count.");
+                }
+            }
+        }
+
         error = _cam->StartCapture();
         if (error != PGRERROR_OK) {
             LOG_ERR("Error starting video capture!");
@@ -136,6 +202,9 @@ PGRSource::PGRSource(int index)
 #endif // PGR_USB2/3
 
         LOG("PGR camera initialised (%dx%d @ %.3f fps)!", _width, _height, _fps);
+        if (_native) {
+            LOG("Capturing native (Mono8/Bayer) frames where supported by the camera pixel format.");
+        }
 
         _open = true;
         _live = true;
@@ -229,10 +298,287 @@ bool PGRSource::setFPS(double fps)
     return ret;
 }
 
+///
+/// Acquisition is restarted to apply the new window. Binning is only supported by USB3 cameras.
+///
+bool PGRSource::setAOI(int& x, int& y, int& w, int& h, int& bin)
+{
+    if (!_open || (bin < 1) || (w <= 0) || (h <= 0)) { return false; }
+
+    bool ret = false;
+#if defined(PGR_USB3)
+    try {
+        _cam->EndAcquisition();
+
+        /// Binning first, so size/offset limits are in binned pixels.
+        if (bin > 1) {
+            if ((_cam->BinningHorizontal.GetAccessMode() == GenApi::RW) && (_cam->BinningVertical.GetAccessMode() == GenApi::RW)) {
+                _cam->BinningHorizontal.SetValue(bin);
+                _cam->BinningVertical.SetValue(bin);
+            } else {
+                LOG_WRN("Warning! Camera does not support binning.");
+            }
+        }
+        bin = std::max(1, static_cast<int>(_cam->BinningHorizontal.GetValue()));
+
+        _cam->OffsetX.SetValue(0);
+        _cam->OffsetY.SetValue(0);
+        int bx = x / bin, by = y / bin, bw = (x + w + bin - 1) / bin - bx, bh = (y + h + bin - 1) / bin - by;
+        alignAOI(bx, bw, static_cast<int>(_cam->OffsetX.GetInc()), static_cast<int>(_cam->Width.GetInc()), static_cast<int>(_cam->Width.GetMax()));
+        alignAOI(by, bh, static_cast<int>(_cam->OffsetY.GetInc()), static_cast<int>(_cam->Height.GetInc()), static_cast<int>(_cam->Height.GetMax()));
+        _cam->Width.SetValue(bw);
+        _cam->Height.SetValue(bh);
+        _cam->OffsetX.SetValue(bx);
+        _cam->OffsetY.SetValue(by);
+
+        x = bx * bin;
+        y = by * bin;
+        w = bw * bin;
+        h = bh * bin;
+        ret = true;
+    }
+    catch (Spinnaker::Exception& e) {
+        LOG_ERR("Error setting camera AOI! Error was: %s", e.what());
+    }
+    catch (...) {
+        LOG_ERR("Error setting camera AOI!");
+    }
+
+    try {
+        _cam->BeginAcquisition();
+        _width = _cam->Width();
+        _height = _cam->Height();
+    }
+    catch (Spinnaker::Exception& e) {
+        LOG_ERR("Error restarting acquisition! Error was: %s", e.what());
+        _open = false;
+        return false;
+    }
+#elif defined(PGR_USB2)
+    if (bin > 1) {
+        LOG_WRN("Warning! Binning is not supported for FlyCapture cameras.");
+        bin = 1;
+    }
+
+    Format7Info info;
+    bool supported = false;
+    info.mode = MODE_0;
+    Format7ImageSettings settings;
+    unsigned int packet_sz = 0;
+    float pc = 0;
+    if ((_cam->GetFormat7Info(&info, &supported) != PGRERROR_OK) || !supported ||
+        (_cam->GetFormat7Configuration(&settings, &packet_sz, &pc) != PGRERROR_OK)) {
+        LOG_ERR("Error! Camera does not support Format7 AOI.");
+        return false;
+    }
+
+    alignAOI(x, w, info.offsetHStepSize, info.imageHStepSize, info.maxWidth);
+    alignAOI(y, h, info.offsetVStepSize, info.imageVStepSize, info.maxHeight);
+    settings.mode = MODE_0;
+    settings.offsetX = x;
+    settings.offsetY = y;
+    settings.width = w;
+    settings.height = h;
+
+    bool valid = false;
+    Format7PacketInfo packet_info;
+    if ((_cam->ValidateFormat7Settings(&settings, &valid, &packet_info) != PGRERROR_OK) || !valid) {
+        LOG_ERR("Error! Invalid camera AOI (%d, %d, %dx%d).", x, y, w, h);
+        return false;
+    }
+
+    _cam->StopCapture();
+    ret = _cam->SetFormat7Configuration(&settings, packet_info.recommendedBytesPerPacket) == PGRERROR_OK;
+    if (!ret) {
+        LOG_ERR("Error setting camera AOI!");
+    }
+    if (_cam->StartCapture() != PGRERROR_OK) {
+        LOG_ERR("Error restarting video capture!");
+        _open = false;
+        return false;
+    }
+    if (ret) {
+        _width = w;
+        _height = h;
+    }
+#endif // PGR_USB2/3
+
+    if (ret) {
+        _fps = getFPS();
+        LOG("Camera AOI set to %dx%d+%d+%d (bin %d) - frames are now %dx%d @ %.3f fps.", w, h, x, y, bin, _width, _height, _fps);
+    }
+    return ret;
+}
+
+#if defined(PGR_USB2)
+///
+/// Absolute value and limits of a camera property.
+///
+static bool getAbsProperty(Camera* cam, PropertyType type, double& val, double& min_val, double& max_val)
+{
+    Property prop(type);
+    PropertyInfo info(type);
+    if ((cam->GetProperty(&prop) != PGRERROR_OK) || (cam->GetPropertyInfo(&info) != PGRERROR_OK) || !info.present || !info.absValSupported) {
+        return false;
+    }
+    val = prop.absValue;
+    min_val = info.absMin;
+    max_val = info.absMax;
+    return true;
+}
+
+///
+/// Set absolute value (manual mode), returning the value applied.
+///
+static bool setAbsProperty(Camera* cam, PropertyType type, double& val)
+{
+    Property prop(type);
+    if (cam->GetProperty(&prop) != PGRERROR_OK) { return false; }
+    prop.autoManualMode = false;
+    prop.absControl = true;
+    prop.onOff = true;
+    prop.absValue = static_cast<float>(val);
+    if ((cam->SetProperty(&prop) != PGRERROR_OK) || (cam->GetProperty(&prop) != PGRERROR_OK)) { return false; }
+    val = prop.absValue;
+    return true;
+}
+#endif // PGR_USB2
+
+bool PGRSource::getExposure(double& us, double& min_us, double& max_us)
+{
+    if (!_open) { return false; }
+#if defined(PGR_USB3)
+    try {
+        us = _cam->ExposureTime.GetValue();
+        min_us = _cam->ExposureTime.GetMin();
+        max_us = _cam->ExposureTime.GetMax();
+        return true;
+    }
+    catch (Spinnaker::Exception& e) {
+        LOG_ERR("Error reading camera exposure! Error was: %s", e.what());
+    }
+    return false;
+#elif defined(PGR_USB2)
+    /// Shutter is in ms.
+    if (!getAbsProperty(_cam.get(), SHUTTER, us, min_us, max_us)) { return false; }
+    us *= 1e3;
+    min_us *= 1e3;
+    max_us *= 1e3;
+    return true;
+#endif // PGR_USB2/3
+}
+
+bool PGRSource::setExposure(double& us)
+{
+    if (!_open) { return false; }
+#if defined(PGR_USB3)
+    try {
+        if (IsWritable(_cam->ExposureAuto)) {
+            _cam->ExposureAuto.SetValue(Spinnaker::ExposureAuto_Off);
+        }
+        _cam->ExposureTime.SetValue(std::max(_cam->ExposureTime.GetMin(), std::min(_cam->ExposureTime.GetMax(), us)));
+        us = _cam->ExposureTime.GetValue();
+        return true;
+    }
+    catch (Spinnaker::Exception& e) {
+        LOG_ERR("Error setting camera exposure! Error was: %s", e.what());
+    }
+    return false;
+#elif defined(PGR_USB2)
+    double ms = us * 1e-3;
+    if (!setAbsProperty(_cam.get(), SHUTTER, ms)) { return false; }
+    us = ms * 1e3;
+    return true;
+#endif // PGR_USB2/3
+}
+
+bool PGRSource::getGain(double& db, double& min_db, double& max_db)
+{
+    if (!_open) { return false; }
+#if defined(PGR_USB3)
+    try {
+        db = _cam->Gain.GetValue();
+        min_db = _cam->Gain.GetMin();
+        max_db = _cam->Gain.GetMax();
+        return true;
+    }
+    catch (Spinnaker::Exception& e) {
+        LOG_ERR("Error reading camera gain! Error was: %s", e.what());
+    }
+    return false;
+#elif defined(PGR_USB2)
+    return getAbsProperty(_cam.get(), GAIN, db, min_db, max_db);
+#endif // PGR_USB2/3
+}
+
+bool PGRSource::setGain(double& db)
+{
+    if (!_open) { return false; }
+#if defined(PGR_USB3)
+    try {
+        if (IsWritable(_cam->GainAuto)) {
+            _cam->GainAuto.SetValue(Spinnaker::GainAuto_Off);
+        }
+        _cam->Gain.SetValue(std::max(_cam->Gain.GetMin(), std::min(_cam->Gain.GetMax(), db)));
+        db = _cam->Gain.GetValue();
+        return true;
+    }
+    catch (Spinnaker::Exception& e) {
+        LOG_ERR("Error setting camera gain! Error was: %s", e.what());
+    }
+    return false;
+#elif defined(PGR_USB2)
+    return setAbsProperty(_cam.get(), GAIN, db);
+#endif // PGR_USB2/3
+}
+
+#if defined(PGR_USB3)
+///
+/// Periodically latch device clock against the host clock.
+///
+void PGRSource::syncClock()
+{
+    double t0 = ts_ms();
+    if (!_clock.latchDue(t0)) { return; }
+
+    try {
+        Spinnaker::GenApi::INodeMap& nodeMap = _cam->GetNodeMap();
+        Spinnaker::GenApi::CCommandPtr ptrLatch = nodeMap.GetNode("TimestampLatch");
+        Spinnaker::GenApi::CIntegerPtr ptrLatchValue = nodeMap.GetNode("TimestampLatchValue");
+        if (!IsAvailable(ptrLatch) || !IsWritable(ptrLatch) || !IsAvailable(ptrLatchValue) || !IsReadable(ptrLatchValue)) {
+            LOG_WRN("Warning! Camera does not support timestamp latching - estimating clock offset from frame arrival times.");
+            _clock.latchFailed();
+            return;
+        }
+        ptrLatch->Execute();
+        double t1 = ts_ms();
+        _clock.addLatch(ptrLatchValue->GetValue() * 1e-6, t0, t1);
+    }
+    catch (Spinnaker::Exception& e) {
+        LOG_WRN("Warning! Unable to latch camera timestamp (%s) - estimating clock offset from frame arrival times.", e.what());
+        _clock.latchFailed();
+    }
+}
+#endif // PGR_USB3
+
 bool PGRSource::grab(cv::Mat& frame)
+{
+    Mat buf;
+    if (!grabBuffer(buf)) { return false; }
+    buf.copyTo(frame);
+    releaseBuffer();
+    return true;
+}
+
+///
+/// Frame wraps converted (or native) SDK image until releaseBuffer() (or next grab).
+///
+bool PGRSource::grabBuffer(cv::Mat& frame)
 {
 	if( !_open ) { return false; }
 
+    releaseBuffer();
+
 #if defined(PGR_USB3)
     ImagePtr pgr_image = NULL;
 
@@ -241,15 +587,17 @@ bool PGRSource::grab(cv::Mat& frame)
         long int timeout = _fps > 0 ? std::max(static_cast<long int>(1000), static_cast<long int>(1000. / _fps)) : 1000; // set capture timeout to at least 1000 ms
         pgr_image = _cam->GetNextImage(timeout);
         double ts = ts_ms();    // backup, in case the device timestamp is junk
-        _ms_since_midnight = ms_since_midnight();
-        _timestamp = pgr_image->GetTimeStamp();
+        double msm = ms_since_midnight();
+        countFrameId(pgr_image->GetFrameID());
+
+        // Device timestamp (ns) on host clock
+        syncClock();
+        setDeviceTimestamp(pgr_image->GetTimeStamp() * 1e-6, ts, msm);
         LOG_DBG("Frame captured %dx%d%d @ %f (t_sys: %f ms, t_day: %f ms)", pgr_image->GetWidth(), pgr_image->GetHeight(), pgr_image->GetNumChannels(), _timestamp, ts, _ms_since_midnight);
-        if (_timestamp <= 0) {
-            _timestamp = ts;
-        }
 
         // Ensure image completion
         if (pgr_image->IsIncomplete()) {
+            _nincomplete.fetch_add(1, std::memory_order_relaxed);
             // Retreive and print the image status description
             LOG_ERR("Error! Image capture incomplete (%s).", Image::GetImageStatusDescription(pgr_image->GetImageStatus()));
             pgr_image->Release();
@@ -268,11 +616,20 @@ bool PGRSource::grab(cv::Mat& frame)
     }
 
     try {
+        // Pass native frame through (held until releaseBuffer)
+        BAYER_TYPE bayer = BAYER_NONE;
+        if (_native && nativeFormat(pgr_image, bayer)) {
+            _bayerType = bayer;
+            _raw_image = pgr_image;
+            frame = Mat(_height, _width, CV_8UC1, _raw_image->GetData(), _raw_image->GetStride());
+            return true;
+        }
+        _bayerType = BAYER_NONE;
+
         // Convert image
-        ImagePtr bgr_image = pgr_image->Convert(PixelFormat_BGR8, NEAREST_NEIGHBOR);
+        _bgr_image = pgr_image->Convert(PixelFormat_BGR8, NEAREST_NEIGHBOR);
 
-        Mat tmp(_height, _width, CV_8UC3, bgr_image->GetData(), bgr_image->GetStride());
-        tmp.copyTo(frame);
+        frame = Mat(_height, _width, CV_8UC3, _bgr_image->GetData(), _bgr_image->GetStride());
 
         // We have to release our original image to clear space on the buffer
         pgr_image->Release();
@@ -290,30 +647,52 @@ bool PGRSource::grab(cv::Mat& frame)
         return false;
     }
 #elif defined(PGR_USB2)
-    Image frame_raw;
+    Image& frame_raw = _raw_image;
     Error error = _cam->RetrieveBuffer(&frame_raw);
     double ts = ts_ms();    // backup, in case the device timestamp is junk
+    double msm = ms_since_midnight();
     //LOG_DBG("Frame captured %dx%d%d @ %f (%f)", pgr_image->GetWidth(), pgr_image->GetHeight(), pgr_image->GetNumChannels(), _timestamp, ts);
     if (error != PGRERROR_OK) {
+        if (error == PGRERROR_IMAGE_CONSISTENCY_ERROR) {
+            _nincomplete.fetch_add(1, std::memory_order_relaxed);
+        }
         LOG_ERR("Error grabbing image frame!");
         return false;
     }
     auto timestamp = frame_raw.GetTimeStamp();
-    _timestamp = timestamp.seconds * 1e3 + timestamp.microSeconds / (double)1e3;
-    if (_timestamp <= 0) {
-        _timestamp = ts;
+    setDeviceTimestamp(timestamp.seconds * 1e3 + timestamp.microSeconds / (double)1e3, ts, msm);
+
+    BAYER_TYPE bayer = BAYER_NONE;
+    if (_native && nativeFormat(frame_raw, bayer)) {
+        _bayerType = bayer;
+        frame = Mat(frame_raw.GetRows(), frame_raw.GetCols(), CV_8UC1, frame_raw.GetData(), frame_raw.GetStride());
+        return true;
     }
+    _bayerType = BAYER_NONE;
 
-    Image frame_bgr;
-    error = frame_raw.Convert(PIXEL_FORMAT_BGR, &frame_bgr);
+    error = frame_raw.Convert(PIXEL_FORMAT_BGR, &_bgr_image);
     if (error != PGRERROR_OK) {
         LOG_ERR("Error converting image format!");
         return false;
     }
-    Mat frame_cv(frame_bgr.GetRows(), frame_bgr.GetCols(), CV_8UC3, frame_bgr.GetData(), frame_bgr.GetStride());
-    frame_cv.copyTo(frame);
+    frame = Mat(_bgr_image.GetRows(), _bgr_image.GetCols(), CV_8UC3, _bgr_image.GetData(), _bgr_image.GetStride());
     return true;
 #endif // PGR_USB2/3
 }
 
+///
+///
+///
+void PGRSource::releaseBuffer()
+{
+#if defined(PGR_USB3)
+    _bgr_image = NULL;
+    if (_raw_image.IsValid()) {
+        _raw_image->Release();  // return buffer to the acquisition stream
+        _raw_image = NULL;
+    }
+#endif // PGR_USB3
+    // USB2 buffers are reused by next grab
+}
+
 #endif // PGR_USB2/3
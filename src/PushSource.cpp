@@ -0,0 +1,126 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       PushSource.cpp
+/// \brief      Frame source fed by the application (embedded use).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "PushSource.h"
+
+#include "Logger.h"
+#include "timing.h"
+
+#include <algorithm>    // max
+
+using cv::Mat;
+using std::lock_guard;
+using std::unique_lock;
+using std::mutex;
+
+///
+///
+///
+PushSource::PushSource(int width, int height, double fps, int max_queue)
+    : _max_queue(std::max(1, max_queue)), _closed(false)
+{
+    _width = width;
+    _height = height;
+    _fps = fps;
+    _live = true;
+    _open = (_width > 0) && (_height > 0);
+    if (!_open) {
+        LOG_ERR("Error! Invalid push source frame size (%dx%d).", _width, _height);
+    }
+}
+
+///
+///
+///
+PushSource::~PushSource()
+{
+    close();
+}
+
+///
+///
+///
+bool PushSource::push(const Mat& frame, double ts, double ms)
+{
+    if (!_open || (frame.cols != _width) || (frame.rows != _height) || ((frame.type() != CV_8UC1) && (frame.type() != CV_8UC3))) {
+        LOG_ERR("Error! Pushed frame is invalid (%dx%d type %d, expected %dx%d CV_8UC1/3).", frame.cols, frame.rows, frame.type(), _width, _height);
+        return false;
+    }
+
+    Frame f;
+    f.frame = frame.u ? frame : frame.clone();  // external memory may be reused once we return
+    f.ts = (ts >= 0) ? ts : ts_ms();
+    f.ms = (ms >= 0) ? ms : ms_since_midnight() - (ts_ms() - f.ts);
+    {
+        lock_guard<mutex> l(_mutex);
+        if (_closed) { return false; }
+        while (static_cast<int>(_queue.size()) >= _max_queue) {
+            _queue.pop_front();
+            _ndropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        _queue.push_back(f);
+    }
+    _cond.notify_all();
+    return true;
+}
+
+///
+///
+///
+void PushSource::close()
+{
+    {
+        lock_guard<mutex> l(_mutex);
+        _closed = true;
+    }
+    _cond.notify_all();
+}
+
+///
+/// Unblock a waiting grab (discards queued frames).
+///
+void PushSource::interrupt()
+{
+    {
+        lock_guard<mutex> l(_mutex);
+        _closed = true;
+        _queue.clear();
+    }
+    _cond.notify_all();
+}
+
+///
+///
+///
+bool PushSource::grab(Mat& frame)
+{
+    Mat buf;
+    if (!grabBuffer(buf)) { return false; }
+    buf.copyTo(frame);
+    return true;
+}
+
+///
+/// Blocks until a frame is pushed. The frame shares the pushed buffer (no copy).
+///
+bool PushSource::grabBuffer(Mat& frame)
+{
+    Frame f;
+    {
+        unique_lock<mutex> l(_mutex);
+        _cond.wait(l, [&] { return !_queue.empty() || _closed; });
+        if (_queue.empty()) { return false; }
+        f = _queue.front();
+        _queue.pop_front();
+    }
+
+    frame = f.frame;
+    _timestamp = f.ts;
+    _ms_since_midnight = f.ms;
+
+    LOG_DBG("Frame pushed @ %f (t_day: %f ms)", _timestamp, _ms_since_midnight);
+    return true;
+}
@@ -0,0 +1,56 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       QualityGovernor.cpp
+/// \brief      Steps tracking work down/up to sustain the source frame rate.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "QualityGovernor.h"
+
+const double GOV_ALPHA = 0.05;          // load/queue smoothing (per frame)
+const double GOV_LOAD_HIGH = 0.9;       // step down above this load
+const double GOV_LOAD_LOW = 0.6;        // step up below this load (at the cheaper level)
+const double GOV_QUEUE_HIGH = 1.0;      // step down above this many queued frames
+const double GOV_QUEUE_LOW = 0.25;
+const double GOV_HOLD_DOWN_MS = 1000;   // min time between changes
+const double GOV_HOLD_UP_MS = 5000;
+
+///
+///
+///
+QualityGovernor::QualityGovernor(double period_ms)
+    : _period_ms(period_ms), _prev_ts(-1), _load(0), _queue(0), _level(0), _change_ts(-1)
+{
+}
+
+///
+///
+///
+int QualityGovernor::update(double busy_ms, int queue, double ts, double now)
+{
+    /// Frame period, measured if not known.
+    if (_prev_ts >= 0) {
+        const double dts = ts - _prev_ts;
+        if ((dts > 0) && (dts < 1000)) {
+            _period_ms = (_period_ms > 0) ? (_period_ms + GOV_ALPHA * (dts - _period_ms)) : dts;
+        }
+    }
+    _prev_ts = ts;
+    if (_period_ms <= 0) { return -1; }
+
+    _load += GOV_ALPHA * ((busy_ms / _period_ms) - _load);
+    _queue += GOV_ALPHA * (queue - _queue);
+    if (_change_ts < 0) { _change_ts = now; }
+
+    int level = _level;
+    if (((_load > GOV_LOAD_HIGH) || (_queue > GOV_QUEUE_HIGH)) && ((now - _change_ts) > GOV_HOLD_DOWN_MS)) {
+        level = (_level + 1 < NUM_LEVELS) ? (_level + 1) : _level;
+    }
+    else if ((_load < GOV_LOAD_LOW) && (_queue < GOV_QUEUE_LOW) && ((now - _change_ts) > GOV_HOLD_UP_MS)) {
+        level = (_level > 0) ? (_level - 1) : 0;
+    }
+    if (level == _level) { return -1; }
+
+    _level = level;
+    _change_ts = now;
+    return _level;
+}
@@ -9,15 +9,33 @@
 #include "TermRecorder.h"
 #include "FileRecorder.h"
 #include "SocketRecorder.h"
+#include "TcpRecorder.h"
 #include "SerialRecorder.h"
+#include "ShmemRecorder.h"
+#include "ColumnRecorder.h"
 #include "misc.h"   // thread priority
+#include "Profiler.h"
+#include "timing.h" // ts_ms
 
 #include <iostream> // cout/cerr
+#include <algorithm> // min
+#include <cstring>   // memcpy
 
 using namespace std;
 
-Recorder::Recorder(RecorderInterface::RecordType type, string fn)
-    : _active(false)
+/// Max number of spare msg buffers to hold on to.
+const size_t MAX_FREE_BUFFERS = 64;
+
+/// Max msgs drained from the queue and handed over in a single writeMsgs call.
+const size_t MAX_BATCH_MSGS = 32;
+
+/// Msg buffers allocated up front, with capacity for a CSV data line or BinaryRecord.
+const size_t PREALLOC_BUFFERS = 8;
+const size_t PREALLOC_BUFFER_BYTES = 1024;
+
+Recorder::Recorder(RecorderInterface::RecordType type, string fn, bool binary, Batching batch, int spin_us)
+    : _active(false), _spin_us(spin_us), _nqueued(0), _parked(false), _lat_hist(nullptr), _lat_hist_int(nullptr),
+    _batch(batch), _rpos(0), _wpos(0)
 {
     /// Set record type.
     switch (type) {
@@ -25,22 +43,48 @@ Recorder::Recorder(RecorderInterface::RecordType type, string fn)
         _record = make_unique<TermRecorder>();
         break;
     case RecorderInterface::RecordType::FILE:
-        _record = make_unique<FileRecorder>();
+        _record = make_unique<FileRecorder>(binary);
         break;
     case RecorderInterface::RecordType::SOCK:
         _record = make_unique<SocketRecorder>();
         break;
+    case RecorderInterface::RecordType::TCP:
+        _record = make_unique<TcpRecorder>();
+        break;
     case RecorderInterface::RecordType::COM:
         _record = make_unique<SerialRecorder>();
         break;
+    case RecorderInterface::RecordType::SHM:
+        _record = make_unique<ShmemRecorder>();
+        break;
+    case RecorderInterface::RecordType::COLS:
+        _record = make_unique<ColumnRecorder>();
+        break;
     default:
         break;
     }
 
-    /// Open record and start async recording.
+    /// Open record and start async recording. Shared memory writes are cheap
+    /// and latency critical, so they are done synchronously in addMsg().
     if (_record && _record->openRecord(fn)) {
         _active = true;
-        _thread = make_unique<thread>(&Recorder::processMsgQ, this);
+        if (type == RecorderInterface::RecordType::SHM) {
+            // no writer thread
+        }
+        else if (_batch.ring_size > 0) {
+            _ring.resize(_batch.ring_size);
+            if ((_batch.flush_bytes == 0) || (_batch.flush_bytes > _batch.ring_size)) {
+                _batch.flush_bytes = _batch.ring_size / 2;
+            }
+            _thread = StartThread(&Recorder::processRing, this);
+        }
+        else {
+            _freeQ.resize(PREALLOC_BUFFERS);
+            for (auto& b : _freeQ) { b.reserve(PREALLOC_BUFFER_BYTES); }
+            _batchMsgs.reserve(MAX_BATCH_MSGS);
+            _batchStamps.reserve(MAX_BATCH_MSGS);
+            _thread = StartThread(&Recorder::processMsgQ, this);
+        }
     }
     else {
         cerr << "Error initialising recorder!" << endl;
@@ -54,22 +98,52 @@ Recorder::~Recorder()
     unique_lock<mutex> l(_qMutex);
     _active = false;
     _qCond.notify_all();
+    _spaceCond.notify_all();
     l.unlock();
 
     if (_thread && _thread->joinable()) {
         _thread->join();
     }
 
-    /// _record->close() called by unique_ptr dstr.
+    /// Finalise the output (e.g. the cols index and footer) only once the writer thread has drained.
+    if (_record) {
+        _record->closeRecord();
+    }
 }
 
-bool Recorder::addMsg(string msg)
+void Recorder::setLatencyHist(LatencyHist* hist, LatencyHist* hist_int)
 {
-    bool ret = false;
     lock_guard<mutex> l(_qMutex);
-    if (_active) {
-        _msgQ.push_back(msg);
-        _qCond.notify_all();
+    _lat_hist = hist;
+    _lat_hist_int = hist_int;
+}
+
+bool Recorder::addMsg(const void* data, size_t len, double stamp_ms)
+{
+    if (!_ring.empty()) {
+        return addRing(static_cast<const char*>(data), len);
+    }
+
+    bool ret = false;
+    unique_lock<mutex> l(_qMutex, defer_lock);
+    PROFILE_LOCK(l, "Recorder::_qMutex wait");
+    if (_active && !_thread) {
+        ret = _record->writeRecord(static_cast<const char*>(data), len);
+    }
+    else if (_active) {
+        _msgQ.emplace_back();
+        if (!_freeQ.empty()) {
+            _msgQ.back().buf = std::move(_freeQ.back());
+            _freeQ.pop_back();
+        }
+        _msgQ.back().buf.assign(static_cast<const char*>(data), len);  // re-uses buffer capacity
+        _msgQ.back().stamp = stamp_ms;
+        _nqueued.store(_msgQ.size(), memory_order_release);
+
+        /// A polling writer picks the msg up without being woken.
+        if ((_spin_us == 0) || _parked) {
+            _qCond.notify_all();
+        }
         ret = true;
     }
     return ret;
@@ -77,29 +151,169 @@ bool Recorder::addMsg(string msg)
 
 void Recorder::processMsgQ()
 {
+    PROFILE_THREAD("Recorder");
+
     /// Set thread high priority (when run as SU).
     if (!SetThreadNormalPriority()) {
         cerr << "Error! Recorder processing thread unable to set thread priority!" << endl;
     }
+    if (!ApplyThreadClass(ThreadClass::IO)) {
+        cerr << "Warning! Unable to apply recorder thread placement (cpus_io)!" << endl;
+    }
+
+    const auto spin = chrono::microseconds(_spin_us);
 
     /// Get a un/lockable lock.
     unique_lock<mutex> l(_qMutex);
     while (_active) {
-        while (_msgQ.size() == 0) {
+        /// Poll without the lock first (low latency mode).
+        if ((_msgQ.size() == 0) && (_spin_us != 0)) {
+            l.unlock();
+            auto t0 = chrono::steady_clock::now();
+            while (_active && (_nqueued.load(memory_order_acquire) == 0)) {
+                if ((_spin_us > 0) && ((chrono::steady_clock::now() - t0) >= spin)) { break; }
+            }
+            l.lock();
+        }
+        while (_active && (_msgQ.size() == 0)) {
+            _parked = true;
             _qCond.wait(l);
-            if (!_active) { break; }
+            _parked = false;
         }
 
         /// Process msg queue. Ignore _active while we have message still to process.
+        /// Everything pending (up to MAX_BATCH_MSGS) is written in one go, msgs stay separate.
         while (_msgQ.size() > 0) {
-            string msg = _msgQ.front();
-            _msgQ.pop_front();
+            while ((_msgQ.size() > 0) && (_batchMsgs.size() < MAX_BATCH_MSGS)) {
+                _batchMsgs.push_back(std::move(_msgQ.front().buf));
+                _batchStamps.push_back(_msgQ.front().stamp);
+                _msgQ.pop_front();
+            }
+            _nqueued.store(_msgQ.size(), memory_order_release);
+            LatencyHist* hist = _lat_hist;
+            LatencyHist* hist_int = _lat_hist_int;
             l.unlock();
 
             // do async i/o
-            _record->writeRecord(msg);
-            l.lock();
+            {
+                PROFILE_ZONE("Recorder::write");
+                if (_batchMsgs.size() == 1) {
+                    _record->writeRecord(_batchMsgs[0]);
+                } else {
+                    _record->writeMsgs(_batchMsgs.data(), _batchMsgs.size());
+                }
+            }
+            const double t = ts_ms();
+            for (double stamp : _batchStamps) {
+                if (stamp < 0) { continue; }
+                double lat = t - stamp;
+                if (hist) { hist->record(lat); }
+                if (hist_int) { hist_int->record(lat); }
+            }
+            PROFILE_LOCK(l, "Recorder::_qMutex wait");
+
+            for (auto& buf : _batchMsgs) {
+                if (_freeQ.size() >= MAX_FREE_BUFFERS) { break; }
+                _freeQ.push_back(std::move(buf));
+            }
+            _batchMsgs.clear();
+            _batchStamps.clear();
         }
     }
     l.unlock();
 }
+
+///
+/// Copy msg into byte ring, blocking while the ring is full.
+///
+bool Recorder::addRing(const char* data, size_t len)
+{
+    const size_t size = _ring.size();
+
+    unique_lock<mutex> l(_qMutex, defer_lock);
+    PROFILE_LOCK(l, "Recorder::_qMutex wait");
+    while (len > 0) {
+        if (!_active) { return false; }
+
+        /// Keep msgs contiguous (only msgs larger than the ring are split).
+        size_t pending = static_cast<size_t>(_wpos - _rpos);
+        if ((pending == size) || ((len <= size) && (len > size - pending))) {
+            _qCond.notify_all();    // make sure writer is draining
+            _spaceCond.wait(l);
+            continue;
+        }
+
+        /// Copy as much as fits (up to two segments at wrap).
+        size_t n = std::min(len, size - pending);
+        size_t off = static_cast<size_t>(_wpos % size);
+        size_t n1 = std::min(n, size - off);
+        memcpy(&_ring[off], data, n1);
+        memcpy(&_ring[0], data + n1, n - n1);
+
+        if (pending == 0) {
+            _pending_since = chrono::steady_clock::now();
+        }
+        _wpos += n;
+        data += n;
+        len -= n;
+
+        /// Only wake writer when there's something to do.
+        if ((pending == 0) || (pending + n >= _batch.flush_bytes)) {
+            _qCond.notify_all();
+        }
+    }
+    return true;
+}
+
+///
+/// Writer thread for batched mode.
+///
+void Recorder::processRing()
+{
+    PROFILE_THREAD("Recorder");
+
+    /// Set thread high priority (when run as SU).
+    if (!SetThreadNormalPriority()) {
+        cerr << "Error! Recorder processing thread unable to set thread priority!" << endl;
+    }
+    if (!ApplyThreadClass(ThreadClass::IO)) {
+        cerr << "Warning! Unable to apply recorder thread placement (cpus_io)!" << endl;
+    }
+
+    const size_t size = _ring.size();
+    const auto latency = chrono::milliseconds(_batch.max_latency_ms);
+
+    unique_lock<mutex> l(_qMutex);
+    while (true) {
+        while (_active && (_wpos == _rpos)) {
+            _qCond.wait(l);
+        }
+        if (_wpos == _rpos) { break; }  // stopped and drained
+
+        /// Let small writes accumulate (ignore latency when stopping).
+        if (_batch.max_latency_ms > 0) {
+            auto deadline = _pending_since + latency;
+            while (_active && ((_wpos - _rpos) < _batch.flush_bytes)) {
+                if (_qCond.wait_until(l, deadline) == cv_status::timeout) { break; }
+            }
+        }
+
+        /// Drain everything pending. Producers only write to free space, so the
+        /// pending bytes can be written without holding the lock.
+        uint64_t end = _wpos;
+        size_t n = static_cast<size_t>(end - _rpos);
+        size_t off = static_cast<size_t>(_rpos % size);
+        size_t n1 = std::min(n, size - off);
+        l.unlock();
+
+        {
+            PROFILE_ZONE("Recorder::write");
+            _record->writeRecords(&_ring[off], n1, &_ring[0], n - n1);
+        }
+
+        l.lock();
+        _rpos = end;
+        _spaceCond.notify_all();
+    }
+    l.unlock();
+}
@@ -21,6 +21,8 @@ public:
 	virtual bool pixelToVector(CmReal x, CmReal y, CmReal direction[3]) const;
 	virtual bool vectorToPixel(const CmReal point[3], CmReal& x, CmReal& y) const;
 	virtual bool validPixel(CmReal x, CmReal y) const;
+	using CameraModel::getProjection;
+	virtual bool getProjection(proj::Rectilinear& p) const;
 	virtual CmReal getFOV() const { return _verticalFOV; }
 
 private:
@@ -110,3 +112,17 @@ bool RectilinearCameraModel::validPixel(CmReal x, CmReal y) const
 	CmReal dy = y - _yc;
 	return _validPixel(x, y, dx*dx + dy*dy);
 }
+
+///
+/// Inline projection.
+///
+bool RectilinearCameraModel::getProjection(proj::Rectilinear& p) const
+{
+	p.f = _focalLengthPixels;
+	p.xc = _xc;
+	p.yc = _yc;
+	p.r2max = _imageCircleR2;
+	p.w = _width;
+	p.h = _height;
+	return true;
+}
@@ -9,6 +9,7 @@
 #include "typesvars.h"
 #include "CameraModel.h"
 #include "Logger.h"
+#include "Profiler.h"
 
 /// OpenCV individual includes required by gcc?
 #include <opencv2/highgui.hpp>
@@ -16,6 +17,8 @@
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/videoio.hpp>
 
+#include <algorithm>    // min, max
+
 
 Remapper::Remapper(int srcW, int srcH, int dstW, int dstH)
 	: _mode(LINEAR), _srcW(srcW), _srcH(srcH), _dstW(dstW), _dstH(dstH)
@@ -175,6 +178,8 @@ void Remapper::_apply(
 	const void *src, void *dst,
 	int srcStep, int dstStep)
 {
+	PROFILE_ZONE("Remapper::apply");
+
 	///
 	/// Sanity check to indirectly test number of channels are valid.
 	///
@@ -185,12 +190,11 @@ void Remapper::_apply(
 		return;
 	}
 
-	float *mapX = _getMapX();
-	float *mapY = _getMapY();
-	if (mapX==0 || mapY==0)
-		return;
-	cv::Mat mMapX(_dstH, _dstW, CV_32FC1, mapX);
-	cv::Mat mMapY(_dstH, _dstW, CV_32FC1, mapY);
+	if (_fixedMap1.empty()) {
+		_updateFixedMaps();
+		if (_fixedMap1.empty())
+			return;
+	}
 
 	int cvInterp;
 	switch (_mode) {
@@ -221,5 +225,98 @@ void Remapper::_apply(
 	cv::Mat mSrc = _getCvMat(cvType, src, _srcW, _srcH, srcStep);
 	cv::Mat mDst = _getCvMat(cvType, dst, _dstW, _dstH, dstStep);
 
-	cv::remap(mSrc, mDst, mMapX, mMapY, cvInterp);
+	///
+	/// Pixels outside the valid rect have no source pixel (constant border).
+	///
+	const cv::Rect& r = _validRect;
+	if (r.y > 0)
+		mDst.rowRange(0, r.y).setTo(cv::Scalar::all(0));
+	if ((r.y + r.height) < _dstH)
+		mDst.rowRange(r.y + r.height, _dstH).setTo(cv::Scalar::all(0));
+	if (r.x > 0)
+		mDst(cv::Rect(0, r.y, r.x, r.height)).setTo(cv::Scalar::all(0));
+	if ((r.x + r.width) < _dstW)
+		mDst(cv::Rect(r.x + r.width, r.y, _dstW - r.x - r.width, r.height)).setTo(cv::Scalar::all(0));
+	if (r.area() <= 0)
+		return;
+
+	cv::Mat mDstRoi = mDst(r);
+	cv::remap(mSrc, mDstRoi, _fixedMap1, _fixedMap2, cvInterp);
+}
+
+#if defined(FICTRAC_OPENCL)
+void Remapper::apply(const cv::UMat& src, cv::UMat& dst)
+{
+	if (src.cols != _srcW || src.rows != _srcH) {
+		LOG_ERR("Error applying remapping! Unexpected source image size (%dx%d)!", src.cols, src.rows);
+		return;
+	}
+
+	if (_fixedMap1.empty()) {
+		_updateFixedMaps();
+		if (_fixedMap1.empty())
+			return;
+	}
+	if (_fixedMap1U.empty() && (_validRect.area() > 0)) {
+		_fixedMap1.copyTo(_fixedMap1U);
+		_fixedMap2.copyTo(_fixedMap2U);
+	}
+
+	int cvInterp;
+	switch (_mode) {
+	case NEAREST: cvInterp = cv::INTER_NEAREST; break;
+	case LINEAR:  cvInterp = cv::INTER_LINEAR; break;
+	case CUBIC:   cvInterp = cv::INTER_CUBIC; break;
+	default:
+		LOG_ERR("Error applying remapping! Invalid interp mode");
+		return;
+	}
+
+	///
+	/// Pixels outside the valid rect have no source pixel (constant border).
+	///
+	dst.create(_dstH, _dstW, src.type());
+	dst.setTo(cv::Scalar::all(0));
+	if (_validRect.area() <= 0)
+		return;
+
+	cv::UMat uDstRoi = dst(_validRect);
+	cv::remap(src, uDstRoi, _fixedMap1U, _fixedMap2U, cvInterp);
+}
+#endif
+
+///
+/// Convert float maps to fixed-point once (rather than inside every cv::remap call).
+///
+void Remapper::_updateFixedMaps()
+{
+	float *mapX = _getMapX();
+	float *mapY = _getMapY();
+	if (mapX==0 || mapY==0)
+		return;
+	cv::Mat mMapX(_dstH, _dstW, CV_32FC1, mapX);
+	cv::Mat mMapY(_dstH, _dstW, CV_32FC1, mapY);
+
+	/// Bounding rect of valid destination pixels.
+	int x0 = _dstW, y0 = _dstH, x1 = -1, y1 = -1;
+	for (int y = 0; y < _dstH; y++) {
+		for (int x = 0; x < _dstW; x++) {
+			int i = y*_dstW + x;
+			if ((mapX[i] < 0) || (mapY[i] < 0))	// INVALID_MAP_VAL or INPAINT_MAP_VAL
+				continue;
+			x0 = std::min(x0, x);  x1 = std::max(x1, x);
+			y0 = std::min(y0, y);  y1 = std::max(y1, y);
+		}
+	}
+	_validRect = (x1 >= x0) ? cv::Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1) : cv::Rect(0, 0, 0, 0);
+	if (_validRect.area() <= 0) {
+		/// Nothing to remap - keep a placeholder so we don't recompute.
+		_fixedMap1.create(1, 1, CV_16SC2);
+		return;
+	}
+
+	/// Nearest neighbour uses rounded integer map only.
+	cv::convertMaps(mMapX(_validRect), mMapY(_validRect), _fixedMap1, _fixedMap2, CV_16SC2, _mode == NEAREST);
+
+	LOG_DBG("Cached fixed-point remap tables (%dx%d valid of %dx%d).", _validRect.width, _validRect.height, _dstW, _dstH);
 }
@@ -0,0 +1,200 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       RoiCache.cpp
+/// \brief      Binary cache of the derived ROI state (remap tables, ROI mask, view rays).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "RoiCache.h"
+
+#include "Logger.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>       // rename, remove
+#include <cstring>      // memcpy
+#include <fstream>
+#include <chrono>
+
+using namespace std;
+
+namespace {
+
+const uint32_t CACHE_MAGIC = 0x43524346;    // "FCRC"
+const uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    int32_t src_w, src_h;
+    int32_t roi_w, roi_h;
+    uint64_t npix;
+};
+
+/// RoiPixel without padding.
+struct CachePixel {
+    int32_t idx;
+    int32_t pad;
+    double v[3];
+};
+
+uint64_t payloadSize(const CacheHeader& h)
+{
+    const uint64_t n = static_cast<uint64_t>(h.roi_w) * h.roi_h;
+    return sizeof(CacheHeader) + 2 * n * sizeof(float) + n + h.npix * sizeof(CachePixel);
+}
+
+} // namespace
+
+///
+///
+///
+uint64_t RoiCache::key(const string& desc)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : desc) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+///
+///
+///
+bool RoiCache::load(const string& fn, uint64_t key, int src_w, int src_h, int roi_w, int roi_h)
+{
+    const uint8_t* p = nullptr;
+    uint64_t len = 0;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fn.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) { return false; }
+    LARGE_INTEGER sz;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &sz) && (sz.QuadPart >= static_cast<LONGLONG>(sizeof(CacheHeader)))) {
+        len = static_cast<uint64_t>(sz.QuadPart);
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) { p = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)); }
+    }
+#else
+    int fd = ::open(fn.c_str(), O_RDONLY);
+    if (fd < 0) { return false; }
+    struct stat st;
+    if ((fstat(fd, &st) == 0) && (st.st_size >= static_cast<off_t>(sizeof(CacheHeader)))) {
+        len = static_cast<uint64_t>(st.st_size);
+        void* m = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) { p = static_cast<const uint8_t*>(m); }
+    }
+    ::close(fd);
+#endif
+
+    bool ret = false;
+    if (p) {
+        CacheHeader h;
+        memcpy(&h, p, sizeof(h));
+        if ((h.magic == CACHE_MAGIC) && (h.version == CACHE_VERSION) && (h.key == key) &&
+            (h.src_w == src_w) && (h.src_h == src_h) && (h.roi_w == roi_w) && (h.roi_h == roi_h) &&
+            (h.npix <= static_cast<uint64_t>(roi_w) * roi_h) && (payloadSize(h) == len))
+        {
+            const size_t n = static_cast<size_t>(roi_w) * roi_h;
+            const uint8_t* q = p + sizeof(CacheHeader);
+
+            map_x.resize(n);
+            memcpy(map_x.data(), q, n * sizeof(float));
+            q += n * sizeof(float);
+            map_y.resize(n);
+            memcpy(map_y.data(), q, n * sizeof(float));
+            q += n * sizeof(float);
+            roi_mask.create(roi_h, roi_w, CV_8UC1);
+            for (int i = 0; i < roi_h; i++) {
+                memcpy(roi_mask.ptr(i), q + i * roi_w, roi_w);
+            }
+            q += n;
+            roi_pix.resize(static_cast<size_t>(h.npix));
+            for (auto& rp : roi_pix) {
+                CachePixel cp;
+                memcpy(&cp, q, sizeof(cp));
+                q += sizeof(cp);
+                rp.idx = cp.idx;
+                rp.v.copy(cp.v);
+            }
+            ret = true;
+        }
+        else {
+            LOG_DBG("ROI cache %s is stale (config or frame size changed).", fn.c_str());
+        }
+    }
+
+#ifdef _WIN32
+    if (p) { UnmapViewOfFile(p); }
+    if (mapping) { CloseHandle(mapping); }
+    CloseHandle(file);
+#else
+    if (p) { munmap(const_cast<uint8_t*>(p), len); }
+#endif
+    return ret;
+}
+
+///
+///
+///
+bool RoiCache::save(const string& fn, uint64_t key, int src_w, int src_h) const
+{
+    const int roi_w = roi_mask.cols, roi_h = roi_mask.rows;
+    const size_t n = static_cast<size_t>(roi_w) * roi_h;
+    if ((map_x.size() != n) || (map_y.size() != n) || (roi_mask.type() != CV_8UC1)) { return false; }
+
+    CacheHeader h;
+    h.magic = CACHE_MAGIC;
+    h.version = CACHE_VERSION;
+    h.key = key;
+    h.src_w = src_w;
+    h.src_h = src_h;
+    h.roi_w = roi_w;
+    h.roi_h = roi_h;
+    h.npix = roi_pix.size();
+
+    /// Several trackers may share a config (e.g. chunked runs) - never expose a partial file.
+    const string tmp_fn = fn + ".tmp" + to_string(chrono::steady_clock::now().time_since_epoch().count());
+    {
+        ofstream f(tmp_fn, ios::binary | ios::trunc);
+        if (!f.is_open()) { return false; }
+        f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        f.write(reinterpret_cast<const char*>(map_x.data()), n * sizeof(float));
+        f.write(reinterpret_cast<const char*>(map_y.data()), n * sizeof(float));
+        for (int i = 0; i < roi_h; i++) {
+            f.write(reinterpret_cast<const char*>(roi_mask.ptr(i)), roi_w);
+        }
+        for (auto& rp : roi_pix) {
+            CachePixel cp;
+            cp.idx = rp.idx;
+            cp.pad = 0;
+            cp.v[0] = rp.v[0];
+            cp.v[1] = rp.v[1];
+            cp.v[2] = rp.v[2];
+            f.write(reinterpret_cast<const char*>(&cp), sizeof(cp));
+        }
+        if (!f.good()) {
+            f.close();
+            remove(tmp_fn.c_str());
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    remove(fn.c_str());     // rename does not replace on Windows
+#endif
+    if (rename(tmp_fn.c_str(), fn.c_str()) != 0) {
+        remove(tmp_fn.c_str());
+        return false;
+    }
+    return true;
+}
@@ -20,6 +20,7 @@ using namespace boost;
 ///
 ///
 SerialRecorder::SerialRecorder()
+    : _writing(false), _stale(0)
 {
     _type = COM;
 }
@@ -50,16 +51,19 @@ bool SerialRecorder::openRecord(std::string port_baud)
 
     // open serial port
     try {
-        asio::io_service io;
-        _port = make_shared<asio::serial_port>(io);
+        _port = make_shared<asio::serial_port>(_io_service);
         _port->open(_port_name);
-        //_port->set_option(asio::serial_port_base::baud_rate(baud));
-        //_port->set_option(asio::serial_port_base::character_size(8));
-        //_port->set_option(asio::serial_port_base::flow_control(serial_port_base::flow_control::none));
-        //_port->set_option(asio::serial_port_base::parity(serial_port_base::parity::none));
-        //_port->set_option(asio::serial_port_base::stop_bits(serial_port_base::stop_bits::one));
         _open = _port->is_open();
         if (!_open) { throw; }
+
+        // 8N1, no flow control (some virtual ports reject options, which is harmless)
+        system::error_code ec;
+        _port->set_option(asio::serial_port_base::baud_rate(baud), ec);
+        if (ec) { LOG_WRN("Warning! Unable to set baud rate for serial port %s (%s).", _port_name.c_str(), ec.message().c_str()); }
+        _port->set_option(asio::serial_port_base::character_size(8), ec);
+        _port->set_option(asio::serial_port_base::flow_control(asio::serial_port_base::flow_control::none), ec);
+        _port->set_option(asio::serial_port_base::parity(asio::serial_port_base::parity::none), ec);
+        _port->set_option(asio::serial_port_base::stop_bits(asio::serial_port_base::stop_bits::one), ec);
     }
     catch (const boost::system::system_error &e) {
         LOG_ERR("Error! Could not open serial port %s @ baud rate %d. Error was %s", _port_name.c_str(), baud, boost::diagnostic_information(e).c_str());
@@ -73,33 +77,87 @@ bool SerialRecorder::openRecord(std::string port_baud)
         LOG_ERR("Error! Could not open serial port %s @ baud rate %d.", _port_name.c_str(), baud);
         _open = false;
     }
+
+    if (_open) {
+        _work = make_unique<asio::io_service::work>(_io_service);
+        _thread = make_unique<thread>([this]() { _io_service.run(); });
+    }
     return _open;
 }
 
 ///
+/// Replace any unsent record and start sending if the port is idle.
+///
+bool SerialRecorder::writeRecord(const char* data, size_t len)
+{
+    return writeRecords(data, len, nullptr, 0);
+}
+
 ///
+/// Batch (split in two at the end of the Recorder's ring) is kept/dropped as a whole.
 ///
-bool SerialRecorder::writeRecord(string s)
+bool SerialRecorder::writeRecords(const char* a, size_t na, const char* b, size_t nb)
 {
-    if (_open) {
-        try {
-            _port->write_some(asio::buffer(s));
-        }
-        catch (const boost::exception &e) {
-            LOG_ERR("Error writing to serial port (%s)! Error was %s", _port_name.c_str(), boost::diagnostic_information(e).c_str());
-            return false;
-        }
+    lock_guard<mutex> l(_mutex);
+    if (!_open) { return false; }
+
+    if (!_next.empty()) { _stale++; }
+    _next.assign(a, na);
+    if (nb > 0) { _next.append(b, nb); }
+    if (!_writing) {
+        _writing = true;
+        _io_service.post([this]() { send(); });
     }
-    return _open;
+    return true;
 }
 
 ///
+/// I/O thread.
+///
+void SerialRecorder::send()
+{
+    {
+        lock_guard<mutex> l(_mutex);
+        if (_next.empty()) {
+            _writing = false;
+            return;
+        }
+        _inflight.swap(_next);
+        _next.clear();
+    }
+
+    asio::async_write(*_port, asio::buffer(_inflight), [this](const system::error_code& ec, size_t) {
+        if (ec && (ec != asio::error::operation_aborted)) {
+            LOG_ERR("Error writing to serial port (%s)! Error was %s", _port_name.c_str(), ec.message().c_str());
+        }
+        send();
+    });
+}
+
 ///
+/// The record in flight and the newest pending record are still sent.
 ///
 void SerialRecorder::closeRecord()
 {
+    {
+        lock_guard<mutex> l(_mutex);
+        if (!_port) { return; }
+        _open = false;
+    }
+
     LOG("Closing serial port %s", _port_name.c_str());
 
-    _open = false;
-    _port->close();
+    _work.reset();
+    if (_thread && _thread->joinable()) {
+        _thread->join();
+    }
+    _thread.reset();
+
+    system::error_code ec;
+    _port->close(ec);
+    _port.reset();
+
+    if (_stale > 0) {
+        LOG("Serial port %s dropped %llu stale records.", _port_name.c_str(), static_cast<unsigned long long>(_stale));
+    }
 }
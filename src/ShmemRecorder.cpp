@@ -0,0 +1,156 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ShmemRecorder.cpp
+/// \brief      Implementation of shared-memory recorder (see ShmemClient.h).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "ShmemRecorder.h"
+
+#include "Logger.h"
+
+#include <new>      // placement new
+#include <cstdlib>  // strtoul
+
+using namespace std;
+using namespace shmem;
+
+///
+///
+///
+ShmemRecorder::ShmemRecorder()
+    : _seg(nullptr), _size(0), _nslots(SLOTS_DEFAULT)
+#ifdef _WIN32
+    , _handle(NULL)
+#endif
+{
+    _type = SHM;
+}
+
+///
+///
+///
+ShmemRecorder::~ShmemRecorder()
+{
+    closeRecord();
+}
+
+///
+/// name[@nslots]
+///
+bool ShmemRecorder::openRecord(std::string name)
+{
+    size_t at = name.find_last_of('@');
+    if (at != string::npos) {
+        unsigned long n = strtoul(name.c_str() + at + 1, nullptr, 10);
+        _nslots = (n > 0) ? static_cast<uint32_t>(n) : SLOTS_DEFAULT;
+        name = name.substr(0, at);
+    }
+    _name = name;
+    _size = segmentSize(_nslots);
+    string obj = objectName(name);
+
+    LOG("Opening shared memory output %s (%u records)", obj.c_str(), _nslots);
+
+#ifdef _WIN32
+    _handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, static_cast<DWORD>(static_cast<uint64_t>(_size) >> 32), static_cast<DWORD>(_size), obj.c_str());
+    if (_handle == NULL) {
+        LOG_ERR("Error! Could not create shared memory %s (err = %d).", obj.c_str(), GetLastError());
+        return false;
+    }
+    void* p = MapViewOfFile(_handle, FILE_MAP_ALL_ACCESS, 0, 0, _size);
+    if (p == NULL) {
+        LOG_ERR("Error! Could not map shared memory %s (err = %d).", obj.c_str(), GetLastError());
+        CloseHandle(_handle);
+        _handle = NULL;
+        return false;
+    }
+#else
+    int fd = shm_open(obj.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        LOG_ERR("Error! Could not create shared memory %s.", obj.c_str());
+        return false;
+    }
+    if (ftruncate(fd, _size) != 0) {
+        LOG_ERR("Error! Could not size shared memory %s.", obj.c_str());
+        ::close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        LOG_ERR("Error! Could not map shared memory %s.", obj.c_str());
+        return false;
+    }
+#endif
+
+    /// (Re)initialise segment. Readers compare the session with the one they attached to, so
+    /// a reused segment (still mapped by a reader, or left behind by a tracker that didn't
+    /// close) continues the count; new segments are zero filled and start at 1.
+    _seg = static_cast<Segment*>(p);
+    const bool reused = (_seg->hdr.magic == MAGIC) && (_seg->hdr.version == VERSION);
+    const uint32_t session = reused ? ((_seg->hdr.session.load(memory_order_relaxed) + 1) | 1) : 1;
+    _seg->hdr.magic = 0;
+    new (&_seg->hdr.session) atomic<uint32_t>(0);
+    new (&_seg->hdr.head) atomic<uint64_t>(0);
+    Slot* slots = _seg->slots();
+    for (uint32_t i = 0; i < _nslots; i++) {
+        new (&slots[i].seq) atomic<uint64_t>(0);
+        slots[i].len = 0;
+    }
+    _seg->hdr.version = VERSION;
+    _seg->hdr.slot_size = sizeof(Slot);
+    _seg->hdr.nslots = _nslots;
+    atomic_thread_fence(memory_order_release);
+    _seg->hdr.magic = MAGIC;
+    _seg->hdr.session.store(session, memory_order_release);
+
+    return (_open = true);
+}
+
+///
+/// Publish one record (single writer).
+///
+bool ShmemRecorder::writeRecord(const char* data, size_t len)
+{
+    if (!_open) { return false; }
+    if (len > PAYLOAD_SIZE) {
+        LOG_ERR("Error! Record too large for shared memory output (%d bytes).", static_cast<int>(len));
+        return false;
+    }
+
+    const uint64_t n = _seg->hdr.head.load(memory_order_relaxed);
+    Slot& s = _seg->slots()[n % _nslots];
+
+    s.seq.store(2 * n + 1, memory_order_relaxed);      // odd - write in progress
+    atomic_thread_fence(memory_order_release);
+    s.len = static_cast<uint32_t>(len);
+    memcpy(s.data, data, len);
+    s.seq.store(2 * (n + 1), memory_order_release);    // complete
+
+    _seg->hdr.head.store(n + 1, memory_order_release);
+    return true;
+}
+
+///
+///
+///
+void ShmemRecorder::closeRecord()
+{
+    _open = false;
+    if (!_seg) { return; }
+
+    LOG("Closing shared memory output...");
+
+    /// Attached readers see the session end (see ShmemReader::stale) - the unlinked segment stays mapped for them.
+    _seg->hdr.session.fetch_add(1, memory_order_release);
+
+#ifdef _WIN32
+    UnmapViewOfFile(_seg);
+    CloseHandle(_handle);
+    _handle = NULL;
+#else
+    munmap(_seg, _size);
+    shm_unlink(objectName(_name).c_str());
+#endif
+    _seg = nullptr;
+}
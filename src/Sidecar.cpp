@@ -0,0 +1,312 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       Sidecar.cpp
+/// \brief      Checksummed binary sidecars for large config blobs (sphere template, ignore polygons).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "Sidecar.h"
+
+#include "Logger.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>       // rename, remove
+#include <cstring>      // memcpy
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <chrono>
+
+using namespace std;
+
+namespace {
+
+const uint32_t SIDECAR_MAGIC = 0x43535446;  // "FTSC"
+const uint32_t SIDECAR_VERSION = 1;
+
+enum : uint32_t {
+    TYPE_MAP = 1,
+    TYPE_POLYS = 2,
+    TYPE_CHECKPOINT = 3
+};
+
+/// Checkpoint payload header (followed by the map).
+struct CheckpointState {
+    double R_roi[9];
+    double ts;
+    uint64_t cnt;
+};
+
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t key;
+    uint64_t size;          // payload bytes
+    uint64_t checksum;      // hash of payload
+    int64_t dims[2];        // type specific
+};
+
+///
+/// Map fn read-only and pass the validated payload to parse().
+///
+bool loadBlob(const string& fn, uint32_t type, uint64_t key, const function<bool(const Header&, const uint8_t*)>& parse)
+{
+    const uint8_t* p = nullptr;
+    uint64_t len = 0;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fn.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) { return false; }
+    LARGE_INTEGER sz;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &sz) && (sz.QuadPart >= static_cast<LONGLONG>(sizeof(Header)))) {
+        len = static_cast<uint64_t>(sz.QuadPart);
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) { p = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)); }
+    }
+#else
+    int fd = ::open(fn.c_str(), O_RDONLY);
+    if (fd < 0) { return false; }
+    struct stat st;
+    if ((fstat(fd, &st) == 0) && (st.st_size >= static_cast<off_t>(sizeof(Header)))) {
+        len = static_cast<uint64_t>(st.st_size);
+        void* m = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) { p = static_cast<const uint8_t*>(m); }
+    }
+    ::close(fd);
+#endif
+
+    bool ret = false;
+    if (p) {
+        Header h;
+        memcpy(&h, p, sizeof(h));
+        const uint8_t* payload = p + sizeof(Header);
+        if ((h.magic != SIDECAR_MAGIC) || (h.version != SIDECAR_VERSION) || (h.type != type) || (h.size != (len - sizeof(Header)))) {
+            LOG_DBG("Sidecar %s is invalid.", fn.c_str());
+        }
+        else if (h.key != key) {
+            LOG_DBG("Sidecar %s is stale (source changed).", fn.c_str());
+        }
+        else if (h.checksum != sidecar::hash(payload, h.size)) {
+            LOG_WRN("Warning! Sidecar %s failed checksum validation.", fn.c_str());
+        }
+        else {
+            ret = parse(h, payload);
+        }
+    }
+
+#ifdef _WIN32
+    if (p) { UnmapViewOfFile(p); }
+    if (mapping) { CloseHandle(mapping); }
+    CloseHandle(file);
+#else
+    if (p) { munmap(const_cast<uint8_t*>(p), len); }
+#endif
+    return ret;
+}
+
+///
+/// Write header and payload chunks atomically (temporary file, then rename).
+///
+bool saveBlob(const string& fn, uint32_t type, uint64_t key, int64_t dim0, int64_t dim1, const vector<pair<const void*, size_t>>& chunks)
+{
+    Header h;
+    h.magic = SIDECAR_MAGIC;
+    h.version = SIDECAR_VERSION;
+    h.type = type;
+    h.reserved = 0;
+    h.key = key;
+    h.size = 0;
+    h.checksum = 14695981039346656037ull;
+    for (auto& c : chunks) {
+        h.size += c.second;
+        h.checksum = sidecar::hash(c.first, c.second, h.checksum);
+    }
+    h.dims[0] = dim0;
+    h.dims[1] = dim1;
+
+    const string tmp_fn = fn + ".tmp" + to_string(chrono::steady_clock::now().time_since_epoch().count());
+    {
+        ofstream f(tmp_fn, ios::binary | ios::trunc);
+        if (!f.is_open()) { return false; }
+        f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        for (auto& c : chunks) {
+            f.write(static_cast<const char*>(c.first), c.second);
+        }
+        if (!f.good()) {
+            f.close();
+            remove(tmp_fn.c_str());
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    remove(fn.c_str());     // rename does not replace on Windows
+#endif
+    if (rename(tmp_fn.c_str(), fn.c_str()) != 0) {
+        remove(tmp_fn.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+namespace sidecar {
+
+///
+///
+///
+uint64_t hash(const void* data, size_t len, uint64_t h)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+///
+///
+///
+uint64_t fileKey(const string& fn)
+{
+    error_code ec;
+    const uintmax_t size = filesystem::file_size(fn, ec);
+    if (ec) { return 0; }
+    const auto mtime = filesystem::last_write_time(fn, ec);
+    if (ec) { return 0; }
+    const int64_t t = static_cast<int64_t>(mtime.time_since_epoch().count());
+    uint64_t h = hash(fn);
+    h = hash(&size, sizeof(size), h);
+    return hash(&t, sizeof(t), h);
+}
+
+///
+///
+///
+bool loadMap(const string& fn, uint64_t key, cv::Mat& map)
+{
+    return loadBlob(fn, TYPE_MAP, key, [&](const Header& h, const uint8_t* p) {
+        const int64_t w = h.dims[0], hh = h.dims[1];
+        if ((w <= 0) || (hh <= 0) || (static_cast<uint64_t>(w * hh) != h.size)) { return false; }
+        map.create(static_cast<int>(hh), static_cast<int>(w), CV_8UC1);
+        for (int i = 0; i < map.rows; i++) {
+            memcpy(map.ptr(i), p + i * w, w);
+        }
+        return true;
+    });
+}
+
+///
+///
+///
+bool saveMap(const string& fn, uint64_t key, const cv::Mat& map)
+{
+    if ((map.type() != CV_8UC1) || map.empty()) { return false; }
+    vector<pair<const void*, size_t>> rows;
+    for (int i = 0; i < map.rows; i++) {
+        rows.push_back({ map.ptr(i), static_cast<size_t>(map.cols) });
+    }
+    return saveBlob(fn, TYPE_MAP, key, map.cols, map.rows, rows);
+}
+
+///
+/// Payload is the int32 length of each polygon followed by all values.
+///
+bool loadPolys(const string& fn, uint64_t key, vector<vector<int>>& polys)
+{
+    return loadBlob(fn, TYPE_POLYS, key, [&](const Header& h, const uint8_t* p) {
+        const int64_t n = h.dims[0], nvals = h.dims[1];
+        if ((n < 0) || (nvals < 0) || (static_cast<uint64_t>((n + nvals) * sizeof(int32_t)) != h.size)) { return false; }
+        vector<int32_t> lens(static_cast<size_t>(n));
+        memcpy(lens.data(), p, lens.size() * sizeof(int32_t));
+        p += lens.size() * sizeof(int32_t);
+        int64_t total = 0;
+        for (auto l : lens) {
+            if (l < 0) { return false; }
+            total += l;
+        }
+        if (total != nvals) { return false; }
+        polys.assign(lens.size(), vector<int>());
+        for (size_t i = 0; i < lens.size(); i++) {
+            polys[i].resize(lens[i]);
+            memcpy(polys[i].data(), p, lens[i] * sizeof(int32_t));
+            p += lens[i] * sizeof(int32_t);
+        }
+        return true;
+    });
+}
+
+///
+///
+///
+bool savePolys(const string& fn, uint64_t key, const vector<vector<int>>& polys)
+{
+    static_assert(sizeof(int) == sizeof(int32_t), "int must be 32 bit");
+    vector<int32_t> lens;
+    int64_t nvals = 0;
+    for (auto& poly : polys) {
+        lens.push_back(static_cast<int32_t>(poly.size()));
+        nvals += poly.size();
+    }
+    vector<pair<const void*, size_t>> chunks;
+    chunks.push_back({ lens.data(), lens.size() * sizeof(int32_t) });
+    for (auto& poly : polys) {
+        chunks.push_back({ poly.data(), poly.size() * sizeof(int32_t) });
+    }
+    return saveBlob(fn, TYPE_POLYS, key, static_cast<int64_t>(polys.size()), nvals, chunks);
+}
+
+///
+/// Payload is the orientation/frame state followed by the map rows.
+///
+bool loadCheckpoint(const string& fn, uint64_t key, Checkpoint& ckpt)
+{
+    return loadBlob(fn, TYPE_CHECKPOINT, key, [&](const Header& h, const uint8_t* p) {
+        const int64_t w = h.dims[0], hh = h.dims[1];
+        if ((w <= 0) || (hh <= 0) || (static_cast<uint64_t>(w * hh) + sizeof(CheckpointState) != h.size)) { return false; }
+        CheckpointState st;
+        memcpy(&st, p, sizeof(st));
+        p += sizeof(st);
+        memcpy(ckpt.R_roi, st.R_roi, sizeof(st.R_roi));
+        ckpt.ts = st.ts;
+        ckpt.cnt = st.cnt;
+        ckpt.map.create(static_cast<int>(hh), static_cast<int>(w), CV_8UC1);
+        for (int i = 0; i < ckpt.map.rows; i++) {
+            memcpy(ckpt.map.ptr(i), p + i * w, w);
+        }
+        return true;
+    });
+}
+
+///
+///
+///
+bool saveCheckpoint(const string& fn, uint64_t key, const Checkpoint& ckpt)
+{
+    const cv::Mat& map = ckpt.map;
+    if ((map.type() != CV_8UC1) || map.empty()) { return false; }
+    CheckpointState st;
+    memcpy(st.R_roi, ckpt.R_roi, sizeof(st.R_roi));
+    st.ts = ckpt.ts;
+    st.cnt = ckpt.cnt;
+    vector<pair<const void*, size_t>> chunks;
+    chunks.push_back({ &st, sizeof(st) });
+    for (int i = 0; i < map.rows; i++) {
+        chunks.push_back({ map.ptr(i), static_cast<size_t>(map.cols) });
+    }
+    return saveBlob(fn, TYPE_CHECKPOINT, key, map.cols, map.rows, chunks);
+}
+
+}
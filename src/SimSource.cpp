@@ -0,0 +1,342 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       SimSource.cpp
+/// \brief      Renders a synthetic textured ball with a known rotation trajectory.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "SimSource.h"
+
+#include "CameraModel.h"
+#include "Logger.h"
+#include "timing.h"
+
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <algorithm>    // min, max, replace
+#include <cmath>
+#include <cstdlib>      // atof, atoi
+
+using cv::Mat;
+using namespace std;
+
+const string SIM_PREFIX = "sim:";
+
+const int SIM_W_DEFAULT = 640;
+const int SIM_H_DEFAULT = 480;
+const double SIM_VFOV_DEFAULT = 45;
+const double SIM_FPS_DEFAULT = 100;
+const int SIM_FRAMES_DEFAULT = 10000;
+const double SIM_SPEED_DEFAULT = 0.01;
+const int SIM_TEX_DEFAULT = 8;
+const double SIM_SPEED_CORR = 0.95;     // frame-to-frame correlation of the random angular velocity
+const uint8_t SIM_BG = 16;              // background grey level
+const int SIM_NOISE_TAB = 1 << 16;
+
+///
+///
+///
+bool SimSource::isSim(const string& src_fn)
+{
+    return src_fn.compare(0, SIM_PREFIX.size(), SIM_PREFIX) == 0;
+}
+
+///
+/// Precompute the ball pixels, texture and trajectory.
+///
+SimSource::SimSource(const string& spec)
+    : _nframes(SIM_FRAMES_DEFAULT), _pos(0), _start_frame(0),
+    _vfov(SIM_VFOV_DEFAULT), _ball_r(-1), _sim_fps(SIM_FPS_DEFAULT), _speed(SIM_SPEED_DEFAULT), _noise(0),
+    _tex_n(SIM_TEX_DEFAULT), _seed(1), _tpace(-1)
+{
+    LOG_DBG("Source is: %s", spec.c_str());
+    _live = false;
+    _width = SIM_W_DEFAULT;
+    _height = SIM_H_DEFAULT;
+
+    if (!parse(spec)) { return; }
+    if (_ball_r <= 0) { _ball_r = 0.8 * _vfov / 2; }
+    if ((_width <= 0) || (_height <= 0) || (_vfov <= 0) || (_vfov >= 180) || (_ball_r >= 90) || (_nframes <= 0) || (_sim_fps <= 0) || (_tex_n < 1)) {
+        LOG_ERR("Error! Invalid simulated source (%s).", spec.c_str());
+        return;
+    }
+    if (!makeTrajectory()) { return; }
+    makeTexture();
+
+    /// Ball pixels, as in Trackball (sphere of radius sin(r) at unit distance along the optical axis).
+    CameraModelPtr model = CameraModel::createRectilinear(_width, _height, _vfov * CM_D2R);
+    const double r_d_ratio = sin(_ball_r * CM_D2R);
+    for (int i = 0; i < _height; i++) {
+        for (int j = 0; j < _width; j++) {
+            double l[3] = { 0, 0, 0 };
+            if (!model->pixelIndexToVector(j, i, l)) { continue; }
+            double n = sqrt(l[0] * l[0] + l[1] * l[1] + l[2] * l[2]);
+            l[0] /= n;  l[1] /= n;  l[2] /= n;
+
+            double q = l[2] * l[2] + r_d_ratio * r_d_ratio - 1;
+            if (q < 0) { continue; }
+            double u = l[2] - sqrt(q);
+            double s[3] = { l[0] * u, l[1] * u, l[2] * u - 1 };
+            n = sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+            s[0] /= n;  s[1] /= n;  s[2] /= n;
+
+            _x.push_back(static_cast<float>(s[0]));
+            _y.push_back(static_cast<float>(s[1]));
+            _z.push_back(static_cast<float>(s[2]));
+            _shade.push_back(static_cast<float>(0.5 - 0.5 * (l[0] * s[0] + l[1] * s[1] + l[2] * s[2])));    // darker towards the edge
+            _idx.push_back(i * _width + j);
+        }
+    }
+    if (_idx.empty()) {
+        LOG_ERR("Error! Simulated ball is not visible (%s).", spec.c_str());
+        return;
+    }
+
+    if (_noise > 0) {
+        mt19937 rng(_seed + 2);
+        normal_distribution<double> dist(0, _noise);
+        _noise_tab.resize(SIM_NOISE_TAB);
+        for (auto& v : _noise_tab) { v = static_cast<int16_t>(std::max(-255., std::min(255., round(dist(rng))))); }
+    }
+
+    _frame.create(_height, _width, CV_8UC1);
+    _frame.setTo(SIM_BG);
+    _out.create(_height, _width, CV_8UC1);
+
+    _t0 = ts_ms();
+    _msm0 = ms_since_midnight();
+    _open = true;
+    LOG("Simulated source initialised (%dx%d, vfov %.1f deg, ball radius %.1f deg, %d frames @ %.1f fps, %zu ball pixels)!",
+        _width, _height, _vfov, _ball_r, _nframes, _sim_fps, _idx.size());
+}
+
+///
+/// key=value,key=value,... after the prefix.
+///
+bool SimSource::parse(const string& spec)
+{
+    stringstream ss(spec.substr(std::min(spec.size(), SIM_PREFIX.size())));
+    string tok;
+    while (getline(ss, tok, ',')) {
+        if (tok.empty()) { continue; }
+        size_t eq = tok.find('=');
+        if (eq == string::npos) {
+            LOG_ERR("Error! Expected key=value in simulated source (%s).", tok.c_str());
+            return false;
+        }
+        const string key = tok.substr(0, eq), val = tok.substr(eq + 1);
+        if (key == "w") { _width = atoi(val.c_str()); }
+        else if (key == "h") { _height = atoi(val.c_str()); }
+        else if (key == "vfov") { _vfov = atof(val.c_str()); }
+        else if (key == "r") { _ball_r = atof(val.c_str()); }
+        else if (key == "fps") { _sim_fps = atof(val.c_str()); }
+        else if (key == "frames") { _nframes = atoi(val.c_str()); }
+        else if (key == "speed") { _speed = atof(val.c_str()); }
+        else if (key == "seed") { _seed = static_cast<unsigned int>(atoi(val.c_str())); }
+        else if (key == "tex") { _tex_n = atoi(val.c_str()); }
+        else if (key == "noise") { _noise = atof(val.c_str()); }
+        else if (key == "traj") { _traj_fn = val; }
+        else {
+            LOG_ERR("Error! Unknown simulated source parameter (%s).", key.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+///
+/// Scripted (traj file) or random (smoothly varying angular velocity) rotations.
+///
+bool SimSource::makeTrajectory()
+{
+    vector<CmPoint64f> script;
+    if (!_traj_fn.empty()) {
+        ifstream f(_traj_fn);
+        if (!f.is_open()) {
+            LOG_ERR("Error! Could not open simulated trajectory (%s).", _traj_fn.c_str());
+            return false;
+        }
+        string line;
+        while (getline(f, line)) {
+            if (line.empty() || (line[0] == '#')) { continue; }
+            std::replace(line.begin(), line.end(), ',', ' ');
+            stringstream ls(line);
+            CmPoint64f w;
+            if (ls >> w[0] >> w[1] >> w[2]) { script.push_back(w); }
+        }
+        if (script.empty()) {
+            LOG_ERR("Error! No rotations in simulated trajectory (%s).", _traj_fn.c_str());
+            return false;
+        }
+    }
+
+    mt19937 rng(_seed);
+    normal_distribution<double> dist(0, _speed * sqrt(1 - SIM_SPEED_CORR * SIM_SPEED_CORR));
+    CmPoint64f w(0, 0, 0);
+    _dr.assign(_nframes, CmPoint64f(0, 0, 0));
+    _r.assign(_nframes, CmPoint64f(0, 0, 0));
+    _R.assign(_nframes, CmMat33d());
+    for (int i = 1; i < _nframes; i++) {
+        if (!script.empty()) {
+            _dr[i] = script[(i - 1) % script.size()];
+        } else {
+            for (int j = 0; j < 3; j++) { w[j] = SIM_SPEED_CORR * w[j] + dist(rng); }
+            _dr[i] = w;
+        }
+        _R[i] = CmMat33d::fromOmegaSmall(_dr[i]) * _R[i - 1];   // pre-multiplied, as Trackball accumulates R_roi
+        _r[i] = _R[i].toOmega();
+    }
+    return true;
+}
+
+///
+/// Random lattice over [-1,1]^3, sampled trilinearly (value noise) at the ball surface.
+///
+void SimSource::makeTexture()
+{
+    mt19937 rng(_seed + 1);
+    uniform_real_distribution<float> dist(0, 1);
+    const int n = _tex_n + 1;
+    _tex.resize(n * n * n);
+    for (auto& v : _tex) { v = dist(rng); }
+}
+
+///
+/// Ball pixels of frame i into _frame (the background never changes).
+///
+void SimSource::render(int i)
+{
+    const double* m = _R[i].m;
+    const float m0 = static_cast<float>(m[0]), m1 = static_cast<float>(m[1]), m2 = static_cast<float>(m[2]);
+    const float m3 = static_cast<float>(m[3]), m4 = static_cast<float>(m[4]), m5 = static_cast<float>(m[5]);
+    const float m6 = static_cast<float>(m[6]), m7 = static_cast<float>(m[7]), m8 = static_cast<float>(m[8]);
+    const int n = _tex_n, n1 = _tex_n + 1;
+    const float scl = 0.5f * n;
+    const float* tex = _tex.data();
+    uint8_t* img = _frame.data;
+
+    const int npix = static_cast<int>(_idx.size());
+    for (int k = 0; k < npix; k++) {
+        // ball frame point (transpose - see Localiser::testRotation())
+        float px = m0 * _x[k] + m3 * _y[k] + m6 * _z[k];
+        float py = m1 * _x[k] + m4 * _y[k] + m7 * _z[k];
+        float pz = m2 * _x[k] + m5 * _y[k] + m8 * _z[k];
+
+        float fx = (px + 1) * scl, fy = (py + 1) * scl, fz = (pz + 1) * scl;
+        int ix = std::max(0, std::min(n - 1, static_cast<int>(fx)));
+        int iy = std::max(0, std::min(n - 1, static_cast<int>(fy)));
+        int iz = std::max(0, std::min(n - 1, static_cast<int>(fz)));
+        fx -= ix;  fy -= iy;  fz -= iz;
+
+        const float* t = tex + (iz * n1 + iy) * n1 + ix;
+        float c00 = t[0] + fx * (t[1] - t[0]);
+        float c01 = t[n1] + fx * (t[n1 + 1] - t[n1]);
+        float c10 = t[n1 * n1] + fx * (t[n1 * n1 + 1] - t[n1 * n1]);
+        float c11 = t[n1 * n1 + n1] + fx * (t[n1 * n1 + n1 + 1] - t[n1 * n1 + n1]);
+        float c0 = c00 + fy * (c01 - c00);
+        float c1 = c10 + fy * (c11 - c10);
+        float v = c0 + fz * (c1 - c0);
+
+        // high contrast blobs
+        v = std::max(0.f, std::min(1.f, 3 * (v - 0.5f) + 0.5f));
+        img[_idx[k]] = static_cast<uint8_t>(_shade[k] * (40 + 200 * v));
+    }
+}
+
+///
+///
+///
+bool SimSource::rewind()
+{
+    if (!_open) { return false; }
+    _pos = _start_frame;
+    _tpace = -1;
+    return true;
+}
+
+///
+/// Random access - frames are rendered from the precomputed trajectory.
+///
+bool SimSource::setStartFrame(int frame)
+{
+    if (!_open || (frame < 0) || (frame >= _nframes)) { return false; }
+    _start_frame = frame;
+    return rewind();
+}
+
+///
+///
+///
+bool SimSource::grab(cv::Mat& frame)
+{
+    Mat buf;
+    if (!grabBuffer(buf)) { return false; }
+    buf.copyTo(frame);
+    return true;
+}
+
+///
+/// Wraps the internal frame (valid until the next grab).
+///
+bool SimSource::grabBuffer(cv::Mat& frame)
+{
+    if (!_open || (_pos >= _nframes)) { return false; }
+
+    render(_pos);
+    if (_noise > 0) {
+        const uint8_t* src = _frame.data;
+        uint8_t* dst = _out.data;
+        const unsigned int off = static_cast<unsigned int>(_pos) * 2654435761u + _seed;     // different noise every frame
+        const int n = _width * _height;
+        for (int i = 0; i < n; i++) {
+            int v = src[i] + _noise_tab[(off + i) & (SIM_NOISE_TAB - 1)];
+            dst[i] = static_cast<uint8_t>(std::max(0, std::min(255, v)));
+        }
+        frame = _out;
+    } else {
+        frame = _frame;
+    }
+
+    _timestamp = _t0 + 1000. * _pos / _sim_fps;
+    _ms_since_midnight = _msm0 + 1000. * _pos / _sim_fps;
+
+    /// Paced playback if a frame rate was requested (src_fps), else as fast as possible.
+    if (_fps > 0) {
+        double t = ts_ms();
+        if (_tpace < 0) { _tpace = t; }
+        double wait = _tpace + 1000. * (_pos - _start_frame) / _fps - t;
+        if (wait >= 1) { sleep(static_cast<long>(round(wait))); }
+    }
+
+    LOG_DBG("Frame %d rendered @ %f (t_day: %f ms)", _pos, _timestamp, _ms_since_midnight);
+    _pos++;
+    return true;
+}
+
+///
+/// One line per frame, as written by Trackball::logData.
+///
+bool SimSource::writeTruth(const string& fn) const
+{
+    ofstream f(fn);
+    if (!f.is_open()) {
+        LOG_ERR("Error! Could not open ground truth file (%s).", fn.c_str());
+        return false;
+    }
+    f.precision(14);
+    const double dts = 1000. / _sim_fps;
+    for (int i = 0; i < _nframes; i++) {
+        const CmPoint64f& dr = _dr[i];
+        const CmPoint64f& r = _r[i];
+        f << i << ", ";
+        f << dr[0] << ", " << dr[1] << ", " << dr[2] << ", " << 0 << ", ";
+        f << "0, 0, 0, ";
+        f << r[0] << ", " << r[1] << ", " << r[2] << ", ";
+        f << "0, 0, 0, ";
+        f << "0, 0, 0, ";
+        f << "0, 0, ";
+        f << "0, 0, ";
+        f << (_t0 + i * dts) << ", " << i << ", " << ((i > 0) ? dts : 0) << ", " << (_msm0 + i * dts) << "\n";
+    }
+    return f.good();
+}
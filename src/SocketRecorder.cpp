@@ -4,16 +4,6 @@
 /// \author     Richard Moore
 /// \copyright  CC BY-NC-SA 3.0
 
-#if 0	// TCP sockets
-
-#ifdef __APPLE__ || __linux__
-#include "SocketRecorder_linux.src"
-#elif _WIN32
-#include "SocketRecorder_win.src"
-#endif
-
-#else	// UDP sockets
-
 #include "SocketRecorder.h"
 
 #include "Logger.h"
@@ -21,10 +11,22 @@
 #include <boost/asio.hpp>
 
 #include <string>
+#include <algorithm>    // min
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>     // strerror
+#endif
 
 using namespace std;
 using boost::asio::ip::udp;
 
+/// Max msgs per sendmmsg batch (larger batches are split).
+const size_t SOCK_BATCH_MAX = 32;
+
+/// Multicast hops (1 = stay on the local subnet).
+const int SOCK_MCAST_TTL = 1;
+
 ///
 ///
 ///
@@ -43,22 +45,46 @@ SocketRecorder::~SocketRecorder()
 }
 
 ///
-///
+/// host_port is a comma separated list of host:port destinations.
 ///
 bool SocketRecorder::openRecord(std::string host_port)
 {
-    // extract host name and port
-    size_t pos = host_port.find_first_of(':');
-    if (pos == string::npos) {
+    _desc = host_port;
+    _endpoints.clear();
+
+    try {
+        // extract host names and ports
+        size_t beg = 0;
+        while (beg < host_port.size()) {
+            size_t end = host_port.find_first_of(',', beg);
+            if (end == string::npos) { end = host_port.size(); }
+            string dest = host_port.substr(beg, end - beg);
+            beg = end + 1;
+
+            dest.erase(0, dest.find_first_not_of(" \t"));
+            dest.erase(dest.find_last_not_of(" \t") + 1);
+            if (dest.empty()) { continue; }
+
+            size_t pos = dest.find_last_of(':');
+            if (pos == string::npos) {
+                LOG_ERR("Error! Malformed host:port string (%s).", dest.c_str());
+                return false;
+            }
+            string host = dest.substr(0, pos);
+            int port = stoi(dest.substr(pos + 1));
+            _endpoints.push_back(udp::endpoint(boost::asio::ip::address::from_string(host), port));
+
+            LOG("Opening UDP connection to %s:%d%s", host.c_str(), port, _endpoints.back().address().is_multicast() ? " (multicast)" : "");
+        }
+    }
+    catch (...) {
+        LOG_ERR("Error! Malformed host:port string (%s).", host_port.c_str());
+        return false;
+    }
+    if (_endpoints.empty()) {
         LOG_ERR("Error! Malformed host:port string.");
         return false;
     }
-    _host = host_port.substr(0, pos);
-    _port = stoi(host_port.substr(pos + 1));
-
-    _endpoint = udp::endpoint(boost::asio::ip::address::from_string(_host), _port);
-
-    LOG("Opening UDP connection to %s:%d", _host.c_str(), _port);
 
     // open socket
     try {
@@ -66,33 +92,108 @@ bool SocketRecorder::openRecord(std::string host_port)
 
         _open = _socket.is_open();
         if (!_open) { throw; }
+
+        for (auto& e : _endpoints) {
+            if (e.address().is_multicast()) {
+                _socket.set_option(boost::asio::ip::multicast::hops(SOCK_MCAST_TTL));
+                _socket.set_option(boost::asio::ip::multicast::enable_loopback(true));  // consumers on this machine
+                break;
+            }
+        }
     }
     catch (const boost::system::system_error& e) {
-        LOG_ERR("Error! Could not open UDP connection to %s:%d due to %s", _host.c_str(), _port, e.what());
+        LOG_ERR("Error! Could not open UDP connection to %s due to %s", _desc.c_str(), e.what());
         _open = false;
     }
     catch (...) {
-        LOG_ERR("Error! Could not open UDP connection to %s:%d.", _host.c_str(), _port);
+        LOG_ERR("Error! Could not open UDP connection to %s.", _desc.c_str());
         _open = false;
     }
+
+#ifdef __linux__
+    /// Message headers for a full batch to every destination, filled per send.
+    _iov.assign(SOCK_BATCH_MAX, iovec());
+    _mmsg.assign(SOCK_BATCH_MAX * _endpoints.size(), mmsghdr());
+#endif
     return _open;
 }
 
 ///
 ///
 ///
-bool SocketRecorder::writeRecord(string s)
+bool SocketRecorder::writeRecord(const char* data, size_t len)
 {
-    if (_open) {
-        try {
-            _socket.send_to(boost::asio::buffer(s), _endpoint);
+    return send(&data, &len, 1);
+}
+
+///
+///
+///
+bool SocketRecorder::writeMsgs(const std::string* msgs, size_t n)
+{
+    const char* data[SOCK_BATCH_MAX];
+    size_t len[SOCK_BATCH_MAX];
+    bool ret = true;
+    for (size_t i = 0; i < n; i += SOCK_BATCH_MAX) {
+        const size_t m = std::min(SOCK_BATCH_MAX, n - i);
+        for (size_t j = 0; j < m; j++) {
+            data[j] = msgs[i + j].data();
+            len[j] = msgs[i + j].size();
         }
-        catch (const boost::system::system_error& e) {
-            LOG_ERR("Error writing to socket (%s:%d)! Error was %s", _host.c_str(), _port, e.what());
+        ret &= send(data, len, m);
+    }
+    return ret;
+}
+
+///
+/// Send n (<= SOCK_BATCH_MAX) msgs to every destination.
+///
+bool SocketRecorder::send(const char* const* data, const size_t* len, size_t n)
+{
+    if (!_open) { return false; }
+
+#ifdef __linux__
+    size_t cnt = 0;
+    for (size_t i = 0; i < n; i++) {
+        _iov[i].iov_base = const_cast<char*>(data[i]);
+        _iov[i].iov_len = len[i];
+        for (auto& e : _endpoints) {
+            msghdr& h = _mmsg[cnt++].msg_hdr;
+            h.msg_name = e.data();
+            h.msg_namelen = static_cast<socklen_t>(e.size());
+            h.msg_iov = &_iov[i];
+            h.msg_iovlen = 1;
+            h.msg_control = nullptr;
+            h.msg_controllen = 0;
+            h.msg_flags = 0;
+        }
+    }
+
+    const int fd = _socket.native_handle();
+    size_t sent = 0;
+    while (sent < cnt) {
+        int ret = sendmmsg(fd, &_mmsg[sent], static_cast<unsigned int>(cnt - sent), 0);
+        if (ret < 0) {
+            if (errno == EINTR) { continue; }
+            LOG_ERR("Error writing to socket (%s)! Error was %s", _desc.c_str(), strerror(errno));
             return false;
         }
+        sent += ret;
     }
-    return _open;
+#else
+    for (size_t i = 0; i < n; i++) {
+        for (auto& e : _endpoints) {
+            try {
+                _socket.send_to(boost::asio::buffer(data[i], len[i]), e);
+            }
+            catch (const boost::system::system_error& err) {
+                LOG_ERR("Error writing to socket (%s)! Error was %s", _desc.c_str(), err.what());
+                return false;
+            }
+        }
+    }
+#endif
+    return true;
 }
 
 ///
@@ -100,9 +201,10 @@ bool SocketRecorder::writeRecord(string s)
 ///
 void SocketRecorder::closeRecord()
 {
+    if (!_socket.is_open()) { return; }
+
     LOG("Closing UDP connection...");
 
     _open = false;
     _socket.close();
 }
-#endif
@@ -0,0 +1,655 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       SphereKernel.cpp
+/// \brief      Vectorised rotation scoring kernel for the sphere surface map.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "SphereKernel.h"
+
+#include "Logger.h"
+#include "Projection.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include <cmath>
+#include <cfloat>   // DBL_MAX
+#include <algorithm>    // min
+
+using namespace std;
+
+namespace {
+
+const float K_PI = static_cast<float>(CM_PI);
+const float K_PI_2 = static_cast<float>(CM_PI_2);
+
+/// Shared with the inline camera model projections (see Projection.h).
+using proj::atan2_approx;
+using proj::ATAN_C1;
+using proj::ATAN_C3;
+using proj::ATAN_C5;
+using proj::ATAN_C7;
+using proj::ATAN_C9;
+using proj::ATAN_C11;
+
+#if defined(__AVX2__)
+inline __m256 madd(__m256 a, __m256 b, __m256 c)
+{
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+inline __m256 atan2_approx(__m256 y, __m256 x)
+{
+    const __m256 sign = _mm256_set1_ps(-0.f);
+    __m256 ay = _mm256_andnot_ps(sign, y), ax = _mm256_andnot_ps(sign, x);
+    __m256 swap = _mm256_cmp_ps(ay, ax, _CMP_GT_OQ);
+    __m256 mx = _mm256_max_ps(ay, ax), mn = _mm256_min_ps(ay, ax);
+    __m256 a = _mm256_and_ps(_mm256_div_ps(mn, mx), _mm256_cmp_ps(mx, _mm256_setzero_ps(), _CMP_GT_OQ));    // zero if mx == 0
+    __m256 s = _mm256_mul_ps(a, a);
+    __m256 r = madd(_mm256_set1_ps(ATAN_C11), s, _mm256_set1_ps(ATAN_C9));
+    r = madd(r, s, _mm256_set1_ps(ATAN_C7));
+    r = madd(r, s, _mm256_set1_ps(ATAN_C5));
+    r = madd(r, s, _mm256_set1_ps(ATAN_C3));
+    r = madd(r, s, _mm256_set1_ps(ATAN_C1));
+    r = _mm256_mul_ps(r, a);
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(K_PI_2), r), swap);
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(K_PI), r), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+    return _mm256_or_ps(r, _mm256_and_ps(sign, y));     // copy sign of y
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+inline float32x4_t atan2_approx(float32x4_t y, float32x4_t x)
+{
+    float32x4_t ay = vabsq_f32(y), ax = vabsq_f32(x);
+    uint32x4_t swap = vcgtq_f32(ay, ax);
+    float32x4_t mx = vmaxq_f32(ay, ax), mn = vminq_f32(ay, ax);
+    uint32x4_t nz = vcgtq_f32(mx, vdupq_n_f32(0));
+    float32x4_t a = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vdivq_f32(mn, mx)), nz));
+    float32x4_t s = vmulq_f32(a, a);
+    float32x4_t r = vfmaq_f32(vdupq_n_f32(ATAN_C9), vdupq_n_f32(ATAN_C11), s);
+    r = vfmaq_f32(vdupq_n_f32(ATAN_C7), r, s);
+    r = vfmaq_f32(vdupq_n_f32(ATAN_C5), r, s);
+    r = vfmaq_f32(vdupq_n_f32(ATAN_C3), r, s);
+    r = vfmaq_f32(vdupq_n_f32(ATAN_C1), r, s);
+    r = vmulq_f32(r, a);
+    r = vbslq_f32(swap, vsubq_f32(vdupq_n_f32(K_PI_2), r), r);
+    r = vbslq_f32(vcltq_f32(x, vdupq_n_f32(0)), vsubq_f32(vdupq_n_f32(K_PI), r), r);
+    uint32x4_t sgn = vandq_u32(vreinterpretq_u32_f32(y), vdupq_n_u32(0x80000000));
+    return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(r), sgn));
+}
+#endif
+
+///
+/// Map pixel index (row major or tiled, see TiledMap) and whether the pixel has been seen.
+///
+template <bool TILED>
+inline int mapIndex(int ix, int iy, int map_step)
+{
+    if (TILED) {
+        return ((((iy >> TiledMap::TILE_BITS) * map_step + (ix >> TiledMap::TILE_BITS)) << (2 * TiledMap::TILE_BITS)) |
+            ((iy & TiledMap::TILE_MASK) << TiledMap::TILE_BITS) | (ix & TiledMap::TILE_MASK));
+    }
+    return iy * map_step + ix;
+}
+
+template <bool TILED>
+inline int mapSeen(const uint8_t* map, const uint64_t* seen, int idx)
+{
+    if (TILED) { return static_cast<int>((seen[idx >> 6] >> (idx & 63)) & 1); }
+    return map[idx] != 128;
+}
+
+#if defined(__AVX2__)
+///
+/// Loop constants for projecting view vectors into the map.
+///
+struct ProjConsts {
+    __m256 pi, one, lon_scl, lat_scl;
+    __m256i zero, w, wm1, h, hm1, step, tmask;
+    ProjConsts(float lon, float lat, int map_w, int map_h, int map_step)
+        : pi(_mm256_set1_ps(K_PI)), one(_mm256_set1_ps(1.f)), lon_scl(_mm256_set1_ps(lon)), lat_scl(_mm256_set1_ps(lat)),
+        zero(_mm256_setzero_si256()), w(_mm256_set1_epi32(map_w)), wm1(_mm256_set1_epi32(map_w - 1)),
+        h(_mm256_set1_epi32(map_h)), hm1(_mm256_set1_epi32(map_h - 1)), step(_mm256_set1_epi32(map_step)),
+        tmask(_mm256_set1_epi32(TiledMap::TILE_MASK)) {}
+};
+
+inline void loadRotation(const double m[9], __m256 mv[9])
+{
+    for (int i = 0; i < 9; i++) { mv[i] = _mm256_set1_ps(static_cast<float>(m[i])); }
+}
+
+///
+/// Map pixel indices of 8 view vectors rotated by (transpose of) m.
+///
+template <bool TILED>
+inline void mapIndices(const __m256 m[9], __m256 vx, __m256 vy, __m256 vz, const ProjConsts& c, int32_t* idx)
+{
+    __m256 px = madd(m[0], vx, madd(m[3], vy, _mm256_mul_ps(m[6], vz)));
+    __m256 py = madd(m[1], vx, madd(m[4], vy, _mm256_mul_ps(m[7], vz)));
+    __m256 pz = madd(m[2], vx, madd(m[5], vy, _mm256_mul_ps(m[8], vz)));
+
+    __m256i ix = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(c.pi, atan2_approx(px, pz)), c.lon_scl));
+    __m256i iy = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_add_ps(py, c.one), c.lat_scl));
+    ix = _mm256_sub_epi32(ix, _mm256_and_si256(_mm256_cmpgt_epi32(ix, c.wm1), c.w));
+    iy = _mm256_sub_epi32(iy, _mm256_and_si256(_mm256_cmpgt_epi32(iy, c.hm1), c.h));
+    ix = _mm256_max_epi32(c.zero, _mm256_min_epi32(ix, c.wm1));
+    iy = _mm256_max_epi32(c.zero, _mm256_min_epi32(iy, c.hm1));
+    if (TILED) {
+        __m256i t = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(iy, TiledMap::TILE_BITS), c.step), _mm256_srli_epi32(ix, TiledMap::TILE_BITS));
+        __m256i o = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(iy, c.tmask), TiledMap::TILE_BITS), _mm256_and_si256(ix, c.tmask));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(idx), _mm256_or_si256(_mm256_slli_epi32(t, 2 * TiledMap::TILE_BITS), o));
+    } else {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(idx), _mm256_add_epi32(_mm256_mullo_epi32(iy, c.step), ix));
+    }
+}
+
+const int SIMD_W = 8;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+///
+/// Loop constants for projecting view vectors into the map.
+///
+struct ProjConsts {
+    float32x4_t pi, one, lon_scl, lat_scl;
+    int32x4_t zero, w, wm1, h, hm1, step, tmask;
+    ProjConsts(float lon, float lat, int map_w, int map_h, int map_step)
+        : pi(vdupq_n_f32(K_PI)), one(vdupq_n_f32(1.f)), lon_scl(vdupq_n_f32(lon)), lat_scl(vdupq_n_f32(lat)),
+        zero(vdupq_n_s32(0)), w(vdupq_n_s32(map_w)), wm1(vdupq_n_s32(map_w - 1)),
+        h(vdupq_n_s32(map_h)), hm1(vdupq_n_s32(map_h - 1)), step(vdupq_n_s32(map_step)),
+        tmask(vdupq_n_s32(TiledMap::TILE_MASK)) {}
+};
+
+inline void loadRotation(const double m[9], float32x4_t mv[9])
+{
+    for (int i = 0; i < 9; i++) { mv[i] = vdupq_n_f32(static_cast<float>(m[i])); }
+}
+
+///
+/// Map pixel indices of 4 view vectors rotated by (transpose of) m.
+///
+template <bool TILED>
+inline void mapIndices(const float32x4_t m[9], float32x4_t vx, float32x4_t vy, float32x4_t vz, const ProjConsts& c, int32_t* idx)
+{
+    float32x4_t px = vfmaq_f32(vfmaq_f32(vmulq_f32(m[6], vz), m[3], vy), m[0], vx);
+    float32x4_t py = vfmaq_f32(vfmaq_f32(vmulq_f32(m[7], vz), m[4], vy), m[1], vx);
+    float32x4_t pz = vfmaq_f32(vfmaq_f32(vmulq_f32(m[8], vz), m[5], vy), m[2], vx);
+
+    int32x4_t ix = vcvtq_s32_f32(vmulq_f32(vsubq_f32(c.pi, atan2_approx(px, pz)), c.lon_scl));
+    int32x4_t iy = vcvtq_s32_f32(vmulq_f32(vaddq_f32(py, c.one), c.lat_scl));
+    ix = vsubq_s32(ix, vandq_s32(vreinterpretq_s32_u32(vcgtq_s32(ix, c.wm1)), c.w));
+    iy = vsubq_s32(iy, vandq_s32(vreinterpretq_s32_u32(vcgtq_s32(iy, c.hm1)), c.h));
+    ix = vmaxq_s32(c.zero, vminq_s32(ix, c.wm1));
+    iy = vmaxq_s32(c.zero, vminq_s32(iy, c.hm1));
+    if (TILED) {
+        int32x4_t t = vmlaq_s32(vshrq_n_s32(ix, TiledMap::TILE_BITS), vshrq_n_s32(iy, TiledMap::TILE_BITS), c.step);
+        int32x4_t o = vorrq_s32(vshlq_n_s32(vandq_s32(iy, c.tmask), TiledMap::TILE_BITS), vandq_s32(ix, c.tmask));
+        vst1q_s32(idx, vorrq_s32(vshlq_n_s32(t, 2 * TiledMap::TILE_BITS), o));
+    } else {
+        vst1q_s32(idx, vmlaq_s32(ix, iy, c.step));
+    }
+}
+
+const int SIMD_W = 4;
+#else
+const int SIMD_W = 1;
+#endif
+
+} // namespace
+
+///
+/// Pack view vectors of valid ROI pixels (stratified order).
+///
+SphereKernel::SphereKernel(const vector<RoiPixel>& roi_pix, int map_w, int map_h)
+    : _map_w(map_w), _map_h(map_h), _team(nullptr), _team_min(0)
+{
+    static const int order[STRATA] = { 0, 4, 2, 6, 1, 5, 3, 7 };    // bit-reversed
+
+    const int n = static_cast<int>(roi_pix.size());
+    _x.resize(n);
+    _y.resize(n);
+    _z.resize(n);
+    _idx.resize(n);
+    int k = 0;
+    for (int s = 0; s < STRATA; s++) {
+        for (int p = order[s]; p < n; p += STRATA, k++) {
+            _x[k] = static_cast<float>(roi_pix[p].v.x);
+            _y[k] = static_cast<float>(roi_pix[p].v.y);
+            _z[k] = static_cast<float>(roi_pix[p].v.z);
+            _idx[k] = roi_pix[p].idx;
+        }
+        if ((s == 0) || (s == 1) || (s == 3)) {
+            _subset.push_back(k);
+        }
+    }
+
+    /// Equi-area projection, see EquiAreaCameraModel::vectorToPixel().
+    ///   px = (pi - atan2(x, z)) * w / 2pi
+    ///   py = (y + 1) * h / 2
+    _lon_scl = static_cast<float>(_map_w / (2 * CM_PI));
+    _lat_scl = static_cast<float>(_map_h / 2.0);
+
+    LOG_DBG("Sphere kernel initialised with %d valid ROI pixels (map %dx%d).", size(), _map_w, _map_h);
+}
+
+///
+/// Scalar reference path, also used for the vector tail.
+///
+template <bool TILED>
+void SphereKernel::accumulateScalar(int k0, int k1, const double m[9], const uint8_t* roi, const uint8_t* map, int map_step, const uint64_t* seen, int64_t& err, int& good) const
+{
+    const float m0 = static_cast<float>(m[0]), m1 = static_cast<float>(m[1]), m2 = static_cast<float>(m[2]);
+    const float m3 = static_cast<float>(m[3]), m4 = static_cast<float>(m[4]), m5 = static_cast<float>(m[5]);
+    const float m6 = static_cast<float>(m[6]), m7 = static_cast<float>(m[7]), m8 = static_cast<float>(m[8]);
+
+    for (int k = k0; k < k1; k++) {
+        // transpose - see Localiser::testRotation()
+        float px = m0 * _x[k] + m3 * _y[k] + m6 * _z[k];
+        float py = m1 * _x[k] + m4 * _y[k] + m7 * _z[k];
+        float pz = m2 * _x[k] + m5 * _y[k] + m8 * _z[k];
+
+        int ix = static_cast<int>((K_PI - atan2_approx(px, pz)) * _lon_scl);
+        int iy = static_cast<int>((py + 1.f) * _lat_scl);
+        if (ix >= _map_w) { ix -= _map_w; }
+        if (iy >= _map_h) { iy -= _map_h; }
+        ix = std::max(0, std::min(ix, _map_w - 1));
+        iy = std::max(0, std::min(iy, _map_h - 1));
+
+        int i = mapIndex<TILED>(ix, iy, map_step);
+        if (!mapSeen<TILED>(map, seen, i)) { continue; }
+        int s = map[i];
+        int r = roi[_idx[k]];
+        err += (r - s) * (r - s);
+        good++;
+    }
+}
+
+///
+/// map_step is the row step (row major) or tiles per row (tiled).
+///
+template <bool TILED>
+int SphereKernel::accumulateT(int k0, int n, const double m[9], const uint8_t* roi, const uint8_t* map, int map_step, const uint64_t* seen, int64_t& err) const
+{
+    int good = 0;
+    int k = k0;
+
+#if defined(__AVX2__)
+    {
+        const ProjConsts c(_lon_scl, _lat_scl, _map_w, _map_h, map_step);
+        __m256 mv[9];
+        loadRotation(m, mv);
+        alignas(32) int32_t idx[SIMD_W];
+
+        for (; k + SIMD_W <= n; k += SIMD_W) {
+            mapIndices<TILED>(mv, _mm256_loadu_ps(&_x[k]), _mm256_loadu_ps(&_y[k]), _mm256_loadu_ps(&_z[k]), c, idx);
+            for (int l = 0; l < SIMD_W; l++) {
+                int s = map[idx[l]];
+                int r = roi[_idx[k + l]];
+                int valid = mapSeen<TILED>(map, seen, idx[l]);
+                err += valid * (r - s) * (r - s);
+                good += valid;
+            }
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    {
+        const ProjConsts c(_lon_scl, _lat_scl, _map_w, _map_h, map_step);
+        float32x4_t mv[9];
+        loadRotation(m, mv);
+        int32_t idx[SIMD_W];
+
+        for (; k + SIMD_W <= n; k += SIMD_W) {
+            mapIndices<TILED>(mv, vld1q_f32(&_x[k]), vld1q_f32(&_y[k]), vld1q_f32(&_z[k]), c, idx);
+            for (int l = 0; l < SIMD_W; l++) {
+                int s = map[idx[l]];
+                int r = roi[_idx[k + l]];
+                int valid = mapSeen<TILED>(map, seen, idx[l]);
+                err += valid * (r - s) * (r - s);
+                good += valid;
+            }
+        }
+    }
+#endif
+
+    /// Scalar fallback/tail.
+    accumulateScalar<TILED>(k, n, m, roi, map, map_step, seen, err, good);
+
+    return good;
+}
+
+///
+/// Pixel blocks outer, rotations inner: view vectors and ROI values are loaded
+/// once per block and reused for every rotation.
+///
+template <bool TILED>
+void SphereKernel::accumulateBatchT(const double* m, int nrot, const uint8_t* roi, const uint8_t* map, int map_step, const uint64_t* seen, int64_t* err, int* good) const
+{
+    const int n = size();
+    for (int j = 0; j < nrot; j++) {
+        err[j] = 0;
+        good[j] = 0;
+    }
+    int k = 0;
+
+#if defined(__AVX2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+    {
+        const ProjConsts c(_lon_scl, _lat_scl, _map_w, _map_h, map_step);
+#if defined(__AVX2__)
+        vector<__m256> mv(9 * nrot);
+#else
+        vector<float32x4_t> mv(9 * nrot);
+#endif
+        for (int j = 0; j < nrot; j++) {
+            loadRotation(&m[9 * j], &mv[9 * j]);
+        }
+        alignas(32) int32_t idx[SIMD_W];
+        int r[SIMD_W];
+
+        for (; k + SIMD_W <= n; k += SIMD_W) {
+#if defined(__AVX2__)
+            const __m256 vx = _mm256_loadu_ps(&_x[k]), vy = _mm256_loadu_ps(&_y[k]), vz = _mm256_loadu_ps(&_z[k]);
+#else
+            const float32x4_t vx = vld1q_f32(&_x[k]), vy = vld1q_f32(&_y[k]), vz = vld1q_f32(&_z[k]);
+#endif
+            for (int l = 0; l < SIMD_W; l++) {
+                r[l] = roi[_idx[k + l]];
+            }
+            for (int j = 0; j < nrot; j++) {
+                mapIndices<TILED>(&mv[9 * j], vx, vy, vz, c, idx);
+                int64_t e = 0;
+                int g = 0;
+                for (int l = 0; l < SIMD_W; l++) {
+                    int s = map[idx[l]];
+                    int valid = mapSeen<TILED>(map, seen, idx[l]);
+                    e += valid * (r[l] - s) * (r[l] - s);
+                    g += valid;
+                }
+                err[j] += e;
+                good[j] += g;
+            }
+        }
+    }
+#endif
+
+    /// Scalar fallback/tail.
+    for (int j = 0; j < nrot; j++) {
+        accumulateScalar<TILED>(k, n, &m[9 * j], roi, map, map_step, seen, err[j], good[j]);
+    }
+}
+
+///
+///
+///
+int SphereKernel::accumulate(const double m[9], const cv::Mat& roi_frame, const cv::Mat& sphere_map, int64_t& err) const
+{
+    return accumulateRange(0, size(), m, roi_frame, sphere_map, err);
+}
+
+///
+///
+///
+int SphereKernel::accumulate(const double m[9], const cv::Mat& roi_frame, const TiledMap& sphere_map, int64_t& err) const
+{
+    return accumulateRange(0, size(), m, roi_frame, sphere_map, err);
+}
+
+///
+/// Pixels [k0, k1) only.
+///
+int SphereKernel::accumulateRange(int k0, int k1, const double m[9], const cv::Mat& roi_frame, const cv::Mat& sphere_map, int64_t& err) const
+{
+    return accumulateRangeT<false>(k0, k1, m, roi_frame.data, sphere_map.data, static_cast<int>(sphere_map.step), nullptr, err);
+}
+
+int SphereKernel::accumulateRange(int k0, int k1, const double m[9], const cv::Mat& roi_frame, const TiledMap& sphere_map, int64_t& err) const
+{
+    return accumulateRangeT<true>(k0, k1, m, roi_frame.data, sphere_map.data(), sphere_map.tilesW(), sphere_map.seen(), err);
+}
+
+///
+/// Chunks are whole SIMD blocks, so only the last chunk has a scalar tail.
+///
+template <bool TILED>
+int SphereKernel::accumulateRangeT(int k0, int k1, const double m[9], const uint8_t* roi, const uint8_t* map, int map_step, const uint64_t* seen, int64_t& err) const
+{
+    if (!_team || ((k1 - k0) < _team_min)) {
+        return accumulateT<TILED>(k0, k1, m, roi, map, map_step, seen, err);
+    }
+
+    const int nt = static_cast<int>(_part.size());
+    const int chunk = ((k1 - k0 + nt - 1) / nt + SIMD_W - 1) / SIMD_W * SIMD_W;
+    _team->run([&](int t) {
+        const int a = std::min(k1, k0 + t * chunk), b = std::min(k1, a + chunk);
+        int64_t e = 0;
+        _part[t].good = accumulateT<TILED>(a, b, m, roi, map, map_step, seen, e);
+        _part[t].err = e;
+    });
+
+    int good = 0;
+    for (int t = 0; t < nt; t++) {
+        err += _part[t].err;
+        good += _part[t].good;
+    }
+    return good;
+}
+
+///
+///
+///
+void SphereKernel::setTeam(ThreadTeam* team, int min_pix)
+{
+    _team = (team && (team->size() > 1)) ? team : nullptr;
+    _team_min = min_pix;
+    _part.assign(_team ? _team->size() : 0, Partial{ 0, 0 });
+}
+
+///
+///
+///
+template <typename Map>
+double SphereKernel::testRotationT(const double m[9], const cv::Mat& roi_frame, const Map& sphere_map) const
+{
+    if (!roi_frame.isContinuous()) {
+        LOG_ERR("Error! Sphere kernel requires a continuous ROI frame!");
+        return DBL_MAX;
+    }
+
+    int64_t err = 0;
+    int cnt = size();
+    int good = accumulate(m, roi_frame, sphere_map, err);
+
+    /// Compute avg squared diff error.
+    if ((cnt > 0) && (good > (0.25 * static_cast<double>(cnt)))) {
+        return static_cast<double>(err) / good;
+    }
+    return DBL_MAX;
+}
+
+double SphereKernel::testRotation(const double m[9], const cv::Mat& roi_frame, const cv::Mat& sphere_map) const
+{
+    return testRotationT(m, roi_frame, sphere_map);
+}
+
+double SphereKernel::testRotation(const double m[9], const cv::Mat& roi_frame, const TiledMap& sphere_map) const
+{
+    return testRotationT(m, roi_frame, sphere_map);
+}
+
+///
+/// Each subsample extends the previous one, so no pixel is scored twice.
+///
+template <typename Map>
+double SphereKernel::testRotationBoundedT(const double m[9], const cv::Mat& roi_frame, const Map& sphere_map, double best, double margin, int* npix) const
+{
+    if (!roi_frame.isContinuous()) {
+        LOG_ERR("Error! Sphere kernel requires a continuous ROI frame!");
+        return DBL_MAX;
+    }
+
+    const int cnt = size();
+    const double thresh = (best < DBL_MAX) ? best * (1 + margin) : DBL_MAX;
+    int64_t err = 0;
+    int good = 0, k = 0;
+    for (size_t s = 0; (s < _subset.size()) && (thresh < DBL_MAX); s++) {
+        good += accumulateRange(k, _subset[s], m, roi_frame, sphere_map, err);
+        k = _subset[s];
+
+        /// Can't reach 25% overlap even if all remaining pixels are seen.
+        if ((good + (cnt - k)) <= (0.25 * static_cast<double>(cnt))) {
+            if (npix) { *npix = k; }
+            return DBL_MAX;
+        }
+        if (good > (0.25 * static_cast<double>(k))) {
+            double est = static_cast<double>(err) / good;
+            if (est > thresh) {
+                if (npix) { *npix = k; }
+                return est;
+            }
+        }
+    }
+    good += accumulateRange(k, cnt, m, roi_frame, sphere_map, err);
+    if (npix) { *npix = cnt; }
+
+    if ((cnt > 0) && (good > (0.25 * static_cast<double>(cnt)))) {
+        return static_cast<double>(err) / good;
+    }
+    return DBL_MAX;
+}
+
+double SphereKernel::testRotationBounded(const double m[9], const cv::Mat& roi_frame, const cv::Mat& sphere_map, double best, double margin, int* npix) const
+{
+    return testRotationBoundedT(m, roi_frame, sphere_map, best, margin, npix);
+}
+
+double SphereKernel::testRotationBounded(const double m[9], const cv::Mat& roi_frame, const TiledMap& sphere_map, double best, double margin, int* npix) const
+{
+    return testRotationBoundedT(m, roi_frame, sphere_map, best, margin, npix);
+}
+
+///
+///
+///
+template <typename Map>
+void SphereKernel::testRotationsT(const double* m, int nrot, const cv::Mat& roi_frame, const Map& sphere_map, double* err) const
+{
+    if (!roi_frame.isContinuous()) {
+        LOG_ERR("Error! Sphere kernel requires a continuous ROI frame!");
+        for (int j = 0; j < nrot; j++) { err[j] = DBL_MAX; }
+        return;
+    }
+
+    vector<int64_t> sum(nrot);
+    vector<int> good(nrot);
+    accumulateBatch(m, nrot, roi_frame, sphere_map, sum.data(), good.data());
+
+    const int cnt = size();
+    for (int j = 0; j < nrot; j++) {
+        err[j] = ((cnt > 0) && (good[j] > (0.25 * static_cast<double>(cnt)))) ? static_cast<double>(sum[j]) / good[j] : DBL_MAX;
+    }
+}
+
+///
+///
+///
+void SphereKernel::accumulateBatch(const double* m, int nrot, const cv::Mat& roi_frame, const cv::Mat& sphere_map, int64_t* err, int* good) const
+{
+    accumulateBatchT<false>(m, nrot, roi_frame.data, sphere_map.data, static_cast<int>(sphere_map.step), nullptr, err, good);
+}
+
+void SphereKernel::accumulateBatch(const double* m, int nrot, const cv::Mat& roi_frame, const TiledMap& sphere_map, int64_t* err, int* good) const
+{
+    accumulateBatchT<true>(m, nrot, roi_frame.data, sphere_map.data(), sphere_map.tilesW(), sphere_map.seen(), err, good);
+}
+
+void SphereKernel::testRotations(const double* m, int nrot, const cv::Mat& roi_frame, const cv::Mat& sphere_map, double* err) const
+{
+    testRotationsT(m, nrot, roi_frame, sphere_map, err);
+}
+
+void SphereKernel::testRotations(const double* m, int nrot, const cv::Mat& roi_frame, const TiledMap& sphere_map, double* err) const
+{
+    testRotationsT(m, nrot, roi_frame, sphere_map, err);
+}
+
+///
+/// Map is sampled at pixel centres, so continuous (u, v) = (ix + 0.5, iy + 0.5)
+/// hits pixel (ix, iy) exactly. Longitude wraps; pixels within half a pixel of
+/// the poles are skipped.
+///
+double SphereKernel::testRotationGrad(const double m[9], const double dm[27], const cv::Mat& roi_frame, const cv::Mat& sphere_map, double grad[3]) const
+{
+    grad[0] = grad[1] = grad[2] = 0;
+    if (!roi_frame.isContinuous()) {
+        LOG_ERR("Error! Sphere kernel requires a continuous ROI frame!");
+        return DBL_MAX;
+    }
+
+    float mf[9], dmf[27];
+    for (int i = 0; i < 9; i++) { mf[i] = static_cast<float>(m[i]); }
+    for (int i = 0; i < 27; i++) { dmf[i] = static_cast<float>(dm[i]); }
+
+    const uint8_t* roi = roi_frame.data;
+    const uint8_t* map = sphere_map.data;
+    const int step = static_cast<int>(sphere_map.step);
+    double err = 0, g[3] = { 0, 0, 0 };
+    int good = 0;
+    for (int k = 0; k < size(); k++) {
+        const float vx = _x[k], vy = _y[k], vz = _z[k];
+
+        // transpose - see Localiser::testRotation()
+        const float px = mf[0] * vx + mf[3] * vy + mf[6] * vz;
+        const float py = mf[1] * vx + mf[4] * vy + mf[7] * vz;
+        const float pz = mf[2] * vx + mf[5] * vy + mf[8] * vz;
+        const float rxz2 = px * px + pz * pz;
+        if (rxz2 < 1e-12f) { continue; }
+
+        /// Continuous map position (pixel centres at integers).
+        float u = (K_PI - atan2_approx(px, pz)) * _lon_scl - 0.5f;
+        float w = (py + 1.f) * _lat_scl - 0.5f;
+        int x0 = static_cast<int>(floor(u)), y0 = static_cast<int>(floor(w));
+        const float fx = u - x0, fy = w - y0;
+        if ((y0 < 0) || (y0 + 1 >= _map_h)) { continue; }
+        if (x0 < 0) { x0 += _map_w; } else if (x0 >= _map_w) { x0 -= _map_w; }
+        const int x1 = (x0 + 1 < _map_w) ? (x0 + 1) : 0;
+
+        const uint8_t* row0 = map + y0 * step;
+        const uint8_t* row1 = row0 + step;
+        const int s00 = row0[x0], s01 = row0[x1], s10 = row1[x0], s11 = row1[x1];
+        if ((s00 == 128) || (s01 == 128) || (s10 == 128) || (s11 == 128)) { continue; }
+
+        /// Bilinear sample and its slope in map pixels.
+        const float a = (1 - fx) * s00 + fx * s01, b = (1 - fx) * s10 + fx * s11;
+        const float s = (1 - fy) * a + fy * b;
+        const float dsdu = (1 - fy) * (s01 - s00) + fy * (s11 - s10);
+        const float dsdw = b - a;
+
+        /// Slope with respect to the rotated vector (see projection above).
+        const float gx = -dsdu * _lon_scl * pz / rxz2;
+        const float gy = dsdw * _lat_scl;
+        const float gz = dsdu * _lon_scl * px / rxz2;
+
+        const float e = roi[_idx[k]] - s;
+        err += e * e;
+        good++;
+
+        /// d(e^2)/dx_i = -2 e (grad_p s . dm_i^T v)
+        for (int i = 0; i < 3; i++) {
+            const float* d = &dmf[9 * i];
+            const float dpx = d[0] * vx + d[3] * vy + d[6] * vz;
+            const float dpy = d[1] * vx + d[4] * vy + d[7] * vz;
+            const float dpz = d[2] * vx + d[5] * vy + d[8] * vz;
+            g[i] -= 2 * e * (gx * dpx + gy * dpy + gz * dpz);
+        }
+    }
+
+    /// Compute avg squared diff error.
+    if ((size() > 0) && (good > (0.25 * static_cast<double>(size())))) {
+        for (int i = 0; i < 3; i++) { grad[i] = g[i] / good; }
+        return err / good;
+    }
+    return DBL_MAX;
+}
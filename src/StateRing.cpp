@@ -0,0 +1,128 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       StateRing.cpp
+/// \brief      Preallocated, time-indexed history of recent tracking states.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "StateRing.h"
+
+#include <algorithm>
+
+using namespace std;
+
+///
+///
+///
+StateRing::StateRing(size_t capacity)
+    : _cap(std::max<size_t>(capacity, 1)), _col(NUM_COLUMNS * _cap, 0), _head(0), _wr(0)
+{
+}
+
+///
+/// Announce the slot being overwritten before writing it (seqlock, see validFrom).
+///
+void StateRing::push(const State& s)
+{
+    const uint64_t n = _head.load(memory_order_relaxed);
+    _wr.store(n + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    const size_t slot = n % _cap;
+    for (int c = 0; c < NUM_COLUMNS; c++) {
+        _col[c * _cap + slot] = s.v[c];
+    }
+
+    _head.store(n + 1, memory_order_release);
+}
+
+///
+///
+///
+uint64_t StateRing::validFrom() const
+{
+    atomic_thread_fence(memory_order_acquire);
+    const uint64_t w = _wr.load(memory_order_relaxed);
+    return (w > _cap) ? (w - _cap) : 0;
+}
+
+///
+/// Binary search over the ring, assumes column c is non-decreasing (timestamps, frame counters).
+///
+bool StateRing::find(Column c, double lo, double hi, uint64_t& first, uint64_t& last) const
+{
+    while (true) {
+        const uint64_t h = count();
+        const uint64_t b = (h > _cap) ? (h - _cap) : 0;
+
+        uint64_t l = b, r = h;
+        while (l < r) {
+            const uint64_t m = l + (r - l) / 2;
+            if (at(c, m) < lo) { l = m + 1; } else { r = m; }
+        }
+        first = l;
+
+        r = h;
+        while (l < r) {
+            const uint64_t m = l + (r - l) / 2;
+            if (at(c, m) <= hi) { l = m + 1; } else { r = m; }
+        }
+        last = l;
+
+        if (validFrom() <= b) { break; }    // writer overtook the search - retry
+    }
+    return first < last;
+}
+
+///
+///
+///
+size_t StateRing::copy(uint64_t& first, uint64_t last, vector<State>& out) const
+{
+    out.clear();
+    const uint64_t h = count();
+    first = std::max(first, (h > _cap) ? (h - _cap) : 0);
+    last = std::min(last, h);
+    if (first >= last) { return 0; }
+
+    out.resize(static_cast<size_t>(last - first));
+    for (size_t k = 0; k < out.size(); k++) {
+        const size_t slot = (first + k) % _cap;
+        for (int c = 0; c < NUM_COLUMNS; c++) {
+            out[k].v[c] = _col[c * _cap + slot];
+        }
+    }
+
+    const uint64_t v = validFrom();
+    if (v > first) {
+        const size_t drop = static_cast<size_t>(std::min<uint64_t>(v - first, out.size()));
+        out.erase(out.begin(), out.begin() + drop);
+        first += drop;
+    }
+    return out.size();
+}
+
+///
+///
+///
+size_t StateRing::copyColumn(Column c, uint64_t& first, uint64_t last, vector<double>& out) const
+{
+    out.clear();
+    const uint64_t h = count();
+    first = std::max(first, (h > _cap) ? (h - _cap) : 0);
+    last = std::min(last, h);
+    if (first >= last) { return 0; }
+
+    out.resize(static_cast<size_t>(last - first));
+    const double* col = &_col[c * _cap];
+    for (size_t k = 0; k < out.size(); k++) {
+        out[k] = col[(first + k) % _cap];
+    }
+
+    const uint64_t v = validFrom();
+    if (v > first) {
+        const size_t drop = static_cast<size_t>(std::min<uint64_t>(v - first, out.size()));
+        out.erase(out.begin(), out.begin() + drop);
+        first += drop;
+    }
+    return out.size();
+}
@@ -0,0 +1,108 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       TaskGraph.cpp
+/// \brief      Small dependency graph of one-off tasks (e.g. overlapped startup steps).
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "TaskGraph.h"
+
+#include "Logger.h"
+#include "misc.h"
+#include "timing.h"
+
+using namespace std;
+
+///
+///
+///
+TaskGraph::Task TaskGraph::add(const string& name, function<bool()> fn, const vector<Task>& deps)
+{
+    lock_guard<mutex> l(_mutex);
+    auto node = make_unique<Node>();
+    node->name = name;
+    node->fn = std::move(fn);
+    node->state = PENDING;
+    for (Task d : deps) {
+        if ((d >= 0) && (d < static_cast<Task>(_nodes.size()))) { node->deps.push_back(d); }
+    }
+    _nodes.push_back(std::move(node));
+
+    const Task t = static_cast<Task>(_nodes.size()) - 1;
+    start(t);
+    return t;
+}
+
+///
+/// Start t if its dependencies have completed (fail it if any failed).
+///
+void TaskGraph::start(Task t)
+{
+    Node& n = *_nodes[t];
+    if (n.state != PENDING) { return; }
+    for (Task d : n.deps) {
+        const State s = _nodes[d]->state;
+        if (s == FAILED) {
+            LOG_DBG("Skipping task %s (dependency %s failed).", n.name.c_str(), _nodes[d]->name.c_str());
+            n.state = FAILED;
+            _cond.notify_all();
+            return;
+        }
+        if (s != DONE) { return; }
+    }
+    n.state = RUNNING;
+    n.thread = StartThread(&TaskGraph::work, this, &n, t);
+}
+
+///
+///
+///
+void TaskGraph::work(Node* n, Task t)
+{
+    const double t0 = ts_ms();
+    const bool ok = n->fn();
+    LOG_DBG("Task %s %s (%.1f ms).", n->name.c_str(), ok ? "done" : "failed", ts_ms() - t0);
+
+    lock_guard<mutex> l(_mutex);
+    n->state = ok ? DONE : FAILED;
+    n->fn = nullptr;    // release captured state
+
+    /// Start (or fail) dependants - failures propagate in index order, as dependencies always precede their tasks.
+    for (Task i = t + 1; i < static_cast<Task>(_nodes.size()); i++) {
+        start(i);
+    }
+    _cond.notify_all();
+}
+
+///
+///
+///
+bool TaskGraph::wait(Task t)
+{
+    unique_lock<mutex> l(_mutex);
+    if ((t < 0) || (t >= static_cast<Task>(_nodes.size()))) { return false; }
+    _cond.wait(l, [&] { return (_nodes[t]->state == DONE) || (_nodes[t]->state == FAILED); });
+
+    /// Reap the thread.
+    unique_ptr<std::thread> th = std::move(_nodes[t]->thread);
+    const bool ok = (_nodes[t]->state == DONE);
+    l.unlock();
+    if (th && th->joinable()) { th->join(); }
+    return ok;
+}
+
+///
+///
+///
+bool TaskGraph::waitAll()
+{
+    bool ok = true;
+    size_t n = 0;
+    {
+        lock_guard<mutex> l(_mutex);
+        n = _nodes.size();
+    }
+    for (size_t i = 0; i < n; i++) {
+        ok &= wait(static_cast<Task>(i));
+    }
+    return ok;
+}
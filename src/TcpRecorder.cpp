@@ -0,0 +1,235 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       TcpRecorder.cpp
+/// \brief      TCP streaming recorder (server) based on boost::asio.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "TcpRecorder.h"
+
+#include "Logger.h"
+#include "misc.h"   // thread placement
+
+#include <algorithm>    // remove_if
+
+using namespace std;
+using boost::asio::ip::tcp;
+
+/// Default max number of msgs queued per client.
+const size_t TCP_QUEUE_DEFAULT = 64;
+
+/// Max number of spare msg buffers to hold on to.
+const size_t TCP_MAX_FREE_BUFFERS = 256;
+
+///
+///
+///
+TcpRecorder::TcpRecorder()
+    : _max_queue(TCP_QUEUE_DEFAULT), _block(false), _acceptor(_io_service)
+{
+    _type = TCP;
+}
+
+///
+///
+///
+TcpRecorder::~TcpRecorder()
+{
+    closeRecord();
+}
+
+///
+///
+///
+bool TcpRecorder::openRecord(std::string host_port)
+{
+    // extract options
+    size_t pos = host_port.find_first_of('@');
+    if (pos != string::npos) {
+        string opts = host_port.substr(pos + 1);
+        host_port = host_port.substr(0, pos);
+        size_t sep = opts.find_first_of(':');
+        try {
+            int q = std::stoi(opts.substr(0, sep));
+            if (q > 0) { _max_queue = q; }
+        }
+        catch (...) {}
+        if (sep != string::npos) {
+            _block = (opts.substr(sep + 1) == "block");
+        }
+    }
+
+    // extract host name and port
+    pos = host_port.find_last_of(':');
+    if (pos == string::npos) {
+        LOG_ERR("Error! Malformed host:port string.");
+        return false;
+    }
+    _desc = host_port;
+
+    try {
+        tcp::endpoint endpoint(boost::asio::ip::address::from_string(host_port.substr(0, pos)), std::stoi(host_port.substr(pos + 1)));
+        _acceptor.open(endpoint.protocol());
+        _acceptor.set_option(tcp::acceptor::reuse_address(true));
+        _acceptor.bind(endpoint);
+        _acceptor.listen();
+    }
+    catch (const boost::system::system_error& e) {
+        LOG_ERR("Error! Could not listen for TCP connections on %s due to %s", _desc.c_str(), e.what());
+        return false;
+    }
+    catch (...) {
+        LOG_ERR("Error! Could not listen for TCP connections on %s.", _desc.c_str());
+        return false;
+    }
+
+    LOG("Listening for TCP clients on %s (queue %zu msgs, %s when full).", _desc.c_str(), _max_queue, _block ? "blocking" : "dropping oldest");
+
+    _open = true;
+    accept();
+    _work = make_unique<boost::asio::io_service::work>(_io_service);
+    _thread = StartThread([this]() {
+        if (!ApplyThreadClass(ThreadClass::IO)) {
+            LOG_WRN("Warning! Unable to apply TCP output thread placement (cpus_io)!");
+        }
+        _io_service.run();
+    });
+    return _open;
+}
+
+///
+/// I/O thread.
+///
+void TcpRecorder::accept()
+{
+    auto c = make_shared<Client>(_io_service);
+    _acceptor.async_accept(c->sock, [this, c](const boost::system::error_code& ec) {
+        if (ec == boost::asio::error::operation_aborted) { return; }    // closing
+        if (ec) {
+            LOG_WRN("Warning! Failed to accept TCP connection on %s (%s).", _desc.c_str(), ec.message().c_str());
+        }
+        else {
+            boost::system::error_code ec2;
+            c->sock.set_option(tcp::no_delay(true), ec2);
+            tcp::endpoint remote = c->sock.remote_endpoint(ec2);
+            c->addr = remote.address().to_string() + ":" + to_string(remote.port());
+            LOG("TCP client connected (%s).", c->addr.c_str());
+
+            lock_guard<mutex> l(_mutex);
+            _clients.push_back(c);
+        }
+        accept();
+    });
+}
+
+///
+/// Queue msg for every connected client.
+///
+bool TcpRecorder::writeRecord(const char* data, size_t len)
+{
+    unique_lock<mutex> l(_mutex);
+    if (!_open) { return false; }
+
+    if (_block) {
+        _cond.wait(l, [&] {
+            if (!_open) { return true; }
+            for (auto& c : _clients) {
+                if (!c->closed && (c->q.size() >= _max_queue)) { return false; }
+            }
+            return true;
+        });
+        if (!_open) { return false; }
+    }
+
+    for (auto& c : _clients) {
+        if (c->closed) { continue; }
+        if (c->q.size() >= _max_queue) {
+            if (_free.size() < TCP_MAX_FREE_BUFFERS) { _free.push_back(std::move(c->q.front())); }
+            c->q.pop_front();
+            c->dropped++;
+        }
+        c->q.emplace_back();
+        if (!_free.empty()) {
+            c->q.back() = std::move(_free.back());
+            _free.pop_back();
+        }
+        c->q.back().assign(data, len);  // re-uses buffer capacity
+        if (!c->writing) {
+            c->writing = true;
+            _io_service.post([this, c]() { send(c); });
+        }
+    }
+
+    /// Forget disconnected clients.
+    _clients.erase(remove_if(_clients.begin(), _clients.end(), [](const shared_ptr<Client>& c) { return c->closed; }), _clients.end());
+    return true;
+}
+
+///
+/// I/O thread. Write everything queued for c, then repeat until the queue is empty.
+///
+void TcpRecorder::send(shared_ptr<Client> c)
+{
+    {
+        lock_guard<mutex> l(_mutex);
+        if (c->closed || c->q.empty()) {
+            c->writing = false;
+            return;
+        }
+        c->inflight.clear();
+        for (auto& msg : c->q) {
+            c->inflight.append(msg);
+            if (_free.size() < TCP_MAX_FREE_BUFFERS) { _free.push_back(std::move(msg)); }
+        }
+        c->q.clear();
+    }
+    _cond.notify_all();
+
+    boost::asio::async_write(c->sock, boost::asio::buffer(c->inflight), [this, c](const boost::system::error_code& ec, size_t) {
+        if (ec) {
+            boost::system::error_code ec2;
+            c->sock.close(ec2);
+            {
+                lock_guard<mutex> l(_mutex);
+                c->closed = true;
+                c->q.clear();
+            }
+            _cond.notify_all();
+            if (ec != boost::asio::error::operation_aborted) {
+                LOG("TCP client disconnected (%s, %llu msgs dropped).", c->addr.c_str(), static_cast<unsigned long long>(c->dropped));
+            }
+            return;
+        }
+        send(c);
+    });
+}
+
+///
+///
+///
+void TcpRecorder::closeRecord()
+{
+    {
+        lock_guard<mutex> l(_mutex);
+        if (!_open && !_thread) { return; }
+        _open = false;
+    }
+    _cond.notify_all();
+
+    LOG("Closing TCP connections...");
+
+    /// Sockets are closed on the i/o thread, pending writes are aborted.
+    _io_service.post([this]() {
+        boost::system::error_code ec;
+        _acceptor.close(ec);
+        lock_guard<mutex> l(_mutex);
+        for (auto& c : _clients) {
+            c->sock.close(ec);
+        }
+    });
+    _work.reset();
+    if (_thread && _thread->joinable()) {
+        _thread->join();
+    }
+    _thread.reset();
+    _clients.clear();
+}
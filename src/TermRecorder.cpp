@@ -27,10 +27,22 @@ TermRecorder::~TermRecorder()
 ///
 ///
 ///
-bool TermRecorder::writeRecord(std::string s)
+bool TermRecorder::writeRecord(const std::string& s)
 {
     if (!_open) { return false; }
     std::cout << s;
     fflush(stdout);     // force flush in Linux
     return true;
 }
+
+///
+/// Write batch with a single flush.
+///
+bool TermRecorder::writeRecords(const char* a, size_t na, const char* b, size_t nb)
+{
+    if (!_open) { return false; }
+    std::cout.write(a, na);
+    std::cout.write(b, nb);
+    fflush(stdout);     // force flush in Linux
+    return true;
+}
@@ -0,0 +1,130 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ThreadPool.cpp
+/// \brief      Simple persistent pool of worker threads for data-parallel jobs.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "ThreadPool.h"
+
+#include "Logger.h"
+#include "misc.h"
+
+using namespace std;
+
+///
+///
+///
+ThreadPool::ThreadPool(int nthreads, bool pin)
+    : _size(nthreads), _pin(pin), _fn(nullptr), _n(0), _busy(0), _gen(0), _next(0), _kill(false)
+{
+    if (_size <= 0) {
+        _size = std::max(1, static_cast<int>(thread::hardware_concurrency()));
+    }
+}
+
+///
+/// Called from run() (holding _runMutex) by the first job that needs workers.
+///
+void ThreadPool::start()
+{
+    int ncores = std::max(1, static_cast<int>(thread::hardware_concurrency()));
+    for (int i = 1; i < _size; i++) {
+        int core = _pin ? (i % ncores) : -1;    // leave core 0 to the calling thread(s)
+        _workers.push_back(make_unique<thread>(&ThreadPool::process, this, core));
+    }
+
+    LOG_DBG("Started thread pool with %d threads%s.", size(), _pin ? " (pinned)" : "");
+}
+
+///
+///
+///
+ThreadPool::~ThreadPool()
+{
+    unique_lock<mutex> l(_mutex);
+    _kill = true;
+    _startCond.notify_all();
+    l.unlock();
+
+    for (auto& t : _workers) {
+        if (t && t->joinable()) {
+            t->join();
+        }
+    }
+}
+
+///
+///
+///
+void ThreadPool::run(int n, const function<void(int)>& fn)
+{
+    if (n <= 0) { return; }
+
+    /// Nothing to share.
+    if ((_size == 1) || (n == 1)) {
+        for (int i = 0; i < n; i++) { fn(i); }
+        return;
+    }
+
+    /// One job at a time (pool may be shared).
+    lock_guard<mutex> r(_runMutex);
+    if (_workers.empty()) { start(); }
+
+    unique_lock<mutex> l(_mutex);
+    _fn = &fn;
+    _n = n;
+    _next = 0;
+    _busy = static_cast<int>(_workers.size());
+    _gen++;
+    _startCond.notify_all();
+    l.unlock();
+
+    /// Help out.
+    work();
+
+    l.lock();
+    while (_busy > 0) {
+        _doneCond.wait(l);
+    }
+    _fn = nullptr;
+}
+
+///
+///
+///
+void ThreadPool::work()
+{
+    int i = 0;
+    while ((i = _next++) < _n) {
+        (*_fn)(i);
+    }
+}
+
+///
+///
+///
+void ThreadPool::process(int core)
+{
+    if ((core >= 0) && !SetThreadAffinity(core)) {
+        LOG_WRN("Warning! Unable to pin thread pool worker to core %d.", core);
+    }
+
+    unsigned int gen = 0;
+
+    unique_lock<mutex> l(_mutex);
+    while (true) {
+        while (!_kill && (_gen == gen)) {
+            _startCond.wait(l);
+        }
+        if (_kill) { break; }
+        gen = _gen;
+
+        l.unlock();
+        work();
+        l.lock();
+
+        if (--_busy == 0) {
+            _doneCond.notify_all();
+        }
+    }
+}
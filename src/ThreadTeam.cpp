@@ -0,0 +1,134 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       ThreadTeam.cpp
+/// \brief      Small team of spinning worker threads for fine-grained (intra-frame) parallel jobs.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "ThreadTeam.h"
+
+#include "Logger.h"
+#include "misc.h"
+
+#include <chrono>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>  // _mm_pause
+#endif
+
+using namespace std;
+
+const int TEAM_SPIN_YIELD = 1024;   // spin iterations before also yielding (oversubscribed cores)
+
+///
+/// Spin loop hint.
+///
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+///
+///
+///
+ThreadTeam::ThreadTeam(int nthreads, const vector<int>& cores, int spin_us)
+    : _fn(nullptr), _spin_us(spin_us), _gen(0), _pending(0), _parked(0), _active(true)
+{
+    for (int i = 1; i < nthreads; i++) {
+        int core = cores.empty() ? -1 : cores[(i - 1) % cores.size()];
+        _workers.push_back(StartThread(&ThreadTeam::process, this, i, core));
+    }
+
+    LOG_DBG("Started thread team with %d threads.", size());
+}
+
+///
+///
+///
+ThreadTeam::~ThreadTeam()
+{
+    {
+        lock_guard<mutex> l(_mutex);
+        _active = false;
+    }
+    _cond.notify_all();
+
+    for (auto& t : _workers) {
+        if (t && t->joinable()) {
+            t->join();
+        }
+    }
+}
+
+///
+///
+///
+void ThreadTeam::run(const function<void(int)>& fn)
+{
+    /// Nothing to share, or team in use by another caller.
+    if (_workers.empty() || _busy.test_and_set(memory_order_acquire)) {
+        for (int i = 0; i < size(); i++) { fn(i); }
+        return;
+    }
+
+    _fn = &fn;
+    _pending.store(static_cast<int>(_workers.size()), memory_order_relaxed);
+    _gen.fetch_add(1, memory_order_seq_cst);
+    if (_parked.load(memory_order_seq_cst) > 0) {
+        lock_guard<mutex> l(_mutex);
+        _cond.notify_all();
+    }
+
+    /// Own share.
+    fn(0);
+
+    for (int iter = 0; _pending.load(memory_order_acquire) > 0; iter++) {
+        cpuRelax();
+        if (iter >= TEAM_SPIN_YIELD) { this_thread::yield(); }
+    }
+    _fn = nullptr;
+    _busy.clear(memory_order_release);
+}
+
+///
+///
+///
+void ThreadTeam::process(int i, int core)
+{
+    if (!ApplyThreadClass(ThreadClass::TRACK)) {
+        LOG_WRN("Warning! Unable to apply thread team placement (cpus_track, rt_sched)!");
+    }
+    if ((core >= 0) && !SetThreadAffinity(core)) {
+        LOG_WRN("Warning! Unable to pin thread team worker to core %d.", core);
+    }
+
+    unsigned int gen = 0;
+    const auto spin = chrono::microseconds(_spin_us);
+    while (_active) {
+        /// Spin for the next job, then park.
+        if (_gen.load(memory_order_acquire) == gen) {
+            auto t0 = chrono::steady_clock::now();
+            int iter = 0;
+            while (_active && (_gen.load(memory_order_acquire) == gen)) {
+                cpuRelax();
+                if (++iter >= TEAM_SPIN_YIELD) { this_thread::yield(); }
+                if ((_spin_us >= 0) && ((iter & 0x3F) == 0) && ((chrono::steady_clock::now() - t0) >= spin)) { break; }
+            }
+        }
+        if (_active && (_gen.load(memory_order_acquire) == gen)) {
+            unique_lock<mutex> l(_mutex);
+            _parked++;
+            while (_active && (_gen.load(memory_order_seq_cst) == gen)) {
+                _cond.wait_for(l, chrono::milliseconds(10));    // guards against a lost wake-up
+            }
+            _parked--;
+        }
+        if (!_active) { break; }
+
+        gen = _gen.load(memory_order_acquire);
+        (*_fn)(i);
+        _pending.fetch_sub(1, memory_order_acq_rel);
+    }
+}
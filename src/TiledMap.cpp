@@ -0,0 +1,67 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       TiledMap.cpp
+/// \brief      Cache-friendly (tiled) mirror of the sphere surface map.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "TiledMap.h"
+
+#include "Logger.h"
+
+#include <algorithm>    // min, max
+
+using cv::Mat;
+
+///
+/// Partial edge tiles are padded as unseen.
+///
+TiledMap::TiledMap(int w, int h)
+    : _w(w), _h(h), _tw((w + TILE_MASK) >> TILE_BITS), _th((h + TILE_MASK) >> TILE_BITS)
+{
+    _data.assign(_tw * _th * TILE * TILE, 128);
+    _seen.assign(_tw * _th, 0);
+    LOG_DBG("Tiled sphere map initialised (%dx%d tiles).", _tw, _th);
+}
+
+///
+///
+///
+void TiledMap::fromMat(const Mat& map)
+{
+    fromMat(map, cv::Rect(0, 0, _w, _h));
+}
+
+///
+/// Whole tiles overlapping r are refreshed.
+///
+void TiledMap::fromMat(const Mat& map, const cv::Rect& r)
+{
+    if ((map.cols != _w) || (map.rows != _h) || (map.type() != CV_8UC1)) {
+        LOG_ERR("Error! Sphere map does not match tiled map (%dx%d)!", _w, _h);
+        return;
+    }
+    if ((r.width <= 0) || (r.height <= 0)) { return; }
+
+    const int ti0 = std::max(r.y, 0) >> TILE_BITS, ti1 = std::min((r.y + r.height - 1) >> TILE_BITS, _th - 1);
+    const int tj0 = std::max(r.x, 0) >> TILE_BITS, tj1 = std::min((r.x + r.width - 1) >> TILE_BITS, _tw - 1);
+    for (int ti = ti0; ti <= ti1; ti++) {
+        for (int tj = tj0; tj <= tj1; tj++) {
+            const int t = ti * _tw + tj;
+            uint8_t* pt = &_data[t << (2 * TILE_BITS)];
+            uint64_t seen = 0;
+            for (int i = 0; i < TILE; i++) {
+                const int y = (ti << TILE_BITS) + i;
+                if (y >= _h) { break; }
+                const uint8_t* pmap = map.ptr(y);
+                for (int j = 0; j < TILE; j++) {
+                    const int x = (tj << TILE_BITS) + j;
+                    if (x >= _w) { break; }
+                    const uint8_t v = pmap[x];
+                    pt[(i << TILE_BITS) | j] = v;
+                    if (v != 128) { seen |= uint64_t(1) << ((i << TILE_BITS) | j); }
+                }
+            }
+            _seen[t] = seen;
+        }
+    }
+}
@@ -15,7 +15,15 @@
 #include "CameraRemap.h"
 #include "BasicRemapper.h"
 #include "misc.h"
+#include "Profiler.h"
+#include "fictrac_version.h"
 #include "CVSource.h"
+#include "DumpSource.h"
+#include "SimSource.h"
+#include "RoiCache.h"
+#include "Sidecar.h"
+#include "QualityGovernor.h"
+#include "TaskGraph.h"
 #if defined(PGR_USB2) || defined(PGR_USB3)
 #include "PGRSource.h"
 #elif defined(BASLER_USB3)
@@ -31,6 +39,8 @@
 #include <sstream>
 #include <cmath>
 #include <exception>
+#include <chrono>
+#include <algorithm>  // partial_sort
 
 using namespace cv;
 using namespace std;
@@ -38,27 +48,132 @@ using namespace std;
 const int DRAW_SPHERE_HIST_LENGTH = 1024;
 const int DRAW_CELL_DIM = 160;
 const int DRAW_FICTIVE_PATH_LENGTH = 1000;
+const double DRAW_PATH_MARGIN = 0.25;   // path view is fitted to the path bounds plus this fraction each side
+const int DRAW_PATH_REDRAW = 100;       // dropped path points before the path view is refitted
+const double DRAW_WARP_STRIPES = 4;     // parallel chunks for the display warp maps
+const int DEBUG_VID_QUEUE_LEN = 16;     // canvases waiting for encoding
+const int RAW_VID_QUEUE_LEN = 16;       // source frames waiting for encoding (dropped when full)
 
 const int Q_FACTOR_DEFAULT = 6;
 const double OPT_TOL_DEFAULT = 1e-3;
 const double OPT_BOUND_DEFAULT = 0.35;
+const string OPT_PREDICTOR_DEFAULT = "lowpass";
+const bool OPT_EARLY_EXIT_DEFAULT = false;
+const double OPT_EARLY_EXIT_MARGIN = 0.25;     // subsample error must exceed best by 25% to stop early
+const bool OPT_FLOAT_DEFAULT = false;
+const bool OPT_GRAD_DEFAULT = false;
+const double OPT_BUDGET_MS_DEFAULT = 0;
+const double OPT_BUDGET_AUTO_PC = 0.5;  // auto time budget as fraction of the frame period
+const bool QUALITY_GOV_DEFAULT = false;
+const int QUALITY_GOV_EVALS_MIN = 10;   // fewest opt_max_evals the quality governor steps down to
+const double OPT_EDGE_TOL_SCL = 2;      // result within this many opt_tol of a shrunk search box edge is retried
 const int OPT_MAX_EVAL_DEFAULT = 50;
+const int OPT_PYR_LEVELS_DEFAULT = 0;
 const bool OPT_GLOBAL_SEARCH_DEFAULT = false;
+const bool OPT_GLOBAL_FIRST_DEFAULT = false;
+const bool OPT_GLOBAL_GRID_DEFAULT = true;
+const int OPT_GLOBAL_THREADS_DEFAULT = 0;
+const int OPT_TEAM_THREADS_DEFAULT = 1;     // score on the tracking thread only
+const int OPT_TEAM_MIN_PIX = 8192;          // ROI pixels worth splitting across the team (~q_factor 10 and above)
+const int OPT_TEAM_SPIN_US = 100;           // team workers spin this long between evaluations before parking
+const double OPT_GLOBAL_GRID_STEP_DEFAULT = CM_PI / 8;
 const int OPT_MAX_BAD_FRAMES_DEFAULT = -1;
+const bool OPT_RECOVER_DEFAULT = false;
+const int OPT_RECOVER_REFINE = 2;       // best recovery hypotheses refined with a local search
+const double OPT_RECOVER_STEPS[] = { 1, 2 };    // discrete recovery rotations about each axis (multiples of opt_bound)
 
 const double THRESH_RATIO_DEFAULT = 1.25;
 const double THRESH_WIN_PC_DEFAULT = 0.25;
+const bool FUSED_PREP_DEFAULT = true;
+const bool PIPELINE_DEFAULT = false;
+const bool MAP_TILED_DEFAULT = false;
+const bool USE_GPU_DEFAULT = false;
+const int BATCH_QUEUE_LEN = 64;     // frames decoded ahead in batch mode
+const bool SRC_HW_DECODE_DEFAULT = false;
+const bool SRC_GREY_DEFAULT = false;
+const bool SRC_NATIVE_DEFAULT = false;
+const int SRC_BUFS_DEFAULT = 0;        // use SDK default
+const bool SRC_AOI_DEFAULT = false;
+const int SRC_BIN_DEFAULT = 1;
+const int SRC_AOI_PAD = 4;      // px around sphere bounding box
+const bool ROI_CACHE_DEFAULT = true;
+const bool CFG_RELOAD_DEFAULT = false;
+const bool CFG_SIDECAR_DEFAULT = true;
+const bool RT_SCHED_DEFAULT = false;
+const int SPIN_WAIT_US_DEFAULT = 0;     // block on handoffs
+const double AE_TARGET_DEFAULT = -1;    // auto exposure off
+const double AE_PERIOD_MS_DEFAULT = 200;
+const double CFG_RELOAD_PERIOD_MS = 500;    // config file poll period (cfg_reload)
+const int FRAME_START_DEFAULT = 0;
+const int FRAME_COUNT_DEFAULT = -1;
+const double CAM_AUX_SYNC_DEFAULT = -1;    // ms, <= 0: half the frame interval
+
+const double STATS_PERIOD_DEFAULT = 0;
+const bool STATS_SOCK_DEFAULT = false;
+const double STATS_CAM_OUT_MAX = 60e3;     // ms, larger offsets mean the source is not timestamping on the host clock
 
 const uint8_t SPHERE_MAP_FIRST_HIT_BONUS = 64;
 
 const string SOCK_HOST_DEFAULT = "127.0.0.1";
 const int SOCK_PORT_DEFAULT = -1;
+const string SOCK_PROTO_DEFAULT = "udp";
+const int SOCK_QUEUE_DEFAULT = 64;          // msgs per TCP client
+const int STATE_RING_LEN_DEFAULT = 4096;    // states (e.g. ~8 s at 500 Hz)
+const string SHM_NAME_DEFAULT = "";         // no shared memory output
+const double CKPT_PERIOD_DEFAULT = 0;       // s (0 = no checkpoints)
+const bool CKPT_RESUME_DEFAULT = true;
+const string SOCK_POLICY_DEFAULT = "drop";
 
 const int COM_BAUD_DEFAULT = 115200;
+const double COM_RATE_DEFAULT = 0;          // Hz (0 = every frame)
+
+const string OUT_FMT_DEFAULT = "csv";
+const int DATA_FLUSH_MS_DEFAULT = 0;
+const int DATA_FLUSH_KB_DEFAULT = 64;
+const size_t DATA_RING_SIZE = 1 << 20;
 
 const bool DO_DISPLAY_DEFAULT = true;
+const double DISP_FPS_DEFAULT = 0;      // as fast as possible
 const bool SAVE_RAW_DEFAULT = false;
 const bool SAVE_DEBUG_DEFAULT = false;
+const bool RAW_DUMP_DEFAULT = false;
+const int VID_THREADS_DEFAULT = 0;      // codec default
+const bool VID_HW_ENCODE_DEFAULT = false;
+
+/// Serialise HighGUI calls across all trackers in this process.
+static std::mutex gui_mutex;
+
+///
+/// Open src_fn as a frame dump, a simulated ball (sim:...), a native camera (camera id, PGR/Basler builds) or an OpenCV source.
+///
+static shared_ptr<FrameSource> openSource(const string& src_fn, bool hw_decode, bool grey, bool native, int bufs)
+{
+    if (DumpSource::isDump(src_fn)) {
+        // pre-recorded frame dump (no decoding)
+        return make_shared<DumpSource>(src_fn);
+    }
+    if (SimSource::isSim(src_fn)) {
+        // synthetic frames (see SimSource.h)
+        return make_shared<SimSource>(src_fn);
+    }
+#if defined(PGR_USB2) || defined(PGR_USB3) || defined(BASLER_USB3)
+    // try specific camera sdk first if available
+    try {
+        if (src_fn.size() > 2) { throw std::exception(); }
+        // first try reading input as camera id
+        int id = std::stoi(src_fn);
+#if defined(PGR_USB2) || defined(PGR_USB3)
+        return make_shared<PGRSource>(id, native, bufs);
+#elif defined(BASLER_USB3)
+        return make_shared<BaslerSource>(id, native, bufs);
+#endif // PGR/BASLER
+    }
+    catch (...) {
+        // fall back to OpenCV
+    }
+#endif // PGR/BASLER
+    return make_shared<CVSource>(src_fn, hw_decode, grey);
+}
 
 /// OpenCV codecs for video writing
 const vector<vector<std::string>> CODECS = {
@@ -91,41 +206,151 @@ bool intersectSphere(const double r, const double camVec[3], double sphereVec[3]
 ///
 /// 
 ///
-Trackball::Trackball(string cfg_fn)
-    : _init(false), _reset(true), _clean_map(true), _active(true), _kill(false), _do_reset(false)
+Trackball::Trackball(shared_ptr<ThreadPool> pool, string name)
+    : _aux_sync_ms(CAM_AUX_SYNC_DEFAULT),
+    _drawIdle(false), _draw_map_ver(0), _draw_hist_reset(true), _disp_period(0),
+    _win_name(name.empty() ? "FicTrac-debug" : "FicTrac-debug (" + name + ")"),
+    _path_minx(0), _path_maxx(0), _path_miny(0), _path_maxy(0), _path_trimmed(0),
+    _pool(pool),
+    _opt_bound(OPT_BOUND_DEFAULT), _opt_tol(OPT_TOL_DEFAULT), _opt_retries(0),
+    _opt_recover(OPT_RECOVER_DEFAULT), _opt_recoveries(0),
+    _opt_budget(0), _opt_overruns(0),
+    _opt_max_evals(OPT_MAX_EVAL_DEFAULT), _opt_early_exit(OPT_EARLY_EXIT_DEFAULT), _opt_grad(OPT_GRAD_DEFAULT),
+    _draw_every(1),
+    _init(false), _reset(true), _clean_map(true), _batch(false), _cnt_offset(0),
+    _prev_heading(0), _prev_path_ts(-1), _prev_log_ts(-1),
+    _prev_t6(-1), _prev_ts(-1), _fps_avg(-1),
+    _cfg_reload(CFG_RELOAD_DEFAULT), _cfg_sidecar(CFG_SIDECAR_DEFAULT), _cfg_check_ts(0),
+    _do_pipeline(false), _map_ver(0), _map_ver_sync(0), _map_dirty_sync(0), _pipeBusy(false), _pipeStop(false),
+    _ckpt_period(CKPT_PERIOD_DEFAULT), _ckpt_last(-1), _ckpt_key(0), _ckpt_map_ver(0), _ckptPending(false), _ckptStop(false),
+    _stats_period(STATS_PERIOD_DEFAULT), _stats_sock(STATS_SOCK_DEFAULT), _live_src(false),
+    _callback_frames(false),
+    _compact_com(false), _com_fields(0), _com_period(0), _com_next_ts(-DBL_MAX),
+    _active(true), _kill(false), _do_reset(false)
 {
-    /// Save execTime for outptut file naming.
-    string exec_time = execTime();
+    /// Instrumentation (timings in ms at us resolution; counters are whole numbers).
+    for (int i = 0; i < NUM_STATS; i++) {
+        double res = ((i == ST_EVALS) || (i == ST_QUEUE)) ? 1 : (i == ST_BOUND) ? 1e-4 : 1e-3;
+        _hist[i] = make_unique<LatencyHist>(res);
+        _hist_int[i] = make_unique<LatencyHist>(res);
+    }
+}
 
+///
+/// Run from a config file (written back with all parameters, optionally watched for changes).
+///
+Trackball::Trackball(string cfg_fn, shared_ptr<ThreadPool> pool, string name, bool batch)
+    : Trackball(pool, name)
+{
     /// Load and parse config file.
     if (_cfg.read(cfg_fn) <= 0) {
         LOG_ERR("Error parsing config file (%s)!", cfg_fn.c_str());
         _active = false;
         return;
     }
+    _cfg_fn = cfg_fn;
+
+    init(nullptr, batch);
+}
+
+///
+///
+///
+Trackball::Trackball(const ConfigParser& cfg, shared_ptr<FrameSource> source, FrameCallback callback, bool callback_frames,
+    shared_ptr<ThreadPool> pool, string name, bool batch)
+    : Trackball(pool, name)
+{
+    _cfg = cfg;
+    _callback = callback;
+    _callback_frames = callback && callback_frames;
+
+    init(source, batch);
+}
+
+///
+/// Shared construction. _cfg has been read; source overrides src_fn if given.
+///
+void Trackball::init(shared_ptr<FrameSource> source, bool batch)
+{
+    /// Save execTime for outptut file naming.
+    string exec_time = execTime();
+
+    /// Thread placement (for this tracker's threads, see StartThread) - must be set before any worker threads are started.
+    vector<int> cpus_grab, cpus_track, cpus_draw, cpus_io;
+    auto getCpus = [&](const string& key, vector<int>& cpus) {
+        if (!_cfg.getVecInt(key, cpus)) {
+            cpus.clear();
+            _cfg.add(key, string("{ }"));
+        }
+    };
+    getCpus("cpus_grab", cpus_grab);
+    getCpus("cpus_track", cpus_track);
+    getCpus("cpus_draw", cpus_draw);
+    getCpus("cpus_io", cpus_io);
+    vector<int> cpus_team;
+    getCpus("cpus_team", cpus_team);
+    bool rt_sched = RT_SCHED_DEFAULT;
+    if (!_cfg.getBool("rt_sched", rt_sched)) {
+        LOG_WRN("Warning! Using default value for rt_sched (%d).", rt_sched);
+        _cfg.add("rt_sched", rt_sched ? "y" : "n");
+    }
+    SetThreadClassConfig(ThreadClass::GRAB, cpus_grab, rt_sched);
+    SetThreadClassConfig(ThreadClass::TRACK, cpus_track, rt_sched);
+    SetThreadClassConfig(ThreadClass::DRAW, cpus_draw, false);
+    SetThreadClassConfig(ThreadClass::IO, cpus_io, false);
+    if (rt_sched && !LockProcessMemory()) {
+        LOG_WRN("Warning! Unable to lock process memory (rt_sched) - check RLIMIT_MEMLOCK/privileges.");
+    }
+
+    /// Low latency handoffs (grabber -> tracker, tracker -> socket) poll rather than block.
+    int spin_wait_us = SPIN_WAIT_US_DEFAULT;
+    if (!_cfg.getInt("spin_wait_us", spin_wait_us)) {
+        LOG_WRN("Warning! Using default value for spin_wait_us (%d).", spin_wait_us);
+        _cfg.add("spin_wait_us", spin_wait_us);
+    }
+    if ((spin_wait_us < 0) && (cpus_grab.empty() || cpus_track.empty() || cpus_io.empty())) {
+        LOG_WRN("Warning! Busy-polling (spin_wait_us < 0) without dedicated cores (cpus_grab, cpus_track, cpus_io) may starve other threads.");
+    }
 
     /// Open frame source and set fps.
     string src_fn = _cfg("src_fn");
-    shared_ptr<FrameSource> source;
-    // try specific camera sdk first if available
-#if defined(PGR_USB2) || defined(PGR_USB3) || defined(BASLER_USB3)
-    try {
-        if (src_fn.size() > 2) { throw std::exception(); }
-        // first try reading input as camera id
-        int id = std::stoi(src_fn);
-#if defined(PGR_USB2) || defined(PGR_USB3)
-        source = make_shared<PGRSource>(id);
-#elif defined(BASLER_USB3)
-        source = make_shared<BaslerSource>(id);
-#endif // PGR/BASLER
+    bool src_hw_decode = SRC_HW_DECODE_DEFAULT;
+    if (!_cfg.getBool("src_hw_decode", src_hw_decode)) {
+        LOG_WRN("Warning! Using default value for src_hw_decode (%d).", src_hw_decode);
+        _cfg.add("src_hw_decode", src_hw_decode ? "y" : "n");
     }
-    catch (...) {
-        // fall back to OpenCV
-        source = make_shared<CVSource>(src_fn);
+    bool src_grey = SRC_GREY_DEFAULT;
+    if (!_cfg.getBool("src_grey", src_grey)) {
+        LOG_WRN("Warning! Using default value for src_grey (%d).", src_grey);
+        _cfg.add("src_grey", src_grey ? "y" : "n");
+    }
+    {
+        string rgb = _cfg("thr_rgb_tfrm");
+        if (src_grey && ((rgb == "red") || (rgb == "r") || (rgb == "green") || (rgb == "g") || (rgb == "blue") || (rgb == "b"))) {
+            LOG_WRN("Warning! Ignoring src_grey, because thr_rgb_tfrm requires colour frames.");
+            src_grey = false;
+        }
     }
-#else // !PGR/BASLER
-    source = make_shared<CVSource>(src_fn);
+    const bool external = static_cast<bool>(source);   // supplied by the application (embedded use)
+    if (external) {
+        if (!src_fn.empty()) { LOG_WRN("Warning! Ignoring src_fn (%s), frames are supplied by the application.", src_fn.c_str()); }
+    }
+    else {
+        bool src_native = SRC_NATIVE_DEFAULT;
+        int src_bufs = SRC_BUFS_DEFAULT;
+#if defined(PGR_USB2) || defined(PGR_USB3) || defined(BASLER_USB3)
+        if (!_cfg.getBool("src_native", src_native)) {
+            LOG_WRN("Warning! Using default value for src_native (%d).", src_native);
+            _cfg.add("src_native", src_native ? "y" : "n");
+        }
+        if (!_cfg.getInt("src_bufs", src_bufs) || (src_bufs < 0)) {
+            src_bufs = SRC_BUFS_DEFAULT;
+            LOG_WRN("Warning! Using default value for src_bufs (%d).", src_bufs);
+            _cfg.add("src_bufs", src_bufs);
+        }
 #endif // PGR/BASLER
+        source = openSource(src_fn, src_hw_decode, src_grey, src_native, src_bufs);
+    }
     if (!source->isOpen()) {
         LOG_ERR("Error! Could not open input frame source (%s)!", src_fn.c_str());
         _active = false;
@@ -140,11 +365,37 @@ Trackball::Trackball(string cfg_fn)
         _cfg.add("src_fps", src_fps);
     }
 
+    /// Sub-range of recorded video (e.g. for chunked reprocessing).
+    int frame_start = FRAME_START_DEFAULT;
+    if (!_cfg.getInt("frame_start", frame_start) || (frame_start < 0)) {
+        frame_start = FRAME_START_DEFAULT;
+        LOG_WRN("Warning! Using default value for frame_start (%d).", frame_start);
+        _cfg.add("frame_start", frame_start);
+    }
+    if (!source->setStartFrame(frame_start)) {
+        LOG_ERR("Error! Unable to start source at frame %d (frame_start).", frame_start);
+        _active = false;
+        return;
+    }
+    _cnt_offset = frame_start;   // output frame counters match a run over the whole video
+    int frame_count = FRAME_COUNT_DEFAULT;
+    if (!_cfg.getInt("frame_count", frame_count)) {
+        LOG_WRN("Warning! Using default value for frame_count (%d).", frame_count);
+        _cfg.add("frame_count", frame_count);
+    }
+
+    _live_src = source->isLive();
+    if (batch && _live_src) {
+        LOG_WRN("Warning! Batch mode is only available for recorded video - ignoring.");
+        batch = false;
+    }
+    _batch = batch;
+
     /// Create base file name for output files.
     _base_fn = _cfg("output_fn");
     if (_base_fn.empty()) {
-        if (!source->isLive()) {
-            _base_fn = src_fn.substr(0, src_fn.length() - 4);
+        if (!source->isLive() && !external && !SimSource::isSim(src_fn)) {
+            _base_fn = src_fn.substr(0, src_fn.length() - (DumpSource::isDump(src_fn) ? 5 : 4));
         } else {
             _base_fn = "fictrac";
         }
@@ -176,6 +427,43 @@ Trackball::Trackball(string cfg_fn)
     _map_h = static_cast<int>(1.5 * _roi_h);
     _map_w = 2 * _map_h;
 
+    /// Tracking state below is allocated (and first written) on the tracking cores, so it
+    /// is local to their NUMA node. Released once the optimisers are initialised. The startup
+    /// task threads (see TaskGraph below) are started inside the scope, so they inherit the
+    /// tracking cores too; they only live until the end of startup.
+    auto numa_scope = make_unique<ScopedThreadAffinity>(cpus_track);
+
+    /// Binary sidecars for the ignore polygons and sphere template (parsed/decoded once).
+    if (!_cfg.getBool("cfg_sidecar", _cfg_sidecar)) {
+        LOG_WRN("Warning! Using default value for cfg_sidecar (%d).", _cfg_sidecar);
+        _cfg.add("cfg_sidecar", _cfg_sidecar ? "y" : "n");
+    }
+    const string cfg_fn = _cfg_fn;      // ignore polygon sidecar and ROI cache are named after the config file
+
+    /// Independent startup steps (template decode, decoder warm-up, output video setup, cache
+    /// writes) run in the background while the ROI state and optimisers are built, and are
+    /// waited on where their results are first needed. Tasks only capture values and members
+    /// that nothing else touches until then.
+    TaskGraph startup;
+
+    /// Sphere map template (decoded or loaded from its sidecar in the background).
+    string sphere_template_fn;
+    const bool load_template = _cfg.getStr("sphere_map_fn", sphere_template_fn);
+    TaskGraph::Task template_task = -1;
+    if (load_template) {
+        template_task = startup.add("sphere template", [this, sphere_template_fn]() {
+            const string map_fn = sphere_template_fn.substr(0, sphere_template_fn.find_last_of('.')) + ".map";
+            const uint64_t map_key = sidecar::fileKey(sphere_template_fn);
+            if (!_cfg_sidecar || (map_key == 0) || !sidecar::loadMap(map_fn, map_key, _sphere_template)) {
+                _sphere_template = cv::imread(sphere_template_fn, 0);
+                if (_cfg_sidecar && !_sphere_template.empty() && !sidecar::saveMap(map_fn, map_key, _sphere_template)) {
+                    LOG_WRN("Warning! Unable to write sphere template sidecar (%s).", map_fn.c_str());
+                }
+            }
+            return (_sphere_template.cols == _map_w) && (_sphere_template.rows == _map_h);
+        });
+    }
+
     /// Load sphere config and mask.
     bool reconfig = false;
     //_cfg.getBool("reconfig", reconfig); // ignore saved roi_c, roi_r, c2a_r, and c2a_t values and recompute from pixel coords - dangerous!!
@@ -213,7 +501,17 @@ Trackball::Trackball(string cfg_fn)
 
             /// Mask out ignore regions.
             vector<vector<int>> ignr_polys;
-            if (_cfg.getVVecInt("roi_ignr", ignr_polys) && (ignr_polys.size() > 0)) {
+            const string ignr_fn = cfg_fn.substr(0, cfg_fn.find_last_of('.')) + "-ignr.bin";
+            const uint64_t ignr_key = sidecar::hash(_cfg("roi_ignr"));
+            const bool ignr_sidecar = _cfg_sidecar && !cfg_fn.empty();
+            bool ignr_valid = ignr_sidecar && sidecar::loadPolys(ignr_fn, ignr_key, ignr_polys);
+            if (!ignr_valid) {
+                ignr_valid = _cfg.getVVecInt("roi_ignr", ignr_polys);
+                if (ignr_valid && ignr_sidecar && !sidecar::savePolys(ignr_fn, ignr_key, ignr_polys)) {
+                    LOG_WRN("Warning! Unable to write ignore region sidecar (%s).", ignr_fn.c_str());
+                }
+            }
+            if (ignr_valid && (ignr_polys.size() > 0)) {
                 /// Load ignore polys from config file.
                 vector<vector<Point2i>> ignr_polys_pts;
                 for (auto poly : ignr_polys) {
@@ -281,18 +579,125 @@ Trackball::Trackball(string cfg_fn)
             _active = false;
             return;
         }
+        _cam_to_lab = CmMat33d(_cam_to_lab_R);
+    }
+
+    /// Camera-side AOI/binning - only stream the sphere bounding box.
+    bool src_aoi = SRC_AOI_DEFAULT;
+    if (!_cfg.getBool("src_aoi", src_aoi)) {
+        LOG_WRN("Warning! Using default value for src_aoi (%d).", src_aoi);
+        _cfg.add("src_aoi", src_aoi ? "y" : "n");
+    }
+    int src_bin = SRC_BIN_DEFAULT;
+    if (!_cfg.getInt("src_bin", src_bin) || (src_bin < 1)) {
+        src_bin = SRC_BIN_DEFAULT;
+        LOG_WRN("Warning! Using default value for src_bin (%d).", src_bin);
+        _cfg.add("src_bin", src_bin);
+    }
+    string aoi_desc = "none";
+    if (_live_src && (src_aoi || (src_bin > 1))) {
+        const int full_w = source->getWidth(), full_h = source->getHeight();
+        cv::Rect box(0, 0, full_w, full_h);
+        if (src_aoi) {
+            auto circ = projCircleInt(_src_model, _sphere_c, _sphere_rad);
+            box = cv::boundingRect(*circ);
+            box.x -= SRC_AOI_PAD;
+            box.y -= SRC_AOI_PAD;
+            box.width += 2 * SRC_AOI_PAD;
+            box.height += 2 * SRC_AOI_PAD;
+            box &= cv::Rect(0, 0, full_w, full_h);
+        }
+
+        int x = box.x, y = box.y, w = box.width, h = box.height, bin = src_bin;
+        if (source->setAOI(x, y, w, h, bin) && (source->getWidth() == (w / bin)) && (source->getHeight() == (h / bin))) {
+            /// Same camera, viewed through the window (continuous coords map as (p - offset) / bin).
+            const double cx = (0.5 * full_w - x) / bin, cy = (0.5 * full_h - y) / bin;
+            if (fisheye) {
+                _src_model = CameraModel::createFisheye(source->getWidth(), source->getHeight(), bin * vfov * CM_D2R / (double)full_h, 360 * CM_D2R, cx, cy);
+            }
+            else {
+                double f = (0.5 * full_h) / tan(0.5 * vfov * CM_D2R) / bin;
+                _src_model = CameraModel::createRectilinear(source->getWidth(), source->getHeight(), 2 * atan(0.5 * source->getHeight() / f), cx, cy);
+            }
+
+            /// Crop (and bin) mask - binned pixels are only valid if all sensor pixels were.
+            Mat aoi_mask = src_mask(cv::Rect(x, y, w, h));
+            if (bin > 1) {
+                Mat binned;
+                cv::resize(aoi_mask, binned, cv::Size(source->getWidth(), source->getHeight()), 0, 0, cv::INTER_AREA);
+                cv::compare(binned, 255, src_mask, cv::CMP_EQ);
+            } else {
+                src_mask = aoi_mask.clone();
+            }
+            LOG("Streaming camera AOI %dx%d+%d+%d (bin %d) around sphere ROI.", w, h, x, y, bin);
+            aoi_desc = to_string(full_w) + "x" + to_string(full_h) + ":" + to_string(w) + "x" + to_string(h) + "+" + to_string(x) + "+" + to_string(y) + "/" + to_string(bin);
+        }
+        else {
+            LOG_ERR("Error! Unable to set camera AOI/binning (src_aoi, src_bin)!");
+            _active = false;
+            return;
+        }
+    }
+
+    /// Source is set up - warm up the decoder of recorded sources (the first decode initialises
+    /// codec, hardware context and buffers) while the ROI state is built. The grabber rewinds
+    /// the source when it starts. Live cameras already stream from open, and the application
+    /// feeds external sources. Sources aren't thread safe, so nothing below touches the source
+    /// until the warm-up has finished (see startup.wait(warm_up)) - use these copies instead.
+    const double source_fps = source->getFPS();
+    const int source_w = source->getWidth(), source_h = source->getHeight();
+    TaskGraph::Task warm_up = -1;
+    if (!_live_src && !external) {
+        warm_up = startup.add("source warm-up", [source]() {
+            cv::Mat frame;
+            source->grab(frame);
+            return true;
+        });
+    }
+
+    /// Derived ROI state (remap tables, ROI mask, view rays) is reused from the
+    /// cache if none of its inputs have changed since it was written.
+    bool roi_cache = ROI_CACHE_DEFAULT;
+    if (!_cfg.getBool("roi_cache", roi_cache)) {
+        LOG_WRN("Warning! Using default value for roi_cache (%d).", roi_cache);
+        _cfg.add("roi_cache", roi_cache ? "y" : "n");
+    }
+    if (cfg_fn.empty()) { roi_cache = false; }
+    const string cache_fn = cfg_fn.substr(0, cfg_fn.find_last_of('.')) + "-roi.cache";
+    uint64_t cache_key = 0;
+    RoiCache cache;
+    bool cached = false;
+    if (roi_cache) {
+        ostringstream desc;
+        desc << std::hexfloat << FICTRAC_VERSION_MAJOR << "." << FICTRAC_VERSION_MIDDLE << "." << FICTRAC_VERSION_MINOR
+            << "|src " << source_w << "x" << source_h << (fisheye ? " fisheye " : " rectilinear ") << vfov
+            << "|aoi " << aoi_desc
+            << "|roi " << _roi_w << "x" << _roi_h << " " << _sphere_c[0] << " " << _sphere_c[1] << " " << _sphere_c[2] << " " << _sphere_rad
+            << "|ignr " << _cfg("roi_ignr");
+        cache_key = RoiCache::key(desc.str());
+        cached = cache.load(cache_fn, cache_key, source_w, source_h, _roi_w, _roi_h);
+        if (cached) {
+            LOG("Loaded ROI remap, mask and view rays from cache (%s).", cache_fn.c_str());
+        }
     }
 
     ///// Remap (ROI) model and remapper.
     double sphere_radPerPix = _sphere_rad * 2.0 / _roi_w;
     _roi_model = CameraModel::createFisheye(_roi_w, _roi_h, sphere_radPerPix, _sphere_rad * 2.0);
     _cam_to_roi = MatrixRemapTransform::createFromOmega(-roi_to_cam_r);
-    CameraRemapPtr remapper = CameraRemapPtr(new CameraRemap(_src_model, _roi_model, _cam_to_roi));
+    CameraRemapPtr remapper;
+    if (cached) {
+        remapper = CameraRemapPtr(new CameraRemap(_src_model, _roi_model, _cam_to_roi, cache.map_x, cache.map_y));
+        _roi_mask = cache.roi_mask;
+    }
+    else {
+        remapper = CameraRemapPtr(new CameraRemap(_src_model, _roi_model, _cam_to_roi));
 
-    /// ROI mask.
-    _roi_mask.create(_roi_h, _roi_w, CV_8UC1);
-    _roi_mask.setTo(cv::Scalar::all(255));
-    remapper->apply(src_mask, _roi_mask);
+        /// ROI mask.
+        _roi_mask.create(_roi_h, _roi_w, CV_8UC1);
+        _roi_mask.setTo(cv::Scalar::all(255));
+        remapper->apply(src_mask, _roi_mask);
+    }
 
     /// Surface mapping.
     _sphere_model = CameraModel::createEquiArea(_map_w, _map_h, CM_PI_2, -CM_PI, CM_PI, -2 * CM_PI);
@@ -302,38 +707,115 @@ Trackball::Trackball(string cfg_fn)
     _sphere_map.setTo(cv::Scalar::all(128));
 
     /// Surface map template.
-    _sphere_template = _sphere_map.clone();
-    {
-        string sphere_template_fn;
-        if (_cfg.getStr("sphere_map_fn", sphere_template_fn)) {
-            _sphere_template = cv::imread(sphere_template_fn, 0);
-            if ((_sphere_template.cols != _map_w) || (_sphere_template.rows != _map_h)) {
-                LOG_ERR("Error! Sphere map template specified in the config file (sphere_map_fn) is invalid (%dx%d)!", _sphere_template.cols, _sphere_template.rows);
-                _active = false;
-                return;
-            }
+    if (load_template) {
+        if (!startup.wait(template_task)) {
+            LOG_ERR("Error! Sphere map template specified in the config file (sphere_map_fn) is invalid (%dx%d)!", _sphere_template.cols, _sphere_template.rows);
+            _active = false;
+            return;
+        }
 
-            /// Store initial sphere map.
-            _sphere_template.copyTo(_sphere_map);
-            _clean_map = false;
+        /// Store initial sphere map.
+        _sphere_template.copyTo(_sphere_map);
+        _clean_map = false;
 
-            LOG("Loaded initial sphere template from %s.", sphere_template_fn.c_str());
-        }
+        LOG("Loaded initial sphere template from %s.", sphere_template_fn.c_str());
+    }
+    else {
+        _sphere_template = _sphere_map.clone();
     }
 
-    /// Pre-calc view rays.
-    _p1s_lut = make_shared<vector<double>>(_roi_w * _roi_h * 3, 0);
-    for (int i = 0; i < _roi_h; i++) {
-        uint8_t* pmask = _roi_mask.ptr(i);
-        for (int j = 0; j < _roi_w; j++) {
-            if (pmask[j] < 255) { continue; }
+    /// Periodic checkpoints of map and orientation.
+    if (!_cfg.getDbl("ckpt_period", _ckpt_period) || (_ckpt_period < 0)) {
+        _ckpt_period = CKPT_PERIOD_DEFAULT;
+        LOG_WRN("Warning! Using default value for ckpt_period (%.1f).", _ckpt_period);
+        _cfg.add("ckpt_period", _ckpt_period);
+    }
+    bool ckpt_resume = CKPT_RESUME_DEFAULT;
+    if (!_cfg.getBool("ckpt_resume", ckpt_resume)) {
+        ckpt_resume = CKPT_RESUME_DEFAULT;
+        LOG_WRN("Warning! Using default value for ckpt_resume (%d).", ckpt_resume);
+        _cfg.add("ckpt_resume", ckpt_resume ? "y" : "n");
+    }
+    _ckpt_fn = _base_fn + "-checkpoint.map";
 
-            double l[3] = { 0, 0, 0 };
-            _roi_model->pixelIndexToVector(j, i, l);
-            vec3normalise(l);
+    /// Pre-calc view rays for valid ROI pixels.
+    if (cached) {
+        _roi_pix = make_shared<vector<RoiPixel>>(std::move(cache.roi_pix));
+    }
+    else {
+        _roi_pix = make_shared<vector<RoiPixel>>();
+        _roi_pix->reserve(_roi_w * _roi_h);
+        for (int i = 0; i < _roi_h; i++) {
+            uint8_t* pmask = _roi_mask.ptr(i);
+            for (int j = 0; j < _roi_w; j++) {
+                if (pmask[j] < 255) { continue; }
+
+                double l[3] = { 0, 0, 0 };
+                _roi_model->pixelIndexToVector(j, i, l);
+                vec3normalise(l);
+
+                double s[3] = { 0, 0, 0 };
+                if (!intersectSphere(_r_d_ratio, l, s)) { pmask[j] = 128; continue; }
+
+                RoiPixel p;
+                p.idx = i * _roi_w + j;
+                p.v.copy(s);
+                p.v.normalise();
+                _roi_pix->push_back(p);
+            }
+        }
+        _roi_pix->shrink_to_fit();
+
+        /// Written in the background (the task owns its copy).
+        if (roi_cache) {
+            auto save = make_shared<RoiCache>();
+            save->map_x = remapper->mapX();
+            save->map_y = remapper->mapY();
+            save->roi_mask = _roi_mask.clone();
+            save->roi_pix = *_roi_pix;
+            startup.add("ROI cache", [save, cache_fn, cache_key, source_w, source_h]() {
+                if (!save->save(cache_fn, cache_key, source_w, source_h)) {
+                    LOG_WRN("Warning! Unable to write ROI cache (%s).", cache_fn.c_str());
+                    return false;
+                }
+                LOG_DBG("Wrote ROI cache (%s).", cache_fn.c_str());
+                return true;
+            });
+        }
+    }
 
-            double* s = &(*_p1s_lut)[(i * _roi_w + j) * 3];
-            if (!intersectSphere(_r_d_ratio, l, s)) { pmask[j] = 128; }
+    /// Auxiliary cameras viewing the same ball (comma separated config files, see AuxCamera).
+    _roi_pix_main = _roi_pix;
+    {
+        vector<string> aux_fns;
+        istringstream ss(_cfg("cam_aux"));
+        string fn;
+        while (getline(ss, fn, ',')) {
+            fn.erase(0, fn.find_first_not_of(" \t{"));
+            fn.erase(fn.find_last_not_of(" \t}") + 1);
+            if (!fn.empty()) { aux_fns.push_back(fn); }
+        }
+        if (!aux_fns.empty()) {
+            double aux_sync = CAM_AUX_SYNC_DEFAULT;
+            if (!_cfg.getDbl("cam_aux_sync", aux_sync)) {
+                LOG_WRN("Warning! Using default value for cam_aux_sync (%.1f).", aux_sync);
+                _cfg.add("cam_aux_sync", aux_sync);
+            }
+            _aux_sync_ms = (aux_sync > 0) ? aux_sync : ((source_fps > 0) ? 500 / source_fps : 20);
+            LOG_DBG("Pairing auxiliary camera frames within %.1f ms.", _aux_sync_ms);
+
+            _roi_pix_main = make_shared<vector<RoiPixel>>(*_roi_pix);
+            for (size_t i = 0; i < aux_fns.size(); i++) {
+                auto cam = make_unique<AuxCamera>();
+                if (!initAuxCamera(aux_fns[i], static_cast<int>(i) + 1, roi_to_cam_r, *cam)) {
+                    _active = false;
+                    return;
+                }
+                _aux.push_back(std::move(cam));
+            }
+            _roi_pix->shrink_to_fit();
+            LOG("Tracking with %d cameras (%d ROI pixels, %d from main camera).",
+                static_cast<int>(_aux.size()) + 1, static_cast<int>(_roi_pix->size()), static_cast<int>(_roi_pix_main->size()));
         }
     }
 
@@ -348,16 +830,106 @@ Trackball::Trackball(string cfg_fn)
         LOG_WRN("Warning! Using default value for opt_bound (%f).", bound);
         _cfg.add("opt_bound", bound);
     }
+    _opt_bound = bound;
+    _opt_tol = tol;
+    buildRecoverSet();
+    string predictor = OPT_PREDICTOR_DEFAULT;
+    if (!_cfg.getStr("opt_predictor", predictor) || !(_motion = MotionModel::create(predictor, bound, tol))) {
+        predictor = OPT_PREDICTOR_DEFAULT;
+        LOG_WRN("Warning! Using default value for opt_predictor (%s).", predictor.c_str());
+        _cfg.add("opt_predictor", predictor);
+        _motion = MotionModel::create(predictor, bound, tol);
+    }
     int max_evals = OPT_MAX_EVAL_DEFAULT;
     if (!_cfg.getInt("opt_max_evals", max_evals) || (max_evals <= 0)) {
         LOG_WRN("Warning! Using default value for opt_max_eval (%d).", max_evals);
         _cfg.add("opt_max_evals", max_evals);
     }
+    int pyr_levels = OPT_PYR_LEVELS_DEFAULT;
+    if (!_cfg.getInt("opt_pyr_levels", pyr_levels) || (pyr_levels < 0)) {
+        pyr_levels = OPT_PYR_LEVELS_DEFAULT;
+        LOG_WRN("Warning! Using default value for opt_pyr_levels (%d).", pyr_levels);
+        _cfg.add("opt_pyr_levels", pyr_levels);
+    }
+    bool early_exit = OPT_EARLY_EXIT_DEFAULT;
+    if (!_cfg.getBool("opt_early_exit", early_exit)) {
+        LOG_WRN("Warning! Using default value for opt_early_exit (%d).", early_exit);
+        _cfg.add("opt_early_exit", early_exit ? "y" : "n");
+    }
+    bool opt_grad = OPT_GRAD_DEFAULT;
+    if (!_cfg.getBool("opt_grad", opt_grad)) {
+        LOG_WRN("Warning! Using default value for opt_grad (%d).", opt_grad);
+        _cfg.add("opt_grad", opt_grad ? "y" : "n");
+    }
+    if (opt_grad && early_exit) {
+        LOG_WRN("Warning! opt_early_exit is not used with gradient based search (opt_grad).");
+        early_exit = false;
+    }
+    _opt_budget = OPT_BUDGET_MS_DEFAULT;
+    if (!_cfg.getDbl("opt_budget_ms", _opt_budget)) {
+        LOG_WRN("Warning! Using default value for opt_budget_ms (%.1f).", _opt_budget);
+        _cfg.add("opt_budget_ms", _opt_budget);
+    }
+    if (_opt_budget < 0) {
+        double fps = source_fps;
+        if (fps <= 0) { fps = src_fps; }
+        if (_batch) {
+            LOG_WRN("Warning! Automatic search time budget (opt_budget_ms) is not used in batch mode.");
+            _opt_budget = 0;
+        } else if (fps <= 0) {
+            LOG_WRN("Warning! Unable to determine source frame rate - search time budget (opt_budget_ms) disabled.");
+            _opt_budget = 0;
+        } else {
+            _opt_budget = OPT_BUDGET_AUTO_PC * 1000 / fps;
+            LOG("Search time budget %.2f ms (%.1f FPS).", _opt_budget, fps);
+        }
+    }
+    bool opt_float = OPT_FLOAT_DEFAULT;
+    if (!_cfg.getBool("opt_float", opt_float)) {
+        LOG_WRN("Warning! Using default value for opt_float (%d).", opt_float);
+        _cfg.add("opt_float", opt_float ? "y" : "n");
+    }
+    if (opt_float) {
+        _roi_pix_f.reserve(_roi_pix->size());
+        for (const auto& p : *_roi_pix) {
+            _roi_pix_f.push_back({ static_cast<float>(p.v.x), static_cast<float>(p.v.y), static_cast<float>(p.v.z), p.idx });
+        }
+    }
     _do_global_search = OPT_GLOBAL_SEARCH_DEFAULT;
     if (!_cfg.getBool("opt_do_global", _do_global_search)) {
         LOG_WRN("Warning! Using default value for opt_do_global (%d).", _do_global_search);
         _cfg.add("opt_do_global", _do_global_search ? "y" : "n");
     }
+    _global_first = OPT_GLOBAL_FIRST_DEFAULT;
+    if (!_cfg.getBool("opt_global_first", _global_first)) {
+        LOG_WRN("Warning! Using default value for opt_global_first (%d).", _global_first);
+        _cfg.add("opt_global_first", _global_first ? "y" : "n");
+    }
+    if (_global_first && (_do_global_search || !load_template)) {
+        _global_first = false;  // already covered by opt_do_global / nothing to localise against
+    }
+    _opt_recover = OPT_RECOVER_DEFAULT;
+    if (!_cfg.getBool("opt_recover", _opt_recover)) {
+        LOG_WRN("Warning! Using default value for opt_recover (%d).", _opt_recover);
+        _cfg.add("opt_recover", _opt_recover ? "y" : "n");
+    }
+    bool global_grid = OPT_GLOBAL_GRID_DEFAULT;
+    if (!_cfg.getBool("opt_global_grid", global_grid)) {
+        LOG_WRN("Warning! Using default value for opt_global_grid (%d).", global_grid);
+        _cfg.add("opt_global_grid", global_grid ? "y" : "n");
+    }
+    int global_threads = OPT_GLOBAL_THREADS_DEFAULT;
+    if (!_cfg.getInt("opt_global_threads", global_threads) || (global_threads < 0)) {
+        global_threads = OPT_GLOBAL_THREADS_DEFAULT;
+        LOG_WRN("Warning! Using default value for opt_global_threads (%d).", global_threads);
+        _cfg.add("opt_global_threads", global_threads);
+    }
+    int team_threads = OPT_TEAM_THREADS_DEFAULT;
+    if (!_cfg.getInt("opt_team_threads", team_threads) || (team_threads < 1)) {
+        team_threads = OPT_TEAM_THREADS_DEFAULT;
+        LOG_WRN("Warning! Using default value for opt_team_threads (%d).", team_threads);
+        _cfg.add("opt_team_threads", team_threads);
+    }
     _max_bad_frames = OPT_MAX_BAD_FRAMES_DEFAULT;
     if (!_cfg.getInt("max_bad_frames", _max_bad_frames)) {
         LOG_WRN("Warning! Using default value for max_bad_frames (%d).", _max_bad_frames);
@@ -378,21 +950,144 @@ Trackball::Trackball(string cfg_fn)
         LOG_WRN("Warning! Using default value for thr_win_pc (%f).", thresh_win_pc);
         _cfg.add("thr_win_pc", thresh_win_pc);
     }
+    bool fused_prep = FUSED_PREP_DEFAULT;
+    if (!_cfg.getBool("fused_prep", fused_prep)) {
+        LOG_WRN("Warning! Using default value for fused_prep (%d).", fused_prep);
+        _cfg.add("fused_prep", fused_prep ? "y" : "n");
+    }
+    _do_pipeline = PIPELINE_DEFAULT;
+    if (!_cfg.getBool("pipeline", _do_pipeline)) {
+        LOG_WRN("Warning! Using default value for pipeline (%d).", _do_pipeline);
+        _cfg.add("pipeline", _do_pipeline ? "y" : "n");
+    }
+    if (!_cfg.getBool("cfg_reload", _cfg_reload)) {
+        LOG_WRN("Warning! Using default value for cfg_reload (%d).", _cfg_reload);
+        _cfg.add("cfg_reload", _cfg_reload ? "y" : "n");
+    }
+
+    /// Tiled copy of the surface map for matching.
+    bool map_tiled = MAP_TILED_DEFAULT;
+    if (!_cfg.getBool("map_tiled", map_tiled)) {
+        LOG_WRN("Warning! Using default value for map_tiled (%d).", map_tiled);
+        _cfg.add("map_tiled", map_tiled ? "y" : "n");
+    }
+    if (map_tiled) {
+        _sphere_tiles = make_unique<TiledMap>(_map_w, _map_h);
+        _sphere_tiles->fromMat(_sphere_map);
+    }
+    _map_dirty = make_unique<DirtyTiles>(_map_w, _map_h);
+
+    /// OpenCL offload of frame preprocessing and global grid scoring (FICTRAC_OPENCL builds).
+    bool use_gpu = USE_GPU_DEFAULT;
+    if (!_cfg.getBool("use_gpu", use_gpu)) {
+        LOG_WRN("Warning! Using default value for use_gpu (%d).", use_gpu);
+        _cfg.add("use_gpu", use_gpu ? "y" : "n");
+    }
+
+    /// Intra-frame parallel scoring.
+    const int hw_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    if (team_threads > hw_threads) {
+        LOG_WRN("Warning! opt_team_threads (%d) exceeds the number of hardware threads - using %d.", team_threads, hw_threads);
+        team_threads = hw_threads;
+    }
+    if (team_threads > 1) {
+        int team_spin = (spin_wait_us < 0) ? -1 : std::max(spin_wait_us, OPT_TEAM_SPIN_US);
+        _team = make_unique<ThreadTeam>(team_threads, cpus_team, team_spin);
+        if (static_cast<int>(_roi_pix->size()) < OPT_TEAM_MIN_PIX) {
+            LOG_WRN("Warning! Only %d ROI pixels - too few to split across the team (opt_team_threads), increase q_factor.", static_cast<int>(_roi_pix->size()));
+        }
+    }
 
     /// Init optimisers.
     _localOpt = make_unique<Localiser>(
-        NLOPT_LN_BOBYQA, bound, tol, max_evals,
+        opt_grad ? NLOPT_LD_LBFGS : NLOPT_LN_BOBYQA, bound, tol, max_evals,
         _sphere_model, _sphere_map,
-        _roi_mask, _p1s_lut);
-
-    _globalOpt = make_unique<Localiser>(
-        NLOPT_GN_CRS2_LM, CM_PI, tol, 1e5,
-        _sphere_model, _sphere_map,
-        _roi_mask, _p1s_lut);
+        _roi_pix, _roi_w, _roi_h, pyr_levels, _sphere_tiles.get());
+    if (early_exit) {
+        _localOpt->setEarlyExit(OPT_EARLY_EXIT_MARGIN);
+    }
+    _localOpt->setTeam(_team.get(), OPT_TEAM_MIN_PIX);
+
+    if (_do_global_search || _global_first) {
+        if (global_grid) {
+            _globalGrid = make_unique<GlobalLocaliser>(
+                OPT_GLOBAL_GRID_STEP_DEFAULT, tol, max_evals,
+                _sphere_model, _sphere_map,
+                _roi_pix, global_threads, _pool, _sphere_tiles.get(), use_gpu);
+        } else {
+            _globalOpt = make_unique<Localiser>(
+                NLOPT_GN_CRS2_LM, CM_PI, tol, 1e5,
+                _sphere_model, _sphere_map,
+                _roi_pix, 0, 0, 0, _sphere_tiles.get());
+            _globalOpt->setTeam(_team.get(), OPT_TEAM_MIN_PIX);
+        }
+    }
+    numa_scope.reset();
+
+    /// Quality governor.
+    _opt_max_evals = max_evals;
+    _opt_early_exit = early_exit;
+    _opt_grad = opt_grad;
+    bool quality_gov = QUALITY_GOV_DEFAULT;
+    if (!_cfg.getBool("quality_gov", quality_gov)) {
+        LOG_WRN("Warning! Using default value for quality_gov (%d).", quality_gov);
+        _cfg.add("quality_gov", quality_gov ? "y" : "n");
+    }
+    if (quality_gov && _batch) {
+        LOG_WRN("Warning! Quality governor (quality_gov) is not used in batch mode.");
+    } else if (quality_gov) {
+        const double fps = source_fps;
+        _governor = make_unique<QualityGovernor>((fps > 0) ? (1000 / fps) : -1);
+    }
+
+    /// Output formats (csv or bin).
+    auto getOutFmt = [&](const string& key) {
+        string fmt = OUT_FMT_DEFAULT;
+        if (!_cfg.getStr(key, fmt) || ((fmt != "csv") && (fmt != "bin"))) {
+            fmt = OUT_FMT_DEFAULT;
+            LOG_WRN("Warning! Using default value for %s (%s).", key.c_str(), fmt.c_str());
+            _cfg.add(key, fmt);
+        }
+        return fmt == "bin";
+    };
+    /// The data log can also be columnar (binary records, encoded on the writer thread).
+    string data_fmt = OUT_FMT_DEFAULT;
+    if (!_cfg.getStr("data_fmt", data_fmt) || ((data_fmt != "csv") && (data_fmt != "bin") && (data_fmt != "col"))) {
+        data_fmt = OUT_FMT_DEFAULT;
+        LOG_WRN("Warning! Using default value for data_fmt (%s).", data_fmt.c_str());
+        _cfg.add("data_fmt", data_fmt);
+    }
+    _bin_log = (data_fmt != "csv");
+    _bin_sock = getOutFmt("sock_fmt");
+    string com_fmt = OUT_FMT_DEFAULT;
+    if (!_cfg.getStr("com_fmt", com_fmt) || ((com_fmt != "csv") && (com_fmt != "bin") && (com_fmt != "compact"))) {
+        com_fmt = OUT_FMT_DEFAULT;
+        LOG_WRN("Warning! Using default value for com_fmt (%s).", com_fmt.c_str());
+        _cfg.add("com_fmt", com_fmt);
+    }
+    _bin_com = (com_fmt == "bin");
+    _compact_com = (com_fmt == "compact");
+
+    /// Data file and serial outputs are batched (socket output preserves datagram boundaries).
+    int data_flush_ms = DATA_FLUSH_MS_DEFAULT;
+    if (!_cfg.getInt("data_flush_ms", data_flush_ms) || (data_flush_ms < 0)) {
+        data_flush_ms = DATA_FLUSH_MS_DEFAULT;
+        LOG_WRN("Warning! Using default value for data_flush_ms (%d).", data_flush_ms);
+        _cfg.add("data_flush_ms", data_flush_ms);
+    }
+    int data_flush_kb = DATA_FLUSH_KB_DEFAULT;
+    if (!_cfg.getInt("data_flush_kb", data_flush_kb) || (data_flush_kb <= 0) || (data_flush_kb * 1024 > DATA_RING_SIZE)) {
+        data_flush_kb = DATA_FLUSH_KB_DEFAULT;
+        LOG_WRN("Warning! Using default value for data_flush_kb (%d).", data_flush_kb);
+        _cfg.add("data_flush_kb", data_flush_kb);
+    }
+    Recorder::Batching data_batch(DATA_RING_SIZE, data_flush_kb * 1024, data_flush_ms);
 
     /// Output.
-    string data_fn = _base_fn + "-" + exec_time + ".dat";
-    _data_log = make_unique<Recorder>(RecorderInterface::RecordType::FILE, data_fn);
+    const bool col_log = (data_fmt == "col");
+    string data_fn = _base_fn + "-" + exec_time + (col_log ? ".ftc" : (_bin_log ? ".bin" : ".dat"));
+    _data_log = make_unique<Recorder>(col_log ? RecorderInterface::RecordType::COLS : RecorderInterface::RecordType::FILE,
+        data_fn, _bin_log, data_batch);
     if (!_data_log->is_active()) {
         LOG_ERR("Error! Unable to open output data log file (%s).", data_fn.c_str());
         _active = false;
@@ -408,12 +1103,57 @@ Trackball::Trackball(string cfg_fn)
             _cfg.add("sock_host", sock_host);
         }
 
-        _data_sock = make_unique<Recorder>(RecorderInterface::RecordType::SOCK, sock_host + ":" + std::to_string(sock_port));
+        string sock_proto = SOCK_PROTO_DEFAULT;
+        if (!_cfg.getStr("sock_proto", sock_proto) || ((sock_proto != "udp") && (sock_proto != "tcp"))) {
+            sock_proto = SOCK_PROTO_DEFAULT;
+            LOG_WRN("Warning! Using default value for sock_proto (%s).", sock_proto.c_str());
+            _cfg.add("sock_proto", sock_proto);
+        }
+        const bool sock_tcp = (sock_proto == "tcp");
+
+        /// TCP send queue and back-pressure policy (per client).
+        int sock_queue = SOCK_QUEUE_DEFAULT;
+        string sock_policy = SOCK_POLICY_DEFAULT;
+        if (sock_tcp) {
+            if (!_cfg.getInt("sock_queue", sock_queue) || (sock_queue <= 0)) {
+                sock_queue = SOCK_QUEUE_DEFAULT;
+                LOG_WRN("Warning! Using default value for sock_queue (%d).", sock_queue);
+                _cfg.add("sock_queue", sock_queue);
+            }
+            if (!_cfg.getStr("sock_policy", sock_policy) || ((sock_policy != "drop") && (sock_policy != "block"))) {
+                sock_policy = SOCK_POLICY_DEFAULT;
+                LOG_WRN("Warning! Using default value for sock_policy (%s).", sock_policy.c_str());
+                _cfg.add("sock_policy", sock_policy);
+            }
+        }
+
+        /// Comma separated destinations, sock_port unless given as host:port.
+        string sock_dests;
+        {
+            istringstream ss(sock_host);
+            string host;
+            while (getline(ss, host, ',')) {
+                host.erase(0, host.find_first_not_of(" \t"));
+                host.erase(host.find_last_not_of(" \t") + 1);
+                if (host.empty()) { continue; }
+                if (!sock_dests.empty()) { sock_dests += ","; }
+                sock_dests += (host.find(':') == string::npos) ? host + ":" + std::to_string(sock_port) : host;
+            }
+        }
+
+        if (sock_tcp) {
+            // listen on the first address only
+            sock_dests = sock_dests.substr(0, sock_dests.find_first_of(',')) + "@" + std::to_string(sock_queue) + ":" + sock_policy;
+            _data_sock = make_unique<Recorder>(RecorderInterface::RecordType::TCP, sock_dests, false, Recorder::Batching(), spin_wait_us);
+        } else {
+            _data_sock = make_unique<Recorder>(RecorderInterface::RecordType::SOCK, sock_dests, false, Recorder::Batching(), spin_wait_us);
+        }
         if (!_data_sock->is_active()) {
             LOG_ERR("Error! Unable to open output data socket (%s:%d).", sock_host.c_str() ,sock_port);
             _active = false;
             return;
         }
+        _data_sock->setLatencyHist(_hist[ST_CAM_SOCK].get(), _hist_int[ST_CAM_SOCK].get());
         _do_sock_output = true;
     }
 
@@ -426,7 +1166,36 @@ Trackball::Trackball(string cfg_fn)
             _cfg.add("com_baud", com_baud);
         }
 
-        _data_com = make_unique<Recorder>(RecorderInterface::RecordType::COM, com_port + "@" + std::to_string(com_baud));
+        /// Compact frames carry a subset of fields (see CompactRecord.h).
+        if (_compact_com) {
+            string bad;
+            _com_fields = compact::parseFields(_cfg("com_fields"), bad);
+            if (!bad.empty()) {
+                LOG_WRN("Warning! Ignoring unknown com_fields (%s).", bad.c_str());
+            }
+            if (_com_fields == 0) {
+                _com_fields = compact::FIELDS_DEFAULT;
+                string fields;
+                for (int i = 0; i < compact::NUM_FIELDS; i++) {
+                    if (_com_fields & (1 << i)) { fields += (fields.empty() ? "" : ", ") + string(compact::fieldName(i)); }
+                }
+                LOG_WRN("Warning! Using default value for com_fields (%s).", fields.c_str());
+                _cfg.add("com_fields", fields);
+            }
+            LOG("Serial output frames are %d bytes.", static_cast<int>(compact::frameSize(_com_fields)));
+        }
+
+        /// Decimation.
+        double com_rate = COM_RATE_DEFAULT;
+        if (!_cfg.getDbl("com_rate", com_rate) || (com_rate < 0)) {
+            com_rate = COM_RATE_DEFAULT;
+            LOG_WRN("Warning! Using default value for com_rate (%f).", com_rate);
+            _cfg.add("com_rate", com_rate);
+        }
+        _com_period = (com_rate > 0) ? (1000 / com_rate) : 0;
+
+        // one msg per record, so that the port only ever sends the newest record (see SerialRecorder)
+        _data_com = make_unique<Recorder>(RecorderInterface::RecordType::COM, com_port + "@" + std::to_string(com_baud), false, Recorder::Batching());
         if (!_data_com->is_active()) {
             LOG_ERR("Error! Unable to open output data com port (%s@%d).", com_port.c_str(), com_baud);
             _active = false;
@@ -435,6 +1204,46 @@ Trackball::Trackball(string cfg_fn)
         _do_com_output = true;
     }
 
+    /// Recent state history (getStateRing, and the shm ring length).
+    int state_ring_len = STATE_RING_LEN_DEFAULT;
+    if (!_cfg.getInt("state_ring_len", state_ring_len) || (state_ring_len < 0)) {
+        state_ring_len = STATE_RING_LEN_DEFAULT;
+        LOG_WRN("Warning! Using default value for state_ring_len (%d).", state_ring_len);
+        _cfg.add("state_ring_len", state_ring_len);
+    }
+    if (state_ring_len > 0) {
+        _state_ring = make_unique<StateRing>(state_ring_len);
+    }
+
+    string shm_name = SHM_NAME_DEFAULT;
+    if (!_cfg.getStr("shm_name", shm_name)) {
+        LOG_WRN("Warning! Using default value for shm_name (%s).", shm_name.c_str());
+        _cfg.add("shm_name", shm_name);
+    }
+    _do_shm_output = false;
+    if (shm_name.length() > 0) {
+        _data_shm = make_unique<Recorder>(RecorderInterface::RecordType::SHM,
+            (state_ring_len > 0) ? shm_name + "@" + to_string(state_ring_len) : shm_name);
+        if (!_data_shm->is_active()) {
+            LOG_ERR("Error! Unable to open output data shared memory (%s).", shm_name.c_str());
+            _active = false;
+            return;
+        }
+        _do_shm_output = true;
+    }
+
+    /// Instrumentation.
+    if (!_cfg.getDbl("stats_period", _stats_period) || (_stats_period < 0)) {
+        _stats_period = STATS_PERIOD_DEFAULT;
+        LOG_WRN("Warning! Using default value for stats_period (%f).", _stats_period);
+        _cfg.add("stats_period", _stats_period);
+    }
+    if (!_cfg.getBool("stats_sock", _stats_sock)) {
+        _stats_sock = STATS_SOCK_DEFAULT;
+        LOG_WRN("Warning! Using default value for stats_sock (%d).", _stats_sock);
+        _cfg.add("stats_sock", _stats_sock ? "y" : "n");
+    }
+
     /// Display.
     _do_display = DO_DISPLAY_DEFAULT;
     if (!_cfg.getBool("do_display", _do_display)) {
@@ -442,7 +1251,7 @@ Trackball::Trackball(string cfg_fn)
         _cfg.add("do_display", _do_display ? "y" : "n");
     }
     _save_raw = SAVE_RAW_DEFAULT;
-    if (!source->isLive() || !_cfg.getBool("save_raw", _save_raw)) {
+    if (!_live_src || !_cfg.getBool("save_raw", _save_raw)) {
         LOG_WRN("Warning! Using default value for save_raw (%d).", _save_raw);
         _cfg.add("save_raw", _save_raw ? "y" : "n");
     }
@@ -455,12 +1264,26 @@ Trackball::Trackball(string cfg_fn)
         LOG("Forcing do_display = true, becase save_debug == true.");
         _do_display = true;
     }
+    if (_batch && (_do_display || _save_debug)) {
+        LOG("Disabling do_display and save_debug in batch mode.");
+        _do_display = _save_debug = false;
+    }
     if (_do_display) {
         _sphere_view.create(_map_h, _map_w, CV_8UC1);
         _sphere_view.setTo(Scalar::all(128));
+
+        double disp_fps = DISP_FPS_DEFAULT;
+        if (!_cfg.getDbl("disp_fps", disp_fps) || (disp_fps < 0)) {
+            disp_fps = DISP_FPS_DEFAULT;
+            LOG_WRN("Warning! Using default value for disp_fps (%f).", disp_fps);
+            _cfg.add("disp_fps", disp_fps);
+        }
+        _disp_period = (disp_fps > 0) ? 1000 / disp_fps : 0;
     }
 
     // do video stuff
+    string raw_vid_fn, dbg_vid_fn;
+    TaskGraph::Task raw_vid_task = -1, dbg_vid_task = -1;
     if (_save_raw || _save_debug) {
         // find codec
         int fourcc = 0;
@@ -484,18 +1307,52 @@ Trackball::Trackball(string cfg_fn)
             LOG_WRN("Warning! Using default value for vid_codec (%s).", cstr.c_str());
             _cfg.add("vid_codec", cstr);
         }
+        int vid_threads = VID_THREADS_DEFAULT;
+        if (!_cfg.getInt("vid_threads", vid_threads) || (vid_threads < 0)) {
+            vid_threads = VID_THREADS_DEFAULT;
+            LOG_WRN("Warning! Using default value for vid_threads (%d).", vid_threads);
+            _cfg.add("vid_threads", vid_threads);
+        }
+        bool vid_hw_encode = VID_HW_ENCODE_DEFAULT;
+        if (!_cfg.getBool("vid_hw_encode", vid_hw_encode)) {
+            LOG_WRN("Warning! Using default value for vid_hw_encode (%d).", vid_hw_encode);
+            _cfg.add("vid_hw_encode", vid_hw_encode ? "y" : "n");
+        }
 
-        // raw input video
+        // raw input video (frames are dropped rather than holding up tracking)
         if (_save_raw) {
-            string vid_fn = _base_fn + "-raw-" + exec_time + "." + fext;
-            double fps = source->getFPS();
+            bool raw_dump = RAW_DUMP_DEFAULT;
+            if (!_cfg.getBool("raw_dump", raw_dump)) {
+                LOG_WRN("Warning! Using default value for raw_dump (%d).", raw_dump);
+                _cfg.add("raw_dump", raw_dump ? "y" : "n");
+            }
+
+            double fps = source_fps;
             if (fps <= 0) {
                 fps = (src_fps > 0) ? src_fps : 25;   // if we can't get fps from source, then use fps from config or - if not specified - default to 25 fps.
             }
-            LOG_DBG("Opening %s for video writing (%s %dx%d @ %f FPS)", vid_fn.c_str(), cstr.c_str(), source->getWidth(), source->getHeight(), fps);
-            _raw_vid.open(vid_fn, fourcc, fps, cv::Size(source->getWidth(), source->getHeight()));
-            if (!_raw_vid.isOpened()) {
-                LOG_ERR("Error! Unable to open raw output video (%s).", vid_fn.c_str());
+            _raw_vid = make_unique<VideoEncoder>(RAW_VID_QUEUE_LEN);
+            const cv::Size sz(source_w, source_h);
+            if (raw_dump) {
+                raw_vid_fn = _base_fn + "-raw-" + exec_time + ".ftrd";
+                LOG_DBG("Opening %s for frame dump (Mono8 %dx%d @ %f FPS)", raw_vid_fn.c_str(), sz.width, sz.height, fps);
+            } else {
+                raw_vid_fn = _base_fn + "-raw-" + exec_time + "." + fext;
+                LOG_DBG("Opening %s for video writing (%s %dx%d @ %f FPS)", raw_vid_fn.c_str(), cstr.c_str(), sz.width, sz.height, fps);
+            }
+
+            /// Encoder setup (codec probing, hardware context) runs in the background.
+            VideoEncoder* vid = _raw_vid.get();
+            const string vid_fn = raw_vid_fn;
+            raw_vid_task = startup.add("raw video", [vid, vid_fn, raw_dump, fourcc, fps, sz, vid_threads, vid_hw_encode]() {
+                return raw_dump ? vid->openDump(vid_fn, fps, sz) : vid->open(vid_fn, fourcc, fps, sz, true, vid_threads, vid_hw_encode);
+            });
+
+            // log lines corresponding to raw video frames
+            string fn = _base_fn + "-rawLogFrames-" + exec_time + ".txt";
+            _raw_frames = make_unique<Recorder>(RecorderInterface::RecordType::FILE, fn);
+            if (!_raw_frames->is_active()) {
+                LOG_ERR("Error! Unable to open raw video frame number log file (%s).", fn.c_str());
                 _active = false;
                 return;
             }
@@ -503,28 +1360,60 @@ Trackball::Trackball(string cfg_fn)
 
         // debug output video
         if (_save_debug) {
-            string vid_fn = _base_fn + "-dbg-" + exec_time + "." + fext;
-            double fps = source->getFPS();
+            dbg_vid_fn = _base_fn + "-dbg-" + exec_time + "." + fext;
+            double fps = source_fps;
             if (fps <= 0) {
                 fps = (src_fps > 0) ? src_fps : 25;   // if we can't get fps from source, then use fps from config or - if not specified - default to 25 fps.
             }
-            LOG_DBG("Opening %s for video writing (%s %dx%d @ %f FPS)", vid_fn.c_str(), cstr.c_str(), 4 * DRAW_CELL_DIM, 3 * DRAW_CELL_DIM, fps);
-            _debug_vid.open(vid_fn, fourcc, fps, cv::Size(4 * DRAW_CELL_DIM, 3 * DRAW_CELL_DIM));
-            if (!_debug_vid.isOpened()) {
-                LOG_ERR("Error! Unable to open debug output video (%s).", vid_fn.c_str());
+            LOG_DBG("Opening %s for video writing (%s %dx%d @ %f FPS)", dbg_vid_fn.c_str(), cstr.c_str(), 4 * DRAW_CELL_DIM, 3 * DRAW_CELL_DIM, fps);
+            _debug_vid = make_unique<VideoEncoder>(DEBUG_VID_QUEUE_LEN);
+            VideoEncoder* vid = _debug_vid.get();
+            const string vid_fn = dbg_vid_fn;
+            dbg_vid_task = startup.add("debug video", [vid, vid_fn, fourcc, fps, vid_threads, vid_hw_encode]() {
+                return vid->open(vid_fn, fourcc, fps, cv::Size(4 * DRAW_CELL_DIM, 3 * DRAW_CELL_DIM), true, vid_threads, vid_hw_encode);
+            });
+
+            // create output file containing log lines corresponding to video frames, for synching video output
+            string fn = _base_fn + "-vidLogFrames-" + exec_time + ".txt";
+            _vid_frames = make_unique<Recorder>(RecorderInterface::RecordType::FILE, fn);
+            if (!_vid_frames->is_active()) {
+                LOG_ERR("Error! Unable to open output video frame number log file (%s).", fn.c_str());
                 _active = false;
                 return;
             }
         }
+    }
 
-        // create output file containing log lines corresponding to video frames, for synching video output
-        string fn = _base_fn + "-vidLogFrames-" + exec_time + ".txt";
-        _vid_frames = make_unique<Recorder>(RecorderInterface::RecordType::FILE, fn);
-        if (!_vid_frames->is_active()) {
-            LOG_ERR("Error! Unable to open output video frame number log file (%s).", fn.c_str());
-            _active = false;
-            return;
-        }
+    /// Closed-loop exposure from the sphere ROI (live cameras only).
+    double ae_target = AE_TARGET_DEFAULT;
+    if (!_cfg.getDbl("ae_target", ae_target) || (ae_target > 255)) {
+        ae_target = AE_TARGET_DEFAULT;
+        LOG_WRN("Warning! Using default value for ae_target (%f).", ae_target);
+        _cfg.add("ae_target", ae_target);
+    }
+    double ae_period_ms = AE_PERIOD_MS_DEFAULT;
+    if (!_cfg.getDbl("ae_period_ms", ae_period_ms) || (ae_period_ms <= 0)) {
+        ae_period_ms = AE_PERIOD_MS_DEFAULT;
+        LOG_WRN("Warning! Using default value for ae_period_ms (%f).", ae_period_ms);
+        _cfg.add("ae_period_ms", ae_period_ms);
+    }
+    /// Background steps the grabber and outputs depend on.
+    if ((raw_vid_task >= 0) && !startup.wait(raw_vid_task)) {
+        LOG_ERR("Error! Unable to open raw output video (%s).", raw_vid_fn.c_str());
+        _active = false;
+        return;
+    }
+    if ((dbg_vid_task >= 0) && !startup.wait(dbg_vid_task)) {
+        LOG_ERR("Error! Unable to open debug output video (%s).", dbg_vid_fn.c_str());
+        _active = false;
+        return;
+    }
+    startup.wait(warm_up);
+
+    shared_ptr<ExposureControl> exposure;
+    if ((ae_target > 0) && _live_src) {
+        exposure = make_shared<ExposureControl>(source, ae_target, ae_period_ms);
+        if (!exposure->isActive()) { exposure.reset(); }
     }
 
     /// Frame source.
@@ -534,11 +1423,51 @@ Trackball::Trackball(string cfg_fn)
         _roi_mask,
         thresh_ratio,
         thresh_win_pc,
-        _cfg("thr_rgb_tfrm")
+        _cfg("thr_rgb_tfrm"),
+        _batch ? BATCH_QUEUE_LEN : 1,   // batch mode decodes ahead; tracking still sees every frame in order
+        frame_count,
+        _do_display || _save_raw || _callback_frames,   // source frames are only used for display, raw video and the output callback
+        spin_wait_us,
+        fused_prep,
+        use_gpu,
+        _save_raw ? RAW_VID_QUEUE_LEN : 0,  // frames queued for raw video still come from the pool
+        exposure
     );
+    for (auto& cam : _aux) {
+        cam->grabber = make_unique<FrameGrabber>(
+            cam->source,
+            cam->remapper,
+            cam->roi_mask,
+            thresh_ratio,
+            thresh_win_pc,
+            _cfg("thr_rgb_tfrm"),
+            _batch ? BATCH_QUEUE_LEN : 1,
+            frame_count,
+            false,      // aux source frames aren't displayed or recorded
+            spin_wait_us,
+            fused_prep,
+            use_gpu,
+            0,
+            nullptr
+        );
+    }
 
     /// Write all parameters back to config file.
-    _cfg.write();
+    if (_cfg_fn.empty()) {
+        if (_cfg_reload) {
+            LOG_WRN("Warning! Parameter reloading (cfg_reload) requires a config file - ignoring.");
+            _cfg_reload = false;
+        }
+    }
+    else {
+        /// Config is no longer modified from here - write it while the remaining state is set up.
+        startup.add("config write", [this]() { _cfg.write(); return true; });
+    }
+
+    /// Output stage works on its own copy of the sphere map.
+    if (_do_pipeline) {
+        _sphere_map_work = _sphere_map.clone();
+    }
 
     /// Data.
     reset();
@@ -546,17 +1475,46 @@ Trackball::Trackball(string cfg_fn)
     // not reset in resetData because they are not affected by heading reset
     _data.cnt = 0;
     _data.intx = _data.inty = 0;
+    _pipe_data = _data;
     _err = 0;
 
+    /// Checkpoints are keyed to the map size and ROI geometry (all cameras).
+    if (_ckpt_period > 0) {
+        _ckpt_key = sidecar::hash(&_map_w, sizeof(_map_w));
+        _ckpt_key = sidecar::hash(&_map_h, sizeof(_map_h), _ckpt_key);
+        for (const auto& p : *_roi_pix) {
+            const double v[3] = { p.v[0], p.v[1], p.v[2] };
+            _ckpt_key = sidecar::hash(&p.idx, sizeof(p.idx), _ckpt_key);
+            _ckpt_key = sidecar::hash(v, sizeof(v), _ckpt_key);
+        }
+        if (ckpt_resume) {
+            loadCheckpoint();
+        }
+    }
+
+    /// Remaining background steps (ROI cache, config) finish before tracking starts.
+    startup.waitAll();
+    if (_cfg_reload) {
+        std::error_code ec;
+        _cfg_mtime = std::filesystem::last_write_time(_cfg_fn, ec);
+        LOG("Watching %s for parameter changes.", _cfg_fn.c_str());
+    }
+
     /// Thread stuff.
     _init = true;
     _active = true;
 
     if (_do_display) {
-        _drawThread = make_unique<std::thread>(&Trackball::processDrawQ, this);
+        _drawThread = StartThread(&Trackball::processDrawQ, this);
+    }
+    if (_do_pipeline) {
+        _pipeThread = StartThread(&Trackball::processPipe, this);
+    }
+    if (_ckpt_period > 0) {
+        _ckptThread = StartThread(&Trackball::processCheckpoints, this);
     }
     // main processing thread
-    _thread = make_unique<std::thread>(&Trackball::process, this);
+    _thread = StartThread(&Trackball::process, this);
 }
 
 ///
@@ -574,21 +1532,298 @@ Trackball::~Trackball()
     }
 
     if (_do_display && _drawThread && _drawThread->joinable()) {
+        {
+            lock_guard<mutex> l(_drawMutex);
+            _drawCond.notify_all();
+        }
         _drawThread->join();
     }
+
+    /// Finish writing the last checkpoint.
+    if (_ckptThread && _ckptThread->joinable()) {
+        {
+            lock_guard<mutex> l(_ckptMutex);
+            _ckptStop = true;
+        }
+        _ckptCond.notify_all();
+        _ckptThread->join();
+    }
+
+    /// Encode remaining video frames.
+    _debug_vid.reset();
+    _raw_vid.reset();
+}
+
+///
+/// Source settings (src_fps, frame_start, src_grey, ...) are shared with the main camera,
+/// geometry (src_fn, vfov, fisheye, roi_*, c2a_r) is read from the aux camera's config file.
+///
+bool Trackball::initAuxCamera(const string& cfg_fn, int slot, const CmPoint64f& roi_to_cam_r, AuxCamera& cam)
+{
+    ConfigParser cfg;
+    if (cfg.read(cfg_fn) <= 0) {
+        LOG_ERR("Error! Unable to read auxiliary camera config file (%s)!", cfg_fn.c_str());
+        return false;
+    }
+    cam.cfg_fn = cfg_fn;
+    cam.ts = cam.ms = -1;
+    cam.pending = false;
+    cam.npix = 0;
+
+    /// Frame source.
+    bool hw_decode = SRC_HW_DECODE_DEFAULT, grey = SRC_GREY_DEFAULT, native = SRC_NATIVE_DEFAULT;
+    int bufs = SRC_BUFS_DEFAULT;
+    _cfg.getBool("src_hw_decode", hw_decode);
+    _cfg.getBool("src_grey", grey);
+    _cfg.getBool("src_native", native);
+    _cfg.getInt("src_bufs", bufs);
+    const string src_fn = cfg("src_fn");
+    cam.source = openSource(src_fn, hw_decode, grey, native, bufs);
+    if (!cam.source->isOpen()) {
+        LOG_ERR("Error! Could not open auxiliary camera frame source (%s)!", src_fn.c_str());
+        return false;
+    }
+    if (cam.source->isLive() != _live_src) {
+        LOG_ERR("Error! Auxiliary camera sources must all be live or all recorded, like the main source (%s).", src_fn.c_str());
+        return false;
+    }
+    double src_fps = -1;
+    if (_cfg.getDbl("src_fps", src_fps) && (src_fps > 0)) {
+        cam.source->setFPS(src_fps);
+    }
+    int frame_start = FRAME_START_DEFAULT;
+    _cfg.getInt("frame_start", frame_start);
+    if (!cam.source->setStartFrame(frame_start)) {
+        LOG_ERR("Error! Unable to start auxiliary camera source at frame %d (frame_start).", frame_start);
+        return false;
+    }
+    const int w = cam.source->getWidth(), h = cam.source->getHeight();
+
+    /// Source camera model.
+    double vfov = -1;
+    if (!cfg.getDbl("vfov", vfov) || (vfov <= 0)) {
+        LOG_ERR("Error! Camera vertical FoV parameter specified in auxiliary camera config file (%s: vfov) is invalid!", cfg_fn.c_str());
+        return false;
+    }
+    bool fisheye = false;
+    if (cfg.getBool("fisheye", fisheye) && fisheye) {
+        cam.src_model = CameraModel::createFisheye(w, h, vfov * CM_D2R / (double)h, 360 * CM_D2R);
+    }
+    else {
+        cam.src_model = CameraModel::createRectilinear(w, h, vfov * CM_D2R);
+    }
+
+    /// Sphere ROI.
+    CmPoint64f sphere_c;
+    double sphere_rad = -1;
+    vector<double> c;
+    vector<int> circ_pxs;
+    if (cfg.getVecDbl("roi_c", c) && (c.size() == 3) && cfg.getDbl("roi_r", sphere_rad)) {
+        sphere_c.copy(c.data());
+    }
+    else if (cfg.getVecInt("roi_circ", circ_pxs)) {
+        vector<Point2d> circ_pts;
+        for (unsigned int i = 1; i < circ_pxs.size(); i += 2) {
+            circ_pts.push_back(Point2d(circ_pxs[i - 1], circ_pxs[i]));
+        }
+        if ((circ_pts.size() < 3) || !circleFit_camModel(circ_pts, cam.src_model, sphere_c, sphere_rad)) {
+            sphere_rad = -1;
+        }
+    }
+    if (sphere_rad <= 0) {
+        LOG_ERR("Error! Sphere ROI configuration specified in auxiliary camera config file (%s: roi_circ, roi_c, roi_r) is invalid!", cfg_fn.c_str());
+        return false;
+    }
+
+    /// Sphere mask, less ignore regions.
+    Mat src_mask(h, w, CV_8UC1, Scalar::all(0));
+    auto int_circ = projCircleInt(cam.src_model, sphere_c, sphere_rad * 0.975f);
+    cv::fillConvexPoly(src_mask, *int_circ, CV_RGB(255, 255, 255));
+    vector<vector<int>> ignr_polys;
+    if (cfg.getVVecInt("roi_ignr", ignr_polys) && (ignr_polys.size() > 0)) {
+        vector<vector<Point2i>> ignr_polys_pts;
+        for (auto poly : ignr_polys) {
+            ignr_polys_pts.push_back(vector<Point2i>());
+            for (unsigned int i = 1; i < poly.size(); i += 2) {
+                ignr_polys_pts.back().push_back(Point2i(poly[i - 1], poly[i]));
+            }
+        }
+        cv::fillPoly(src_mask, ignr_polys_pts, CV_RGB(0, 0, 0));
+    }
+
+    /// View vectors are rotated from this camera's ROI frame into the main camera's ROI
+    /// frame: aux ROI -> aux camera (as applied by the remapper) -> lab -> main camera -> main ROI.
+    vector<double> c2a_r;
+    if (!cfg.getVecDbl("c2a_r", c2a_r) || (c2a_r.size() != 3)) {
+        LOG_ERR("Error! Camera-to-lab coordinate tranformation specified in auxiliary camera config file (%s: c2a_r) is invalid!", cfg_fn.c_str());
+        return false;
+    }
+    const CmPoint64f aux_roi_to_cam_r = sphere_c.getRotationTo(CmPoint64f(0, 0, 1));
+    const CmMat33d aux_to_main = CmMat33d::fromOmegaSmall(roi_to_cam_r) * _cam_to_lab.t()
+        * CmMat33d::fromOmegaSmall(CmPoint64f(c2a_r[0], c2a_r[1], c2a_r[2])) * CmMat33d::fromOmegaSmall(aux_roi_to_cam_r).t();
+
+    /// Remap (ROI) model and remapper, at the main camera's ROI resolution.
+    cam.roi_model = CameraModel::createFisheye(_roi_w, _roi_h, sphere_rad * 2.0 / _roi_w, sphere_rad * 2.0);
+    cam.remapper = CameraRemapPtr(new CameraRemap(cam.src_model, cam.roi_model, MatrixRemapTransform::createFromOmega(-aux_roi_to_cam_r)));
+    cam.roi_mask.create(_roi_h, _roi_w, CV_8UC1);
+    cam.roi_mask.setTo(cv::Scalar::all(255));
+    cam.remapper->apply(src_mask, cam.roi_mask);
+
+    /// View rays for valid ROI pixels, indexed into this camera's slot of the stacked ROI frame.
+    const double r_d_ratio = sin(sphere_rad);
+    const int offset = slot * _roi_w * _roi_h;
+    for (int i = 0; i < _roi_h; i++) {
+        uint8_t* pmask = cam.roi_mask.ptr(i);
+        for (int j = 0; j < _roi_w; j++) {
+            if (pmask[j] < 255) { continue; }
+
+            double l[3] = { 0, 0, 0 };
+            cam.roi_model->pixelIndexToVector(j, i, l);
+            vec3normalise(l);
+
+            double s[3] = { 0, 0, 0 };
+            if (!intersectSphere(r_d_ratio, l, s)) { pmask[j] = 128; continue; }
+
+            RoiPixel p;
+            p.idx = offset + i * _roi_w + j;
+            p.v.copy(s);
+            p.v.normalise();
+            p.v = p.v.getTransformed(aux_to_main.data());
+            _roi_pix->push_back(p);
+            cam.npix++;
+        }
+    }
+
+    LOG("Auxiliary camera %d (%s): %d ROI pixels.", slot, src_fn.c_str(), cam.npix);
+    return true;
+}
+
+///
+/// Pair each aux camera's frame with the main camera's frame by timestamp (within
+/// _aux_sync_ms) and stack all ROIs into _roi_frame. Older aux frames are dropped.
+/// If an aux camera is already ahead, matched is false and the main frame should be
+/// skipped (the aux frame is kept for the next main frame). False if a stream ended.
+///
+bool Trackball::grabAux(bool& matched)
+{
+    const int n = static_cast<int>(_aux.size());
+    matched = true;
+    for (int i = 0; i < n; i++) {
+        AuxCamera& cam = *_aux[i];
+        while (!cam.pending || (cam.ts < _data.ts - _aux_sync_ms)) {
+            if (cam.pending) {
+                LOG_DBG("Dropping auxiliary camera %d frame (%.1f ms behind).", i + 1, _data.ts - cam.ts);
+            }
+            if (!cam.grabber->getNextFrameSet(cam.src_frame, cam.roi_frame, cam.ts, cam.ms)) {
+                LOG_DBG("Auxiliary camera stream ended (%s).", cam.cfg_fn.c_str());
+                return false;
+            }
+            cam.pending = true;
+        }
+        if (cam.ts > _data.ts + _aux_sync_ms) { matched = false; }
+    }
+    if (!matched) {
+        LOG_DBG("Skipping frame %d - no matching auxiliary camera frame.", _data.cnt);
+        return true;
+    }
+
+    /// Previous stacked frame may still be held by the output stage or drawing thread.
+    if ((_roi_joint.rows != (n + 1) * _roi_h) || (_roi_joint.cols != _roi_w) || (_roi_joint.u && (_roi_joint.u->refcount > 1))) {
+        _roi_joint.release();
+        _roi_joint.create((n + 1) * _roi_h, _roi_w, CV_8UC1);
+    }
+    _roi_frame.copyTo(_roi_joint.rowRange(0, _roi_h));
+    for (int i = 0; i < n; i++) {
+        _aux[i]->roi_frame.copyTo(_roi_joint.rowRange((i + 1) * _roi_h, (i + 2) * _roi_h));
+        _aux[i]->pending = false;
+        LOG_DBG("Auxiliary camera %d frame skew: %.1f ms.", i + 1, _aux[i]->ts - _data.ts);
+    }
+    _roi_frame = _roi_joint;
+    return true;
 }
 
 ///
 ///
 ///
-void Trackball::resetData()
+void Trackball::resetData(DATA& data)
 {
     DATA new_data;
-    new_data.cnt = _data.cnt;       // preserve cnt across resets (but reset seq)
-    new_data.intx = _data.intx;     // can preserve intx/y because they're not affected by heading reset
-    new_data.inty = _data.inty;
+    new_data.cnt = data.cnt;        // preserve cnt across resets (but reset seq)
+    new_data.intx = data.intx;      // can preserve intx/y because they're not affected by heading reset
+    new_data.inty = data.inty;
+
+    data = new_data;
+}
+
+///
+/// Tracking thread only.
+///
+void Trackball::checkReload(double ts)
+{
+    if ((ts - _cfg_check_ts) < CFG_RELOAD_PERIOD_MS) { return; }
+    _cfg_check_ts = ts;
+
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(_cfg_fn, ec);
+    if (ec || (mtime == _cfg_mtime)) { return; }
+    _cfg_mtime = mtime;
+    reloadParams();
+}
 
-    _data = new_data;
+///
+/// Re-read the live tunable parameters. Invalid or missing values are ignored
+/// (keeping the current value), so a half-written file is harmless.
+///
+void Trackball::reloadParams()
+{
+    ConfigParser cfg;
+    if (cfg.read(_cfg_fn) <= 0) {
+        LOG_WRN("Warning! Unable to re-read config file (%s) - parameters unchanged.", _cfg_fn.c_str());
+        return;
+    }
+
+    auto update = [&](const string& key, double& val, bool valid(double)) {
+        double v = val;
+        if (!cfg.getDbl(key, v) || (v == val)) { return false; }
+        if (!valid(v)) {
+            LOG_WRN("Warning! Ignoring invalid value for %s (%f).", key.c_str(), v);
+            return false;
+        }
+        LOG("Updated %s (%f -> %f).", key.c_str(), val, v);
+        val = v;
+        _cfg.add(key, val);
+        return true;
+    };
+
+    /// Thresholding (applied by the grabber before its next frame).
+    double thresh_ratio = _cfg.get<double>("thr_ratio"), thresh_win_pc = _cfg.get<double>("thr_win_pc");
+    bool thr = update("thr_ratio", thresh_ratio, [](double v) { return v > 0; });
+    thr |= update("thr_win_pc", thresh_win_pc, [](double v) { return (v >= 0) && (v <= 1.0); });
+    if (thr) {
+        _frameGrabber->setThreshold(thresh_ratio, thresh_win_pc);
+        for (auto& cam : _aux) { cam->grabber->setThreshold(thresh_ratio, thresh_win_pc); }
+    }
+
+    /// Optimisation (applied before the next search).
+    double max_evals = _cfg.get<int>("opt_max_evals");
+    int nevals = static_cast<int>(max_evals);
+    bool opt = update("opt_bound", _opt_bound, [](double v) { return v > 0; });
+    opt |= update("opt_tol", _opt_tol, [](double v) { return v > 0; });
+    if (update("opt_max_evals", max_evals, [](double v) { return (v >= 1) && (v == floor(v)); })) {
+        nevals = static_cast<int>(max_evals);
+        _cfg.add("opt_max_evals", nevals);
+        opt = true;
+    }
+    if (opt) {
+        _localOpt->setLimits(_opt_bound, _opt_tol, nevals);
+        if (_globalGrid) { _globalGrid->setLimits(_opt_tol, nevals); }
+        if (_globalOpt) { _globalOpt->setLimits(_globalOpt->getBound(), _opt_tol, static_cast<int>(1e5)); }
+        _motion->setLimits(_opt_bound, _opt_tol);
+        buildRecoverSet();
+        _opt_max_evals = nevals;
+        if (_governor && (_governor->level() > 0)) { applyQuality(_governor->level()); }
+    }
+    update("opt_max_err", _error_thresh, [](double v) { return true; });
 }
 
 ///
@@ -598,19 +1833,36 @@ void Trackball::reset()
 {
     _reset = true;
 
+    /// Let the output stage finish the frame in flight before touching its state.
+    if (_do_pipeline) {
+        waitPipeIdle();
+    }
+
     /// Clear maps if we can't search the entire sphere to relocalise.
-    if (!_do_global_search) {
+    if (!_do_global_search && !_global_first) {
         //FIXME: possible for users to specify sphere_template without enabling global search..
         _sphere_template.copyTo(_sphere_map);
+        if (_sphere_tiles) {
+            _sphere_tiles->fromMat(_sphere_map);
+        }
+        if (_do_pipeline) {
+            _sphere_template.copyTo(_sphere_map_work);
+            _map_ver_sync = _map_ver;
+        }
+        _map_dirty->markAll();
         _clean_map = true;
     }
 
-    resetData();
+    resetData(_data);
+    if (_do_pipeline) {
+        resetData(_pipe_data);
+    }
 
     /// Drawing.
     if (_do_display) {
-        _R_roi_hist.clear();
-        _pos_heading_hist.clear();
+        _R_roi_new.clear();
+        _pos_heading_new.clear();
+        _draw_hist_reset = true;
     }
 
     _do_reset = false;
@@ -621,6 +1873,7 @@ void Trackball::reset()
 ///
 void Trackball::process()
 {
+    PROFILE_THREAD("Tracking");
     LOG_DBG("Starting sphere tracking loop!");
 
     /// Set thread high priority (when run as SU).
@@ -629,18 +1882,38 @@ void Trackball::process()
     } else {
         LOG_DBG("Set processing thread priority to HIGH!");
     }
+    if (!ApplyThreadClass(ThreadClass::TRACK)) {
+        LOG_WRN("Warning! Unable to apply tracking thread placement (cpus_track, rt_sched)!");
+    }
 
     /// Sphere tracking loop.
     int nbad = 0;
     double t0 = ts_ms();
     double t1, t2, t3, t4, t5, t6;
     double t1avg = 0, t2avg = 0, t3avg = 0, t4avg = 0, t5avg = 0, t6avg = 0;
-    double tfirst = -1, tlast = 0;
+    double tfirst = -1, tlast = 0, tstats = t0;
     while (!_kill && _active && _frameGrabber->getNextFrameSet(_src_frame, _roi_frame, _data.ts, _data.ms)) {
+        if (!_aux.empty()) {
+            bool matched = false;
+            if (!grabAux(matched)) { break; }
+            if (!matched) {
+                _data.cnt++;    // keep frame counter in step with the source
+                continue;
+            }
+        }
         t1 = ts_ms();
 
-        PRINT("");
-        LOG("Frame %d", _data.cnt);
+        recordStat(ST_QUEUE, static_cast<double>(_frameGrabber->getQueueDepth()));
+
+        /// Raw video - queue the (pooled) source frame, never wait on the encoder.
+        if (_save_raw && _raw_vid->write(_src_frame, _data.ts, _data.ms, false)) {
+            _raw_frames->addMsg(to_string(_data.cnt) + "\n");
+        }
+
+        if (!_batch) {
+            PRINT("");
+            LOG("Frame %d", _data.cnt);
+        }
 
         /// Handle reset request
         if (_do_reset) {
@@ -648,8 +1921,20 @@ void Trackball::process()
             reset();
         }
 
+        /// Apply parameter changes.
+        if (_cfg_reload) {
+            checkReload(t1);
+        }
+
+        /// Pick up map updates from the output stage.
+        if (_do_pipeline) {
+            syncSphereMap();
+        }
+
         /// Localise current view of sphere.
-        if (!doSearch(_do_global_search)) {
+        bool good = doSearch(_do_global_search || _global_first);
+        _global_first = false;  // opt_global_first only localises the first frame
+        if (!good) {
             t2 = t3 = t4 = t5 = ts_ms();
             LOG_WRN("Warning! Could not match current sphere orientation to within error threshold (%f).\nNo data will be output for this frame!", _error_thresh);
             nbad++;
@@ -658,16 +1943,41 @@ void Trackball::process()
             /// Clear reset flag.
             _reset = false;
 
-            t2 = ts_ms();
-            updateSphere();
-            t3 = ts_ms();
-            updatePath();
-            t4 = ts_ms();
-            logData();  // only output good data
-            t5 = ts_ms();
+            t2 = t3 = t4 = t5 = ts_ms();
+            if (!_do_pipeline) {
+                updateSphere(_data.R_roi, _roi_frame, _sphere_map);
+                t3 = ts_ms();
+                updatePath(_data, _reset);
+                t4 = ts_ms();
+                logData(_data, _err);  // only output good data
+                _state.publish(_data);
+                pushState(_data, _err);
+                checkpoint(_data, _sphere_map);
+                if (_callback) {
+                    FrameViews views = { _src_frame, _roi_frame, _sphere_map };
+                    _callback(_data, _callback_frames ? &views : nullptr);
+                }
+                t5 = ts_ms();
+            }
+            if (!_roi_pix->empty()) {
+                _clean_map = false;
+            }
             nbad = 0;
         }
 
+        /// Hand the frame over to the output stage (map/path/log/display).
+        if (_do_pipeline) {
+            auto job = make_shared<PipeJob>();
+            job->data = _data;
+            job->roi_frame = _roi_frame;
+            if (_do_display || _callback_frames) {
+                job->src_frame = _src_frame;
+            }
+            job->err = _err;
+            job->good = good;
+            pushPipeJob(job);
+        }
+
         /// Handle failed localisation.
         if ((_max_bad_frames >= 0) && (nbad > _max_bad_frames)) {
             nbad = 0;
@@ -676,19 +1986,8 @@ void Trackball::process()
             _data.seq++;
         }
 
-        if (_do_display) {
-            auto data = make_shared<DrawData>();
-            data->log_frame = _data.cnt;
-            data->src_frame = _src_frame.clone();
-            data->roi_frame = _roi_frame.clone();
-            data->sphere_map = _sphere_map.clone();
-            data->sphere_view = _sphere_view.clone();
-            data->dr_roi = _data.dr_roi;
-            data->R_roi = _data.R_roi.clone();
-            data->R_roi_hist = _R_roi_hist;
-            data->pos_heading_hist = _pos_heading_hist;
-
-            updateCanvasAsync(data);
+        if (_do_display && !_do_pipeline) {
+            packageDrawData(_data, _src_frame, _roi_frame, _sphere_map);
         }
         t6 = ts_ms();
 
@@ -703,21 +2002,52 @@ void Trackball::process()
 
             // opt evals
             _data.evals_avg += _nevals;
+
+            recordStat(ST_GRAB, t1 - t0);
+            recordStat(ST_OPT, t2 - t1);
+            if (!_do_pipeline) {    // output stage records its own timings
+                recordStat(ST_MAP, t3 - t2);
+                recordStat(ST_PATH, t4 - t3);
+                recordStat(ST_LOG, t5 - t4);
+                recordStat(ST_DISP, t6 - t5);
+            }
+            recordStat(ST_FRAME, t6 - t0);
+            recordStat(ST_EVALS, _nevals);
+        }
+        if (_prev_t6 < 0) {
+            _prev_t6 = t6;
+            _prev_ts = _data.ts;
+        }
+        double fps_out = (t6 - _prev_t6) > 0 ? 1000 / (t6 - _prev_t6) : 0;
+        if (_fps_avg < 0) { _fps_avg = fps_out; }
+        _fps_avg += 0.25 * (fps_out - _fps_avg);
+        double fps_in = (_data.ts - _prev_ts) > 0 ? 1000 / (_data.ts - _prev_ts) : 0;
+        if (!_batch) {
+            LOG("Timing grab/opt/map/plot/log/disp: %.1f / %.1f / %.1f / %.1f / %.1f / %.1f ms",
+                t1 - t0, t2 - t1, t3 - t2, t4 - t3, t5 - t4, t6 - t5);
+            LOG("Average frame rate [in/out]: %.1f [%.1f / %.1f] fps", _fps_avg, fps_in, fps_out);
+        }
+        _prev_t6 = t6;
+        _prev_ts = _data.ts;
+
+        /// Scale work to the frame rate.
+        if (_governor) {
+            int level = _governor->update(t6 - t1, _frameGrabber->getQueueDepth(), _data.ts, t6);
+            if (level >= 0) {
+                LOG("Quality governor: load %.0f%%, queue %.1f - switching to level %d.", 100 * _governor->load(), _governor->queue(), level);
+                applyQuality(level);
+            }
+        }
+
+        /// Periodic latency report.
+        if ((_stats_period > 0) && ((t6 - tstats) >= 1000 * _stats_period)) {
+            dumpLatency(true);
+            tstats = t6;
         }
-        LOG("Timing grab/opt/map/plot/log/disp: %.1f / %.1f / %.1f / %.1f / %.1f / %.1f ms",
-            t1 - t0, t2 - t1, t3 - t2, t4 - t3, t5 - t4, t6 - t5);
-        static double prev_t6 = t6;
-        double fps_out = (t6 - prev_t6) > 0 ? 1000 / (t6 - prev_t6) : 0;
-        static double fps_avg = fps_out;
-        fps_avg += 0.25 * (fps_out - fps_avg);
-        static double prev_ts = _data.ts;
-        double fps_in = (_data.ts - prev_ts) > 0 ? 1000 / (_data.ts - prev_ts) : 0;
-        LOG("Average frame rate [in/out]: %.1f [%.1f / %.1f] fps", fps_avg, fps_in, fps_out);
-        prev_t6 = t6;
-        prev_ts = _data.ts;
 
         /// Always increment frame counter.
         _data.cnt++;
+        PROFILE_FRAME();
 
         t0 = ts_ms();
         if (tfirst < 0) { tfirst = t0; }
@@ -726,22 +2056,155 @@ void Trackball::process()
 
     LOG_DBG("Stopped sphere tracking loop!");
 
+    /// Drain and stop the output stage, then fold its state back for dumpStats().
+    if (_do_pipeline && _pipeThread) {
+        {
+            lock_guard<mutex> l(_pipeMutex);
+            _pipeStop = true;
+        }
+        _pipeCond.notify_all();
+        if (_pipeThread->joinable()) {
+            _pipeThread->join();
+        }
+        syncSphereMap();
+
+        DATA data = _pipe_data;
+        data.cnt = _data.cnt;
+        data.seq = _data.seq;
+        data.evals_avg = _data.evals_avg;
+        _data = data;
+    }
+
     _frameGrabber->terminate();     // make sure we've stopped grabbing frames as well
+    for (auto& cam : _aux) { cam->grabber->terminate(); }
+
+    if (_data.cnt > 1) {
+        PRINT("\n----------------------------------------------------------------------------");
+        LOG("Trackball timing:");
+        LOG("Average grab/opt/map/plot/log/disp time: %.1f / %.1f / %.1f / %.1f / %.1f / %.1f ms",
+            t1avg / (_data.cnt - 1), t2avg / (_data.cnt - 1), t3avg / (_data.cnt - 1), t4avg / (_data.cnt - 1), t5avg / (_data.cnt - 1), t6avg / (_data.cnt - 1));
+        LOG("Average fps: %.2f", 1000. * (_data.cnt - 1) / (tlast - tfirst));
+
+        PRINT("");
+        LOG("Optimiser test data:");
+        LOG("Average number evals / frame: %.1f", _data.evals_avg / (_data.cnt - 1));
+        PRINT("----------------------------------------------------------------------------");
+    }
+
+    _active = false;
+}
+
+///
+/// Output stage of the pipelined tracking loop.
+///
+void Trackball::processPipe()
+{
+    PROFILE_THREAD("Output");
+    LOG_DBG("Starting output stage!");
+
+    if (!ApplyThreadClass(ThreadClass::TRACK)) {
+        LOG_WRN("Warning! Unable to apply output stage thread placement (cpus_track, rt_sched)!");
+    }
+
+    unique_lock<mutex> l(_pipeMutex);
+    while (true) {
+        _pipeCond.wait(l, [&] { return _pipeJob || _pipeStop; });
+        if (!_pipeJob) { break; }   // stopped and drained
+
+        auto job = _pipeJob;
+        _pipeJob.reset();
+        _pipeBusy = true;
+        l.unlock();
+
+        runPipeJob(job);
+
+        l.lock();
+        _pipeBusy = false;
+        _pipeCond.notify_all();
+    }
+
+    LOG_DBG("Stopped output stage!");
+}
+
+///
+/// Integrate map, path and output for a single frame (output stage).
+///
+void Trackball::runPipeJob(shared_ptr<PipeJob> job)
+{
+    /// Take over search result, keep integrated path state.
+    const DATA& d = job->data;
+    _pipe_data.cnt = d.cnt;
+    _pipe_data.seq = d.seq;
+    _pipe_data.ts = d.ts;
+    _pipe_data.ms = d.ms;
+    _pipe_data.dr_roi = d.dr_roi;
+    _pipe_data.r_roi = d.r_roi;
+    _pipe_data.R_roi = d.R_roi;
+
+    double t0 = ts_ms(), t1 = t0, t2 = t0, t3 = t0;
+    if (job->good) {
+        {
+            lock_guard<mutex> l(_pipeMapMutex);
+            updateSphere(_pipe_data.R_roi, job->roi_frame, _sphere_map_work);
+            _map_ver++;
+        }
+        t1 = ts_ms();
+        updatePath(_pipe_data, false);
+        t2 = ts_ms();
+        logData(_pipe_data, job->err);
+        _state.publish(_pipe_data);
+        pushState(_pipe_data, job->err);
+        checkpoint(_pipe_data, _sphere_map_work);
+        if (_callback) {
+            FrameViews views = { job->src_frame, job->roi_frame, _sphere_map_work };
+            _callback(_pipe_data, _callback_frames ? &views : nullptr);
+        }
+        t3 = ts_ms();
+    }
+
+    if (_do_display) {
+        packageDrawData(_pipe_data, job->src_frame, job->roi_frame, _sphere_map_work);
+    }
+
+    if (d.cnt > 0) {
+        recordStat(ST_MAP, t1 - t0);
+        recordStat(ST_PATH, t2 - t1);
+        recordStat(ST_LOG, t3 - t2);
+        recordStat(ST_DISP, ts_ms() - t3);
+    }
+}
+
+///
+/// Hand a frame to the output stage. Blocks while the previous frame is still in flight.
+///
+void Trackball::pushPipeJob(shared_ptr<PipeJob> job)
+{
+    unique_lock<mutex> l(_pipeMutex);
+    _pipeCond.wait(l, [&] { return !_pipeJob && !_pipeBusy; });
+    _pipeJob = job;
+    _pipeCond.notify_all();
+}
 
-    if (_data.cnt > 1) {
-        PRINT("\n----------------------------------------------------------------------------");
-        LOG("Trackball timing:");
-        LOG("Average grab/opt/map/plot/log/disp time: %.1f / %.1f / %.1f / %.1f / %.1f / %.1f ms",
-            t1avg / (_data.cnt - 1), t2avg / (_data.cnt - 1), t3avg / (_data.cnt - 1), t4avg / (_data.cnt - 1), t5avg / (_data.cnt - 1), t6avg / (_data.cnt - 1));
-        LOG("Average fps: %.2f", 1000. * (_data.cnt - 1) / (tlast - tfirst));
+///
+///
+///
+void Trackball::waitPipeIdle()
+{
+    unique_lock<mutex> l(_pipeMutex);
+    _pipeCond.wait(l, [&] { return !_pipeJob && !_pipeBusy; });
+}
 
-        PRINT("");
-        LOG("Optimiser test data:");
-        LOG("Average number evals / frame: %.1f", _data.evals_avg / (_data.cnt - 1));
-        PRINT("----------------------------------------------------------------------------");
+///
+/// Copy the output stage map into the map used for matching (if it has changed).
+///
+void Trackball::syncSphereMap()
+{
+    lock_guard<mutex> l(_pipeMapMutex);
+    if (_map_ver_sync != _map_ver) {
+        /// Only changed tiles (same size/type, so Localiser headers stay valid).
+        _map_dirty->update(_sphere_map_work, _sphere_map, _map_dirty_sync, _sphere_tiles.get());
+        _map_ver_sync = _map_ver;
     }
-
-    _active = false;
 }
 
 ///
@@ -749,16 +2212,41 @@ void Trackball::process()
 ///
 bool Trackball::doSearch(bool allow_global = false)
 {
-    /// Maintain a low-pass filtered rotation to use as guess.
-    static CmPoint64f guess(0, 0, 0);
-    if (_reset) { guess = CmPoint64f(0, 0, 0); }
+    /// Predict rotation (search guess) and search box from previous frames.
+    if (_reset) {
+        _motion->reset();
+        _last_good_dr = CmPoint64f(0, 0, 0);
+    }
 
     /// Run optimisation and save result.
     _nevals = 0;
+    _data.budget_hit = false;
+    if (_opt_budget > 0) { _localOpt->setDeadline(ts_ms() + _opt_budget); }
+    CmPoint64f guess(0, 0, 0);
     if (!_reset) {
+        CmPoint64f bound;
+        _motion->predict(guess, bound);
         _data.dr_roi = guess;
-        _err = _localOpt->search(_roi_frame, _data.R_roi, _data.dr_roi);  // _dr_roi contains optimal rotation
+        _err = _localOpt->search(_roi_frame, _data.R_roi, _data.dr_roi, bound);  // _dr_roi contains optimal rotation
         _nevals = _localOpt->getNumEval();
+        _data.budget_hit = _localOpt->hitDeadline();
+
+        /// Result on the edge of a shrunk search box may be clipped - search again with the full box.
+        const double edge = OPT_EDGE_TOL_SCL * _opt_tol;
+        bool retry = false;
+        for (int i = 0; i < 3; i++) {
+            if ((bound[i] < _opt_bound) && (fabs(_data.dr_roi[i] - guess[i]) >= (bound[i] - edge))) { retry = true; }
+        }
+        if (retry && !_data.budget_hit) {
+            LOG_DBG("Search hit predicted bound (%.3f %.3f %.3f) - retrying with opt_bound.", bound[0], bound[1], bound[2]);
+            _data.dr_roi = guess;
+            _err = _localOpt->search(_roi_frame, _data.R_roi, _data.dr_roi);
+            _nevals += _localOpt->getNumEval();
+            _data.budget_hit = _localOpt->hitDeadline();
+            _opt_retries++;
+            bound = CmPoint64f(_opt_bound, _opt_bound, _opt_bound);
+        }
+        recordStat(ST_BOUND, std::max(bound[0], std::max(bound[1], bound[2])));
     }
     else {
         _data.dr_roi = CmPoint64f(0, 0, 0);
@@ -767,13 +2255,25 @@ bool Trackball::doSearch(bool allow_global = false)
 
     /// Check optimisation.
     bool bad_frame = _error_thresh >= 0 ? (_err > _error_thresh) : false;
+    if (bad_frame && _opt_recover && !_reset && !_data.budget_hit) {
+        bad_frame = !recoverSearch(guess);
+    }
+    if (_data.budget_hit) {
+        _opt_overruns++;
+        LOG_DBG("Search stopped at time budget (%.2f ms, %d evals).", _opt_budget, _nevals);
+    }
     if (allow_global && (bad_frame || (_reset && !_clean_map))) {
 
         LOG("Doing global search");
 
         // do global search
-        _err = _globalOpt->search(_roi_frame, _data.R_roi, _data.r_roi); // use last know orientation, _r_roi, as guess and update with result
-        _nevals = _globalOpt->getNumEval();
+        if (_globalGrid) {
+            _err = _globalGrid->search(_roi_frame, _data.R_roi, _data.r_roi);   // parallel grid search over all orientations
+            _nevals = _globalGrid->getNumEval();
+        } else {
+            _err = _globalOpt->search(_roi_frame, _data.R_roi, _data.r_roi); // use last know orientation, _r_roi, as guess and update with result
+            _nevals = _globalOpt->getNumEval();
+        }
         bad_frame = _error_thresh >= 0 ? (_err > _error_thresh) : false;
 
         // if global search failed as well, just reset global orientation too
@@ -783,82 +2283,219 @@ bool Trackball::doSearch(bool allow_global = false)
         
         // reset sphere to found orientation with zero motion
         _data.dr_roi = CmPoint64f(0, 0, 0);  // zero relative rotation
-        _data.R_roi = CmPoint64f::omegaToMatrix(_data.r_roi);
+        _data.R_roi = CmMat33d::fromOmega(_data.r_roi);
     }
     else {
         /// Accumulate sphere orientation.
-        Mat tmpR = CmPoint64f::omegaToMatrix(_data.dr_roi);    // relative rotation (angle-axis) in ROI frame
+        CmMat33d tmpR = CmMat33d::fromOmegaSmall(_data.dr_roi);    // relative rotation (angle-axis) in ROI frame
         _data.R_roi = tmpR * _data.R_roi;                     // pre-multiply to accumulate orientation matrix
-        _data.r_roi = CmPoint64f::matrixToOmega(_data.R_roi);
+        _data.r_roi = _data.R_roi.toOmega();
     }
 
     LOG("optimum sphere rotation:\t%.3f %.3f %.3f  (err=%.3e/its=%d)", _data.dr_roi[0], _data.dr_roi[1], _data.dr_roi[2], _err, _nevals);
     LOG_DBG("Current sphere orientation:\t%.3f %.3f %.3f", _data.r_roi[0], _data.r_roi[1], _data.r_roi[2]);
 
-    if (!bad_frame) {
-        guess = 0.9 * _data.dr_roi + 0.1 * guess;
-    } else {
-        guess = CmPoint64f(0,0,0);
+    if (!_reset) {
+        _motion->update(_data.dr_roi, !bad_frame);
+        if (!bad_frame) { _last_good_dr = _data.dr_roi; }
     }
 
     return !bad_frame;
 }
 
+///
+/// Intermediate tier between the local and global searches: score the last
+/// good rotation, zero motion, the predicted rotation and a fixed set of
+/// discrete rotations in a single sweep, then refine the best few.
+///
+bool Trackball::recoverSearch(const CmPoint64f& guess)
+{
+    vector<double> x = {
+        _last_good_dr[0], _last_good_dr[1], _last_good_dr[2],
+        0, 0, 0,
+        guess[0], guess[1], guess[2]
+    };
+    x.insert(x.end(), _recover_set.begin(), _recover_set.end());
+    const int n = static_cast<int>(x.size() / 3);
+
+    vector<double> err(n);
+    _localOpt->testRotations(_roi_frame, _data.R_roi, x.data(), n, err.data());
+    _nevals += n;
+
+    vector<int> idx(n);
+    for (int i = 0; i < n; i++) { idx[i] = i; }
+    const int nrefine = std::min(OPT_RECOVER_REFINE, n);
+    partial_sort(idx.begin(), idx.begin() + nrefine, idx.end(), [&](int a, int b) { return err[a] < err[b]; });
+
+    /// Full bound local search about each of the best hypotheses.
+    for (int k = 0; k < nrefine; k++) {
+        const int i = idx[k];
+        CmPoint64f dr(x[3 * i + 0], x[3 * i + 1], x[3 * i + 2]);
+        double e = _localOpt->search(_roi_frame, _data.R_roi, dr);
+        _nevals += _localOpt->getNumEval();
+        if (e < _err) {
+            _err = e;
+            _data.dr_roi = dr;
+        }
+    }
+
+    if (_err > _error_thresh) { return false; }
+
+    _opt_recoveries++;
+    LOG_DBG("Recovered bad frame from hypothesis %d (err=%.3e).", idx[0], _err);
+    return true;
+}
+
+///
+/// Quality governor levels (cumulative): 1 halves opt_max_evals, 2 adds early
+/// exit (subsampled) scoring unless the search is gradient based, 3 halves the
+/// display rate and 4 quarters both opt_max_evals and the display rate. Level 0
+/// restores the configured settings.
+///
+void Trackball::applyQuality(int level)
+{
+    int evals = _opt_max_evals;
+    if (level >= 4) { evals /= 4; }
+    else if (level >= 1) { evals /= 2; }
+    evals = std::max(std::min(QUALITY_GOV_EVALS_MIN, _opt_max_evals), evals);
+    const bool early_exit = _opt_early_exit || ((level >= 2) && !_opt_grad);
+    const int draw_every = (level >= 4) ? 4 : (level >= 3) ? 2 : 1;
+
+    _localOpt->setLimits(_opt_bound, _opt_tol, evals);
+    _localOpt->setEarlyExit(early_exit ? OPT_EARLY_EXIT_MARGIN : 0);
+    _draw_every = draw_every;
+
+    LOG("Quality level %d: opt_max_evals %d, early exit %s, display every %d frame(s).", level, evals, early_exit ? "on" : "off", draw_every);
+}
+
+///
+/// Rotations of each multiple of opt_bound, both ways about each axis.
+///
+void Trackball::buildRecoverSet()
+{
+    _recover_set.clear();
+    for (double step : OPT_RECOVER_STEPS) {
+        for (int a = 0; a < 3; a++) {
+            for (int sgn = -1; sgn <= 1; sgn += 2) {
+                double v[3] = { 0, 0, 0 };
+                v[a] = sgn * step * _opt_bound;
+                _recover_set.insert(_recover_set.end(), v, v + 3);
+            }
+        }
+    }
+}
+
 ///
 ///
 ///
-void Trackball::updateSphere()
+void Trackball::updateSphere(const CmMat33d& R_roi, const Mat& roi_frame, Mat& sphere_map)
 {
-    double* m = reinterpret_cast<double*>(_data.R_roi.data); // absolute orientation (3d mat) in ROI frame
+    PROFILE_ZONE("Trackball::updateSphere");
+
+    const double* m = R_roi.data(); // absolute orientation (3d mat) in ROI frame
 
     if (_do_display) {
+        /// Copy on write - leave the view held by a draw snapshot alone.
+        if (_sphere_view.u && (_sphere_view.u->refcount > 1)) {
+            std::swap(_sphere_view, _sphere_view_spare);
+            if (!_sphere_view.u || (_sphere_view.u->refcount > 1)) {
+                _sphere_view = Mat(_map_h, _map_w, CV_8UC1);
+            }
+        }
         _sphere_view.setTo(Scalar::all(128));
     }
 
-    double p2s[3];
-    int cnt = 0, good = 0;
-    int px = 0, py = 0;
-    for (int i = 0; i < _roi_h; i++) {
-        const uint8_t* pmask = _roi_mask.ptr(i);
-        const uint8_t* proi = _roi_frame.ptr(i);
-        for (int j = 0; j < _roi_w; j++) {
-            if (pmask[j] < 255) { continue; }
-            cnt++;
+    /// Keep tiled mirror in step when updating the matching map.
+    TiledMap* tiles = (sphere_map.data == _sphere_map.data) ? _sphere_tiles.get() : nullptr;
 
-            // rotate point about rotation axis (sphere coords)
-            double* v = &(*_p1s_lut)[(i * _roi_w + j) * 3];
-            //p2s[0] = m[0] * v[0] + m[1] * v[1] + m[2] * v[2];
-            //p2s[1] = m[3] * v[0] + m[4] * v[1] + m[5] * v[2];
-            //p2s[2] = m[6] * v[0] + m[7] * v[1] + m[8] * v[2];
-            // transpose - see Localiser::testRotation()
-            p2s[0] = m[0] * v[0] + m[3] * v[1] + m[6] * v[2];
-            p2s[1] = m[1] * v[0] + m[4] * v[1] + m[7] * v[2];
-            p2s[2] = m[2] * v[0] + m[5] * v[1] + m[8] * v[2];
-
-
-            // map vector in sphere coords to pixel
-            if (!_sphere_model->vectorToPixelIndex(p2s, px, py)) { continue; }
-            uint8_t& map = _sphere_map.data[py * _sphere_map.step + px];
-
-            // update map tile
-            if ((map == 0) || (map == 255)) {
-                // map tile frozen
-                good++;
-            } else if (map == 128) {
-                // map tile previously unseen
-                map = (proi[j] == 255) ? (128 + SPHERE_MAP_FIRST_HIT_BONUS) : (128 - SPHERE_MAP_FIRST_HIT_BONUS);
-            } else {
-                good++;
-                map = (proi[j] == 255) ? (map + 1) : (map - 1);
+    proj::EquiArea ea;
+    if (_sphere_model->getProjection(ea)) {
+        if (!_roi_pix_f.empty()) {
+            updateSphereT(ea, _roi_pix_f, m, roi_frame, sphere_map, tiles);
+        } else {
+            updateSphereT(ea, *_roi_pix, m, roi_frame, sphere_map, tiles);
+        }
+    } else {
+        updateSphereT(proj::Model{ _sphere_model.get() }, *_roi_pix, m, roi_frame, sphere_map, tiles);
+    }
+}
+
+///
+/// Proj is one of the projection functors in Projection.h (see updateSphere).
+/// Pix is RoiPixel (double) or RoiPixelF (float, opt_float), which sets the
+/// precision of the rotation and projection.
+///
+/// With a thread team, the (expensive) projection of all ROI pixels is split
+/// across the team first. Map pixels are then still updated in ROI pixel order
+/// on the calling thread, so the map is identical to the single threaded result.
+///
+template <typename Proj, typename Pix>
+void Trackball::updateSphereT(const Proj& proj, const vector<Pix>& roi_pix, const double md[9], const Mat& roi_frame, Mat& sphere_map, TiledMap* tiles)
+{
+    typedef decltype(roiView(roi_pix[0], 0)) T;
+    T m[9];
+    for (int i = 0; i < 9; i++) { m[i] = static_cast<T>(md[i]); }
+
+    // rotate point about rotation axis (sphere coords) and map vector in sphere coords to pixel
+    auto project = [&](const Pix& p, int& px, int& py) {
+        const T v[3] = { roiView(p, 0), roiView(p, 1), roiView(p, 2) };
+        // transpose - see Localiser::testRotation()
+        const T p2s[3] = {
+            m[0] * v[0] + m[3] * v[1] + m[6] * v[2],
+            m[1] * v[0] + m[4] * v[1] + m[7] * v[2],
+            m[2] * v[0] + m[5] * v[1] + m[8] * v[2] };
+        return proj.index(p2s, px, py);
+    };
+
+    const int npix = static_cast<int>(roi_pix.size());
+    const int step = static_cast<int>(sphere_map.step);
+    const bool par = _team && (npix >= OPT_TEAM_MIN_PIX);
+    if (par) {
+        _upd_idx.resize(npix);
+        const int chunk = (npix + _team->size() - 1) / _team->size();
+        _team->run([&](int t) {
+            int qx = 0, qy = 0;
+            for (int k = t * chunk, k1 = std::min(npix, k + chunk); k < k1; k++) {
+                _upd_idx[k] = project(roi_pix[k], qx, qy) ? (qy * step + qx) : -1;
             }
+        });
+    }
 
-            // display
-            if (_do_display) { _sphere_view.at<uint8_t>(py, px) = proi[j]; }
+    int cnt = 0, good = 0;
+    int px = 0, py = 0;
+    const uint8_t* proi = roi_frame.data;
+    for (int k = 0; k < npix; k++) {
+        const Pix& p = roi_pix[k];
+        cnt++;
+
+        if (par) {
+            if (_upd_idx[k] < 0) { continue; }
+            px = _upd_idx[k] % step;
+            py = _upd_idx[k] / step;
+        } else if (!project(p, px, py)) { continue; }
+        uint8_t& map = sphere_map.data[py * step + px];
+
+        // update map tile
+        const uint8_t r = proi[p.idx];
+        if ((map == 0) || (map == 255)) {
+            // map tile frozen
+            good++;
+        } else if (map == 128) {
+            // map tile previously unseen
+            map = (r == 255) ? (128 + SPHERE_MAP_FIRST_HIT_BONUS) : (128 - SPHERE_MAP_FIRST_HIT_BONUS);
+            _map_dirty->mark(px, py);
+        } else {
+            good++;
+            map = (r == 255) ? (map + 1) : (map - 1);
+            _map_dirty->mark(px, py);
         }
+        if (tiles) { tiles->set(px, py, map); }
+
+        // display
+        if (_do_display) { _sphere_view.at<uint8_t>(py, px) = r; }
     }
     
     if (cnt > 0) {
-        _clean_map = false;
         LOG_DBG("Sphere ROI match overlap: %.1f%%", 100 * good / static_cast<double>(cnt));
     }
     else {
@@ -869,7 +2506,7 @@ void Trackball::updateSphere()
 ///
 ///
 ///
-void Trackball::updatePath()
+void Trackball::updatePath(DATA& data, bool reset)
 {
     // rel vec roi
     // _dr_roi
@@ -878,25 +2515,25 @@ void Trackball::updatePath()
     // _R_roi
 
     // abs vec roi
-    _data.r_roi = CmPoint64f::matrixToOmega(_data.R_roi);
+    data.r_roi = data.R_roi.toOmega();
     
     // rel vec cam
-    _data.dr_cam = _data.dr_roi/*.getTransformed(_roi_to_cam_R)*/;
+    data.dr_cam = data.dr_roi/*.getTransformed(_roi_to_cam_R)*/;
 
     // abs mat cam
-    _data.R_cam = /*_roi_to_cam_R * */_data.R_roi;
+    data.R_cam = /*_roi_to_cam_R * */data.R_roi;
 
     // abs vec cam
-    _data.r_cam = CmPoint64f::matrixToOmega(_data.R_cam);
+    data.r_cam = data.R_cam.toOmega();
 
     // rel vec world
-    _data.dr_lab = _data.dr_cam.getTransformed(_cam_to_lab_R);
+    data.dr_lab = data.dr_cam.getTransformed(_cam_to_lab.data());
 
     // abs mat world
-    _data.R_lab = _cam_to_lab_R * _data.R_cam;
+    data.R_lab = _cam_to_lab * data.R_cam;
 
     // abs vec world
-    _data.r_lab = CmPoint64f::matrixToOmega(_data.R_lab);
+    data.r_lab = data.R_lab.toOmega();
 
 
     //// store initial rotation from template (if any)
@@ -924,66 +2561,85 @@ void Trackball::updatePath()
 
 
     // running speed, radians/frame (-ve rotation around x-axis causes y-axis translation & vice-versa!!)
-    _data.velx = _data.dr_lab[1];
-    _data.vely = -_data.dr_lab[0];
-    _data.step_mag = sqrt(_data.velx * _data.velx + _data.vely * _data.vely);  // magnitude (radians) of ball rotation excluding turning (change in heading)
+    data.velx = data.dr_lab[1];
+    data.vely = -data.dr_lab[0];
+    data.step_mag = sqrt(data.velx * data.velx + data.vely * data.vely);  // magnitude (radians) of ball rotation excluding turning (change in heading)
     
     // test data
-    if (_data.cnt > 0) {
-        _data.dist += _data.step_mag;
-        double v = _data.dr_lab.len();
-        double delta = v - _data.step_avg;
-        _data.step_avg += delta / static_cast<double>(_data.cnt); // running average
-        double delta2 = v - _data.step_avg;
-        _data.step_var += delta * delta2;  // running variance (Welford's alg)
+    if (data.cnt > 0) {
+        data.dist += data.step_mag;
+        double v = data.dr_lab.len();
+        double delta = v - data.step_avg;
+        data.step_avg += delta / static_cast<double>(data.cnt); // running average
+        double delta2 = v - data.step_avg;
+        data.step_var += delta * delta2;  // running variance (Welford's alg)
     }
 
     // running direction
-    _data.step_dir = atan2(_data.vely, _data.velx);
-    if (_data.step_dir < 0) { _data.step_dir += 360 * CM_D2R; }
+    data.step_dir = atan2(data.vely, data.velx);
+    if (data.step_dir < 0) { data.step_dir += 360 * CM_D2R; }
 
     // integrated x/y pos (optical mouse style)
-    _data.intx += _data.velx;
-    _data.inty += _data.vely;
+    data.intx += data.velx;
+    data.inty += data.vely;
 
     // integrate bee heading
-    _data.heading -= _data.dr_lab[2];
-    while (_data.heading < 0) { _data.heading += 360 * CM_D2R; }
-    while (_data.heading >= 360 * CM_D2R) { _data.heading -= 360 * CM_D2R; }
-    _data.ang_dist += abs(_data.dr_lab[2]);
+    data.heading -= data.dr_lab[2];
+    while (data.heading < 0) { data.heading += 360 * CM_D2R; }
+    while (data.heading >= 360 * CM_D2R) { data.heading -= 360 * CM_D2R; }
+    data.ang_dist += abs(data.dr_lab[2]);
 
     // integrate 2d position
     {
         const int steps = 4;	// increasing this doesn't help much
-        double step = _data.step_mag / steps;
-        static double prev_heading = 0;
-        if (_reset) { prev_heading = 0; }
-        double heading_step = (_data.heading - prev_heading);
+        double step = data.step_mag / steps;
+        double& prev_heading = _prev_heading;
+        if (reset) { prev_heading = 0; }
+        double heading_step = (data.heading - prev_heading);
         while (heading_step >= 180 * CM_D2R) { heading_step -= 360 * CM_D2R; }
         while (heading_step < -180 * CM_D2R) { heading_step += 360 * CM_D2R; }
         heading_step /= steps;  // do after wrapping above
 
         // super-res integration
-        CmPoint64f dir(_data.velx, _data.vely, 0);
+        CmPoint64f dir(data.velx, data.vely, 0);
         dir.normalise();
         dir.rotateAboutNorm(CmPoint(0, 0, 1), prev_heading + heading_step / 2.0);
         for (int i = 0; i < steps; i++) {
-            _data.posx += step * dir[0];
-            _data.posy += step * dir[1];
+            data.posx += step * dir[0];
+            data.posy += step * dir[1];
             dir.rotateAboutNorm(CmPoint(0, 0, 1), heading_step);
         }
-        prev_heading = _data.heading;
+        prev_heading = data.heading;
+    }
+
+    // motion rates over the last frame (dr_* are relative to the previous good frame)
+    {
+        double& prev_ts = _prev_path_ts;
+        if (reset) { prev_ts = -1; }
+        const double dt = data.ts - prev_ts;
+        if ((prev_ts >= 0) && (dt > 0)) {
+            data.w_lab = data.dr_lab / dt;
+            data.heading_rate = -data.dr_lab[2] / dt;
+            data.velx_rate = data.velx / dt;
+            data.vely_rate = data.vely / dt;
+        }
+        else {
+            data.w_lab = CmPoint64f(0, 0, 0);
+            data.heading_rate = data.velx_rate = data.vely_rate = 0;
+        }
+        prev_ts = data.ts;
     }
 
     if (_do_display) {
         // update pos hist (in ROI-space!)
-        _R_roi_hist.push_back(_data.R_roi.clone());
-        while (_R_roi_hist.size() > DRAW_SPHERE_HIST_LENGTH) {
-            _R_roi_hist.pop_front();
+        /// Only new entries are handed over (see packageDrawData). Trim in bulk if the draw thread falls behind.
+        _R_roi_new.push_back(data.R_roi);
+        if (_R_roi_new.size() >= 2 * DRAW_SPHERE_HIST_LENGTH) {
+            _R_roi_new.erase(_R_roi_new.begin(), _R_roi_new.end() - DRAW_SPHERE_HIST_LENGTH);
         }
-        _pos_heading_hist.push_back(CmPoint(_data.posx, _data.posy, _data.heading));
-        while (_pos_heading_hist.size() > DRAW_FICTIVE_PATH_LENGTH) {
-            _pos_heading_hist.pop_front();
+        _pos_heading_new.push_back(CmPoint(data.posx, data.posy, data.heading));
+        if (_pos_heading_new.size() >= 2 * DRAW_FICTIVE_PATH_LENGTH) {
+            _pos_heading_new.erase(_pos_heading_new.begin(), _pos_heading_new.end() - DRAW_FICTIVE_PATH_LENGTH);
         }
     }
 }
@@ -991,43 +2647,122 @@ void Trackball::updatePath()
 ///
 ///
 ///
-bool Trackball::logData()
+bool Trackball::logData(const DATA& data, double err)
 {
-    std::stringstream ss;
-    ss.precision(14);
-
-    static double prev_ts = _data.ts;
-
-    // frame_count
-    ss << _data.cnt << ", ";
-    // rel_vec_cam[3] | error
-    ss << _data.dr_cam[0] << ", " << _data.dr_cam[1] << ", " << _data.dr_cam[2] << ", " << _err << ", ";
-    // rel_vec_world[3]
-    ss << _data.dr_lab[0] << ", " << _data.dr_lab[1] << ", " << _data.dr_lab[2] << ", ";
-    // abs_vec_cam[3]
-    ss << _data.r_cam[0] << ", " << _data.r_cam[1] << ", " << _data.r_cam[2] << ", ";
-    // abs_vec_world[3]
-    ss << _data.r_lab[0] << ", " << _data.r_lab[1] << ", " << _data.r_lab[2] << ", ";
-    // integrated xpos | integrated ypos | integrated heading
-    ss << _data.posx << ", " << _data.posy << ", " << _data.heading << ", ";
-    // direction (radians) | speed (radians/frame)
-    ss << _data.step_dir << ", " << _data.step_mag << ", ";
-    // integrated x movement | integrated y movement (mouse output equivalent)
-    ss << _data.intx << ", " << _data.inty << ", ";
-    // timestamp (ms since epoch) | sequence number | delta ts (ms since last frame) | timestamp (ms since midnight)
-    ss << _data.ts << ", " << _data.seq << ", " << (_data.ts - prev_ts) << ", " << _data.ms << std::endl;
-
-    prev_ts = _data.ts;     // caution - be sure that this time delta corresponds to deltas for step size, rotation rate, etc!!
-
-    // async i/o
+    double& prev_ts = _prev_log_ts;
+    if (prev_ts < 0) { prev_ts = data.ts; }
+    double dts = data.ts - prev_ts;
+    prev_ts = data.ts;      // caution - be sure that this time delta corresponds to deltas for step size, rotation rate, etc!!
+
     bool ret = true;
-    if (_do_sock_output) {
-        ret &= _data_sock->addMsg("FT, " + ss.str());
+
+    /// Serial output at the decimated rate (com_rate). Half a frame of slack keeps
+    /// the rate from aliasing down when the period is a multiple of the frame period.
+    bool do_com = _do_com_output;
+    if (do_com && (_com_period > 0)) {
+        do_com = (data.ts + 0.5 * dts) >= _com_next_ts;
+        if (do_com) {
+            _com_next_ts += _com_period;
+            if (_com_next_ts < data.ts) { _com_next_ts = data.ts + _com_period; }   // first record or after a gap
+        }
+    }
+
+    /// Camera-to-output latency (only meaningful if the source timestamps on the host clock).
+    /// Socket msgs are stamped with the frame timestamp so the writer can time the actual send.
+    double lat = ts_ms() - data.ts;
+    const bool lat_valid = _live_src && (lat >= 0) && (lat < STATS_CAM_OUT_MAX);
+    const double sock_stamp = lat_valid ? data.ts : -1;
+
+    /// Binary record (see BinaryRecord.h).
+    if (_bin_log || (_do_sock_output && _bin_sock) || (do_com && (_bin_com || _compact_com)) || _do_shm_output) {
+        BinaryRecord rec;
+        rec.frame_cnt = data.cnt + _cnt_offset;
+        rec.seq = data.seq;
+        for (int i = 0; i < 3; i++) {
+            rec.dr_cam[i] = data.dr_cam[i];
+            rec.dr_lab[i] = data.dr_lab[i];
+            rec.r_cam[i] = data.r_cam[i];
+            rec.r_lab[i] = data.r_lab[i];
+        }
+        rec.err = err;
+        rec.posx = data.posx;
+        rec.posy = data.posy;
+        rec.heading = data.heading;
+        rec.step_dir = data.step_dir;
+        rec.step_mag = data.step_mag;
+        rec.intx = data.intx;
+        rec.inty = data.inty;
+        rec.ts = data.ts;
+        rec.dts = dts;
+        rec.ms = data.ms;
+        for (int i = 0; i < 3; i++) {
+            rec.w_lab[i] = data.w_lab[i];
+        }
+        rec.heading_rate = data.heading_rate;
+        rec.velx_rate = data.velx_rate;
+        rec.vely_rate = data.vely_rate;
+
+        // async i/o
+        if (_do_sock_output && _bin_sock) {
+            ret &= _data_sock->addMsg(&rec, sizeof(rec), sock_stamp);
+        }
+        if (do_com && _bin_com) {
+            ret &= _data_com->addMsg(&rec, sizeof(rec));
+        }
+        if (do_com && _compact_com) {
+            compact::encode(rec, _com_fields, _com_buf);
+            ret &= _data_com->addMsg(_com_buf.data(), _com_buf.size());
+        }
+        if (_do_shm_output) {
+            ret &= _data_shm->addMsg(&rec, sizeof(rec));    // synchronous
+        }
+        if (_bin_log) {
+            ret &= _data_log->addMsg(&rec, sizeof(rec));
+        }
+    }
+
+    /// CSV record (see doc/data_header.txt).
+    if (!_bin_log || (_do_sock_output && !_bin_sock) || (do_com && !_bin_com && !_compact_com)) {
+        std::stringstream ss;
+        ss.precision(14);
+
+        // frame_count
+        ss << "FT, " << (data.cnt + _cnt_offset) << ", ";
+        // rel_vec_cam[3] | error
+        ss << data.dr_cam[0] << ", " << data.dr_cam[1] << ", " << data.dr_cam[2] << ", " << err << ", ";
+        // rel_vec_world[3]
+        ss << data.dr_lab[0] << ", " << data.dr_lab[1] << ", " << data.dr_lab[2] << ", ";
+        // abs_vec_cam[3]
+        ss << data.r_cam[0] << ", " << data.r_cam[1] << ", " << data.r_cam[2] << ", ";
+        // abs_vec_world[3]
+        ss << data.r_lab[0] << ", " << data.r_lab[1] << ", " << data.r_lab[2] << ", ";
+        // integrated xpos | integrated ypos | integrated heading
+        ss << data.posx << ", " << data.posy << ", " << data.heading << ", ";
+        // direction (radians) | speed (radians/frame)
+        ss << data.step_dir << ", " << data.step_mag << ", ";
+        // integrated x movement | integrated y movement (mouse output equivalent)
+        ss << data.intx << ", " << data.inty << ", ";
+        // timestamp (ms since epoch) | sequence number | delta ts (ms since last frame) | timestamp (ms since midnight)
+        ss << data.ts << ", " << data.seq << ", " << dts << ", " << data.ms << std::endl;
+
+        const string msg = ss.str();
+        const size_t hdr = 4;   // "FT, " prefix, only sent to socket/com
+
+        // async i/o
+        if (_do_sock_output && !_bin_sock) {
+            ret &= _data_sock->addMsg(msg, sock_stamp);
+        }
+        if (do_com && !_bin_com && !_compact_com) {
+            ret &= _data_com->addMsg(msg);
+        }
+        if (!_bin_log) {
+            ret &= _data_log->addMsg(msg.data() + hdr, msg.size() - hdr);
+        }
     }
-    if (_do_com_output) {
-        ret &= _data_com->addMsg("FT, " + ss.str());
+
+    if (lat_valid) {
+        recordStat(ST_CAM_OUT, lat);
     }
-    ret &= _data_log->addMsg(ss.str());
     return ret;
 }
 
@@ -1036,11 +2771,11 @@ bool Trackball::logData()
 ///
 double Trackball::testRotation(const double x[3])
 {
-    static double lmat[9];
+    double lmat[9];
     CmPoint64f tmp(x[0], x[1], x[2]);
-    tmp.omegaToMatrix(lmat);                    // relative rotation in camera frame
-    double* rmat = (double*)_data.R_roi.data;  // pre-multiply to orientation matrix
-    static double m[9];                         // absolute orientation in camera frame
+    tmp.omegaToMatrixSmall(lmat);               // relative rotation in camera frame
+    const double* rmat = _data.R_roi.data();   // pre-multiply to orientation matrix
+    double m[9];                                // absolute orientation in camera frame
 
     m[0] = lmat[0] * rmat[0] + lmat[1] * rmat[3] + lmat[2] * rmat[6];
     m[1] = lmat[0] * rmat[1] + lmat[1] * rmat[4] + lmat[2] * rmat[7];
@@ -1071,33 +2806,25 @@ double Trackball::testRotation(const double x[3])
     double p2s[3];
     int cnt = 0, good = 0;
     int px = 0, py = 0;
-    for (int i = 0; i < _roi_h; i++) {
-        uint8_t* pmask = _roi_mask.ptr(i);
-        uint8_t* proi = _roi_frame.ptr(i);
-        double* v = &(*_p1s_lut)[i * _roi_w * 3];
-        for (int j = 0; j < _roi_w; j++) {
-            if (pmask[j] < 255) { continue; }
-            cnt++;
+    const uint8_t* proi = _roi_frame.data;
+    for (const auto& p : *_roi_pix) {
+        cnt++;
 
-            // rotate point about rotation axis (sphere coords)
-            int jjj = 3 * j;
-            //p2s[0] = m[0] * v[jjj + 0] + m[1] * v[jjj + 1] + m[2] * v[jjj + 2];
-            //p2s[1] = m[3] * v[jjj + 0] + m[4] * v[jjj + 1] + m[5] * v[jjj + 2];
-            //p2s[2] = m[6] * v[jjj + 0] + m[7] * v[jjj + 1] + m[8] * v[jjj + 2];
-            // transpose
-            p2s[0] = m[0] * v[jjj + 0] + m[3] * v[jjj + 1] + m[6] * v[jjj + 2];
-            p2s[1] = m[1] * v[jjj + 0] + m[4] * v[jjj + 1] + m[7] * v[jjj + 2];
-            p2s[2] = m[2] * v[jjj + 0] + m[5] * v[jjj + 1] + m[8] * v[jjj + 2];
+        // rotate point about rotation axis (sphere coords)
+        const CmPoint64f& v = p.v;
+        // transpose
+        p2s[0] = m[0] * v[0] + m[3] * v[1] + m[6] * v[2];
+        p2s[1] = m[1] * v[0] + m[4] * v[1] + m[7] * v[2];
+        p2s[2] = m[2] * v[0] + m[5] * v[1] + m[8] * v[2];
 
-            // map vector in sphere coords to pixel
-            if (!_sphere_model->vectorToPixelIndex(p2s, px, py)) { continue; }  // sphere model is spherical, so pixel should never fall outside valid area
+        // map vector in sphere coords to pixel
+        if (!_sphere_model->vectorToPixelIndex(p2s, px, py)) { continue; }  // sphere model is spherical, so pixel should never fall outside valid area
 
-            int r = proi[j];
-            int s = _sphere_map.data[py * _sphere_map.step + px];
-            if (s == 128) { continue; }
-            err += (r - s) * (r - s);
-            good++;     // number of test pixels that correspond to previously seen pixels
-        }
+        int r = proi[p.idx];
+        int s = _sphere_map.data[py * _sphere_map.step + px];
+        if (s == 128) { continue; }
+        err += (r - s) * (r - s);
+        good++;     // number of test pixels that correspond to previously seen pixels
     }
 
     /// Compute avg squared diff error.
@@ -1111,82 +2838,128 @@ double Trackball::testRotation(const double x[3])
 }
 
 ///
+/// Proj re-projects into the ROI camera model (see makeSphereRotMaps).
 ///
-///
-void makeSphereRotMaps(
-    CameraModelPtr cam_model,
-    Mat& mapX, Mat& mapY, const Mat& mask,
+template <typename Proj>
+void makeSphereRotMapsT(
+    const Proj& proj, const vector<RoiPixel>& roi_pix,
+    Mat& mapX, Mat& mapY,
     double sphere_r_d_ratio, const CmPoint64f& rot_angle_axis)
 {
-    CmPoint64f sc(0, 0, 1);
-    int w = mapX.cols, h = mapX.rows;
-    float *mapx = (float*)mapX.data, *mapy = (float*)mapY.data;
-    for (int i = 0, it = 0; i < h; ++i) {
-        const uint8_t* pmask = mask.ptr(i);
-        for (int j = 0; j < w; ++j, ++it) {
-            if (pmask[j] < 255) {
-                mapx[it] = -1;
-                mapy[it] = -1;
-                continue;
-            }
-
-            CmPoint64f p;
-            cam_model->pixelIndexToVector(j, i, p);
-            p.normalise();
-
-            double a = 1.0;
-            double b = 2.0*(p[0] * -sc[0] + p[1] * -sc[1] + p[2] * -sc[2]);
-            double c = sc[0] * sc[0] + sc[1] * sc[1] + sc[2] * sc[2] - sphere_r_d_ratio * sphere_r_d_ratio;
-
-            double quad = b * b - 4 * a*c;
-            if (quad < 0) {
-                mapx[it] = -1;
-                mapy[it] = -1;
-                continue;
-            }
+    // -ve rotation to rotate vector, not axes (see Localiser::testRotation())
+    double R[9];
+    (-rot_angle_axis).omegaToMatrix(R);
 
-            // get point on surface of sphere (camera coords)
-            // double u1 = (-b+sqrt(quad))/(2.0*a);
-            double u2 = (-b - sqrt(quad)) / (2.0 * a);
-            // double u = std::min(u1,u2);
-            //CmPoint64f p1 = p * u2;
+    /// Surface point (sphere coords) is the cached view ray intersection scaled by the sphere radius.
+    const double r = sphere_r_d_ratio;
+    const double m[9] = {
+        r * R[0], r * R[1], r * R[2],
+        r * R[3], r * R[4], r * R[5],
+        r * R[6], r * R[7], r * R[8] };
 
-            // switch to sphere coords
-            p = u2 * p - sc;
+    float *mapx = (float*)mapX.data, *mapy = (float*)mapY.data;
+    const RoiPixel* pix = roi_pix.data();
+    cv::parallel_for_(cv::Range(0, static_cast<int>(roi_pix.size())), [&](const cv::Range& range) {
+        for (int k = range.start; k < range.end; k++) {
+            const CmPoint64f& v = pix[k].v;
+            const int it = pix[k].idx;
 
             // rotate point about rotation axis (sphere coords)
-            // -ve rotation to rotate vector, not axes (see Localiser::testRotation())
-            p.rotateAbout(-rot_angle_axis);
+            double p[3] = {
+                m[0] * v[0] + m[1] * v[1] + m[2] * v[2],
+                m[3] * v[0] + m[4] * v[1] + m[5] * v[2],
+                m[6] * v[0] + m[7] * v[1] + m[8] * v[2] };
 
             // check whether point has disappeared
-            if (p.dot(sc) > 0) {
+            if (p[2] > 0) {
                 mapx[it] = -1;
                 mapy[it] = -1;
                 continue;
             }
 
             // switch back to camera coords
-            p = p + sc;
+            p[2] += 1;
 
             // re-intersect with camera model
             double x2 = 0, y2 = 0;
-            cam_model->vectorToPixelIndex(p, x2, y2);
+            proj(p, x2, y2);
+            CameraModel::continuousToIndex(x2, y2);
 
             mapx[it] = static_cast<float>(x2);
             mapy[it] = static_cast<float>(y2);
         }
+    }, DRAW_WARP_STRIPES);
+}
+
+///
+/// Warp maps for the ROI rotated by rot_angle_axis. Sphere intersection is
+/// taken from the pre-calculated ROI pixels (also used for matching), so only
+/// the rotation and re-projection are done here. Maps must be pre-set to -1.
+///
+void makeSphereRotMaps(
+    CameraModelPtr cam_model, const vector<RoiPixel>& roi_pix,
+    Mat& mapX, Mat& mapY,
+    double sphere_r_d_ratio, const CmPoint64f& rot_angle_axis)
+{
+    proj::Fisheye fisheye;
+    proj::Rectilinear rectilinear;
+    if (cam_model->getProjection(fisheye)) {
+        makeSphereRotMapsT(fisheye, roi_pix, mapX, mapY, sphere_r_d_ratio, rot_angle_axis);
+    } else if (cam_model->getProjection(rectilinear)) {
+        makeSphereRotMapsT(rectilinear, roi_pix, mapX, mapY, sphere_r_d_ratio, rot_angle_axis);
+    } else {
+        makeSphereRotMapsT(proj::Model{ cam_model.get() }, roi_pix, mapX, mapY, sphere_r_d_ratio, rot_angle_axis);
     }
 }
 
 
 
+///
+///
+///
+void Trackball::packageDrawData(const DATA& data, const Mat& src_frame, const Mat& roi_frame, const Mat& sphere_map)
+{
+    /// Reduced display rate (quality governor) - the debug video keeps every frame.
+    const int every = _draw_every.load(memory_order_relaxed);
+    if ((every > 1) && !_save_debug && (data.cnt % every)) { return; }
+
+    /// Don't build snapshots the draw thread won't get to.
+    {
+        unique_lock<mutex> l(_drawMutex, defer_lock);
+        PROFILE_LOCK(l, "Trackball::_drawMutex wait");
+        if (!_drawIdle || !_drawQ.empty()) { return; }
+    }
+
+    auto draw = make_shared<DrawData>();
+    draw->log_frame = data.cnt;
+    draw->src_frame = src_frame;        // pooled frames aren't reused while referenced - no copy
+    draw->roi_frame = roi_frame;
+    draw->sphere_view = _sphere_view;   // copy on write (see updateSphere)
+    {
+        /// The idle draw thread no longer reads the previous snapshot, so just copy changed tiles into it.
+        unique_lock<mutex> l(_pipeMapMutex, defer_lock);
+        if (_do_pipeline) { l.lock(); }
+        _map_dirty->update(sphere_map, _draw_map, _draw_map_ver);
+    }
+    draw->sphere_map = _draw_map;
+    draw->dr_roi = data.dr_roi;
+    draw->R_roi = data.R_roi;
+    draw->hist_reset = _draw_hist_reset;
+    draw->R_roi_new.swap(_R_roi_new);
+    draw->pos_heading_new.swap(_pos_heading_new);
+    _draw_hist_reset = false;
+
+    updateCanvasAsync(draw);
+}
+
 ///
 ///
 ///
 bool Trackball::updateCanvasAsync(shared_ptr<DrawData> data)
 {
     bool ret = false;
-    lock_guard<mutex> l(_drawMutex);
+    unique_lock<mutex> l(_drawMutex, defer_lock);
+    PROFILE_LOCK(l, "Trackball::_drawMutex wait");
     if (_active) {
         _drawQ.push_back(data);
         _drawCond.notify_all();
@@ -1200,10 +2973,15 @@ bool Trackball::updateCanvasAsync(shared_ptr<DrawData> data)
 ///
 void Trackball::processDrawQ()
 {
+    PROFILE_THREAD("Drawing");
+
     /// Set thread higher priority (when run as SU).
     if (!SetThreadNormalPriority()) {
         LOG_ERR("Error! Unable to set thread priority!");
     }
+    if (!ApplyThreadClass(ThreadClass::DRAW)) {
+        LOG_WRN("Warning! Unable to apply drawing thread placement (cpus_draw)!");
+    }
 
     /// Get a un/lockable lock.
     unique_lock<mutex> l(_drawMutex);
@@ -1211,10 +2989,12 @@ void Trackball::processDrawQ()
     /// Process drawing queue.
     while (_active) {
         /// Wait for data.
+        _drawIdle = true;
         while (_drawQ.size() == 0) {
             _drawCond.wait(l);
             if (!_active) { break; }
         }
+        _drawIdle = false;
         if (!_active) { break; }
 
         /// Retrieve data.
@@ -1229,135 +3009,206 @@ void Trackball::processDrawQ()
         l.unlock();
 
         /// Draw canvas unlocked.
+        auto t0 = chrono::steady_clock::now();
         drawCanvas(data);
 
-        l.lock();
+        PROFILE_LOCK(l, "Trackball::_drawMutex wait");
+
+        /// Rate limit - no snapshots are built until the next refresh is due.
+        if (_disp_period > 0) {
+            auto next = t0 + chrono::microseconds(static_cast<long long>(1000 * _disp_period));
+            _drawCond.wait_until(l, next, [this] { return !_active; });
+        }
     }
     l.unlock();
 
     LOG_DBG("Finished processing drawing queue.");
 }
 
+///
+/// Append new points to the fictive path cell. The view (path bounds plus a
+/// margin) is only refitted, and the whole path redrawn, when a new point
+/// falls outside it or once DRAW_PATH_REDRAW old points have been dropped.
+///
+void Trackball::drawPath(const vector<CmPoint64f>& pos_heading_new, bool reset)
+{
+    if (_draw_path.empty()) {
+        _draw_path.create(DRAW_CELL_DIM, 2 * DRAW_CELL_DIM, CV_8UC3);
+        reset = true;
+    }
+    if (reset) {
+        _draw_path_hist.clear();
+        _path_trimmed = 0;
+    }
+
+    bool redraw = reset;
+    size_t first = _draw_path_hist.size();     // first new point
+    for (const auto& p : pos_heading_new) {
+        _draw_path_hist.push_back(p);
+        if ((p.x < _path_minx) || (p.x > _path_maxx) || (p.y < _path_miny) || (p.y > _path_maxy)) {
+            redraw = true;
+        }
+    }
+    while (_draw_path_hist.size() > DRAW_FICTIVE_PATH_LENGTH) {
+        _draw_path_hist.pop_front();
+        _path_trimmed++;
+        if (first > 0) { first--; }
+    }
+    if (_path_trimmed >= DRAW_PATH_REDRAW) {
+        redraw = true;
+    }
+
+    const int npts = _draw_path_hist.size();
+    if (redraw) {
+        double minx = DBL_MAX, maxx = -DBL_MAX, miny = DBL_MAX, maxy = -DBL_MAX;
+        for (const auto& p : _draw_path_hist) {
+            minx = std::min(minx, p.x);
+            maxx = std::max(maxx, p.x);
+            miny = std::min(miny, p.y);
+            maxy = std::max(maxy, p.y);
+        }
+        if (npts == 0) { minx = maxx = miny = maxy = 0; }
+        double mgx = DRAW_PATH_MARGIN * (maxx - minx), mgy = DRAW_PATH_MARGIN * (maxy - miny);
+        _path_minx = minx - mgx;
+        _path_maxx = maxx + mgx;
+        _path_miny = miny - mgy;
+        _path_maxy = maxy + mgy;
+        _path_trimmed = 0;
+
+        _draw_path.setTo(Scalar::all(0));
+        first = 0;
+    }
+    if (npts < 2) { return; }
+
+    double sclx = (_path_minx != _path_maxx) ? double(DRAW_CELL_DIM - 8) / (_path_maxx - _path_minx) : 1;
+    double scly = (_path_miny != _path_maxy) ? double(2 * DRAW_CELL_DIM - 4) / (_path_maxy - _path_miny) : 1;
+    double scl = std::min(sclx, scly);
+
+    double my = (2 * DRAW_CELL_DIM - scl * (_path_maxy - _path_miny)) / 2, mx = DRAW_CELL_DIM - (DRAW_CELL_DIM - scl * (_path_maxx - _path_minx)) / 2;  // zeroth pixel for y/x data axes
+    int i0 = std::max(1, static_cast<int>(first));
+    double ppx = mx - scl * (_draw_path_hist[i0 - 1].x - _path_minx), ppy = my + scl * (_draw_path_hist[i0 - 1].y - _path_miny);
+    for (int i = i0; i < npts; i++) {
+        double px = mx - scl * (_draw_path_hist[i].x - _path_minx), py = my + scl * (_draw_path_hist[i].y - _path_miny);
+        cv::line(_draw_path,
+            cv::Point(static_cast<int>(round(ppy * 16)), static_cast<int>(round(ppx * 16))),
+            cv::Point(static_cast<int>(round(py * 16)), static_cast<int>(round(px * 16))),
+            CV_RGB(255, 255, 255), 1, cv::LINE_AA, 4);
+        ppx = px;
+        ppy = py;
+    }
+}
+
 ///
 ///
 ///
 void Trackball::drawCanvas(shared_ptr<DrawData> data)
 {
-    static Mat canvas(3 * DRAW_CELL_DIM, 4 * DRAW_CELL_DIM, CV_8UC3);
+    PROFILE_ZONE("Trackball::drawCanvas");
+
+    /// Previous canvas may still be queued for encoding.
+    if (_canvas.empty() || (_canvas.u && (_canvas.u->refcount > 1))) {
+        _canvas = Mat(3 * DRAW_CELL_DIM, 4 * DRAW_CELL_DIM, CV_8UC3);
+    }
+    Mat& canvas = _canvas;
     canvas.setTo(Scalar::all(0));
 
     /// Unpack current data.
     Mat& src_frame = data->src_frame;
-    Mat& roi_frame = data->roi_frame;
+    Mat roi_frame = data->roi_frame.rowRange(0, _roi_h);   // main camera (aux ROIs are stacked below)
     CmPoint64f& dr_roi = data->dr_roi;
-    Mat& R_roi = data->R_roi;
+    CmMat33d& R_roi = data->R_roi;
     Mat& sphere_view = data->sphere_view;
     Mat& sphere_map = data->sphere_map;
-    deque<Mat>& R_roi_hist = data->R_roi_hist;
-    deque<CmPoint64f>& pos_heading_hist = data->pos_heading_hist;
     unsigned int log_frame = data->log_frame;
 
     /// Draw source image.
     double radPerPix = _sphere_rad * 3.0 / (2 * DRAW_CELL_DIM);
-    static CameraModelPtr draw_camera = CameraModel::createFisheye(
-        2 * DRAW_CELL_DIM, 2 * DRAW_CELL_DIM, radPerPix, 360 * CM_D2R);
-    static CameraRemapPtr draw_remapper = CameraRemapPtr(new CameraRemap(
-        _src_model, draw_camera, _cam_to_roi));
-        
+    if (!_draw_camera) {
+        _draw_camera = CameraModel::createFisheye(
+            2 * DRAW_CELL_DIM, 2 * DRAW_CELL_DIM, radPerPix, 360 * CM_D2R);
+        _draw_remapper = CameraRemapPtr(new CameraRemap(
+            _src_model, _draw_camera, _cam_to_roi));
+        _draw_mapX.create(_roi_h, _roi_w, CV_32FC1);
+        _draw_mapY.create(_roi_h, _roi_w, CV_32FC1);
+        _draw_prev_roi = roi_frame;     // no copy!
+        _draw_warp_roi.create(_roi_h, _roi_w, CV_8UC1);
+        _draw_diff_roi.create(_roi_h, _roi_w, CV_8UC1);
+        _draw_resize_roi.create(DRAW_CELL_DIM, DRAW_CELL_DIM, CV_8UC1);
+        _draw_resize_diff.create(DRAW_CELL_DIM, DRAW_CELL_DIM, CV_8UC1);
+        _draw_resize_view.create(DRAW_CELL_DIM, 2 * DRAW_CELL_DIM, CV_8UC1);
+        _draw_resize_map.create(DRAW_CELL_DIM, 2 * DRAW_CELL_DIM, CV_8UC1);
+    }
+    CameraModelPtr& draw_camera = _draw_camera;
+
     Mat draw_input = canvas(Rect(0, 0, 2 * DRAW_CELL_DIM, 2 * DRAW_CELL_DIM));
-    draw_remapper->apply(src_frame, draw_input);
+    _draw_remapper->apply(src_frame, draw_input);
 
     /// Sphere warping.
-    static Mat mapX(_roi_h, _roi_w, CV_32FC1);
+    Mat& mapX = _draw_mapX;
     mapX.setTo(Scalar::all(-1));
-    static Mat mapY(_roi_h, _roi_w, CV_32FC1);
+    Mat& mapY = _draw_mapY;
     mapY.setTo(Scalar::all(-1));
-    makeSphereRotMaps(_roi_model, mapX, mapY, _roi_mask, _r_d_ratio, dr_roi);
+    makeSphereRotMaps(_roi_model, *_roi_pix_main, mapX, mapY, _r_d_ratio, dr_roi);
 
     BasicRemapper warper(_roi_w, _roi_h, mapX, mapY);
-    static Mat prev_roi = roi_frame;   // no copy!
-    static Mat warp_roi(_roi_h, _roi_w, CV_8UC1);
+    Mat& warp_roi = _draw_warp_roi;
     warp_roi.setTo(Scalar::all(0));
-    warper.apply(prev_roi, warp_roi);
-    prev_roi = roi_frame;  // no copy!
+    warper.apply(_draw_prev_roi, warp_roi);
+    _draw_prev_roi = roi_frame;  // no copy!
 
     /// Diff image.
-    static Mat diff_roi(_roi_h, _roi_w, CV_8UC1);
+    Mat& diff_roi = _draw_diff_roi;
     cv::absdiff(roi_frame, warp_roi, diff_roi);
 
     /// Draw thresholded ROI.
-    static Mat resize_roi(DRAW_CELL_DIM, DRAW_CELL_DIM, CV_8UC1);
+    Mat& resize_roi = _draw_resize_roi;
     cv::resize(roi_frame, resize_roi, resize_roi.size());
     Mat draw_roi = canvas(Rect(2 * DRAW_CELL_DIM, 0, DRAW_CELL_DIM, DRAW_CELL_DIM));
     cv::cvtColor(resize_roi, draw_roi, cv::COLOR_GRAY2BGR);
 
     /// Draw warped diff ROI.
-    static Mat resize_diff(DRAW_CELL_DIM, DRAW_CELL_DIM, CV_8UC1);
+    Mat& resize_diff = _draw_resize_diff;
     cv::resize(diff_roi, resize_diff, resize_diff.size());
     Mat draw_diff = canvas(Rect(3 * DRAW_CELL_DIM, 0, DRAW_CELL_DIM, DRAW_CELL_DIM));
     cv::cvtColor(resize_diff, draw_diff, cv::COLOR_GRAY2BGR);
 
     /// Draw current sphere view.
-    static Mat resize_view(DRAW_CELL_DIM, 2 * DRAW_CELL_DIM, CV_8UC1);
+    Mat& resize_view = _draw_resize_view;
     cv::resize(sphere_view, resize_view, resize_view.size());
     Mat draw_view = canvas(Rect(2 * DRAW_CELL_DIM, 1 * DRAW_CELL_DIM, 2 * DRAW_CELL_DIM, DRAW_CELL_DIM));
     cv::cvtColor(resize_view, draw_view, cv::COLOR_GRAY2BGR);
 
     /// Draw current sphere map.
-    static Mat resize_map(DRAW_CELL_DIM, 2 * DRAW_CELL_DIM, CV_8UC1);
+    Mat& resize_map = _draw_resize_map;
     cv::resize(sphere_map, resize_map, resize_map.size());
     Mat draw_map = canvas(Rect(2 * DRAW_CELL_DIM, 2 * DRAW_CELL_DIM, 2 * DRAW_CELL_DIM, DRAW_CELL_DIM));
     cv::cvtColor(resize_map, draw_map, cv::COLOR_GRAY2BGR);
 
     /// Draw fictive path.
     //FIXME: add heading arrow to fictive path
-    {
-        int npts = pos_heading_hist.size();
-        if (npts > 0) {
-            double minx = DBL_MAX, maxx = -DBL_MAX, miny = DBL_MAX, maxy = -DBL_MAX;
-            for (auto p : pos_heading_hist) {
-                double x = p.x, y = p.y;
-                if (x < minx)
-                    minx = x;
-                if (x > maxx)
-                    maxx = x;
-                if (y < miny)
-                    miny = y;
-                if (y > maxy)
-                    maxy = y;
-            }
-            double scl = 1;
-            if (npts > 1) {
-                double sclx = (minx != maxx) ? double(DRAW_CELL_DIM - 8) / (maxx - minx) : 1;
-                double scly = (miny != maxy) ? double(2 * DRAW_CELL_DIM - 4) / (maxy - miny) : 1;
-                scl = std::min(sclx, scly);
-            }
-
-            Mat draw_path = canvas(Rect(0, 2 * DRAW_CELL_DIM, 2 * DRAW_CELL_DIM, DRAW_CELL_DIM));
-            double my = (2 * DRAW_CELL_DIM - scl * (maxy - miny)) / 2, mx = DRAW_CELL_DIM - (DRAW_CELL_DIM - scl * (maxx - minx)) / 2;  // zeroth pixel for y/x data axes
-            double ppx = mx - scl * (pos_heading_hist[0].x - minx), ppy = my + scl * (pos_heading_hist[0].y - miny);
-            for (int i = 1; i < npts; i++) {
-                double px = mx - scl * (pos_heading_hist[i].x - minx), py = my + scl * (pos_heading_hist[i].y - miny);
-                cv::line(draw_path,
-                    cv::Point(static_cast<int>(round(ppy * 16)), static_cast<int>(round(ppx * 16))),
-                    cv::Point(static_cast<int>(round(py * 16)), static_cast<int>(round(px * 16))),
-                    CV_RGB(255, 255, 255), 1, cv::LINE_AA, 4);
-                ppx = px;
-                ppy = py;
-            }
-        }
-    }
+    drawPath(data->pos_heading_new, data->hist_reset);
+    _draw_path.copyTo(canvas(Rect(0, 2 * DRAW_CELL_DIM, 2 * DRAW_CELL_DIM, DRAW_CELL_DIM)));
 
     /// Draw sphere orientation history (animal position history on sphere).
     {
         static const CmPoint up(0, 0, -1.0);
-        CmPoint up_roi = up.getTransformed(/*_roi_to_cam_R.t() * */_cam_to_lab_R.t()).getNormalised() * _r_d_ratio;
+        CmPoint up_roi = up.getTransformed(/*_roi_to_cam_R.t() * */_cam_to_lab.t().data()).getNormalised() * _r_d_ratio;
+
+        /// (R_roi * R^T).up = R_roi.(R^T.up), so R^T.up is only computed once per historic orientation.
+        if (data->hist_reset) {
+            _draw_sphere_hist.clear();
+        }
+        for (const auto& R : data->R_roi_new) {
+            _draw_sphere_hist.push_back(up_roi.getTransformed(R.t().data()));   // multiply by transpose - see Localiser::testRotation()
+        }
+        while (_draw_sphere_hist.size() > DRAW_SPHERE_HIST_LENGTH) {
+            _draw_sphere_hist.pop_front();
+        }
 
         double ppx = -1, ppy = -1;
         draw_camera->vectorToPixelIndex(up_roi, ppx, ppy);  // don't need to correct for roi2cam R because origin is implicitly centre of draw_camera image anyway
-        for (int i = R_roi_hist.size() - 1; i >= 0; i--) {
-            // multiply by transpose - see Localiser::testRotation()
-            CmPoint vec = up_roi.getTransformed(R_roi * R_roi_hist[i].t()).getNormalised() * _r_d_ratio;
+        for (int i = _draw_sphere_hist.size() - 1; i >= 0; i--) {
+            CmPoint vec = _draw_sphere_hist[i].getTransformed(R_roi.data()).getNormalised() * _r_d_ratio;
 
             // sphere is centred at (0,0,1) cam coords, with r
             double px = -1, py = -1;
@@ -1369,7 +3220,7 @@ void Trackball::drawCanvas(shared_ptr<DrawData> data)
 
                 // draw link
                 if ((ppx >= 0) && (ppy >= 0) && (px >= 0) && (py >= 0) && (ppx < draw_input.cols) && (ppy < draw_input.rows) && (px < draw_input.cols) && (py < draw_input.rows)) {
-                    float mix = 0.33f + 0.67f * (i + 0.5f) / static_cast<float>(R_roi_hist.size());
+                    float mix = 0.33f + 0.67f * (i + 0.5f) / static_cast<float>(_draw_sphere_hist.size());
                     cv::Vec3b rgb = draw_input.at<cv::Vec3b>(static_cast<int>((ppy + py) / 2.f), static_cast<int>((ppx + px) / 2.f));   // px/py are pixel index values
                     int b = static_cast<int>((1 - mix) * rgb[0] + mix * 255.f + 0.5f);
                     int g = static_cast<int>((1 - mix) * rgb[1] + mix * 255.f + 0.5f);
@@ -1431,8 +3282,12 @@ void Trackball::drawCanvas(shared_ptr<DrawData> data)
         255, 255, 0);
 
     /// Display
-    cv::imshow("FicTrac-debug", canvas);
-    uint16_t key = cv::waitKey(1);
+    uint16_t key = 0;
+    {
+        lock_guard<mutex> l(gui_mutex);     // HighGUI is not thread safe (several trackers per process)
+        cv::imshow(_win_name, canvas);
+        key = cv::waitKey(1);
+    }
     if (key == 0x1B) {  // esc
         LOG("Exiting");
         terminate();
@@ -1442,23 +3297,69 @@ void Trackball::drawCanvas(shared_ptr<DrawData> data)
         _do_reset = true;
     }
 
-    if (_save_raw) {
-        _raw_vid.write(src_frame);
-    }
     if (_save_debug) {
-        _debug_vid.write(canvas);
-    }
-    if (_save_raw || _save_debug) {
+        _debug_vid->write(canvas);     // waits for queue space - no debug frames are dropped
         _vid_frames->addMsg(to_string(log_frame) + "\n");
     }
 }
 
 ///
+/// Append to the state history (tracking thread, or output stage if pipelined).
 ///
+void Trackball::pushState(const DATA& data, double err)
+{
+    if (!_state_ring) { return; }
+
+    StateRing::State s;
+    s[StateRing::FRAME] = data.cnt + _cnt_offset;
+    s[StateRing::SEQ] = data.seq;
+    s[StateRing::TS] = data.ts;
+    s[StateRing::MS] = data.ms;
+    s[StateRing::ERR] = err;
+    for (int i = 0; i < 3; i++) {
+        s.v[StateRing::DR_LAB_X + i] = data.dr_lab[i];
+        s.v[StateRing::R_LAB_X + i] = data.r_lab[i];
+        s.v[StateRing::W_LAB_X + i] = data.w_lab[i];
+    }
+    s[StateRing::HEADING] = data.heading;
+    s[StateRing::POSX] = data.posx;
+    s[StateRing::POSY] = data.posy;
+    s[StateRing::INTX] = data.intx;
+    s[StateRing::INTY] = data.inty;
+    s[StateRing::STEP_DIR] = data.step_dir;
+    s[StateRing::STEP_MAG] = data.step_mag;
+    _state_ring->push(s);
+}
+
+///
+/// Same model as extrap::extrapolate(), with the cam/ROI orientation following the lab orientation.
 ///
-shared_ptr<Trackball::DATA> Trackball::getState()
+Trackball::DATA Trackball::predictState(double ts, double max_dt) const
 {
-    return make_shared<DATA>(_data);
+    DATA data = _state.read();
+    if (data.ts < 0) { return data; }   // nothing published yet
+
+    const double dt = std::max(-max_dt, std::min(max_dt, ts - data.ts));
+    double r[3], w[3], r_out[3];
+    for (int i = 0; i < 3; i++) {
+        r[i] = data.r_lab[i];
+        w[i] = data.w_lab[i];
+    }
+    extrap::advance(r, w, dt, r_out);
+    data.r_lab = CmPoint64f(r_out[0], r_out[1], r_out[2]);
+    data.R_lab = CmMat33d::fromOmega(data.r_lab);
+    data.R_cam = data.R_roi = _cam_to_lab.t() * data.R_lab;
+    data.r_cam = data.r_roi = data.R_cam.toOmega();
+
+    double dx = 0, dy = 0;
+    extrap::advancePath(data.heading, data.heading_rate, data.velx_rate, data.vely_rate, dt, data.heading, dx, dy);
+    data.posx += dx;
+    data.posy += dy;
+    data.intx += data.velx_rate * dt;
+    data.inty += data.vely_rate * dt;
+    data.ts += dt;
+    data.ms += dt;
+    return data;
 }
 
 ///
@@ -1476,6 +3377,181 @@ void Trackball::dumpStats()
     PRINT("Integrated X/Y position: (%.3e, %.3e) rad (%f / %f %% total path length)", _data.posx, _data.posy, _data.posx * 100. / _data.dist, _data.posy * 100. / _data.dist);
     PRINT("Average/stdev rotation: %.3e / %.3e rad/frame", _data.step_avg, sqrt(_data.step_var / _data.cnt));  // population variance
     PRINT("\n----------------------------------------------------------------------");
+    PRINT("Trackball latency");
+    dumpLatency(false);
+    PRINT("\n----------------------------------------------------------------------");
+}
+
+///
+///
+///
+void Trackball::recordStat(StatId id, double v)
+{
+    _hist[id]->record(v);
+    _hist_int[id]->record(v);
+}
+
+///
+/// Print latency percentiles (since start, or since the last interval dump).
+/// Interval dumps are also sent over the socket as ST lines (see doc/data_header.txt).
+///
+void Trackball::dumpLatency(bool interval)
+{
+    static const char* names[NUM_STATS] = { "grab", "opt", "map", "path", "log", "disp", "frame", "cam_out", "evals", "queue", "bound", "cam_sock" };
+
+    const bool to_sock = interval && _stats_sock && _do_sock_output && !_bin_sock;
+    const unsigned long long dropped = _frameGrabber ? _frameGrabber->getDropped() : 0;
+    const unsigned long long cam_dropped = _frameGrabber ? _frameGrabber->getSource()->getDropped() : 0;
+    const unsigned long long cam_incomplete = _frameGrabber ? _frameGrabber->getSource()->getIncomplete() : 0;
+    const unsigned long long raw_dropped = _raw_vid ? _raw_vid->getDropped() : 0;
+    char buf[256];
+
+    for (int i = 0; i < NUM_STATS; i++) {
+        LatencyHist::Summary st = interval ? _hist_int[i]->summarise(true) : _hist[i]->summarise();
+        if (st.count == 0) { continue; }
+
+        const unsigned long long n = st.count;
+        const char* unit = ((i < ST_EVALS) || (i == ST_CAM_SOCK)) ? "ms" : (i == ST_BOUND) ? "rad" : "";
+        if (interval) {
+            LOG("%-8s n=%llu mean=%.2f p50=%.2f p99=%.2f p99.9=%.2f max=%.2f %s", names[i], n, st.mean, st.p50, st.p99, st.p999, st.max, unit);
+        } else {
+            PRINT("%-8s n=%llu mean=%.2f p50=%.2f p99=%.2f p99.9=%.2f max=%.2f %s", names[i], n, st.mean, st.p50, st.p99, st.p999, st.max, unit);
+        }
+
+        if (to_sock) {
+            int len = snprintf(buf, sizeof(buf), "ST, %u, %s, %llu, %.3f, %.3f, %.3f, %.3f, %.3f\n",
+                _data.cnt, names[i], n, st.mean, st.p50, st.p99, st.p999, st.max);
+            _data_sock->addMsg(std::string(buf, len));
+        }
+    }
+
+    if (interval) {
+        LOG("Dropped frames: %llu (camera: %llu, incomplete: %llu)", dropped, cam_dropped, cam_incomplete);
+        LOG("Search retries: %llu", _opt_retries);
+        if (_opt_recover) { LOG("Search recoveries: %llu", _opt_recoveries); }
+        if (_opt_budget > 0) { LOG("Search time budget overruns: %llu", _opt_overruns); }
+        if (_raw_vid) { LOG("Raw video frames dropped: %llu", raw_dropped); }
+    } else {
+        PRINT("Dropped frames: %llu (camera: %llu, incomplete: %llu)", dropped, cam_dropped, cam_incomplete);
+        PRINT("Search retries: %llu", _opt_retries);
+        if (_opt_recover) { PRINT("Search recoveries: %llu", _opt_recoveries); }
+        if (_opt_budget > 0) { PRINT("Search time budget overruns: %llu", _opt_overruns); }
+        if (_raw_vid) { PRINT("Raw video frames dropped: %llu", raw_dropped); }
+    }
+    if (to_sock) {
+        int len = snprintf(buf, sizeof(buf), "ST, %u, dropped, %llu\n", _data.cnt, dropped);
+        _data_sock->addMsg(std::string(buf, len));
+        len = snprintf(buf, sizeof(buf), "ST, %u, cam_dropped, %llu\n", _data.cnt, cam_dropped);
+        _data_sock->addMsg(std::string(buf, len));
+        len = snprintf(buf, sizeof(buf), "ST, %u, cam_incomplete, %llu\n", _data.cnt, cam_incomplete);
+        _data_sock->addMsg(std::string(buf, len));
+        len = snprintf(buf, sizeof(buf), "ST, %u, opt_retries, %llu\n", _data.cnt, _opt_retries);
+        _data_sock->addMsg(std::string(buf, len));
+        if (_opt_recover) {
+            len = snprintf(buf, sizeof(buf), "ST, %u, opt_recovered, %llu\n", _data.cnt, _opt_recoveries);
+            _data_sock->addMsg(std::string(buf, len));
+        }
+        if (_opt_budget > 0) {
+            len = snprintf(buf, sizeof(buf), "ST, %u, opt_overruns, %llu\n", _data.cnt, _opt_overruns);
+            _data_sock->addMsg(std::string(buf, len));
+        }
+        if (_raw_vid) {
+            len = snprintf(buf, sizeof(buf), "ST, %u, raw_vid_dropped, %llu\n", _data.cnt, raw_dropped);
+            _data_sock->addMsg(std::string(buf, len));
+        }
+    }
+}
+
+///
+/// Tracking thread (output stage if pipelined), after each good frame.
+///
+void Trackball::checkpoint(const DATA& data, const Mat& sphere_map)
+{
+    if (_ckpt_period <= 0) { return; }
+    const double t = ts_ms();
+    if ((_ckpt_last >= 0) && ((t - _ckpt_last) < 1000 * _ckpt_period)) { return; }
+
+    /// Never wait on the disk - skip (and retry next frame) while the previous checkpoint is being written.
+    {
+        lock_guard<mutex> l(_ckptMutex);
+        if (_ckptPending) { return; }
+    }
+
+    /// The idle writer no longer reads the snapshot, so just copy changed tiles into it.
+    {
+        unique_lock<mutex> l(_pipeMapMutex, defer_lock);
+        if (_do_pipeline) { l.lock(); }
+        _map_dirty->update(sphere_map, _ckpt.map, _ckpt_map_ver);
+    }
+    memcpy(_ckpt.R_roi, data.R_roi.data(), sizeof(_ckpt.R_roi));
+    _ckpt.ts = data.ts;
+    _ckpt.cnt = data.cnt;
+    _ckpt_last = t;
+
+    {
+        lock_guard<mutex> l(_ckptMutex);
+        _ckptPending = true;
+    }
+    _ckptCond.notify_all();
+}
+
+///
+/// Checkpoint writer thread.
+///
+void Trackball::processCheckpoints()
+{
+    if (!ApplyThreadClass(ThreadClass::IO)) {
+        LOG_WRN("Warning! Unable to apply checkpoint thread placement (cpus_io)!");
+    }
+
+    unique_lock<mutex> l(_ckptMutex);
+    while (true) {
+        _ckptCond.wait(l, [&] { return _ckptPending || _ckptStop; });
+        if (!_ckptPending) { break; }   // stopped with nothing left to write
+
+        l.unlock();
+        const double t0 = ts_ms();
+        if (!sidecar::saveCheckpoint(_ckpt_fn, _ckpt_key, _ckpt)) {
+            LOG_WRN("Warning! Unable to write checkpoint (%s).", _ckpt_fn.c_str());
+        } else {
+            LOG_DBG("Checkpoint of frame %llu written (%.1f ms).", static_cast<unsigned long long>(_ckpt.cnt), ts_ms() - t0);
+        }
+
+        l.lock();
+        _ckptPending = false;
+    }
+}
+
+///
+/// Warm start: restore map and orientation, so tracking relocks with a local search.
+///
+bool Trackball::loadCheckpoint()
+{
+    sidecar::Checkpoint ckpt;
+    if (!sidecar::loadCheckpoint(_ckpt_fn, _ckpt_key, ckpt) || (ckpt.map.cols != _map_w) || (ckpt.map.rows != _map_h)) {
+        LOG_DBG("No valid checkpoint to resume from (%s).", _ckpt_fn.c_str());
+        return false;
+    }
+
+    ckpt.map.copyTo(_sphere_map);
+    if (_sphere_tiles) {
+        _sphere_tiles->fromMat(_sphere_map);
+    }
+    if (_do_pipeline) {
+        ckpt.map.copyTo(_sphere_map_work);
+        _map_ver_sync = _map_ver;
+    }
+    _map_dirty->markAll();
+    _clean_map = false;
+
+    /// Orientation only - path integration starts afresh with the new data log.
+    _data.R_roi = CmMat33d(ckpt.R_roi);
+    _data.r_roi = _data.R_roi.toOmega();
+    _pipe_data = _data;
+    _reset = false;
+
+    LOG("Resuming from checkpoint of frame %llu (%s).", static_cast<unsigned long long>(ckpt.cnt), _ckpt_fn.c_str());
+    return true;
 }
 
 ///
@@ -1487,7 +3563,21 @@ bool Trackball::writeTemplate(std::string fn)
     
     string template_fn = _base_fn + "-template.png";
 
-    bool ret = cv::imwrite(template_fn, _sphere_map);
+    /// The output stage map is the most up to date (written directly, no snapshot).
+    bool ret = false;
+    {
+        lock_guard<mutex> l(_pipeMapMutex);
+        const Mat& map = _do_pipeline ? _sphere_map_work : _sphere_map;
+        ret = cv::imwrite(template_fn, map);
+
+        /// Sidecar is keyed to the image just written, so loading it later skips the decode.
+        if (ret && _cfg_sidecar) {
+            const string map_fn = template_fn.substr(0, template_fn.find_last_of('.')) + ".map";
+            if (!sidecar::saveMap(map_fn, sidecar::fileKey(template_fn), map)) {
+                LOG_WRN("Warning! Unable to write sphere template sidecar (%s).", map_fn.c_str());
+            }
+        }
+    }
     if (!ret) {
         LOG_ERR("Error! Could not write template to disk (%s).", template_fn.c_str());
     } else {
@@ -0,0 +1,190 @@
+/// FicTrac http://rjdmoore.net/fictrac/
+/// \file       VideoEncoder.cpp
+/// \brief      Threaded video writer with a bounded frame queue.
+/// \author     Richard Moore
+/// \copyright  CC BY-NC-SA 3.0
+
+#include "VideoEncoder.h"
+
+#include "Logger.h"
+#include "misc.h"
+
+#include <cstdlib>  // getenv, setenv
+
+using namespace std;
+
+/// VideoWriter open params (incl. VIDEOWRITER_PROP_HW_ACCELERATION) were added in OpenCV 4.5.2.
+#if (CV_VERSION_MAJOR > 4) || ((CV_VERSION_MAJOR == 4) && ((CV_VERSION_MINOR > 5) || ((CV_VERSION_MINOR == 5) && (CV_VERSION_REVISION >= 2))))
+#define CV_HAS_HW_ENCODE
+#endif
+
+///
+/// The FFmpeg backend takes codec options from the environment when the writer is opened.
+/// An existing OPENCV_FFMPEG_WRITER_OPTIONS (set by the user) takes precedence.
+///
+static void setEncoderThreads(int threads)
+{
+    if (threads <= 0) { return; }
+    if (getenv("OPENCV_FFMPEG_WRITER_OPTIONS")) {
+        LOG_WRN("Warning! OPENCV_FFMPEG_WRITER_OPTIONS is set - ignoring encoder thread count (%d).", threads);
+        return;
+    }
+    string opt = "threads;" + to_string(threads);
+#ifdef _WIN32
+    _putenv_s("OPENCV_FFMPEG_WRITER_OPTIONS", opt.c_str());
+#else
+    setenv("OPENCV_FFMPEG_WRITER_OPTIONS", opt.c_str(), 0);
+#endif
+}
+
+///
+///
+///
+VideoEncoder::VideoEncoder(size_t queue_len)
+    : _q(queue_len > 0 ? queue_len : 1), _open(false), _active(false), _written(0), _dropped(0)
+{
+}
+
+///
+///
+///
+VideoEncoder::~VideoEncoder()
+{
+    close();
+}
+
+///
+///
+///
+bool VideoEncoder::open(const string& fn, int fourcc, double fps, cv::Size size, bool is_color, int threads, bool hw_accel)
+{
+    close();
+
+    setEncoderThreads(threads);
+
+    if (hw_accel) {
+#ifdef CV_HAS_HW_ENCODE
+        if (is_color) {
+            vector<int> params = { cv::VIDEOWRITER_PROP_HW_ACCELERATION, cv::VIDEO_ACCELERATION_ANY };
+            _writer.open(fn, cv::CAP_ANY, fourcc, fps, size, params);
+            if (_writer.isOpened() && (_writer.get(cv::VIDEOWRITER_PROP_HW_ACCELERATION) != cv::VIDEO_ACCELERATION_NONE)) {
+                LOG("Using hardware accelerated encode (type %d).", static_cast<int>(_writer.get(cv::VIDEOWRITER_PROP_HW_ACCELERATION)));
+                return start();
+            }
+            _writer.release();
+        }
+        LOG_WRN("Warning! Hardware accelerated encode unavailable - using software encode.");
+#else
+        LOG_WRN("Warning! Hardware accelerated encode requires OpenCV >= 4.5.2 - using software encode.");
+#endif
+    }
+
+    _writer.open(fn, fourcc, fps, size, is_color);
+    if (!_writer.isOpened()) { return false; }
+
+    return start();
+}
+
+///
+///
+///
+bool VideoEncoder::openDump(const string& fn, double fps, cv::Size size)
+{
+    close();
+
+    _dump = make_unique<FrameDumpWriter>();
+    if (!_dump->open(fn, size.width, size.height, fps)) {
+        _dump.reset();
+        return false;
+    }
+
+    return start();
+}
+
+///
+///
+///
+bool VideoEncoder::start()
+{
+    _written = _dropped = 0;
+    _active = true;
+    _open = true;
+    _thread = StartThread(&VideoEncoder::process, this);
+    return true;
+}
+
+///
+///
+///
+bool VideoEncoder::write(const cv::Mat& frame, double timestamp, double ms_since_midnight, bool block)
+{
+    if (!_open) { return false; }
+
+    Frame f;
+    f.img = frame;  // no copy
+    f.timestamp = timestamp;
+    f.ms_since_midnight = ms_since_midnight;
+    while (!_q.push(std::move(f))) {
+        if (!block || !_active) {
+            _dropped++;
+            return false;
+        }
+        _q.waitNotFull(_active);
+    }
+    return true;
+}
+
+///
+///
+///
+void VideoEncoder::close()
+{
+    if (!_open) { return; }
+
+    _active = false;
+    _q.notify();
+    if (_thread && _thread->joinable()) {
+        _thread->join();
+    }
+    _thread.reset();
+    _writer.release();
+    _dump.reset();
+    _open = false;
+
+    if (_dropped > 0) {
+        LOG_WRN("Warning! Video encoder dropped %llu of %llu frames.", _dropped.load(), _dropped + _written);
+    }
+}
+
+///
+/// Drain queue until closed.
+///
+void VideoEncoder::process()
+{
+    if (!SetThreadNormalPriority()) {
+        LOG_ERR("Error! Video encoder thread unable to set thread priority!");
+    }
+    if (!ApplyThreadClass(ThreadClass::IO)) {
+        LOG_WRN("Warning! Unable to apply video encoder thread placement (cpus_io)!");
+    }
+
+    Frame f;
+    while (_active || !_q.empty()) {
+        if (!_q.pop(f)) {
+            _q.waitNotEmpty(_active);
+            continue;
+        }
+        if (_dump) {
+            if (f.img.channels() == 1) {
+                _dump->write(f.img, f.timestamp, f.ms_since_midnight);
+            } else {
+                cv::cvtColor(f.img, _grey, cv::COLOR_BGR2GRAY);
+                _dump->write(_grey, f.timestamp, f.ms_since_midnight);
+            }
+        } else {
+            _writer.write(f.img);
+        }
+        _written++;
+        f.img.release();    // hand the buffer back to the producer
+    }
+}
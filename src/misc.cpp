@@ -10,12 +10,17 @@
 
 #ifdef __linux__ 
 // linux inludes
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
 #elif _WIN32
 #include <windows.h>
 #endif
 
 
 #include <cstdio>
+#include <cstring>    // memcpy
+#include <algorithm>  // max
 
 ///
 /// Helper function to force getchar to take new key press.
@@ -83,3 +88,153 @@ bool SetThreadNormalPriority()
     return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_NORMAL);
 #endif
 }
+
+bool SetThreadAffinity(int core)
+{
+    if (core < 0) { return false; }
+#ifdef __linux__ 
+    // linux
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#elif _WIN32
+    /// See https://docs.microsoft.com/en-us/windows/desktop/api/winbase/nf-winbase-setthreadaffinitymask
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core) != 0;
+#endif
+}
+
+bool SetThreadAffinity(const std::vector<int>& cores)
+{
+    if (cores.empty()) { return false; }
+#ifdef __linux__ 
+    // linux
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (auto c : cores) {
+        if ((c < 0) || (c >= CPU_SETSIZE)) { return false; }
+        CPU_SET(c, &cpus);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#elif _WIN32
+    DWORD_PTR mask = 0;
+    for (auto c : cores) {
+        if ((c < 0) || (c >= static_cast<int>(8 * sizeof(DWORD_PTR)))) { return false; }
+        mask |= DWORD_PTR(1) << c;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#endif
+}
+
+bool SetThreadRealtime(int prio_offset)
+{
+#ifdef __linux__ 
+    // linux - requires CAP_SYS_NICE (or an rtprio limit)
+    sched_param param;
+    param.sched_priority = std::max(sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO) - prio_offset);
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#elif _WIN32
+    /// See https://docs.microsoft.com/en-us/windows/desktop/procthread/scheduling-priorities
+    return SetThreadPriority(GetCurrentThread(), (prio_offset > 0) ? THREAD_PRIORITY_HIGHEST : THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+}
+
+bool LockProcessMemory()
+{
+#ifdef __linux__ 
+    // linux - avoids page faults in the real-time threads
+    return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+#elif _WIN32
+    return false;
+#endif
+}
+
+///
+/// Thread placement. Placements are immutable once shared - setting a class
+/// replaces the calling thread's placement with an updated copy.
+///
+struct ThreadPlacement {
+    struct Class {
+        std::vector<int> cores;
+        bool realtime = false;
+    } cls[static_cast<int>(ThreadClass::NUM)];
+};
+
+namespace {
+thread_local ThreadPlacementPtr thread_placement;
+const int THREAD_CLASS_RT_OFFSET[static_cast<int>(ThreadClass::NUM)] = { 0, 1, 0, 0 };    // grabber above tracker
+}
+
+void SetThreadClassConfig(ThreadClass c, const std::vector<int>& cores, bool realtime)
+{
+    auto place = thread_placement ? std::make_shared<ThreadPlacement>(*thread_placement) : std::make_shared<ThreadPlacement>();
+    place->cls[static_cast<int>(c)].cores = cores;
+    place->cls[static_cast<int>(c)].realtime = realtime;
+    thread_placement = place;
+}
+
+std::vector<int> GetThreadClassCores(ThreadClass c)
+{
+    return thread_placement ? thread_placement->cls[static_cast<int>(c)].cores : std::vector<int>();
+}
+
+ThreadPlacementPtr GetThreadPlacement()
+{
+    return thread_placement;
+}
+
+void SetThreadPlacement(ThreadPlacementPtr place)
+{
+    thread_placement = place;
+}
+
+bool ApplyThreadClass(ThreadClass c)
+{
+    if (!thread_placement) { return true; }
+    const ThreadPlacement::Class& cfg = thread_placement->cls[static_cast<int>(c)];
+    bool ret = true;
+    if (!cfg.cores.empty()) { ret &= SetThreadAffinity(cfg.cores); }
+    if (cfg.realtime) { ret &= SetThreadRealtime(THREAD_CLASS_RT_OFFSET[static_cast<int>(c)]); }
+    return ret;
+}
+
+ScopedThreadAffinity::ScopedThreadAffinity(const std::vector<int>& cores)
+    : _set(false)
+{
+    if (cores.empty()) { return; }
+#ifdef __linux__ 
+    // linux
+    cpu_set_t prev;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(prev), &prev) != 0) { return; }
+    _prev.resize(sizeof(prev));
+    memcpy(_prev.data(), &prev, sizeof(prev));
+    _set = SetThreadAffinity(cores);
+#elif _WIN32
+    /// Previous mask is returned when setting a new one.
+    DWORD_PTR mask = 0;
+    for (auto c : cores) {
+        if ((c < 0) || (c >= static_cast<int>(8 * sizeof(DWORD_PTR)))) { return; }
+        mask |= DWORD_PTR(1) << c;
+    }
+    DWORD_PTR prev = SetThreadAffinityMask(GetCurrentThread(), mask);
+    if (prev == 0) { return; }
+    _prev.resize(sizeof(prev));
+    memcpy(_prev.data(), &prev, sizeof(prev));
+    _set = true;
+#endif
+}
+
+ScopedThreadAffinity::~ScopedThreadAffinity()
+{
+    if (!_set) { return; }
+#ifdef __linux__ 
+    // linux
+    cpu_set_t prev;
+    memcpy(&prev, _prev.data(), sizeof(prev));
+    pthread_setaffinity_np(pthread_self(), sizeof(prev), &prev);
+#elif _WIN32
+    DWORD_PTR prev;
+    memcpy(&prev, _prev.data(), sizeof(prev));
+    SetThreadAffinityMask(GetCurrentThread(), prev);
+#endif
+}